@@ -0,0 +1,145 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Opens an atlas package written by BRAINSABCPackAtlas, checks that it
+// matches its atlas definition, and that every mapped image is identical in
+// geometry and pixels to the file named by the atlas definition.  A package
+// that is missing a prior must be rejected.
+//
+
+#include "AtlasDefinition.h"
+#include "AtlasPackage.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIterator.h"
+#include "itksys/SystemTools.hxx"
+#include <iostream>
+
+template <typename TImage>
+static bool
+CompareWithAtlasFile(const AtlasPackage *package, const std::string & entryName, const std::string & filename)
+{
+  using ReaderType = itk::ImageFileReader<TImage>;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  const typename TImage::Pointer fileImage = reader->GetOutput();
+  const typename TImage::Pointer packedImage = package->GetImage<TImage>(entryName);
+
+  if( fileImage->GetLargestPossibleRegion() != packedImage->GetLargestPossibleRegion()
+      || fileImage->GetSpacing() != packedImage->GetSpacing()
+      || fileImage->GetOrigin() != packedImage->GetOrigin()
+      || fileImage->GetDirection() != packedImage->GetDirection() )
+    {
+    std::cerr << "Geometry of " << entryName << " differs from " << filename << std::endl;
+    return false;
+    }
+
+  itk::ImageRegionConstIterator<TImage> fileIt(fileImage, fileImage->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<TImage> packedIt(packedImage, packedImage->GetLargestPossibleRegion() );
+  for( ; !fileIt.IsAtEnd(); ++fileIt, ++packedIt )
+    {
+    if( fileIt.Get() != packedIt.Get() )
+      {
+      std::cerr << "Pixel " << fileIt.GetIndex() << " of " << entryName << " differs from " << filename << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+int main(int argc, char * *argv)
+{
+  if( argc < 4 )
+    {
+    std::cerr << "Usage: " << argv[0] << " atlasDefinition.xml atlasPackage incompletePackage" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string atlasDefinitionFile = argv[1];
+  const std::string atlasPackageFile = argv[2];
+  const std::string incompletePackageFile = argv[3];
+
+  const std::string atlasDefinitionPath = itksys::SystemTools::GetParentDirectory( atlasDefinitionFile.c_str() );
+  AtlasDefinition   atlasDefinition;
+  atlasDefinition.InitFromXML(atlasDefinitionFile);
+
+  using FloatImageType = AtlasPackageWriter::FloatImageType;
+  using ByteImageType = AtlasPackageWriter::ByteImageType;
+
+  bool allPassed = true;
+  try
+    {
+    AtlasPackage::Pointer package = AtlasPackage::New();
+    package->Open(atlasPackageFile);
+    package->VerifyAtlasDefinition(atlasDefinition);
+
+    allPassed &= CompareWithAtlasFile<ByteImageType>(
+        package, AtlasPackage::TemplateBrainMaskName(),
+        FindPathFromAtlasXML(atlasDefinition.GetTemplateBrainMask(), atlasDefinitionPath) );
+    for( const auto & templateVolume : atlasDefinition.GetTemplateVolumes() )
+      {
+      allPassed &= CompareWithAtlasFile<FloatImageType>(
+          package, AtlasPackage::TemplateVolumeName(templateVolume.first),
+          FindPathFromAtlasXML(templateVolume.second, atlasDefinitionPath) );
+      }
+    for( const auto & tissueType : atlasDefinition.TissueTypes() )
+      {
+      allPassed &= CompareWithAtlasFile<FloatImageType>(
+          package, AtlasPackage::PriorName(tissueType),
+          FindPathFromAtlasXML(atlasDefinition.GetPriorFilename(tissueType), atlasDefinitionPath) );
+      }
+
+    // Repack everything but the last prior; that package must not verify.
+    AtlasPackageWriter incompleteWriter;
+    incompleteWriter.AddImage(AtlasPackage::TemplateBrainMaskName(),
+                              package->GetImage<ByteImageType>(AtlasPackage::TemplateBrainMaskName() ).GetPointer() );
+    for( const auto & templateVolume : atlasDefinition.GetTemplateVolumes() )
+      {
+      const std::string name = AtlasPackage::TemplateVolumeName(templateVolume.first);
+      incompleteWriter.AddImage(name, package->GetImage<FloatImageType>(name).GetPointer() );
+      }
+    const AtlasDefinition::TissueTypeVector & tissueTypes = atlasDefinition.TissueTypes();
+    for( size_t i = 0; i + 1 < tissueTypes.size(); ++i )
+      {
+      const std::string name = AtlasPackage::PriorName(tissueTypes[i]);
+      incompleteWriter.AddImage(name, package->GetImage<FloatImageType>(name).GetPointer() );
+      }
+    incompleteWriter.Write(incompletePackageFile);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  AtlasPackage::Pointer incompletePackage = AtlasPackage::New();
+  incompletePackage->Open(incompletePackageFile);
+  try
+    {
+    incompletePackage->VerifyAtlasDefinition(atlasDefinition);
+    std::cerr << "A package without the prior " << atlasDefinition.TissueTypes().back()
+              << " was accepted" << std::endl;
+    allPassed = false;
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cout << "Incomplete package rejected as expected: " << err.GetDescription() << std::endl;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -374,3 +374,13 @@ AtlasDefinition::DebugPrint()
     }
   std::cout << "</Atlas>" << std::endl;
 }
+
+std::string
+FindPathFromAtlasXML(const std::string & xmlCodedPath, const std::string & atlasDefinitionPath)
+{
+  if( xmlCodedPath[0] != '/' ) // If not an absolute path, assume relative path
+    {
+    return atlasDefinitionPath+"/"+xmlCodedPath;
+    }
+  return xmlCodedPath;
+}
@@ -385,4 +385,12 @@ private:
   BoundsMapType m_LastPriorBounds;
 };
 
+/**
+ * \def FindPathFromAtlasXML
+ * \param The encoded file name, if abosolute, then use it, else prepend atlasDefinitionPath
+ * \param atlasDefinitionPath the directory path for the XML file
+ * \return either the absolute path, or the prepended path
+ */
+extern std::string FindPathFromAtlasXML(const std::string & xmlCodedPath, const std::string & atlasDefinitionPath);
+
 #endif // AtlasDefinition_h
@@ -0,0 +1,340 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "AtlasPackage.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <itksys/SystemTools.hxx>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+/** Fixed size file header, followed by NumberOfEntries EntryRecords */
+struct PackageHeader
+  {
+  char     Magic[16];
+  uint32_t ByteOrderMark;
+  uint32_t NumberOfEntries;
+  uint64_t HeaderBytes;
+  };
+
+const uint32_t PackageByteOrderMark = 0x01020304;
+
+uint64_t
+AlignOffset(const uint64_t offset)
+{
+  return ( ( offset + AtlasPackage::DataAlignment - 1 ) / AtlasPackage::DataAlignment )
+         * AtlasPackage::DataAlignment;
+}
+}
+
+AtlasPackage::AtlasPackage() :
+  m_MappedData(nullptr),
+  m_MappedLength(0)
+#ifdef _WIN32
+  , m_FileHandle(nullptr),
+  m_MappingHandle(nullptr)
+#endif
+{
+}
+
+AtlasPackage::~AtlasPackage()
+{
+  this->Close();
+}
+
+void
+AtlasPackage::Close()
+{
+  if( m_MappedData == nullptr )
+    {
+    return;
+    }
+#ifdef _WIN32
+  UnmapViewOfFile(m_MappedData);
+  CloseHandle(static_cast<HANDLE>(m_MappingHandle) );
+  CloseHandle(static_cast<HANDLE>(m_FileHandle) );
+  m_MappingHandle = nullptr;
+  m_FileHandle = nullptr;
+#else
+  munmap(m_MappedData, m_MappedLength);
+#endif
+  m_MappedData = nullptr;
+  m_MappedLength = 0;
+  m_Entries.clear();
+}
+
+void
+AtlasPackage::Open(const std::string & filename)
+{
+  this->Close();
+  m_FileName = filename;
+
+  const uint64_t fileLength = itksys::SystemTools::FileLength(filename);
+  if( fileLength < sizeof(PackageHeader) )
+    {
+    itkExceptionMacro( << "Atlas package " << filename << " can not be read or is too small" );
+    }
+
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if( fileHandle == INVALID_HANDLE_VALUE )
+    {
+    itkExceptionMacro( << "Could not open atlas package " << filename );
+    }
+  HANDLE mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+  if( mappingHandle == nullptr )
+    {
+    CloseHandle(fileHandle);
+    itkExceptionMacro( << "Could not map atlas package " << filename );
+    }
+  void *mapped = MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+  if( mapped == nullptr )
+    {
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    itkExceptionMacro( << "Could not map atlas package " << filename );
+    }
+  m_FileHandle = fileHandle;
+  m_MappingHandle = mappingHandle;
+#else
+  const int fd = open(filename.c_str(), O_RDONLY);
+  if( fd < 0 )
+    {
+    itkExceptionMacro( << "Could not open atlas package " << filename );
+    }
+  // MAP_PRIVATE keeps the mapping shared with other readers until a page is written.
+  void *mapped = mmap(nullptr, fileLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if( mapped == MAP_FAILED )
+    {
+    itkExceptionMacro( << "Could not map atlas package " << filename );
+    }
+#endif
+  m_MappedData = static_cast<char *>( mapped );
+  m_MappedLength = fileLength;
+
+  PackageHeader header;
+  std::memcpy(&header, m_MappedData, sizeof(header) );
+  if( std::memcmp(header.Magic, Magic(), sizeof(header.Magic) ) != 0
+      || header.ByteOrderMark != PackageByteOrderMark )
+    {
+    this->Close();
+    itkExceptionMacro( << filename << " is not an atlas package for this platform" );
+    }
+  if( header.HeaderBytes > m_MappedLength
+      || sizeof(PackageHeader) + header.NumberOfEntries * sizeof(EntryRecord) > header.HeaderBytes )
+    {
+    this->Close();
+    itkExceptionMacro( << "Atlas package " << filename << " has a corrupt header" );
+    }
+
+  const char *recordPtr = m_MappedData + sizeof(PackageHeader);
+  for( uint32_t i = 0; i < header.NumberOfEntries; ++i, recordPtr += sizeof(EntryRecord) )
+    {
+    EntryRecord record;
+    std::memcpy(&record, recordPtr, sizeof(record) );
+    record.Name[sizeof(record.Name) - 1] = '\0';
+    if( record.DataOffset % DataAlignment != 0
+        || record.DataOffset + record.DataBytes > m_MappedLength )
+      {
+      const std::string badName = record.Name;
+      this->Close();
+      itkExceptionMacro( << "Atlas package " << filename << " entry " << badName << " is out of range" );
+      }
+    m_Entries[record.Name] = record;
+    }
+}
+
+bool
+AtlasPackage::HasImage(const std::string & name) const
+{
+  return m_Entries.find(name) != m_Entries.end();
+}
+
+void
+AtlasPackage::VerifyAtlasDefinition(AtlasDefinition & atlasDefinition) const
+{
+  std::vector<std::string> expectedNames;
+  expectedNames.push_back(TemplateBrainMaskName() );
+  for( const auto & templateVolume : atlasDefinition.GetTemplateVolumes() )
+    {
+    expectedNames.push_back(TemplateVolumeName(templateVolume.first) );
+    }
+  for( const auto & tissueType : atlasDefinition.TissueTypes() )
+    {
+    expectedNames.push_back(PriorName(tissueType) );
+    }
+
+  for( const auto & name : expectedNames )
+    {
+    if( !this->HasImage(name) )
+      {
+      itkExceptionMacro( << "Atlas package " << m_FileName << " has no image " << name
+                         << " required by the atlas definition" );
+      }
+    }
+  if( m_Entries.size() != expectedNames.size() )
+    {
+    for( const auto & entry : m_Entries )
+      {
+      if( std::find(expectedNames.begin(), expectedNames.end(), entry.first) == expectedNames.end() )
+        {
+        itkExceptionMacro( << "Atlas package " << m_FileName << " image " << entry.first
+                           << " is not in the atlas definition" );
+        }
+      }
+    }
+}
+
+std::vector<std::string>
+AtlasPackage::GetImageNames() const
+{
+  std::vector<std::string> names;
+  for( const auto & entry : m_Entries )
+    {
+    names.push_back(entry.first);
+    }
+  return names;
+}
+
+const AtlasPackage::EntryRecord &
+AtlasPackage::FindEntry(const std::string & name) const
+{
+  auto it = m_Entries.find(name);
+  if( it == m_Entries.end() )
+    {
+    itkExceptionMacro( << "Atlas package " << m_FileName << " has no image named " << name );
+    }
+  return it->second;
+}
+
+void
+AtlasPackage::PrintSelf(std::ostream & os, itk::Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "FileName: " << m_FileName << std::endl;
+  os << indent << "MappedLength: " << m_MappedLength << std::endl;
+  for( const auto & entry : m_Entries )
+    {
+    os << indent << "  " << entry.first << " : "
+       << entry.second.Size[0] << "x" << entry.second.Size[1] << "x" << entry.second.Size[2]
+       << " code " << entry.second.PixelCode << std::endl;
+    }
+}
+
+template <typename TImage>
+void
+AtlasPackageWriter::AddImageInternal(const std::string & name, const TImage *image, uint32_t pixelCode)
+{
+  AtlasPackage::EntryRecord record;
+  std::memset(&record, 0, sizeof(record) );
+  if( name.size() >= sizeof(record.Name) )
+    {
+    itkGenericExceptionMacro( << "Atlas package entry name too long: " << name );
+    }
+  std::strncpy(record.Name, name.c_str(), sizeof(record.Name) - 1);
+  record.PixelCode = pixelCode;
+
+  const typename TImage::RegionType & region = image->GetLargestPossibleRegion();
+  if( region != image->GetBufferedRegion() )
+    {
+    itkGenericExceptionMacro( << "Atlas package entry " << name << " must be fully buffered" );
+    }
+  uint64_t numberOfPixels = 1;
+  for( unsigned int d = 0; d < AtlasPackage::ImageDimension; ++d )
+    {
+    record.Size[d] = region.GetSize()[d];
+    record.Spacing[d] = image->GetSpacing()[d];
+    record.Origin[d] = image->GetOrigin()[d];
+    for( unsigned int c = 0; c < AtlasPackage::ImageDimension; ++c )
+      {
+      record.Direction[d * AtlasPackage::ImageDimension + c] = image->GetDirection()[d][c];
+      }
+    numberOfPixels *= record.Size[d];
+    }
+  record.DataBytes = numberOfPixels * sizeof(typename TImage::PixelType);
+
+  m_Records.push_back(record);
+  m_Buffers.push_back(image->GetBufferPointer() );
+  m_Holders.push_back(image);
+}
+
+void
+AtlasPackageWriter::AddImage(const std::string & name, const FloatImageType *image)
+{
+  this->AddImageInternal(name, image, AtlasPackage::FLOAT32);
+}
+
+void
+AtlasPackageWriter::AddImage(const std::string & name, const ByteImageType *image)
+{
+  this->AddImageInternal(name, image, AtlasPackage::UINT8);
+}
+
+void
+AtlasPackageWriter::Write(const std::string & filename) const
+{
+  PackageHeader header;
+  std::memset(&header, 0, sizeof(header) );
+  std::memcpy(header.Magic, AtlasPackage::Magic(), sizeof(header.Magic) );
+  header.ByteOrderMark = PackageByteOrderMark;
+  header.NumberOfEntries = static_cast<uint32_t>( m_Records.size() );
+  header.HeaderBytes = AlignOffset(sizeof(PackageHeader) + m_Records.size() * sizeof(AtlasPackage::EntryRecord) );
+
+  std::vector<AtlasPackage::EntryRecord> records(m_Records);
+  uint64_t                               offset = header.HeaderBytes;
+  for( auto & record : records )
+    {
+    record.DataOffset = offset;
+    offset = AlignOffset(offset + record.DataBytes);
+    }
+
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if( !out.good() )
+    {
+    itkGenericExceptionMacro( << "Could not open " << filename << " for writing" );
+    }
+  out.write(reinterpret_cast<const char *>( &header ), sizeof(header) );
+  out.write(reinterpret_cast<const char *>( records.data() ), records.size() * sizeof(AtlasPackage::EntryRecord) );
+
+  const std::vector<char> padding(AtlasPackage::DataAlignment, 0);
+  uint64_t                written = sizeof(header) + records.size() * sizeof(AtlasPackage::EntryRecord);
+  for( size_t i = 0; i < records.size(); ++i )
+    {
+    out.write(padding.data(), records[i].DataOffset - written);
+    out.write(static_cast<const char *>( m_Buffers[i] ), records[i].DataBytes);
+    written = records[i].DataOffset + records[i].DataBytes;
+    }
+  // Pad the last entry so every mapped buffer ends on a page boundary.
+  out.write(padding.data(), AlignOffset(written) - written);
+  if( !out.good() )
+    {
+    itkGenericExceptionMacro( << "Failed writing atlas package " << filename );
+    }
+}
@@ -0,0 +1,201 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __AtlasPackage_h
+#define __AtlasPackage_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkImportImageContainer.h"
+#include "AtlasDefinition.h"
+
+/** \class AtlasPackage
+ *
+ * A packed, uncompressed representation of the images of an AtlasDefinition
+ * that BRAINSABC reads (templates, brain mask and priors).
+ *
+ * The package is built once with AtlasPackageWriter (see
+ * BRAINSABCPackAtlas), and opened by BRAINSABC with Open().  Each image
+ * is stored at a page aligned offset so that the file can be memory mapped
+ * and the pixel buffers handed to itk::Image without a copy.  The mapping is
+ * private copy-on-write, so concurrent processes share the page cache, and a
+ * filter that modifies a prior in place only duplicates the touched pages.
+ *
+ * Images returned from GetImage() hold a reference to the package, so the
+ * mapping stays valid for as long as any of the images are alive.
+ */
+class AtlasPackage : public itk::Object
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(AtlasPackage);
+
+  using Self = AtlasPackage;
+  using Superclass = itk::Object;
+  using Pointer = itk::SmartPointer<Self>;
+  using ConstPointer = itk::SmartPointer<const Self>;
+
+  itkNewMacro(Self);
+  itkTypeMacro(AtlasPackage, itk::Object);
+
+  static constexpr unsigned int ImageDimension = 3;
+
+  /** Pixel types that can be stored in a package */
+  enum PixelCodeType { FLOAT32 = 1, UINT8 = 2 };
+
+  /** On disk description of one image in the package */
+  struct EntryRecord
+    {
+    char     Name[128];
+    uint32_t PixelCode;
+    uint32_t Reserved;
+    uint64_t Size[ImageDimension];
+    double   Spacing[ImageDimension];
+    double   Origin[ImageDimension];
+    double   Direction[ImageDimension * ImageDimension];
+    uint64_t DataOffset;
+    uint64_t DataBytes;
+    };
+
+  /** Canonical entry names for the images of an AtlasDefinition */
+  static std::string TemplateBrainMaskName()
+  {
+    return "TemplateBrainMask";
+  }
+
+  static std::string TemplateVolumeName(const std::string & imageType)
+  {
+    return "Template:" + imageType;
+  }
+
+  static std::string PriorName(const std::string & tissueType)
+  {
+    return "Prior:" + tissueType;
+  }
+
+  /** Map a package file, throws an itk::ExceptionObject on failure */
+  void Open(const std::string & filename);
+
+  bool HasImage(const std::string & name) const;
+
+  /** Throw an itk::ExceptionObject unless the package holds exactly the
+   * brain mask, template volumes and priors named by the atlas definition. */
+  void VerifyAtlasDefinition(AtlasDefinition & atlasDefinition) const;
+
+  std::vector<std::string> GetImageNames() const;
+
+  /** Return an image that wraps the mapped pixels of the named entry.
+   * TImage must be a 3D itk::Image of float or unsigned char matching the
+   * pixel type stored in the package. */
+  template <typename TImage>
+  typename TImage::Pointer GetImage(const std::string & name) const;
+
+  /** Alignment of every pixel buffer in the file */
+  static constexpr uint64_t DataAlignment = 4096;
+
+  static const char * Magic()
+  {
+    return "BRAINSABCATLASv1";
+  }
+
+protected:
+  AtlasPackage();
+  ~AtlasPackage() override;
+  void PrintSelf(std::ostream & os, itk::Indent indent) const override;
+
+private:
+  template <typename TPixel>
+  static uint32_t PixelCode();
+
+  const EntryRecord & FindEntry(const std::string & name) const;
+
+  void Close();
+
+  std::string                            m_FileName;
+  char *                                 m_MappedData;
+  uint64_t                               m_MappedLength;
+#ifdef _WIN32
+  void *                                 m_FileHandle;
+  void *                                 m_MappingHandle;
+#endif
+  std::map<std::string, EntryRecord>     m_Entries;
+};
+
+/** \class AtlasPackageImportContainer
+ * An import container over package memory that keeps the owning
+ * AtlasPackage (and therefore the mapping) alive.
+ */
+template <typename TPixel>
+class AtlasPackageImportContainer : public itk::ImportImageContainer<itk::SizeValueType, TPixel>
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(AtlasPackageImportContainer);
+
+  using Self = AtlasPackageImportContainer;
+  using Superclass = itk::ImportImageContainer<itk::SizeValueType, TPixel>;
+  using Pointer = itk::SmartPointer<Self>;
+  using ConstPointer = itk::SmartPointer<const Self>;
+
+  itkNewMacro(Self);
+  itkTypeMacro(AtlasPackageImportContainer, ImportImageContainer);
+
+  void SetPackage(const AtlasPackage *package)
+  {
+    m_Package = package;
+  }
+
+protected:
+  AtlasPackageImportContainer() = default;
+  ~AtlasPackageImportContainer() override = default;
+
+private:
+  AtlasPackage::ConstPointer m_Package;
+};
+
+/** \class AtlasPackageWriter
+ * Collects images and writes them as an AtlasPackage file.
+ */
+class AtlasPackageWriter
+{
+public:
+  using FloatImageType = itk::Image<float, AtlasPackage::ImageDimension>;
+  using ByteImageType = itk::Image<unsigned char, AtlasPackage::ImageDimension>;
+
+  void AddImage(const std::string & name, const FloatImageType *image);
+
+  void AddImage(const std::string & name, const ByteImageType *image);
+
+  /** Write all added images, throws an itk::ExceptionObject on failure */
+  void Write(const std::string & filename) const;
+
+private:
+  template <typename TImage>
+  void AddImageInternal(const std::string & name, const TImage *image, uint32_t pixelCode);
+
+  std::vector<AtlasPackage::EntryRecord> m_Records;
+  std::vector<const void *>              m_Buffers;
+  std::vector<itk::LightObject::ConstPointer> m_Holders;
+};
+
+#include "AtlasPackage.hxx"
+
+#endif // __AtlasPackage_h
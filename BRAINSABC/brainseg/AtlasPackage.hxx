@@ -0,0 +1,90 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __AtlasPackage_hxx
+#define __AtlasPackage_hxx
+
+#include "AtlasPackage.h"
+
+template <>
+inline uint32_t
+AtlasPackage::PixelCode<float>()
+{
+  return AtlasPackage::FLOAT32;
+}
+
+template <>
+inline uint32_t
+AtlasPackage::PixelCode<unsigned char>()
+{
+  return AtlasPackage::UINT8;
+}
+
+template <typename TImage>
+typename TImage::Pointer
+AtlasPackage::GetImage(const std::string & name) const
+{
+  static_assert( TImage::ImageDimension == ImageDimension, "AtlasPackage only holds 3D images" );
+  using PixelType = typename TImage::PixelType;
+  using ContainerType = AtlasPackageImportContainer<PixelType>;
+
+  const EntryRecord & entry = this->FindEntry(name);
+  if( entry.PixelCode != PixelCode<PixelType>() )
+    {
+    itkExceptionMacro( << "Atlas package entry " << name << " has pixel code " << entry.PixelCode
+                       << " which does not match the requested image type" );
+    }
+
+  typename TImage::SizeType      size;
+  typename TImage::SpacingType   spacing;
+  typename TImage::PointType     origin;
+  typename TImage::DirectionType direction;
+  itk::SizeValueType             numberOfPixels = 1;
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    size[d] = static_cast<itk::SizeValueType>( entry.Size[d] );
+    spacing[d] = entry.Spacing[d];
+    origin[d] = entry.Origin[d];
+    for( unsigned int c = 0; c < ImageDimension; ++c )
+      {
+      direction[d][c] = entry.Direction[d * ImageDimension + c];
+      }
+    numberOfPixels *= size[d];
+    }
+  if( numberOfPixels * sizeof(PixelType) != entry.DataBytes )
+    {
+    itkExceptionMacro( << "Atlas package entry " << name << " is corrupt" );
+    }
+
+  typename ContainerType::Pointer container = ContainerType::New();
+  container->SetPackage(this);
+  container->SetImportPointer( reinterpret_cast<PixelType *>( m_MappedData + entry.DataOffset ),
+                               numberOfPixels, false );
+
+  typename TImage::Pointer image = TImage::New();
+  typename TImage::RegionType region;
+  region.SetSize(size);
+  image->SetRegions(region);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(direction);
+  image->SetPixelContainer(container);
+  return image;
+}
+
+#endif // __AtlasPackage_hxx
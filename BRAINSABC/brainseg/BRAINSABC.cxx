@@ -44,6 +44,7 @@
 #include "mu.h"
 //#include "EMSParameters.h"
 #include "AtlasDefinition.h"
+#include "AtlasPackage.h"
 #include <vector>
 #include "Log.h"
 
@@ -83,22 +84,6 @@ using ShortImagePointer = ShortImageType::Pointer;
 
 #undef MU_MANUAL_INSTANTIATION
 
-/**
- * \def FindPathFromAtlasXML
- * \param The encoded file name, if abosolute, then use it, else prepend atlasDefinitionPath
- * \param atlasDefinitionPath the directory path for the XML file
- * \return either the absolute path, or the prepended path
- */
-  static std::string
-FindPathFromAtlasXML( const std::string xmlCodedPath, std::string atlasDefinitionPath)
-{
-  if( xmlCodedPath[0] != '/' ) // If not an absolute path, assume relative path
-    {
-    return atlasDefinitionPath+"/"+xmlCodedPath;
-    }
-  return xmlCodedPath;
-}
-
 //
 // Get a version of the filename that does not include the preceeding path, or
 // the image file extensions.
@@ -265,6 +250,23 @@ int main(int argc, char * *argv)
 ;
   atlasDefinitionParser.DebugPrint();
 
+  AtlasPackage::Pointer atlasPackageReader = nullptr;
+  if( !atlasPackage.empty() )
+    {
+    atlasPackageReader = AtlasPackage::New();
+    try
+      {
+      atlasPackageReader->Open(atlasPackage);
+      atlasPackageReader->VerifyAtlasDefinition(atlasDefinitionParser);
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      muLogMacro( << "Error reading Atlas Package from "
+                  << atlasPackage << ": " << err << std::endl );
+      return EXIT_FAILURE;
+      }
+    }
+
   AtlasRegType::MapOfStringVectors inputVolumeMap =
     CreateTypedMap(input_VolumeTypes,input_Volumes);
   AtlasRegType::MapOfStringVectors outputVolumeMap;
@@ -473,21 +475,37 @@ int main(int argc, char * *argv)
     muLogMacro( <<  "No template mask specified" << std::endl );
     return EXIT_FAILURE;
     }
-  muLogMacro( << "Reading mask : " << templateMask << "...\n");
-
-  ReaderPointer imgreader = ReaderType::New();
-  imgreader->SetFileName( templateMask.c_str() );
-
-  try
+  if( atlasPackageReader.IsNotNull() )
     {
-    imgreader->Update();
+    muLogMacro( << "Mapping mask from atlas package : " << atlasPackage << "...\n");
+    try
+      {
+      atlasBrainMask = atlasPackageReader->GetImage<ByteImageType>( AtlasPackage::TemplateBrainMaskName() );
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      muLogMacro( << "ERROR:  " << err << std::endl );
+      return EXIT_FAILURE;
+      }
     }
-  catch( ... )
+  else
     {
-    muLogMacro( << "ERROR:  Could not read image " << templateMask << "." << std::endl );
-    return EXIT_FAILURE;
+    muLogMacro( << "Reading mask : " << templateMask << "...\n");
+
+    ReaderPointer imgreader = ReaderType::New();
+    imgreader->SetFileName( templateMask.c_str() );
+
+    try
+      {
+      imgreader->Update();
+      }
+    catch( ... )
+      {
+      muLogMacro( << "ERROR:  Could not read image " << templateMask << "." << std::endl );
+      return EXIT_FAILURE;
+      }
+    atlasBrainMask = imgreader->GetOutput();
     }
-  atlasBrainMask = imgreader->GetOutput();
   }
 
   AtlasRegType::MapOfFloatImageVectors intraSubjectRegisteredImageMap;
@@ -665,22 +683,41 @@ int main(int argc, char * *argv)
   for(auto mapIt = templateVolumes.begin();
       mapIt != templateVolumes.end(); ++mapIt)
     {
-    const std::string curAtlasName = FindPathFromAtlasXML(*(mapIt->second.begin()),atlasDefinitionPath);
-    muLogMacro(<< "\n***Reading atlas image " << mapIt->first << ": " << curAtlasName << "...\n");
-    LocalReaderPointer imgreader = LocalReaderType::New();
-    imgreader->SetFileName(curAtlasName.c_str());
-    try
+    FloatImagePointer rawAtlasImage;
+    if( atlasPackageReader.IsNotNull() )
       {
-      imgreader->Update();
+      muLogMacro(<< "\n***Mapping atlas image " << mapIt->first << " from atlas package...\n");
+      try
+        {
+        rawAtlasImage =
+          atlasPackageReader->GetImage<FloatImageType>( AtlasPackage::TemplateVolumeName( mapIt->first ) );
+        }
+      catch( itk::ExceptionObject & err )
+        {
+        muLogMacro( << "ERROR:  " << err << std::endl );
+        return EXIT_FAILURE;
+        }
       }
-    catch( ... )
+    else
       {
-      muLogMacro( << "ERROR:  Could not read image " << curAtlasName << "." << std::endl );
-      return EXIT_FAILURE;
+      const std::string curAtlasName = FindPathFromAtlasXML(*(mapIt->second.begin()),atlasDefinitionPath);
+      muLogMacro(<< "\n***Reading atlas image " << mapIt->first << ": " << curAtlasName << "...\n");
+      LocalReaderPointer imgreader = LocalReaderType::New();
+      imgreader->SetFileName(curAtlasName.c_str());
+      try
+        {
+        imgreader->Update();
+        }
+      catch( ... )
+        {
+        muLogMacro( << "ERROR:  Could not read image " << curAtlasName << "." << std::endl );
+        return EXIT_FAILURE;
+        }
+      rawAtlasImage = imgreader->GetOutput();
       }
     muLogMacro( << "Standardizing Intensities: ..." );
     FloatImagePointer img_i =
-      StandardizeMaskIntensity<FloatImageType, ByteImageType>(imgreader->GetOutput(),
+      StandardizeMaskIntensity<FloatImageType, ByteImageType>(rawAtlasImage,
                                                               atlasBrainMask,
                                                               0.0005, 1.0 - 0.0005,
                                                               1,
@@ -1071,16 +1108,25 @@ int main(int argc, char * *argv)
     unsigned int                   AirIndex = 10000;
     for( unsigned int i = 0; i < PriorNames.size(); i++ )
       {
-      using LocalReaderType = itk::ImageFileReader<FloatImageType>;
-      using LocalReaderPointer = LocalReaderType::Pointer;
-      LocalReaderPointer priorReader = LocalReaderType::New();
-      const std::string curPriorAtlasName = FindPathFromAtlasXML(
-        atlasDefinitionParser.GetPriorFilename(PriorNames[i]),
-        atlasDefinitionPath);
-      priorReader->SetFileName( curPriorAtlasName );
-      priorReader->Update();
-      FloatImageType::Pointer temp = priorReader->GetOutput();
-      atlasOriginalPriors[i] = temp;
+      if( atlasPackageReader.IsNotNull() )
+        {
+        // The priors wrap the mapped package memory, no decompression or copy.
+        atlasOriginalPriors[i] =
+          atlasPackageReader->GetImage<FloatImageType>( AtlasPackage::PriorName(PriorNames[i]) );
+        }
+      else
+        {
+        using LocalReaderType = itk::ImageFileReader<FloatImageType>;
+        using LocalReaderPointer = LocalReaderType::Pointer;
+        LocalReaderPointer priorReader = LocalReaderType::New();
+        const std::string curPriorAtlasName = FindPathFromAtlasXML(
+          atlasDefinitionParser.GetPriorFilename(PriorNames[i]),
+          atlasDefinitionPath);
+        priorReader->SetFileName( curPriorAtlasName );
+        priorReader->Update();
+        FloatImageType::Pointer temp = priorReader->GetOutput();
+        atlasOriginalPriors[i] = temp;
+        }
       // Set the index for the background values.
       if( PriorNames[i] == std::string("AIR") )
         {
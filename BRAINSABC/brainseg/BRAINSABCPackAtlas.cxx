@@ -0,0 +1,95 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include <iostream>
+#include <string>
+#include "itkImageFileReader.h"
+#include "itksys/SystemTools.hxx"
+#include "AtlasDefinition.h"
+#include "AtlasPackage.h"
+#include "BRAINSABCPackAtlasCLP.h"
+
+template <typename TImage>
+static typename TImage::Pointer
+ReadAtlasImage(const std::string & filename)
+{
+  using ReaderType = itk::ImageFileReader<TImage>;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  reader->Update();
+  return reader->GetOutput();
+}
+
+int main(int argc, char * *argv)
+{
+  PARSE_ARGS;
+
+  if( atlasDefinition.empty() || outputAtlasPackage.empty() )
+    {
+    std::cerr << "ERROR: --atlasDefinition and --outputAtlasPackage are required" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const std::string atlasDefinitionPath = itksys::SystemTools::GetParentDirectory( atlasDefinition.c_str() );
+  AtlasDefinition   atlasDefinitionParser;
+  try
+    {
+    atlasDefinitionParser.InitFromXML(atlasDefinition);
+    }
+  catch( ... )
+    {
+    std::cerr << "ERROR: reading Atlas Definition from " << atlasDefinition << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  using FloatImageType = AtlasPackageWriter::FloatImageType;
+  using ByteImageType = AtlasPackageWriter::ByteImageType;
+
+  AtlasPackageWriter packageWriter;
+  try
+    {
+    const std::string brainMask = FindPathFromAtlasXML(atlasDefinitionParser.GetTemplateBrainMask(), atlasDefinitionPath);
+    std::cout << "Packing " << brainMask << std::endl;
+    packageWriter.AddImage(AtlasPackage::TemplateBrainMaskName(), ReadAtlasImage<ByteImageType>(brainMask).GetPointer() );
+
+    for( const auto & templateVolume : atlasDefinitionParser.GetTemplateVolumes() )
+      {
+      const std::string templateFile = FindPathFromAtlasXML(templateVolume.second, atlasDefinitionPath);
+      std::cout << "Packing " << templateFile << std::endl;
+      packageWriter.AddImage(AtlasPackage::TemplateVolumeName(templateVolume.first),
+                             ReadAtlasImage<FloatImageType>(templateFile).GetPointer() );
+      }
+
+    for( const auto & tissueType : atlasDefinitionParser.TissueTypes() )
+      {
+      const std::string priorFile =
+        FindPathFromAtlasXML(atlasDefinitionParser.GetPriorFilename(tissueType), atlasDefinitionPath);
+      std::cout << "Packing " << priorFile << std::endl;
+      packageWriter.AddImage(AtlasPackage::PriorName(tissueType),
+                             ReadAtlasImage<FloatImageType>(priorFile).GetPointer() );
+      }
+
+    packageWriter.Write(outputAtlasPackage);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << "ERROR: " << err << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -22,6 +22,7 @@
 
 #include "genericRegistrationHelper.h"
 #include "itkCorrelationImageToImageMetricv4.h"
+#include "itkFastMattesMutualInformationImageToImageMetricv4.h"
 #include "itkMeanSquaresImageToImageMetricv4.h"
 #include "itkKullbackLeiblerCompareHistogramImageToImageMetric.h"
 #include "itkHistogramImageToImageMetric.h"
@@ -37,6 +38,8 @@
 #include "itkNormalizedMutualInformationHistogramImageToImageMetric.h"
 
 #include  <algorithm>
+#include  <cmath>
+#include  <sstream>
 
 // A little dummy function to make it easy to stop the debugger.
 void debug_catch(void)
@@ -84,6 +87,85 @@ ConvertMaskImageToSpatialMask( itk::Image<unsigned char,3>::ConstPointer inputIm
   return so;
 }
 
+std::vector<std::vector<double> >
+ParseLevelSchedules( const std::vector<std::string> & stageSchedules, const std::string & optionName )
+{
+  std::vector<std::vector<double> > schedules;
+  for( const auto & stageSchedule : stageSchedules )
+    {
+    std::vector<double> levels;
+    std::stringstream   scheduleStream(stageSchedule);
+    std::string         level;
+    while( std::getline(scheduleStream, level, 'x') )
+      {
+      std::istringstream levelStream(level);
+      double             value;
+      if( !( levelStream >> value ) || !( levelStream >> std::ws ).eof() || value < 0.0 )
+        {
+        itkGenericExceptionMacro(<< "Invalid --" << optionName << " schedule \"" << stageSchedule
+                                 << "\", expected non negative values separated by x (e.g. 4x2x1)");
+        }
+      levels.push_back(value);
+      }
+    if( levels.empty() )
+      {
+      itkGenericExceptionMacro(<< "Empty --" << optionName << " schedule");
+      }
+    // getline does not report the empty level after a trailing 'x'
+    const size_t lastCharacter = stageSchedule.find_last_not_of(" \t");
+    if( lastCharacter != std::string::npos && stageSchedule[lastCharacter] == 'x' )
+      {
+      itkGenericExceptionMacro(<< "Invalid --" << optionName << " schedule \"" << stageSchedule
+                               << "\", expected non negative values separated by x (e.g. 4x2x1)");
+      }
+    schedules.push_back(levels);
+    }
+  return schedules;
+}
+
+void
+BuildLevelSchedules( const std::vector<std::string> & transformTypes,
+                     const std::vector<std::string> & shrinkFactors,
+                     const std::vector<std::string> & smoothingSigmas,
+                     std::vector<std::vector<unsigned int> > & shrinkFactorsSchedule,
+                     std::vector<std::vector<double> > & smoothingSigmasSchedule )
+{
+  const std::vector<std::vector<double> > parsedShrinkFactors = ParseLevelSchedules(shrinkFactors, "shrinkFactors");
+  const std::vector<std::vector<double> > parsedSmoothingSigmas =
+    ParseLevelSchedules(smoothingSigmas, "smoothingSigmas");
+  if( ( parsedShrinkFactors.size() != 1 && parsedShrinkFactors.size() != transformTypes.size() )
+      || ( parsedSmoothingSigmas.size() != 1 && parsedSmoothingSigmas.size() != transformTypes.size() ) )
+    {
+    itkGenericExceptionMacro(<< "The shrinkFactors and smoothingSigmas arrays must match the length of the"
+                             << " transformType, or have a single schedule that is used for all registration"
+                             << " phases.");
+    }
+  shrinkFactorsSchedule.clear();
+  smoothingSigmasSchedule.clear();
+  for( size_t stage = 0; stage < transformTypes.size(); ++stage )
+    {
+    const std::vector<double> & stageShrinkFactors = parsedShrinkFactors[parsedShrinkFactors.size() == 1 ? 0 : stage];
+    const std::vector<double> & stageSmoothingSigmas =
+      parsedSmoothingSigmas[parsedSmoothingSigmas.size() == 1 ? 0 : stage];
+    if( stageShrinkFactors.size() != stageSmoothingSigmas.size() )
+      {
+      itkGenericExceptionMacro(<< "The " << transformTypes[stage] << " phase must have as many shrink factors as"
+                               << " smoothing sigmas, one value for each resolution level.");
+      }
+    std::vector<unsigned int> stageFactors;
+    for( const double factor : stageShrinkFactors )
+      {
+      if( factor < 1.0 || factor != std::floor(factor) )
+        {
+        itkGenericExceptionMacro(<< "Shrink factors must be integers of at least 1.");
+        }
+      stageFactors.push_back( static_cast<unsigned int>( factor ) );
+      }
+    shrinkFactorsSchedule.push_back(stageFactors);
+    smoothingSigmasSchedule.push_back(stageSmoothingSigmas);
+    }
+}
+
 namespace itk
 {
 BRAINSFitHelper::BRAINSFitHelper() :
@@ -116,6 +198,8 @@ BRAINSFitHelper::BRAINSFitHelper() :
   m_InitializeTransformMode("Off"),
   m_MaskInferiorCutOffFromCenter(1000),
   m_SplineGridSize(3, 10),
+  m_ShrinkFactors(1, std::vector<unsigned int>(1, 1) ),
+  m_SmoothingSigmas(1, std::vector<double>(1, 0.0) ),
   m_CostFunctionConvergenceFactor(1e+9),
   m_ProjectedGradientTolerance(1e-5),
   m_MaxBSplineDisplacement(0.0),
@@ -407,7 +491,9 @@ BRAINSFitHelper::Update(void)
   GenericMetricType::Pointer metric;
   if( this->m_CostMetricName == "MMI" )
     {
-    using MIMetricType = itk::MattesMutualInformationImageToImageMetricv4<FixedImageType, MovingImageType, FixedImageType, RealType>;
+    // Evaluates the rigid and affine stages with a specialized kernel, and
+    // falls back to the ITK Mattes metric for the BSpline stage.
+    using MIMetricType = itk::FastMattesMutualInformationImageToImageMetricv4<FixedImageType, MovingImageType, FixedImageType, RealType>;
     MIMetricType::Pointer mutualInformationMetric = MIMetricType::New();
     //The next line was a hack for early ITKv4 mattes mutual informaiton
     //that was using a lot of memory
@@ -561,6 +647,26 @@ BRAINSFitHelper::PrintSelf(std::ostream & os, Indent indent) const
     os << this->m_SplineGridSize[q] << " ";
     }
   os << "]" << std::endl;
+  os << indent << "ShrinkFactors:     [";
+  for( unsigned int q = 0; q < this->m_ShrinkFactors.size(); ++q )
+    {
+    for( unsigned int level = 0; level < this->m_ShrinkFactors[q].size(); ++level )
+      {
+      os << ( level == 0 ? "" : "x" ) << this->m_ShrinkFactors[q][level];
+      }
+    os << " ";
+    }
+  os << "]" << std::endl;
+  os << indent << "SmoothingSigmas:     [";
+  for( unsigned int q = 0; q < this->m_SmoothingSigmas.size(); ++q )
+    {
+    for( unsigned int level = 0; level < this->m_SmoothingSigmas[q].size(); ++level )
+      {
+      os << ( level == 0 ? "" : "x" ) << this->m_SmoothingSigmas[q][level];
+      }
+    os << " ";
+    }
+  os << "]" << std::endl;
 
   if( m_CurrentGenericTransform.IsNotNull() )
     {
@@ -758,6 +864,32 @@ BRAINSFitHelper::PrintCommandLine(const bool dumpTempVolumes, const std::string
       }
     }
   oss << " \\" << std::endl;
+  oss << "--shrinkFactors ";
+  for( unsigned int q = 0; q < this->m_ShrinkFactors.size(); ++q )
+    {
+    for( unsigned int level = 0; level < this->m_ShrinkFactors[q].size(); ++level )
+      {
+      oss << ( level == 0 ? "" : "x" ) << this->m_ShrinkFactors[q][level];
+      }
+    if( q < this->m_ShrinkFactors.size() - 1 )
+      {
+      oss << ",";
+      }
+    }
+  oss << " \\" << std::endl;
+  oss << "--smoothingSigmas ";
+  for( unsigned int q = 0; q < this->m_SmoothingSigmas.size(); ++q )
+    {
+    for( unsigned int level = 0; level < this->m_SmoothingSigmas[q].size(); ++level )
+      {
+      oss << ( level == 0 ? "" : "x" ) << this->m_SmoothingSigmas[q][level];
+      }
+    if( q < this->m_SmoothingSigmas.size() - 1 )
+      {
+      oss << ",";
+      }
+    }
+  oss << " \\" << std::endl;
 
   if( m_CurrentGenericTransform.IsNotNull() )
     {
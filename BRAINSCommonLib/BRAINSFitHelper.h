@@ -46,10 +46,10 @@
 #include "GenericTransformImage.h"
 #include "ReadMask.h"
 #include "BRAINSMacro.h"
+#include "BRAINSFitSamplingCache.h"
 
 #include "itkIO.h"
 #include "itkFindCenterOfBrainFilter.h"
-#include "itkImageRandomNonRepeatingConstIteratorWithIndex.h"
 #include "itkMersenneTwisterRandomVariateGenerator.h"
 
 namespace itk
@@ -82,6 +82,10 @@ public:
   using MovingImageConstPointer = MovingImageType::ConstPointer;
   using MovingImagePointer = MovingImageType::Pointer;
 
+  /** One list of per level values, coarsest first, for each transform stage. */
+  using ShrinkFactorsScheduleType = std::vector<std::vector<unsigned int> >;
+  using SmoothingSigmasScheduleType = std::vector<std::vector<double> >;
+
   /** Constants for the image dimensions */
   static constexpr unsigned int FixedImageDimension = FixedImageType::ImageDimension;
   static constexpr unsigned int MovingImageDimension = MovingImageType::ImageDimension;
@@ -190,6 +194,19 @@ public:
   itkSetMacro(RestoreState,  CompositeTransformType::Pointer);
   itkGetConstMacro(RestoreState,  CompositeTransformType::Pointer);
   VECTORitkSetMacro(SplineGridSize, std::vector<int>       );
+  /** Shrink factors and smoothing sigmas (in mm) of the resolution levels
+   * of each transform stage, coarsest first.  Either one schedule per
+   * TransformType, or a single schedule used for every stage. */
+  void SetShrinkFactors(const ShrinkFactorsScheduleType & shrinkFactors)
+  {
+    this->m_ShrinkFactors = shrinkFactors;
+    this->Modified();
+  }
+  void SetSmoothingSigmas(const SmoothingSigmasScheduleType & smoothingSigmas)
+  {
+    this->m_SmoothingSigmas = smoothingSigmas;
+    this->Modified();
+  }
 
   itkGetConstMacro(ActualNumberOfIterations,      unsigned int);
   itkGetConstMacro(PermittedNumberOfIterations,   unsigned int);
@@ -300,6 +317,8 @@ private:
   std::string              m_InitializeTransformMode;
   double                   m_MaskInferiorCutOffFromCenter;
   std::vector<int>         m_SplineGridSize;
+  ShrinkFactorsScheduleType   m_ShrinkFactors;
+  SmoothingSigmasScheduleType m_SmoothingSigmas;
   double                   m_CostFunctionConvergenceFactor;
   double                   m_ProjectedGradientTolerance;
   double                   m_MaxBSplineDisplacement;
@@ -351,57 +370,20 @@ BRAINSFitHelper::SetupRegistration(GenericMetricType *costMetric)
     {
     localCostMetric->SetMovingImageMask(this->m_MovingBinaryVolume);
     }
-  if( this->m_FixedBinaryVolume.IsNotNull() )
+  if( this->m_FixedBinaryVolume.IsNotNull() || this->m_SamplingStrategy == AffineRegistrationType::RANDOM )
     {
-    // In this case the registration framework does not do sampling inside the mask area.
-    // It picks samples from the whole image, and those samples that are inside the mask are selected by metric.
-    // However, we want to pick all of our intended samples from the mask area, so we do sampling here.
-
-    // First overwrite the sampling strategy to be none
+    // The registration framework would draw new samples from the whole image
+    // at every stage, and only afterwards drop those outside the mask.  We
+    // want all of our samples inside the mask area, drawn once per fixed
+    // image and mask and shared with every later registration in this
+    // process, so the sampling is done here and passed to the metric.
+    // Without a mask only Random sampling is replaced, Regular sampling is
+    // left to the framework.
     this->m_SamplingStrategy = AffineRegistrationType::NONE;
 
-    // then pick the samples inside the mask and pass them to metric
-    typename MetricSamplePointSetType::Pointer samplePointSet = MetricSamplePointSetType::New();
-    samplePointSet->Initialize();
-
-    using SamplePointType = typename MetricSamplePointSetType::PointType;
-    const unsigned long numberOfAllSamples = this->m_FixedVolume->GetBufferedRegion().GetNumberOfPixels();
-
-    const unsigned long sampleCount = static_cast<unsigned long>(std::ceil( numberOfAllSamples * this->m_SamplingPercentage ) );
-
-    using RandomizerType = Statistics::MersenneTwisterRandomVariateGenerator;
-    typename RandomizerType::Pointer randomizer = RandomizerType::New();
-    randomizer->SetSeed( 1234 );
-
-    itk::ImageRandomNonRepeatingConstIteratorWithIndex<FixedImageType> NRit( this->m_FixedVolume,
-      this->m_FixedVolume->GetBufferedRegion() );
-    NRit.ReinitializeSeed(121212);
-
-    const typename FixedImageType::SpacingType oneThirdVirtualSpacing = this->m_FixedVolume->GetSpacing() / 3.0;
-    NRit.SetNumberOfSamples( numberOfAllSamples ); //Take random samples from entire image.
-    NRit.GoToBegin();
-    unsigned long samplesInsideMask = 0;
-    while( !NRit.IsAtEnd()  && ( samplesInsideMask < sampleCount ) )
-      {
-      SamplePointType testPoint;
-      this->m_FixedVolume->TransformIndexToPhysicalPoint(NRit.GetIndex(), testPoint);
-      if( this->m_FixedBinaryVolume->IsInsideInWorldSpace(testPoint) )
-        {
-        // randomly perturb the point within a voxel (approximately)
-        for ( unsigned int d = 0; d < FixedImageDimension; d++ )
-          {
-          testPoint[d] += randomizer->GetNormalVariate() * oneThirdVirtualSpacing[d];
-          }
-        samplePointSet->SetPoint( samplesInsideMask, testPoint );
-        ++samplesInsideMask;
-        }
-      ++NRit;
-      }
-
-    if( samplePointSet.IsNull() )
-      {
-      itkGenericExceptionMacro("samplePointSet is empty.");
-      }
+    using SamplingCacheType = BRAINSFitSamplingCache<FixedImageType>;
+    const typename MetricSamplePointSetType::ConstPointer samplePointSet =
+      SamplingCacheType::GetSampledPointSet( this->m_FixedVolume, this->m_FixedBinaryVolume, this->m_SamplingPercentage );
 
     localCostMetric->SetUseSampledPointSet( true );
     localCostMetric->SetFixedSampledPointSet( samplePointSet );
@@ -451,6 +433,8 @@ BRAINSFitHelper::SetupRegistration(GenericMetricType *costMetric)
   myHelper->SetCurrentGenericTransform(this->m_CurrentGenericTransform);
   myHelper->SetRestoreState(this->m_RestoreState);
   myHelper->SetSplineGridSize(this->m_SplineGridSize);
+  myHelper->SetShrinkFactors(this->m_ShrinkFactors);
+  myHelper->SetSmoothingSigmas(this->m_SmoothingSigmas);
   myHelper->SetCostFunctionConvergenceFactor(this->m_CostFunctionConvergenceFactor);
   myHelper->SetProjectedGradientTolerance(this->m_ProjectedGradientTolerance);
   myHelper->SetMaxBSplineDisplacement(this->m_MaxBSplineDisplacement);
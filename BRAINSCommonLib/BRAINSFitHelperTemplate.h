@@ -124,6 +124,10 @@ public:
   using MovingBinaryVolumePointer = typename MovingBinaryVolumeType::Pointer;
 
   using AffineRegistrationType = itk::ImageRegistrationMethodv4<FixedImageType, MovingImageType>;
+
+  /** One list of per level values, coarsest first, for each transform stage. */
+  using ShrinkFactorsScheduleType = std::vector<std::vector<unsigned int> >;
+  using SmoothingSigmasScheduleType = std::vector<std::vector<double> >;
   using TranslationTransformType = itk::TranslationTransform<RealType, MovingImageDimension>;
   using AffineTransformType = itk::AffineTransform<RealType, MovingImageDimension>;
   using ScalableAffineTransformType = itk::ScalableAffineTransform<RealType, MovingImageDimension>;
@@ -218,6 +222,20 @@ public:
   VECTORitkSetMacro(TransformType, std::vector<std::string> );
   // cppcheck-suppress unusedFunction
   VECTORitkSetMacro(SplineGridSize, std::vector<int>       );
+  /** Shrink factors and smoothing sigmas (in mm) of the resolution levels
+   * of each transform stage, coarsest first.  Like NumberOfIterations there
+   * is either one schedule per TransformType, or a single schedule that is
+   * used for every stage. */
+  void SetShrinkFactors(const ShrinkFactorsScheduleType & shrinkFactors)
+  {
+    this->m_ShrinkFactors = shrinkFactors;
+    this->Modified();
+  }
+  void SetSmoothingSigmas(const SmoothingSigmasScheduleType & smoothingSigmas)
+  {
+    this->m_SmoothingSigmas = smoothingSigmas;
+    this->Modified();
+  }
 
   itkGetConstMacro(ActualNumberOfIterations,      unsigned int);
   itkGetConstMacro(PermittedNumberOfIterations,   unsigned int);
@@ -282,6 +300,8 @@ protected:
             typename FitCommonCodeMetricType>
   void FitCommonCode(int numberOfIterations,
                      double minimumStepLength,
+                     const std::vector<unsigned int> & shrinkFactors,
+                     const std::vector<double> & smoothingSigmas,
                      typename CompositeTransformType::Pointer & initialITKTransform);
 private:
 
@@ -315,6 +335,8 @@ private:
   std::string              m_InitializeTransformMode;
   double                   m_MaskInferiorCutOffFromCenter;
   std::vector<int>         m_SplineGridSize;
+  ShrinkFactorsScheduleType   m_ShrinkFactors;
+  SmoothingSigmasScheduleType m_SmoothingSigmas;
   double                   m_CostFunctionConvergenceFactor;
   double                   m_ProjectedGradientTolerance;
   double                   m_MaxBSplineDisplacement;
@@ -36,6 +36,13 @@
 #include "itkStatisticsLabelObject.h"
 #include "itkLabelImageToStatisticsLabelMapFilter.h"
 #include "itkMacro.h"
+#include "itkShrinkImageFilter.h"
+#include "itkSmoothingRecursiveGaussianImageFilter.h"
+#include "itkMattesMutualInformationImageToImageMetricv4.h"
+#include "itkJointHistogramMutualInformationImageToImageMetricv4.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <map>
 
 namespace itk
 {
@@ -138,6 +145,205 @@ ValidateTransformRankOrdering(const std::vector<std::string> & transformType)
     }
 }
 
+/** Smooth and shrink an image to roughly targetSpacing for the rotation
+ * pre-search.  Images that are already coarse are returned unchanged. */
+template <typename TImage>
+typename TImage::ConstPointer
+ShrinkImageForRotationPreSearch( const TImage *image, const double targetSpacing )
+{
+  using SmootherType = itk::SmoothingRecursiveGaussianImageFilter<TImage, TImage>;
+  using ShrinkerType = itk::ShrinkImageFilter<TImage, TImage>;
+
+  typename ShrinkerType::ShrinkFactorsType shrinkFactors;
+  typename SmootherType::SigmaArrayType    sigmas;
+  bool                                     needsShrinking = false;
+  for( unsigned int d = 0; d < TImage::ImageDimension; ++d )
+    {
+    const double       spacing = image->GetSpacing()[d];
+    const unsigned int maxFactor =
+      static_cast<unsigned int>( image->GetLargestPossibleRegion().GetSize()[d] / 16 );
+    shrinkFactors[d] = std::max( 1U, std::min( static_cast<unsigned int>( targetSpacing / spacing ), maxFactor ) );
+    sigmas[d] = 0.5 * shrinkFactors[d] * spacing;
+    needsShrinking = needsShrinking || shrinkFactors[d] > 1;
+    }
+  if( !needsShrinking )
+    {
+    return image;
+    }
+
+  typename SmootherType::Pointer smoother = SmootherType::New();
+  smoother->SetInput(image);
+  smoother->SetSigmaArray(sigmas);
+  typename ShrinkerType::Pointer shrinker = ShrinkerType::New();
+  shrinker->SetInput( smoother->GetOutput() );
+  shrinker->SetShrinkFactors(shrinkFactors);
+  shrinker->Update();
+  typename TImage::ConstPointer shrunk = shrinker->GetOutput();
+  return shrunk;
+}
+
+/** Coarse to fine search over the three Euler angles of initialTransform.
+ * The cost is evaluated on smoothed and downsampled copies of the images
+ * held by the metric components.  Every worker owns a single threaded clone
+ * of the multi metric and of the transform, and evaluates an interleaved
+ * share of each search grid.  The minimum is taken in grid order, so the
+ * result does not depend on the number of threads. */
+template <typename FixedImageType, typename MovingImageType, typename MultiMetricType>
+itk::Euler3DTransform<double>::Pointer
+DoRotationPreSearch( const MultiMetricType *costMetric,
+                     const ImageMaskPointer & fixedMask,
+                     const ImageMaskPointer & movingMask,
+                     const itk::Euler3DTransform<double> *initialTransform )
+{
+  using EulerAngle3DTransformType = itk::Euler3DTransform<double>;
+  using ImageMetricType = itk::ImageToImageMetricv4<FixedImageType, MovingImageType, FixedImageType, double>;
+  using MattesMetricType =
+    itk::MattesMutualInformationImageToImageMetricv4<FixedImageType, MovingImageType, FixedImageType, double>;
+  using JointHistogramMetricType =
+    itk::JointHistogramMutualInformationImageToImageMetricv4<FixedImageType, MovingImageType, FixedImageType, double>;
+  using FixedImageConstPointer = typename FixedImageType::ConstPointer;
+  using MovingImageConstPointer = typename MovingImageType::ConstPointer;
+
+  constexpr double       preSearchSpacing = 4.0; // mm
+  constexpr int          halfWidth = 3;
+  constexpr int          gridWidth = 2 * halfWidth + 1;
+  constexpr unsigned int gridSize = gridWidth * gridWidth * gridWidth;
+  const double           one_degree = itk::Math::pi / 180.0;
+  // +-30 degrees in 10 degree steps, then refine around the best angles.
+  const std::vector<double> levelStepSizes = { 10.0 * one_degree, 10.0 / 3.0 * one_degree, 10.0 / 9.0 * one_degree };
+
+  std::vector<const ImageMetricType *>                           components;
+  std::vector<FixedImageConstPointer>                            shrunkFixedImages;
+  std::vector<MovingImageConstPointer>                           shrunkMovingImages;
+  std::map<const FixedImageType *, FixedImageConstPointer>   fixedCache;
+  std::map<const MovingImageType *, MovingImageConstPointer> movingCache;
+  for( const auto & metric : costMetric->GetMetricQueue() )
+    {
+    const ImageMetricType *component = dynamic_cast<const ImageMetricType *>( metric.GetPointer() );
+    if( component == nullptr )
+      {
+      itkGenericExceptionMacro(<< "The rotation pre-search requires image to image metrics");
+      }
+    const FixedImageType * fixedImage = component->GetFixedImage();
+    const MovingImageType *movingImage = component->GetMovingImage();
+    if( fixedCache.find(fixedImage) == fixedCache.end() )
+      {
+      fixedCache[fixedImage] = ShrinkImageForRotationPreSearch<FixedImageType>(fixedImage, preSearchSpacing);
+      }
+    if( movingCache.find(movingImage) == movingCache.end() )
+      {
+      movingCache[movingImage] = ShrinkImageForRotationPreSearch<MovingImageType>(movingImage, preSearchSpacing);
+      }
+    components.push_back(component);
+    shrunkFixedImages.push_back(fixedCache[fixedImage]);
+    shrunkMovingImages.push_back(movingCache[movingImage]);
+    }
+
+  const unsigned int numberOfWorkers =
+    std::max( 1U, std::min( itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(), gridSize ) );
+  std::vector<typename MultiMetricType::Pointer>    workerMetrics(numberOfWorkers);
+  std::vector<EulerAngle3DTransformType::Pointer> workerTransforms(numberOfWorkers);
+  for( unsigned int w = 0; w < numberOfWorkers; ++w )
+    {
+    workerTransforms[w] = EulerAngle3DTransformType::New();
+    workerTransforms[w]->SetCenter( initialTransform->GetCenter() );
+    workerTransforms[w]->SetTranslation( initialTransform->GetTranslation() );
+
+    workerMetrics[w] = MultiMetricType::New();
+    for( size_t c = 0; c < components.size(); ++c )
+      {
+      typename ImageMetricType::Pointer clone =
+        dynamic_cast<ImageMetricType *>( components[c]->CreateAnother().GetPointer() );
+      clone->SetFixedImage(shrunkFixedImages[c]);
+      clone->SetMovingImage(shrunkMovingImages[c]);
+      clone->SetVirtualDomainFromImage(shrunkFixedImages[c]);
+      // Masks given to the search win, otherwise keep those of the component.
+      if( fixedMask.IsNotNull() )
+        {
+        clone->SetFixedImageMask(fixedMask);
+        }
+      else
+        {
+        clone->SetFixedImageMask( components[c]->GetFixedImageMask() );
+        }
+      if( movingMask.IsNotNull() )
+        {
+        clone->SetMovingImageMask(movingMask);
+        }
+      else
+        {
+        clone->SetMovingImageMask( components[c]->GetMovingImageMask() );
+        }
+      clone->SetUseSampledPointSet(false);
+      clone->SetUseFixedImageGradientFilter(false);
+      clone->SetUseMovingImageGradientFilter(false);
+      clone->SetMaximumNumberOfWorkUnits(1);
+      const MattesMetricType *mattes = dynamic_cast<const MattesMetricType *>( components[c] );
+      if( mattes != nullptr )
+        {
+        dynamic_cast<MattesMetricType *>( clone.GetPointer() )->SetNumberOfHistogramBins(
+          mattes->GetNumberOfHistogramBins() );
+        }
+      const JointHistogramMetricType *jointHistogram = dynamic_cast<const JointHistogramMetricType *>( components[c] );
+      if( jointHistogram != nullptr )
+        {
+        JointHistogramMetricType *jointHistogramClone = dynamic_cast<JointHistogramMetricType *>( clone.GetPointer() );
+        jointHistogramClone->SetNumberOfHistogramBins( jointHistogram->GetNumberOfHistogramBins() );
+        jointHistogramClone->SetVarianceForJointPDFSmoothing( jointHistogram->GetVarianceForJointPDFSmoothing() );
+        }
+      workerMetrics[w]->AddMetric(clone);
+      }
+    if( costMetric->GetMetricWeights().Size() == components.size() )
+      {
+      workerMetrics[w]->SetMetricWeights( costMetric->GetMetricWeights() );
+      }
+    workerMetrics[w]->SetMovingTransform(workerTransforms[w]);
+    workerMetrics[w]->Initialize();
+    }
+
+  const EulerAngle3DTransformType::ParametersType & initialParameters = initialTransform->GetParameters();
+  double bestAngles[3] = { initialParameters[0], initialParameters[1], initialParameters[2] };
+  double bestValue = itk::NumericTraits<double>::max();
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  for( const double stepSize : levelStepSizes )
+    {
+    const double        center[3] = { bestAngles[0], bestAngles[1], bestAngles[2] };
+    std::vector<double> values(gridSize);
+    auto                gridAngles = [&](unsigned int g, double angles[3])
+      {
+        angles[0] = center[0] + ( static_cast<int>( g % gridWidth ) - halfWidth ) * stepSize;
+        angles[1] = center[1] + ( static_cast<int>( ( g / gridWidth ) % gridWidth ) - halfWidth ) * stepSize;
+        angles[2] = center[2] + ( static_cast<int>( g / ( gridWidth * gridWidth ) ) - halfWidth ) * stepSize;
+      };
+    mt->ParallelizeArray( 0, numberOfWorkers,
+                          [&](itk::SizeValueType w)
+                            {
+                              for( unsigned int g = w; g < gridSize; g += numberOfWorkers )
+                                {
+                                double angles[3];
+                                gridAngles(g, angles);
+                                workerTransforms[w]->SetRotation(angles[0], angles[1], angles[2]);
+                                values[g] = workerMetrics[w]->GetValue();
+                                }
+                            },
+                          nullptr );
+    for( unsigned int g = 0; g < gridSize; ++g )
+      {
+      if( values[g] < bestValue )
+        {
+        bestValue = values[g];
+        gridAngles(g, bestAngles);
+        }
+      }
+    }
+
+  EulerAngle3DTransformType::Pointer bestTransform = EulerAngle3DTransformType::New();
+  bestTransform->SetCenter( initialTransform->GetCenter() );
+  bestTransform->SetTranslation( initialTransform->GetTranslation() );
+  bestTransform->SetRotation(bestAngles[0], bestAngles[1], bestAngles[2]);
+  return bestTransform;
+}
+
 template <typename FixedImageType, typename MovingImageType, typename TransformType,
           typename SpecificInitializerType, typename DoCenteredInitializationMetricType>
 typename TransformType::Pointer
@@ -327,93 +533,19 @@ DoCenteredInitialization( typename FixedImageType::Pointer & orientedFixedVolume
     //double max_cc = CostMetricObject->GetValue( currentEulerAngles3D->GetParameters() );
     double max_cc = CostMetricObject->GetValue();
 
-    // rough search in neighborhood.
-    const double one_degree = 1.0F * itk::Math::pi / 180.0F;
-    const double HAStepSize = 3.0 * one_degree;
-    const double PAStepSize = 3.0 * one_degree;
-    // Quick search just needs to get an approximate angle correct.
-    {
-    constexpr double HARange = 12.0;
-    for( double HA = -HARange * one_degree; HA <= HARange * one_degree; HA += HAStepSize )
+    // Search a wide range of rotations on downsampled images, and only keep
+    // the result when it also improves the full resolution cost.
+    typename EulerAngle3DTransformType::Pointer searchedEulerAngles3D =
+      DoRotationPreSearch<FixedImageType, MovingImageType, DoCenteredInitializationMetricType>(
+        CostMetricObject.GetPointer(), fixedMask, movingMask, currentEulerAngles3D.GetPointer() );
+    currentEulerAngles3D->SetParameters( searchedEulerAngles3D->GetParameters() );
+    const double current_cc = CostMetricObject->GetValue();
+    if( current_cc < max_cc )
       {
-      constexpr double PARange = 12.0;
-      for( double PA = -PARange * one_degree; PA <= PARange * one_degree; PA += PAStepSize )
-        {
-        currentEulerAngles3D->SetRotation(PA, 0, HA);
-        //const double current_cc = CostMetricObject->GetValue( currentEulerAngles3D->GetParameters() );
-        const double current_cc = CostMetricObject->GetValue();
-        if( current_cc < max_cc )
-          {
-          max_cc = current_cc;
-          bestEulerAngles3D->SetFixedParameters( currentEulerAngles3D->GetFixedParameters() );
-          bestEulerAngles3D->SetParameters( currentEulerAngles3D->GetParameters() );
-          }
-        // #define DEBUGGING_PRINT_IMAGES
-#ifdef DEBUGGING_PRINT_IMAGES
-        {
-        std::cout << "quick search "
-                  << " HA= " << ( currentEulerAngles3D->GetParameters()[2] ) * 180.0 / itk::Math::pi
-                  << " PA= " << ( currentEulerAngles3D->GetParameters()[0] ) * 180.0 / itk::Math::pi
-                  << " cc="  <<  current_cc
-                  << std::endl;
-        }
-        if( 0 )
-          {
-          using ResampleFilterType = itk::ResampleImageFilter<FixedImageType, MovingImageType, double>;
-          typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
-
-          resampler->SetTransform(currentEulerAngles3D);
-          resampler->SetInput(orientedMovingVolume);
-          // Remember:  the Data is Moving's, the shape is Fixed's.
-          resampler->SetOutputParametersFromImage(orientedFixedVolume);
-          resampler->Update();            //  Explicit Update() required
-          // here.
-          typename FixedImageType::Pointer ResampledImage = resampler->GetOutput();
-
-          using Checkerfilter = itk::CheckerBoardImageFilter<FixedImageType>;
-          typename Checkerfilter::Pointer checker = Checkerfilter::New();
-          unsigned int array[3] = { 36, 36, 36 };
-
-          checker->SetInput1(orientedFixedVolume);
-          checker->SetInput2(ResampledImage);
-          checker->SetCheckerPattern(array);
-          try
-            {
-            checker->Update();
-            }
-          catch( itk::ExceptionObject & err )
-            {
-            std::cout << "Caught an ITK exception: " << std::endl;
-            std::cout << err << " " << __FILE__ << " " << __LINE__ << std::endl;
-            throw;
-            }
-          char filename[300];
-          sprintf(filename, "%05.2f_%05.2f_%05.2f.nii.gz",
-                  ( currentEulerAngles3D->GetParameters()[2] ) * 180 / itk::Math::pi,
-                  ( currentEulerAngles3D->GetParameters()[0] ) * 180 / itk::Math::pi, current_cc);
-
-          {
-          using WriterType = typename itk::ImageFileWriter<FixedImageType>;
-          typename WriterType::Pointer writer = WriterType::New();
-          writer->UseCompressionOn();
-          writer->SetFileName(filename);
-          writer->SetInput( checker->GetOutput() );
-          try
-            {
-            writer->Update();
-            }
-          catch( itk::ExceptionObject & err )
-            {
-            std::cout << "Exception Object caught: " << std::endl;
-            std::cout << err << std::endl;
-            throw;
-            }
-          }
-          }
-#endif
-        }
+      max_cc = current_cc;
+      bestEulerAngles3D->SetFixedParameters( currentEulerAngles3D->GetFixedParameters() );
+      bestEulerAngles3D->SetParameters( currentEulerAngles3D->GetParameters() );
       }
-    }
     // DEBUGGING_PRINT_IMAGES INFORMATION
 #ifdef DEBUGGING_PRINT_IMAGES
     {
@@ -542,6 +674,8 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::BRAINSFitHelperTemplat
   m_InitializeTransformMode("Off"),
   m_MaskInferiorCutOffFromCenter(1000),
   m_SplineGridSize(3, 10),
+  m_ShrinkFactors(1, std::vector<unsigned int>(1, 1) ),
+  m_SmoothingSigmas(1, std::vector<double>(1, 0.0) ),
   m_CostFunctionConvergenceFactor(1e+9),
   m_ProjectedGradientTolerance(1e-5),
   m_MaxBSplineDisplacement(0.0),
@@ -576,6 +710,8 @@ void
 BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::FitCommonCode(
   int numberOfIterations,
   double minimumStepLength,
+  const std::vector<unsigned int> & shrinkFactors,
+  const std::vector<double> & smoothingSigmas,
   typename CompositeTransformType::Pointer & initialITKTransform)
 {
   // FitCommonCode
@@ -593,6 +729,8 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::FitCommonCode(
   appMutualRegistration->SetNumberOfIterations( numberOfIterations);
   appMutualRegistration->SetSamplingStrategy(m_SamplingStrategy);
   appMutualRegistration->SetSamplingPercentage(m_SamplingPercentage);
+  appMutualRegistration->SetShrinkFactors(shrinkFactors);
+  appMutualRegistration->SetSmoothingSigmas(smoothingSigmas);
   // HACK appMutualRegistration->MetricSamplingReinitializeSeed(121212);
 
   appMutualRegistration->SetRelaxationFactor( m_RelaxationFactor );
@@ -737,6 +875,24 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::Update(void)
     {
     localNumberOfIterations = m_NumberOfIterations;
     }
+  if( ( m_ShrinkFactors.size() != 1 && m_ShrinkFactors.size() != m_TransformType.size() )
+      || ( m_SmoothingSigmas.size() != 1 && m_SmoothingSigmas.size() != m_TransformType.size() ) )
+    {
+    itkGenericExceptionMacro(<< "ERROR:  Wrong number of schedules for ShrinkFactors or SmoothingSigmas."
+                             << " They either need to be 1 or the same size as TransformType.")
+    }
+  ShrinkFactorsScheduleType   localShrinkFactors( m_TransformType.size() );
+  SmoothingSigmasScheduleType localSmoothingSigmas( m_TransformType.size() );
+  for( unsigned int q = 0; q < m_TransformType.size(); ++q )
+    {
+    localShrinkFactors[q] = m_ShrinkFactors[m_ShrinkFactors.size() == 1 ? 0 : q];
+    localSmoothingSigmas[q] = m_SmoothingSigmas[m_SmoothingSigmas.size() == 1 ? 0 : q];
+    if( localShrinkFactors[q].empty() || localShrinkFactors[q].size() != localSmoothingSigmas[q].size() )
+      {
+      itkGenericExceptionMacro(<< "ERROR:  ShrinkFactors and SmoothingSigmas of the " << m_TransformType[q]
+                               << " stage must have the same, non zero, number of levels.")
+      }
+    }
   std::string localInitializeTransformMode(this->m_InitializeTransformMode);
   for( unsigned int currentTransformIndex = 0;
        currentTransformIndex < m_TransformType.size();
@@ -898,6 +1054,8 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::Update(void)
       this->FitCommonCode<TransformType, OptimizerType, MetricType>
         (localNumberOfIterations[currentTransformIndex],
          localMinimumStepLength[currentTransformIndex],
+         localShrinkFactors[currentTransformIndex],
+         localSmoothingSigmas[currentTransformIndex],
         this->m_CurrentGenericTransform);
       // NOW, after running the above function, the m_CurrentGenericTransform contains the integration of initial transform and rigid registration results.
       ///////////////////////
@@ -992,6 +1150,8 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::Update(void)
       this->FitCommonCode<TransformType, OptimizerType, MetricType>
       (localNumberOfIterations[currentTransformIndex],
        localMinimumStepLength[currentTransformIndex],
+       localShrinkFactors[currentTransformIndex],
+       localSmoothingSigmas[currentTransformIndex],
        this->m_CurrentGenericTransform);
       // NOW, after running the above function, the m_CurrentGenericTransform contains the integration of initial transform and ScaleVersor registration results.
       /////////////////////
@@ -1088,6 +1248,8 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::Update(void)
       this->FitCommonCode<TransformType, OptimizerType, MetricType>
       (localNumberOfIterations[currentTransformIndex],
        localMinimumStepLength[currentTransformIndex],
+       localShrinkFactors[currentTransformIndex],
+       localSmoothingSigmas[currentTransformIndex],
        this->m_CurrentGenericTransform);
       // NOW, after running the above function, the m_CurrentGenericTransform contains the integration of initial transform and ScaleSkew registration results that is an "Affine" transform.
       /////////////////////
@@ -1183,6 +1345,8 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::Update(void)
       this->FitCommonCode<TransformType, OptimizerType, MetricType>
       (localNumberOfIterations[currentTransformIndex],
        localMinimumStepLength[currentTransformIndex],
+       localShrinkFactors[currentTransformIndex],
+       localSmoothingSigmas[currentTransformIndex],
        this->m_CurrentGenericTransform);
       // NOW, after running the above function, the m_CurrentGenericTransform contains the integration of initial transform and Affine registration results.
       /////////////////////
@@ -1565,16 +1729,21 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::Update(void)
           }
         }
 
-      // we have a 1 level BSpline registration.
-      constexpr unsigned int numberOfLevels = 1;
+      // The BSpline grid is not refined between levels; only the images are
+      // shrunk and smoothed by the schedule of this stage.
+      const std::vector<unsigned int> & bsplineShrinkFactors = localShrinkFactors[currentTransformIndex];
+      const std::vector<double> &       bsplineSmoothingSigmas = localSmoothingSigmas[currentTransformIndex];
+      const unsigned int                numberOfLevels = bsplineShrinkFactors.size();
 
       typename BSplineRegistrationType::ShrinkFactorsArrayType shrinkFactorsPerLevel;
-      shrinkFactorsPerLevel.SetSize( 1 );
-      shrinkFactorsPerLevel[0] = 1;
-
+      shrinkFactorsPerLevel.SetSize( numberOfLevels );
       typename BSplineRegistrationType::SmoothingSigmasArrayType smoothingSigmasPerLevel;
-      smoothingSigmasPerLevel.SetSize( 1 );
-      smoothingSigmasPerLevel[0] = 0;
+      smoothingSigmasPerLevel.SetSize( numberOfLevels );
+      for( unsigned int level = 0; level < numberOfLevels; ++level )
+        {
+        shrinkFactorsPerLevel[level] = bsplineShrinkFactors[level];
+        smoothingSigmasPerLevel[level] = bsplineSmoothingSigmas[level];
+        }
 
       bsplineRegistration->SetNumberOfLevels( numberOfLevels );
       bsplineRegistration->SetSmoothingSigmasPerLevel( smoothingSigmasPerLevel );
@@ -1822,6 +1991,26 @@ BRAINSFitHelperTemplate<FixedImageType, MovingImageType>::PrintSelf(std::ostream
     os << this->m_SplineGridSize[q] << " ";
     }
   os << "]" << std::endl;
+  os << indent << "ShrinkFactors:     [";
+  for( unsigned int q = 0; q < this->m_ShrinkFactors.size(); ++q )
+    {
+    for( unsigned int level = 0; level < this->m_ShrinkFactors[q].size(); ++level )
+      {
+      os << ( level == 0 ? "" : "x" ) << this->m_ShrinkFactors[q][level];
+      }
+    os << " ";
+    }
+  os << "]" << std::endl;
+  os << indent << "SmoothingSigmas:     [";
+  for( unsigned int q = 0; q < this->m_SmoothingSigmas.size(); ++q )
+    {
+    for( unsigned int level = 0; level < this->m_SmoothingSigmas[q].size(); ++level )
+      {
+      os << ( level == 0 ? "" : "x" ) << this->m_SmoothingSigmas[q][level];
+      }
+    os << " ";
+    }
+  os << "]" << std::endl;
 
   if( m_CurrentGenericTransform.IsNotNull() )
     {
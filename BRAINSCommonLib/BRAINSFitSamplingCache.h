@@ -0,0 +1,296 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSFitSamplingCache_h
+#define __BRAINSFitSamplingCache_h
+
+#include "BRAINSImageContentKey.h"
+#include "itkImage.h"
+#include "itkPointSet.h"
+#include "itkSpatialObject.h"
+#include "itkImageMaskSpatialObject.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <vector>
+
+/** \class BRAINSFitSamplingCache
+ *
+ * Builds the sampled fixed point set used by the registration metrics, and
+ * keeps the most recent ones for the life of the process.  BRAINSABC and
+ * the other BRAINSFitHelper clients register many moving images against the
+ * same fixed image and mask, and every call used to redraw the samples and
+ * re-test every candidate against the mask spatial object.
+ *
+ * The samples are stratified: the in-mask voxels are visited in scan order
+ * and split into consecutive strata of equal size, one jittered sample is
+ * drawn from each.  The point set keeps coordinates and fixed intensities in
+ * its (contiguous) points and point data containers.
+ *
+ * The geometry and a hash of the pixels of the fixed image, the mask and
+ * the sampling percentage identify an entry.  An ImageMaskSpatialObject is
+ * identified the same way by its image, and by its object to world
+ * transform; other masks by the object and its modified time.  The hashes
+ * are computed on every call, so a write through the buffer of the fixed
+ * image or of the mask image builds a new entry.  Images with the same
+ * content, as the per job grafts of the BRAINSFit batch mode, share their
+ * entry.
+ */
+template <typename TFixedImage>
+class BRAINSFitSamplingCache
+{
+public:
+  using FixedImageType = TFixedImage;
+  using PixelType = typename FixedImageType::PixelType;
+  static constexpr unsigned int ImageDimension = FixedImageType::ImageDimension;
+
+  using MaskType = itk::SpatialObject<ImageDimension>;
+  using PointSetType = itk::PointSet<PixelType, ImageDimension>;
+  using PointSetConstPointer = typename PointSetType::ConstPointer;
+
+  /** Number of point sets kept, the least recently used is dropped first */
+  static constexpr unsigned int MaximumNumberOfEntries = 4;
+
+  /** Return the stratified sample of fixedImage inside mask (the whole image
+   * when mask is null).  The number of samples is samplingPercentage of the
+   * number of fixed image voxels, as with the ImageRegistrationMethodv4
+   * sampling strategies. */
+  static PointSetConstPointer GetSampledPointSet(const FixedImageType *fixedImage,
+                                                 const MaskType *mask,
+                                                 const double samplingPercentage)
+  {
+    const KeyType               key = MakeKey(fixedImage, mask, samplingPercentage);
+    std::lock_guard<std::mutex> lock( GetMutex() );
+    EntryListType &             entries = GetEntries();
+    for( auto it = entries.begin(); it != entries.end(); ++it )
+      {
+      if( it->Key == key )
+        {
+        entries.splice( entries.begin(), entries, it );
+        return entries.front().PointSet;
+        }
+      }
+
+    EntryType entry;
+    entry.Key = key;
+    entry.PointSet = BuildSampledPointSet(fixedImage, mask, samplingPercentage);
+    entries.push_front(entry);
+    if( entries.size() > MaximumNumberOfEntries )
+      {
+      entries.pop_back();
+      }
+    return entries.front().PointSet;
+  }
+
+  /** Drop every cached point set */
+  static void Clear()
+  {
+    std::lock_guard<std::mutex> lock( GetMutex() );
+    GetEntries().clear();
+  }
+
+private:
+  using MaskImageType = itk::Image<unsigned char, ImageDimension>;
+  using ImageMaskSpatialObjectType = itk::ImageMaskSpatialObject<ImageDimension>;
+  using ObjectToWorldMatrixType = itk::Matrix<double, ImageDimension, ImageDimension>;
+  using ObjectToWorldOffsetType = itk::Vector<double, ImageDimension>;
+
+  /** What identifies a point set.  An image mask is known by the content of
+   * its image, any other mask (held by the key, so that its address is not
+   * reused) by its modified time. */
+  struct KeyType
+    {
+    BRAINSUtils::ImageContentKey<FixedImageType> FixedImage;
+    bool                                         HasMaskImage;
+    BRAINSUtils::ImageContentKey<MaskImageType>  MaskImage;
+    ObjectToWorldMatrixType                      MaskObjectToWorldMatrix;
+    ObjectToWorldOffsetType                      MaskObjectToWorldOffset;
+    typename MaskType::ConstPointer              Mask;
+    itk::ModifiedTimeType                        MaskMTime;
+    double                                       SamplingPercentage;
+
+    bool operator==(const KeyType & other) const
+    {
+      if( SamplingPercentage != other.SamplingPercentage || HasMaskImage != other.HasMaskImage
+          || FixedImage != other.FixedImage )
+        {
+        return false;
+        }
+      if( HasMaskImage )
+        {
+        return MaskImage == other.MaskImage && MaskObjectToWorldMatrix == other.MaskObjectToWorldMatrix
+               && MaskObjectToWorldOffset == other.MaskObjectToWorldOffset;
+        }
+      return Mask.GetPointer() == other.Mask.GetPointer() && MaskMTime == other.MaskMTime;
+    }
+    };
+
+  struct EntryType
+    {
+    KeyType              Key;
+    PointSetConstPointer PointSet;
+    };
+  using EntryListType = std::list<EntryType>;
+
+  static KeyType MakeKey(const FixedImageType *fixedImage, const MaskType *mask, const double samplingPercentage)
+  {
+    KeyType key;
+    key.FixedImage = BRAINSUtils::GetImageContentKey(fixedImage);
+    const ImageMaskSpatialObjectType *imageMask = dynamic_cast<const ImageMaskSpatialObjectType *>( mask );
+    key.HasMaskImage = imageMask != nullptr && imageMask->GetImage() != nullptr;
+    if( key.HasMaskImage )
+      {
+      key.MaskImage = BRAINSUtils::GetImageContentKey( imageMask->GetImage() );
+      key.MaskObjectToWorldMatrix = imageMask->GetObjectToWorldTransform()->GetMatrix();
+      key.MaskObjectToWorldOffset = imageMask->GetObjectToWorldTransform()->GetOffset();
+      key.MaskMTime = 0;
+      }
+    else
+      {
+      key.Mask = mask;
+      key.MaskMTime = mask ? mask->GetMTime() : 0;
+      }
+    key.SamplingPercentage = samplingPercentage;
+    return key;
+  }
+
+  static std::mutex & GetMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static EntryListType & GetEntries()
+  {
+    static EntryListType entries;
+    return entries;
+  }
+
+  /** Return the mask image when it can be indexed with the fixed image
+   * indices, so the mask is tested without going through world space. */
+  static const MaskImageType *
+  GetAlignedMaskImage(const FixedImageType *fixedImage, const MaskType *mask)
+  {
+    const ImageMaskSpatialObjectType *imageMask = dynamic_cast<const ImageMaskSpatialObjectType *>( mask );
+    if( imageMask == nullptr )
+      {
+      return nullptr;
+      }
+    const auto *maskImage = imageMask->GetImage();
+    const auto *objectToWorld = imageMask->GetObjectToWorldTransform();
+    if( maskImage->GetBufferedRegion() != fixedImage->GetBufferedRegion()
+        || !maskImage->GetSpacing().GetVnlVector().is_equal( fixedImage->GetSpacing().GetVnlVector(), 1e-6 )
+        || !maskImage->GetOrigin().GetVnlVector().is_equal( fixedImage->GetOrigin().GetVnlVector(), 1e-6 )
+        || !maskImage->GetDirection().GetVnlMatrix().is_equal( fixedImage->GetDirection().GetVnlMatrix(), 1e-6 )
+        || !objectToWorld->GetMatrix().GetVnlMatrix().is_identity(1e-6)
+        || objectToWorld->GetOffset().GetNorm() > 1e-6 )
+      {
+      return nullptr;
+      }
+    return maskImage;
+  }
+
+  static PointSetConstPointer BuildSampledPointSet(const FixedImageType *fixedImage,
+                                                   const MaskType *mask,
+                                                   const double samplingPercentage)
+  {
+    using IteratorType = itk::ImageRegionConstIteratorWithIndex<FixedImageType>;
+    using RandomizerType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
+
+    const typename FixedImageType::RegionType region = fixedImage->GetBufferedRegion();
+    const MaskImageType *                     maskImage = GetAlignedMaskImage(fixedImage, mask);
+
+    // Pass 1: find the in-mask voxels once.
+    std::vector<bool> insideMask( region.GetNumberOfPixels(), true );
+    size_t            numberOfInsideVoxels = insideMask.size();
+    if( mask != nullptr )
+      {
+      numberOfInsideVoxels = 0;
+      size_t offset = 0;
+      for( IteratorType it(fixedImage, region); !it.IsAtEnd(); ++it, ++offset )
+        {
+        bool inside;
+        if( maskImage != nullptr )
+          {
+          inside = maskImage->GetPixel( it.GetIndex() ) != 0;
+          }
+        else
+          {
+          typename FixedImageType::PointType                  point;
+          fixedImage->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+          inside = mask->IsInsideInWorldSpace(point);
+          }
+        insideMask[offset] = inside;
+        numberOfInsideVoxels += inside ? 1 : 0;
+        }
+      }
+
+    const size_t requestedSamples =
+      static_cast<size_t>( std::ceil( region.GetNumberOfPixels() * samplingPercentage ) );
+    const size_t numberOfSamples = std::min( requestedSamples, numberOfInsideVoxels );
+    if( numberOfSamples == 0 )
+      {
+      itkGenericExceptionMacro(<< "No fixed image samples inside the mask");
+      }
+
+    // Pass 2: one jittered sample from each stratum of in-mask voxels.
+    typename RandomizerType::Pointer randomizer = RandomizerType::New();
+    randomizer->Initialize( 121212 );
+    const double stratumSize = static_cast<double>( numberOfInsideVoxels ) / numberOfSamples;
+    const typename FixedImageType::SpacingType oneThirdSpacing = fixedImage->GetSpacing() / 3.0;
+
+    typename PointSetType::Pointer pointSet = PointSetType::New();
+    pointSet->GetPoints()->Reserve( numberOfSamples );
+    pointSet->GetPointData()->Reserve( numberOfSamples );
+
+    size_t stratum = 0;
+    size_t nextSample = static_cast<size_t>( randomizer->GetVariateWithOpenUpperRange() * stratumSize );
+    size_t insideCount = 0;
+    size_t offset = 0;
+    for( IteratorType it(fixedImage, region); !it.IsAtEnd() && stratum < numberOfSamples; ++it, ++offset )
+      {
+      if( !insideMask[offset] )
+        {
+        continue;
+        }
+      if( insideCount++ != nextSample )
+        {
+        continue;
+        }
+      typename PointSetType::PointType                    point;
+      fixedImage->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+      for( unsigned int d = 0; d < ImageDimension; ++d )
+        {
+        point[d] += randomizer->GetNormalVariate() * oneThirdSpacing[d];
+        }
+      pointSet->GetPoints()->SetElement(stratum, point);
+      pointSet->GetPointData()->SetElement(stratum, it.Get() );
+
+      ++stratum;
+      nextSample = static_cast<size_t>( ( stratum + randomizer->GetVariateWithOpenUpperRange() ) * stratumSize );
+      }
+    PointSetConstPointer result = pointSet.GetPointer();
+    return result;
+  }
+};
+
+#endif // __BRAINSFitSamplingCache_h
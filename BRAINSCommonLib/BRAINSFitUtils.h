@@ -31,6 +31,8 @@
 
 #include <vcl_compiler.h>
 #include <iostream>
+#include <string>
+#include <vector>
 #include "algorithm"
 
 /**
@@ -50,6 +52,30 @@ extern
 itk::ImageMaskSpatialObject<3>::ConstPointer
 ConvertMaskImageToSpatialMask(itk::Image<unsigned char,3>::ConstPointer inputImage );
 
+/**
+ * Parse one resolution schedule per registration stage, with the levels of
+ * a stage separated by 'x', coarsest first (e.g. 4x2x1).  Throws on empty
+ * schedules and on values that are not non negative numbers.
+ */
+extern
+std::vector<std::vector<double> >
+ParseLevelSchedules(const std::vector<std::string> & stageSchedules, const std::string & optionName);
+
+/**
+ * Build the per stage shrink factor and smoothing sigma schedules of the
+ * transformTypes stages from the --shrinkFactors and --smoothingSigmas
+ * strings.  A single schedule is used for every stage.  Throws unless both
+ * options have one schedule or one per stage, every stage has as many shrink
+ * factors as smoothing sigmas, and the shrink factors are integers >= 1.
+ */
+extern
+void
+BuildLevelSchedules(const std::vector<std::string> & transformTypes,
+                    const std::vector<std::string> & shrinkFactors,
+                    const std::vector<std::string> & smoothingSigmas,
+                    std::vector<std::vector<unsigned int> > & shrinkFactorsSchedule,
+                    std::vector<std::vector<double> > & smoothingSigmasSchedule);
+
 template <typename TransformType, unsigned int VImageDimension>
 void DoCenteredTransformMaskClipping(
   ImageMaskPointer & fixedMask,
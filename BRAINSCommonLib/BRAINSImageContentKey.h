@@ -0,0 +1,127 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSImageContentKey_h
+#define __BRAINSImageContentKey_h
+
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Identity of the content of an image, for the per-process result caches.
+ *
+ * The key holds the geometry of the image and a hash of its pixel bytes.
+ * The hash is computed on every lookup, in one threaded pass over the
+ * buffer, so a write through the buffer pointer, which does not change any
+ * modified time, gives a different key.  The image must be fully buffered.
+ */
+namespace BRAINSUtils
+{
+/** Bytes hashed by one task of HashPixels */
+constexpr size_t PixelHashBlockBytes = 32768;
+
+/** 64 bit FNV-1a of the pixel bytes, 8 bytes at a time and folded after
+ * each step, hashed by blocks in parallel and then over the blocks. */
+template <typename TImage>
+uint64_t
+HashPixels(const TImage *image)
+{
+  constexpr uint64_t   offsetBasis = 14695981039346656037ULL;
+  constexpr uint64_t   prime = 1099511628211ULL;
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>( image->GetBufferPointer() );
+  const size_t         numberOfBytes =
+    image->GetPixelContainer()->Size() * sizeof( typename TImage::PixelContainer::Element );
+  const size_t          numberOfBlocks = ( numberOfBytes + PixelHashBlockBytes - 1 ) / PixelHashBlockBytes;
+  std::vector<uint64_t> blockHashes( numberOfBlocks );
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfBlocks,
+                        [&](itk::SizeValueType block)
+                          {
+                            const size_t end = std::min( numberOfBytes, ( block + 1 ) * PixelHashBlockBytes );
+                            size_t       b = block * PixelHashBlockBytes;
+                            uint64_t     hash = offsetBasis;
+                            for( ; b + 8 <= end; b += 8 )
+                              {
+                              uint64_t word;
+                              std::memcpy( &word, bytes + b, 8 );
+                              hash = ( hash ^ word ) * prime;
+                              hash ^= hash >> 32;
+                              }
+                            for( ; b < end; ++b )
+                              {
+                              hash = ( hash ^ bytes[b] ) * prime;
+                              }
+                            blockHashes[block] = hash;
+                          },
+                        nullptr );
+
+  uint64_t hash = offsetBasis ^ numberOfBytes;
+  for( const uint64_t blockHash : blockHashes )
+    {
+    hash = ( hash ^ blockHash ) * prime;
+    hash ^= hash >> 32;
+    }
+  return hash;
+}
+
+template <typename TImage>
+struct ImageContentKey
+  {
+  typename TImage::RegionType    Region;
+  typename TImage::SpacingType   Spacing;
+  typename TImage::PointType     Origin;
+  typename TImage::DirectionType Direction;
+  uint64_t                       PixelHash;
+
+  bool operator==(const ImageContentKey & other) const
+  {
+    return PixelHash == other.PixelHash && Region == other.Region && Spacing == other.Spacing
+           && Origin == other.Origin && Direction == other.Direction;
+  }
+
+  bool operator!=(const ImageContentKey & other) const
+  {
+    return !( *this == other );
+  }
+  };
+
+/** Key of the geometry and pixels of a fully buffered image */
+template <typename TImage>
+ImageContentKey<TImage>
+GetImageContentKey(const TImage *image)
+{
+  if( image->GetBufferedRegion() != image->GetLargestPossibleRegion() )
+    {
+    itkGenericExceptionMacro(<< "Only fully buffered images can be identified by their content");
+    }
+  ImageContentKey<TImage> key;
+  key.Region = image->GetBufferedRegion();
+  key.Spacing = image->GetSpacing();
+  key.Origin = image->GetOrigin();
+  key.Direction = image->GetDirection();
+  key.PixelHash = HashPixels( image );
+  return key;
+}
+} // end namespace BRAINSUtils
+
+#endif // __BRAINSImageContentKey_h
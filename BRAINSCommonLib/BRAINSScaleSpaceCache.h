@@ -0,0 +1,480 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __BRAINSScaleSpaceCache_h
+#define __BRAINSScaleSpaceCache_h
+
+#include "BRAINSImageContentKey.h"
+#include "itkImage.h"
+#include "itkCovariantVector.h"
+#include "itkCastImageFilter.h"
+#include "itkGaussianOperator.h"
+#include "itkRecursiveGaussianImageFilter.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <vector>
+
+/** \class BRAINSScaleSpaceCache
+ *
+ * Gaussian smoothed images and Gaussian derivative gradients of an image,
+ * kept for the life of the process so that the tools (and the stages of one
+ * tool) that need the same scale of the same image compute it once.
+ *
+ * Sigma is in physical units.  The image is filtered one axis at a time,
+ * and each axis is filtered with the cheapest method for its sigma in
+ * voxels: up to MaximumFIRSigma the discrete Gaussian kernel of
+ * DiscreteGaussianImageFilter (maximum error 0.01, at most 32 taps) is
+ * applied by rows, wider axes use RecursiveGaussianImageFilter, whose cost
+ * does not depend on sigma.  The FIR pass accumulates whole rows of the image,
+ * along x as well as across rows for the other axes, in loops the compiler
+ * vectorizes.  Borders are zero flux (the nearest voxel is repeated).
+ *
+ * The first derivative along an axis is the central difference of the
+ * smoothed image, so a sigma of 0 gives the gradient of
+ * GradientMagnitudeImageFilter.  Gradients are along the image axes, in
+ * intensity per physical unit, with no direction cosines applied.
+ *
+ * The geometry of the image, a hash of its pixel values, sigma and the kind
+ * of result identify an entry.  The hash is computed on every call, in one
+ * pass over the pixels that costs much less than the filtering, so an entry
+ * is never stale: a write through the buffer of the image, which does not
+ * change any modified time, gives a new hash.  Entries keep the results but
+ * not the images they were computed from.  At most MaximumCachedBytes of
+ * results are kept, the least recently used are dropped first, and a
+ * larger result is returned without being cached.  The image must be fully
+ * buffered.  Cached results are shared, so they must not be the input of a
+ * filter that runs in place.
+ *
+ * The Compute methods filter the same way without the cache, for results
+ * that are only used once.
+ */
+template <typename TInputImage>
+class BRAINSScaleSpaceCache
+{
+public:
+  using InputImageType = TInputImage;
+  static constexpr unsigned int ImageDimension = InputImageType::ImageDimension;
+
+  using RealImageType = itk::Image<float, ImageDimension>;
+  using RealImageConstPointer = typename RealImageType::ConstPointer;
+  using GradientPixelType = itk::CovariantVector<float, ImageDimension>;
+  using GradientImageType = itk::Image<GradientPixelType, ImageDimension>;
+  using GradientImageConstPointer = typename GradientImageType::ConstPointer;
+
+  /** Bytes of results kept, the least recently used are dropped first */
+  static constexpr size_t MaximumCachedBytes = size_t( 512 ) << 20;
+
+  /** Widest sigma, in voxels, filtered with a FIR kernel */
+  static constexpr double MaximumFIRSigma = 2.0;
+
+  /** image smoothed with a Gaussian of standard deviation sigma */
+  static RealImageConstPointer GetSmoothedImage(const InputImageType *image, const double sigma)
+  {
+    const KeyType               key = MakeKey(image, sigma, SmoothedImage);
+    std::lock_guard<std::mutex> lock( GetMutex() );
+    const EntryType *           entry = FindEntry(key);
+    if( entry != nullptr )
+      {
+      return entry->Smoothed;
+      }
+    const RealImageConstPointer smoothed = ComputeSmoothedImage(image, sigma);
+    AddEntry(key, smoothed, nullptr);
+    return smoothed;
+  }
+
+  /** Gradient of image smoothed with a Gaussian of standard deviation sigma */
+  static GradientImageConstPointer GetGradientImage(const InputImageType *image, const double sigma)
+  {
+    const KeyType               key = MakeKey(image, sigma, Gradient);
+    std::lock_guard<std::mutex> lock( GetMutex() );
+    const EntryType *           entry = FindEntry(key);
+    if( entry != nullptr )
+      {
+      return entry->GradientImage;
+      }
+    const GradientImageConstPointer gradient = ComputeGradientImage(image, sigma);
+    AddEntry(key, nullptr, gradient);
+    return gradient;
+  }
+
+  /** Magnitude of GetGradientImage, computed from the cached gradient */
+  static RealImageConstPointer GetGradientMagnitudeImage(const InputImageType *image, const double sigma)
+  {
+    return ComputeMagnitude( GetGradientImage(image, sigma) );
+  }
+
+  /** GetSmoothedImage without the cache */
+  static RealImageConstPointer ComputeSmoothedImage(const InputImageType *image, const double sigma)
+  {
+    CheckFullyBuffered(image);
+    return ComputeScaleSpace( CastToReal(image), sigma, ImageDimension );
+  }
+
+  /** GetGradientImage without the cache */
+  static GradientImageConstPointer ComputeGradientImage(const InputImageType *image, const double sigma)
+  {
+    CheckFullyBuffered(image);
+    return ComputeGradient(image, sigma);
+  }
+
+  /** GetGradientMagnitudeImage without the cache */
+  static RealImageConstPointer ComputeGradientMagnitudeImage(const InputImageType *image, const double sigma)
+  {
+    return ComputeMagnitude( ComputeGradientImage(image, sigma) );
+  }
+
+  /** Drop every cached result */
+  static void Clear()
+  {
+    std::lock_guard<std::mutex> lock( GetMutex() );
+    GetEntries().clear();
+    GetCachedBytes() = 0;
+  }
+
+private:
+  enum ResultType { SmoothedImage = 0, Gradient = 1 };
+
+  /** What identifies a result, the image is only known by its geometry and
+   * a hash of its pixels */
+  struct KeyType
+    {
+    BRAINSUtils::ImageContentKey<InputImageType> Image;
+    double                                       Sigma;
+    ResultType                                   Result;
+
+    bool operator==(const KeyType & other) const
+    {
+      return Sigma == other.Sigma && Result == other.Result && Image == other.Image;
+    }
+    };
+
+  struct EntryType
+    {
+    KeyType                   Key;
+    RealImageConstPointer     Smoothed;
+    GradientImageConstPointer GradientImage;
+    size_t                    Bytes;
+    };
+  using EntryListType = std::list<EntryType>;
+
+  /** Pixels per task of the pixel wise passes */
+  static constexpr size_t BlockSize = 4096;
+
+  static std::mutex & GetMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static EntryListType & GetEntries()
+  {
+    static EntryListType entries;
+    return entries;
+  }
+
+  /** Bytes of the results in GetEntries() */
+  static size_t & GetCachedBytes()
+  {
+    static size_t cachedBytes = 0;
+    return cachedBytes;
+  }
+
+  static void CheckFullyBuffered(const InputImageType *image)
+  {
+    if( image->GetBufferedRegion() != image->GetLargestPossibleRegion() )
+      {
+      itkGenericExceptionMacro(<< "Scale space images can only be computed from a fully buffered image");
+      }
+  }
+
+  static KeyType MakeKey(const InputImageType *image, const double sigma, const ResultType result)
+  {
+    CheckFullyBuffered(image);
+    KeyType key;
+    key.Image = BRAINSUtils::GetImageContentKey(image);
+    key.Sigma = sigma;
+    key.Result = result;
+    return key;
+  }
+
+  /** The entry of key moved to the front, or null */
+  static const EntryType * FindEntry(const KeyType & key)
+  {
+    EntryListType & entries = GetEntries();
+    for( auto it = entries.begin(); it != entries.end(); ++it )
+      {
+      if( it->Key == key )
+        {
+        entries.splice( entries.begin(), entries, it );
+        return &entries.front();
+        }
+      }
+    return nullptr;
+  }
+
+  /** Cache the result of key (one of smoothed and gradient), dropping the
+   * least recently used entries to stay within MaximumCachedBytes */
+  static void AddEntry(const KeyType & key, const RealImageConstPointer & smoothed,
+                       const GradientImageConstPointer & gradient)
+  {
+    EntryType entry;
+    entry.Key = key;
+    entry.Smoothed = smoothed;
+    entry.GradientImage = gradient;
+    entry.Bytes = key.Image.Region.GetNumberOfPixels()
+      * ( gradient.IsNotNull() ? sizeof( GradientPixelType ) : sizeof( typename RealImageType::PixelType ) );
+    if( entry.Bytes > MaximumCachedBytes )
+      {
+      return;
+      }
+
+    EntryListType & entries = GetEntries();
+    size_t &        cachedBytes = GetCachedBytes();
+    while( !entries.empty() && cachedBytes + entry.Bytes > MaximumCachedBytes )
+      {
+      cachedBytes -= entries.back().Bytes;
+      entries.pop_back();
+      }
+    entries.push_front(entry);
+    cachedBytes += entry.Bytes;
+  }
+
+  /** Pixel wise norm of gradient */
+  static RealImageConstPointer ComputeMagnitude(const GradientImageConstPointer & gradient)
+  {
+    typename RealImageType::Pointer magnitude = RealImageType::New();
+    magnitude->CopyInformation( gradient );
+    magnitude->SetRegions( gradient->GetBufferedRegion() );
+    magnitude->Allocate();
+
+    const GradientPixelType *source = gradient->GetBufferPointer();
+    float *                  destination = magnitude->GetBufferPointer();
+    const size_t             numberOfPixels = gradient->GetBufferedRegion().GetNumberOfPixels();
+    const size_t             numberOfBlocks = ( numberOfPixels + BlockSize - 1 ) / BlockSize;
+
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray( 0, numberOfBlocks,
+                          [&](itk::SizeValueType block)
+                            {
+                              const size_t end = std::min( numberOfPixels, ( block + 1 ) * BlockSize );
+                              for( size_t p = block * BlockSize; p < end; ++p )
+                                {
+                                destination[p] = source[p].GetNorm();
+                                }
+                            },
+                          nullptr );
+    RealImageConstPointer result = magnitude.GetPointer();
+    return result;
+  }
+
+  static RealImageConstPointer CastToReal(const InputImageType *image)
+  {
+    using CastFilterType = itk::CastImageFilter<InputImageType, RealImageType>;
+    typename CastFilterType::Pointer caster = CastFilterType::New();
+    caster->SetInput( image );
+    caster->InPlaceOff();
+    caster->Update();
+    RealImageConstPointer result = caster->GetOutput();
+    return result;
+  }
+
+  /** The discrete Gaussian of sigmaVoxels (a single 1 for 0), or its central
+   * difference in intensity per physical unit when order is 1.
+   * Output voxel x is the sum of kernel[k] * input voxel (x + k - radius). */
+  static std::vector<float> GetFIRKernel(const double sigmaVoxels, const unsigned int order, const double spacing)
+  {
+    std::vector<double> gaussian( 1, 1.0 );
+    if( sigmaVoxels > 0.0 )
+      {
+      itk::GaussianOperator<double, 1> gaussianOperator;
+      gaussianOperator.SetVariance( sigmaVoxels * sigmaVoxels );
+      gaussianOperator.SetMaximumError( 0.01 );
+      gaussianOperator.SetMaximumKernelWidth( 32 );
+      gaussianOperator.CreateDirectional();
+      gaussian.assign( gaussianOperator.Begin(), gaussianOperator.End() );
+      }
+    if( order == 0 )
+      {
+      return std::vector<float>( gaussian.begin(), gaussian.end() );
+      }
+
+    std::vector<float> derivative( gaussian.size() + 2, 0.0F );
+    for( size_t k = 0; k < derivative.size(); ++k )
+      {
+      const double previous = ( k >= 2 ) ? gaussian[k - 2] : 0.0;
+      const double next = ( k < gaussian.size() ) ? gaussian[k] : 0.0;
+      derivative[k] = static_cast<float>( ( previous - next ) / ( 2.0 * spacing ) );
+      }
+    return derivative;
+  }
+
+  /** input filtered along axis with the Gaussian of sigma, or its first derivative */
+  static RealImageConstPointer FilterAlongAxis(const RealImageType *input, const unsigned int axis, const double sigma,
+                                               const unsigned int order)
+  {
+    const double spacing = input->GetSpacing()[axis];
+    const double sigmaVoxels = sigma / spacing;
+    if( sigmaVoxels > MaximumFIRSigma )
+      {
+      using RecursiveFilterType = itk::RecursiveGaussianImageFilter<RealImageType, RealImageType>;
+      typename RecursiveFilterType::Pointer recursiveFilter = RecursiveFilterType::New();
+      recursiveFilter->SetInput( input );
+      recursiveFilter->SetDirection( axis );
+      recursiveFilter->SetSigma( sigma );
+      recursiveFilter->SetNormalizeAcrossScale( false );
+      recursiveFilter->SetOrder( order == 0 ? RecursiveFilterType::ZeroOrder : RecursiveFilterType::FirstOrder );
+      recursiveFilter->Update();
+      RealImageConstPointer result = recursiveFilter->GetOutput();
+      return result;
+      }
+    if( sigmaVoxels <= 0.0 && order == 0 )
+      {
+      RealImageConstPointer result = input;
+      return result;
+      }
+
+    const std::vector<float>  kernel = GetFIRKernel(sigmaVoxels, order, spacing);
+    const itk::OffsetValueType radius = static_cast<itk::OffsetValueType>( kernel.size() / 2 );
+
+    typename RealImageType::Pointer output = RealImageType::New();
+    output->CopyInformation( input );
+    output->SetRegions( input->GetBufferedRegion() );
+    output->Allocate();
+
+    const typename RealImageType::SizeType size = input->GetBufferedRegion().GetSize();
+    const itk::OffsetValueType             rowLength = size[0];
+    const size_t                           numberOfRows = input->GetBufferedRegion().GetNumberOfPixels() / rowLength;
+    // Rows between two neighbours along axis, and the extent of axis
+    size_t rowStride = 1;
+    for( unsigned int d = 1; d < axis; ++d )
+      {
+      rowStride *= size[d];
+      }
+    const itk::OffsetValueType axisLength = size[axis];
+    const float *              inputBuffer = input->GetBufferPointer();
+    float *                    outputBuffer = output->GetBufferPointer();
+
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray( 0, numberOfRows,
+                          [&](itk::SizeValueType row)
+                            {
+                              const float *in = inputBuffer + row * rowLength;
+                              float *      out = outputBuffer + row * rowLength;
+                              std::fill( out, out + rowLength, 0.0F );
+                              if( axis == 0 )
+                                {
+                                // Interior voxels read no clamped neighbour.
+                                const itk::OffsetValueType interiorStart = std::min( radius, rowLength );
+                                const itk::OffsetValueType interiorEnd =
+                                  std::max( interiorStart, rowLength - radius );
+                                for( itk::OffsetValueType k = -radius; k <= radius; ++k )
+                                  {
+                                  const float weight = kernel[k + radius];
+                                  for( itk::OffsetValueType x = interiorStart; x < interiorEnd; ++x )
+                                    {
+                                    out[x] += weight * in[x + k];
+                                    }
+                                  for( itk::OffsetValueType x = 0; x < interiorStart; ++x )
+                                    {
+                                    out[x] += weight * in[std::min( std::max( x + k, itk::OffsetValueType( 0 ) ),
+                                                                    rowLength - 1 )];
+                                    }
+                                  for( itk::OffsetValueType x = interiorEnd; x < rowLength; ++x )
+                                    {
+                                    out[x] += weight * in[std::min( x + k, rowLength - 1 )];
+                                    }
+                                  }
+                                }
+                              else
+                                {
+                                const itk::OffsetValueType position = ( row / rowStride ) % axisLength;
+                                for( itk::OffsetValueType k = -radius; k <= radius; ++k )
+                                  {
+                                  const float                weight = kernel[k + radius];
+                                  const itk::OffsetValueType neighbour =
+                                    std::min( std::max( position + k, itk::OffsetValueType( 0 ) ), axisLength - 1 );
+                                  const float *              source =
+                                    in + ( neighbour - position ) * static_cast<itk::OffsetValueType>( rowStride )
+                                    * rowLength;
+                                  for( itk::OffsetValueType x = 0; x < rowLength; ++x )
+                                    {
+                                    out[x] += weight * source[x];
+                                    }
+                                  }
+                                }
+                            },
+                          nullptr );
+    RealImageConstPointer result = output.GetPointer();
+    return result;
+  }
+
+  /** image smoothed along every axis, and differentiated along
+   * derivativeAxis (none when it is ImageDimension) */
+  static RealImageConstPointer ComputeScaleSpace(RealImageConstPointer image, const double sigma,
+                                                 const unsigned int derivativeAxis)
+  {
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      image = FilterAlongAxis( image, d, sigma, d == derivativeAxis ? 1 : 0 );
+      }
+    return image;
+  }
+
+  static GradientImageConstPointer ComputeGradient(const InputImageType *image, const double sigma)
+  {
+    const RealImageConstPointer        realImage = CastToReal(image);
+    std::vector<RealImageConstPointer> derivatives( ImageDimension );
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      derivatives[d] = ComputeScaleSpace( realImage, sigma, d );
+      }
+
+    typename GradientImageType::Pointer gradient = GradientImageType::New();
+    gradient->CopyInformation( realImage );
+    gradient->SetRegions( realImage->GetBufferedRegion() );
+    gradient->Allocate();
+
+    GradientPixelType *destination = gradient->GetBufferPointer();
+    const size_t       numberOfPixels = realImage->GetBufferedRegion().GetNumberOfPixels();
+    const size_t       numberOfBlocks = ( numberOfPixels + BlockSize - 1 ) / BlockSize;
+
+    itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray( 0, numberOfBlocks,
+                          [&](itk::SizeValueType block)
+                            {
+                              const size_t end = std::min( numberOfPixels, ( block + 1 ) * BlockSize );
+                              for( unsigned int d = 0; d < ImageDimension; ++d )
+                                {
+                                const float *source = derivatives[d]->GetBufferPointer();
+                                for( size_t p = block * BlockSize; p < end; ++p )
+                                  {
+                                  destination[p][d] = source[p];
+                                  }
+                                }
+                            },
+                          nullptr );
+    GradientImageConstPointer result = gradient.GetPointer();
+    return result;
+  }
+};
+
+#endif // __BRAINSScaleSpaceCache_h
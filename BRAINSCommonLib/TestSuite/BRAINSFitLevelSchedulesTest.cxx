@@ -0,0 +1,148 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Checks the parsing and validation of the BRAINSFit --shrinkFactors and
+// --smoothingSigmas schedules:
+//  - ParseLevelSchedules must split each stage schedule at 'x', coarsest
+//    level first, and reject empty schedules, empty levels, trailing text
+//    and negative values;
+//  - BuildLevelSchedules must use a single schedule for every stage, or one
+//    schedule per stage, and reject any other number of schedules, a stage
+//    with more or fewer shrink factors than smoothing sigmas, and shrink
+//    factors that are not integers of at least 1.
+// BRAINSFitTest_MismatchedLevelSchedules runs BRAINSFit itself with such a
+// schedule and expects it to fail.
+//
+
+#include "BRAINSFitUtils.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+using StringListType = std::vector<std::string>;
+using ShrinkFactorsScheduleType = std::vector<std::vector<unsigned int> >;
+using SmoothingSigmasScheduleType = std::vector<std::vector<double> >;
+
+bool
+ExpectParsed(const StringListType & schedules, const SmoothingSigmasScheduleType & expected)
+{
+  const SmoothingSigmasScheduleType parsed = ParseLevelSchedules(schedules, "shrinkFactors");
+  if( parsed != expected )
+    {
+    std::cerr << "ParseLevelSchedules did not split";
+    for( const auto & schedule : schedules )
+      {
+      std::cerr << " \"" << schedule << "\"";
+      }
+    std::cerr << " as expected" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+bool
+ExpectParseFailure(const std::string & schedule)
+{
+  try
+    {
+    ParseLevelSchedules(StringListType(1, schedule), "smoothingSigmas");
+    }
+  catch( itk::ExceptionObject & )
+    {
+    return true;
+    }
+  std::cerr << "ParseLevelSchedules accepted \"" << schedule << "\"" << std::endl;
+  return false;
+}
+
+bool
+ExpectBuildFailure(const std::string & caseName, const StringListType & transformTypes,
+                   const StringListType & shrinkFactors, const StringListType & smoothingSigmas)
+{
+  ShrinkFactorsScheduleType   shrinkFactorsSchedule;
+  SmoothingSigmasScheduleType smoothingSigmasSchedule;
+  try
+    {
+    BuildLevelSchedules(transformTypes, shrinkFactors, smoothingSigmas, shrinkFactorsSchedule,
+                        smoothingSigmasSchedule);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cout << caseName << " rejected: " << err.GetDescription() << std::endl;
+    return true;
+    }
+  std::cerr << caseName << " was accepted" << std::endl;
+  return false;
+}
+} // end namespace
+
+int main(int, char *[])
+{
+  bool allPassed = true;
+  try
+    {
+    allPassed &= ExpectParsed( { "4x2x1" }, { { 4.0, 2.0, 1.0 } } );
+    allPassed &= ExpectParsed( { "1" }, { { 1.0 } } );
+    allPassed &= ExpectParsed( { "2x1", " 1.5 x0 " }, { { 2.0, 1.0 }, { 1.5, 0.0 } } );
+    allPassed &= ExpectParsed( {}, {} );
+    for( const std::string schedule : { "", "4xx1", "4x2x", "4x2y", "4 2", "-1x0", "x1" } )
+      {
+      allPassed &= ExpectParseFailure(schedule);
+      }
+
+    const StringListType        transformTypes = { "Rigid", "Affine", "BSpline" };
+    ShrinkFactorsScheduleType   shrinkFactorsSchedule;
+    SmoothingSigmasScheduleType smoothingSigmasSchedule;
+    BuildLevelSchedules(transformTypes, { "4x2x1" }, { "2x1x0" }, shrinkFactorsSchedule, smoothingSigmasSchedule);
+    if( shrinkFactorsSchedule != ShrinkFactorsScheduleType(3, { 4, 2, 1 } )
+        || smoothingSigmasSchedule != SmoothingSigmasScheduleType(3, { 2.0, 1.0, 0.0 } ) )
+      {
+      std::cerr << "A single schedule is not used for every stage" << std::endl;
+      allPassed = false;
+      }
+    BuildLevelSchedules(transformTypes, { "4x2", "2x1", "1" }, { "1x0", "0.5x0", "0" }, shrinkFactorsSchedule,
+                        smoothingSigmasSchedule);
+    if( shrinkFactorsSchedule != ShrinkFactorsScheduleType{ { 4, 2 }, { 2, 1 }, { 1 } }
+        || smoothingSigmasSchedule != SmoothingSigmasScheduleType{ { 1.0, 0.0 }, { 0.5, 0.0 }, { 0.0 } } )
+      {
+      std::cerr << "The per stage schedules are not kept in stage order" << std::endl;
+      allPassed = false;
+      }
+
+    allPassed &= ExpectBuildFailure("Two schedules for three stages", transformTypes, { "4x2", "2x1" },
+                                    { "1x0" } );
+    allPassed &= ExpectBuildFailure("Two sigma schedules for three stages", transformTypes, { "4x2" },
+                                    { "1x0", "1x0" } );
+    allPassed &= ExpectBuildFailure("Three shrink factors and two sigmas", transformTypes, { "4x2x1" },
+                                    { "1x0" } );
+    allPassed &= ExpectBuildFailure("One stage of mismatched lengths", transformTypes, { "4x2", "2x1", "1" },
+                                    { "1x0", "0", "0" } );
+    allPassed &= ExpectBuildFailure("A fractional shrink factor", transformTypes, { "2.5x1" }, { "1x0" } );
+    allPassed &= ExpectBuildFailure("A zero shrink factor", transformTypes, { "0" }, { "0" } );
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,177 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Runs the DoRotationPreSearch of BRAINSFitHelperTemplate on a real image
+// pair with a Mattes metric, once with a single thread, where one worker
+// evaluates every grid point in order, and once with several workers.  The
+// two searches must pick the same angles:
+//  - without masks;
+//  - with fixed and moving ImageMaskSpatialObjects passed to the search;
+//  - with the same masks held only by the metric component, which the
+//    search must use for both images, so the angles must also be those of
+//    the previous case.
+//
+
+#include "BRAINSFitHelper.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include <iostream>
+#include <string>
+
+namespace
+{
+using ImageType = itk::Image<float, 3>;
+using MultiMetricType = itk::BRAINSFitHelperTemplate<ImageType, ImageType>::MultiMetricType;
+using MattesMetricType = itk::MattesMutualInformationImageToImageMetricv4<ImageType, ImageType, ImageType, double>;
+using MaskSpatialObjectType = itk::ImageMaskSpatialObject<3>;
+using EulerTransformType = itk::Euler3DTransform<double>;
+
+constexpr unsigned int ParallelNumberOfThreads = 8;
+
+/** An ellipsoid with semi-axes of 0.4 of the image extent at its center */
+ImageMaskPointer
+CreateEllipsoidMask(const ImageType *image)
+{
+  using MaskImageType = MaskSpatialObjectType::ImageType;
+  const ImageType::RegionType region = image->GetLargestPossibleRegion();
+  MaskImageType::Pointer      maskImage = MaskImageType::New();
+  maskImage->CopyInformation(image);
+  maskImage->SetRegions(region);
+  maskImage->Allocate();
+  for( itk::ImageRegionIteratorWithIndex<MaskImageType> it(maskImage, region); !it.IsAtEnd(); ++it )
+    {
+    double distance = 0.0;
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      const double extent = region.GetSize()[d];
+      const double x = ( it.GetIndex()[d] - region.GetIndex()[d] - 0.5 * extent ) / ( 0.4 * extent );
+      distance += x * x;
+      }
+    it.Set(distance <= 1.0 ? 1 : 0);
+    }
+  MaskSpatialObjectType::Pointer mask = MaskSpatialObjectType::New();
+  mask->SetImage(maskImage);
+  mask->Update();
+  ImageMaskPointer result = mask.GetPointer();
+  return result;
+}
+
+itk::Point<double, 3>
+ImageCenter(const ImageType *image)
+{
+  const ImageType::RegionType     region = image->GetLargestPossibleRegion();
+  itk::ContinuousIndex<double, 3> centerIndex;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    centerIndex[d] = region.GetIndex()[d] + 0.5 * ( region.GetSize()[d] - 1 );
+    }
+  itk::Point<double, 3> center;
+  image->TransformContinuousIndexToPhysicalPoint(centerIndex, center);
+  return center;
+}
+
+/** The angles found by the search with numberOfThreads threads */
+EulerTransformType::ParametersType
+Search(const ImageType *fixedImage, const ImageType *movingImage, const ImageMaskPointer & componentFixedMask,
+       const ImageMaskPointer & componentMovingMask, const ImageMaskPointer & fixedMask,
+       const ImageMaskPointer & movingMask, const unsigned int numberOfThreads)
+{
+  const unsigned int savedNumberOfThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads(numberOfThreads);
+
+  EulerTransformType::Pointer initialTransform = EulerTransformType::New();
+  const itk::Point<double, 3> fixedCenter = ImageCenter(fixedImage);
+  initialTransform->SetCenter(fixedCenter);
+  initialTransform->SetTranslation(ImageCenter(movingImage) - fixedCenter);
+
+  MattesMetricType::Pointer metric = MattesMetricType::New();
+  metric->SetNumberOfHistogramBins(50);
+  metric->SetFixedImage(fixedImage);
+  metric->SetMovingImage(movingImage);
+  metric->SetFixedImageMask(componentFixedMask);
+  metric->SetMovingImageMask(componentMovingMask);
+  MultiMetricType::Pointer multiMetric = MultiMetricType::New();
+  multiMetric->AddMetric(metric);
+  multiMetric->SetMovingTransform(initialTransform);
+  multiMetric->Initialize();
+
+  const EulerTransformType::Pointer searched =
+    itk::DoRotationPreSearch<ImageType, ImageType, MultiMetricType>(multiMetric.GetPointer(), fixedMask, movingMask,
+                                                                    initialTransform.GetPointer() );
+  itk::MultiThreaderBase::SetGlobalDefaultNumberOfThreads(savedNumberOfThreads);
+  return searched->GetParameters();
+}
+
+bool
+CompareSearches(const std::string & caseName, const ImageType *fixedImage, const ImageType *movingImage,
+                const ImageMaskPointer & componentFixedMask, const ImageMaskPointer & componentMovingMask,
+                const ImageMaskPointer & fixedMask, const ImageMaskPointer & movingMask,
+                EulerTransformType::ParametersType & angles)
+{
+  const EulerTransformType::ParametersType serial =
+    Search(fixedImage, movingImage, componentFixedMask, componentMovingMask, fixedMask, movingMask, 1);
+  const EulerTransformType::ParametersType parallel = Search(fixedImage, movingImage, componentFixedMask,
+                                                             componentMovingMask, fixedMask, movingMask,
+                                                             ParallelNumberOfThreads);
+  angles = serial;
+  const bool passed = serial == parallel;
+  std::cout << caseName << ": serial " << serial << ", parallel " << parallel << ( passed ? " passed" : " FAILED" )
+            << std::endl;
+  return passed;
+}
+} // end namespace
+
+int main(int argc, char *argv[])
+{
+  if( argc < 3 )
+    {
+    std::cerr << "Usage: " << argv[0] << " fixedImage movingImage" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  bool allPassed = true;
+  try
+    {
+    const ImageType::Pointer fixedImage = itkUtil::ReadImage<ImageType>(argv[1]);
+    const ImageType::Pointer movingImage = itkUtil::ReadImage<ImageType>(argv[2]);
+    const ImageMaskPointer   fixedMask = CreateEllipsoidMask(fixedImage);
+    const ImageMaskPointer   movingMask = CreateEllipsoidMask(movingImage);
+    const ImageMaskPointer   noMask;
+
+    EulerTransformType::ParametersType unmaskedAngles;
+    EulerTransformType::ParametersType passedMaskAngles;
+    EulerTransformType::ParametersType componentMaskAngles;
+    allPassed &= CompareSearches("No masks", fixedImage, movingImage, noMask, noMask, noMask, noMask, unmaskedAngles);
+    allPassed &= CompareSearches("Masks passed to the search", fixedImage, movingImage, noMask, noMask, fixedMask,
+                                 movingMask, passedMaskAngles);
+    allPassed &= CompareSearches("Masks of the metric", fixedImage, movingImage, fixedMask, movingMask, noMask,
+                                 noMask, componentMaskAngles);
+    if( componentMaskAngles != passedMaskAngles )
+      {
+      std::cerr << "The masks of the metric are not used like the masks passed to the search" << std::endl;
+      allPassed = false;
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,211 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Checks the stratified sample of BRAINSFitSamplingCache on an anisotropic
+// image with an ellipsoidal ImageMaskSpatialObject:
+//  - the number of samples is the sampling percentage of the image voxels;
+//  - the intensity of every voxel is its offset in the buffer, so the point
+//    data of a sample tells the voxel it was drawn from, which must be in
+//    the mask and within six jitter standard deviations of the sample;
+//  - sample k must be drawn from stratum k of the in-mask voxels in scan
+//    order;
+//  - the sample is the same when it is built again.
+// The cache must return the same point set for the same content, also
+// through a graft of the fixed image, and a new one for another sampling
+// percentage, or after the fixed or mask pixels are changed through their
+// buffer pointers.
+//
+
+#include "BRAINSFitSamplingCache.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+using FixedImageType = itk::Image<float, 3>;
+using MaskImageType = itk::Image<unsigned char, 3>;
+using MaskSpatialObjectType = itk::ImageMaskSpatialObject<3>;
+using SamplingCacheType = BRAINSFitSamplingCache<FixedImageType>;
+using PointSetType = SamplingCacheType::PointSetType;
+
+constexpr double SamplingPercentage = 0.05;
+
+} // end namespace
+
+int main(int, char *[])
+{
+  FixedImageType::SizeType size;
+  size[0] = 40;
+  size[1] = 36;
+  size[2] = 24;
+  FixedImageType::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 1.2;
+  spacing[2] = 2.0;
+
+  FixedImageType::Pointer fixedImage = FixedImageType::New();
+  fixedImage->SetRegions( size );
+  fixedImage->SetSpacing( spacing );
+  fixedImage->Allocate();
+  const size_t numberOfPixels = fixedImage->GetLargestPossibleRegion().GetNumberOfPixels();
+  for( size_t p = 0; p < numberOfPixels; ++p )
+    {
+    fixedImage->GetBufferPointer()[p] = static_cast<float>( p );
+    }
+
+  MaskImageType::Pointer maskImage = MaskImageType::New();
+  maskImage->CopyInformation( fixedImage );
+  maskImage->SetRegions( size );
+  maskImage->Allocate();
+  // Rank of each in-mask voxel in scan order
+  std::vector<size_t> insideRank( numberOfPixels, numberOfPixels );
+  size_t              numberOfInsideVoxels = 0;
+  for( itk::ImageRegionIteratorWithIndex<MaskImageType> it( maskImage, maskImage->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const MaskImageType::IndexType index = it.GetIndex();
+    const double                   x = ( index[0] - 19.5 ) / 15.0;
+    const double                   y = ( index[1] - 17.5 ) / 13.0;
+    const double                   z = ( index[2] - 11.5 ) / 9.0;
+    const bool                     inside = x * x + y * y + z * z <= 1.0;
+    it.Set( inside ? 1 : 0 );
+    if( inside )
+      {
+      insideRank[maskImage->ComputeOffset( index )] = numberOfInsideVoxels++;
+      }
+    }
+  MaskSpatialObjectType::Pointer mask = MaskSpatialObjectType::New();
+  mask->SetImage( maskImage );
+  mask->Update();
+
+  bool allPassed = true;
+  try
+    {
+    SamplingCacheType::Clear();
+    const PointSetType::ConstPointer sample =
+      SamplingCacheType::GetSampledPointSet( fixedImage, mask, SamplingPercentage );
+    const size_t numberOfSamples = sample->GetNumberOfPoints();
+    const size_t expectedNumberOfSamples =
+      static_cast<size_t>( std::ceil( fixedImage->GetLargestPossibleRegion().GetNumberOfPixels() * SamplingPercentage ) );
+    std::cout << numberOfSamples << " samples of " << numberOfInsideVoxels << " in-mask voxels" << std::endl;
+    if( numberOfSamples != expectedNumberOfSamples || sample->GetPointData()->Size() != numberOfSamples )
+      {
+      std::cerr << "Expected " << expectedNumberOfSamples << " samples" << std::endl;
+      allPassed = false;
+      }
+
+    const double stratumSize = static_cast<double>( numberOfInsideVoxels ) / numberOfSamples;
+    size_t       numberOfStrayedSamples = 0;
+    size_t       numberOfUnstratifiedSamples = 0;
+    for( size_t k = 0; k < numberOfSamples; ++k )
+      {
+      const size_t offset = static_cast<size_t>( sample->GetPointData()->ElementAt( k ) );
+      if( offset >= numberOfPixels || insideRank[offset] == numberOfPixels )
+        {
+        ++numberOfStrayedSamples;
+        continue;
+        }
+      FixedImageType::PointType voxelCenter;
+      fixedImage->TransformIndexToPhysicalPoint( fixedImage->ComputeIndex( offset ), voxelCenter );
+      const PointSetType::PointType & point = sample->GetPoints()->ElementAt( k );
+      for( unsigned int d = 0; d < 3; ++d )
+        {
+        if( std::abs( point[d] - voxelCenter[d] ) > 6.0 * spacing[d] / 3.0 )
+          {
+          ++numberOfStrayedSamples;
+          break;
+          }
+        }
+      const double rank = static_cast<double>( insideRank[offset] );
+      if( rank < std::floor( k * stratumSize ) || rank >= std::ceil( ( k + 1 ) * stratumSize ) )
+        {
+        ++numberOfUnstratifiedSamples;
+        }
+      }
+    if( numberOfStrayedSamples > 0 )
+      {
+      std::cerr << numberOfStrayedSamples << " samples are not jittered from an in-mask voxel" << std::endl;
+      allPassed = false;
+      }
+    if( numberOfUnstratifiedSamples > 0 )
+      {
+      std::cerr << numberOfUnstratifiedSamples << " samples are outside their stratum" << std::endl;
+      allPassed = false;
+      }
+
+    // Same content: the same point set, also for a graft of the fixed image.
+    FixedImageType::Pointer graft = FixedImageType::New();
+    graft->Graft( fixedImage );
+    if( SamplingCacheType::GetSampledPointSet( fixedImage, mask, SamplingPercentage ) != sample
+        || SamplingCacheType::GetSampledPointSet( graft, mask, SamplingPercentage ) != sample )
+      {
+      std::cerr << "The cached sample is not reused" << std::endl;
+      allPassed = false;
+      }
+    if( SamplingCacheType::GetSampledPointSet( fixedImage, mask, 2.0 * SamplingPercentage ) == sample
+        || SamplingCacheType::GetSampledPointSet( fixedImage, nullptr, SamplingPercentage ) == sample )
+      {
+      std::cerr << "The cached sample is returned for other parameters" << std::endl;
+      allPassed = false;
+      }
+
+    // Built again, the sample is the same.
+    SamplingCacheType::Clear();
+    const PointSetType::ConstPointer rebuilt =
+      SamplingCacheType::GetSampledPointSet( fixedImage, mask, SamplingPercentage );
+    bool same = rebuilt->GetNumberOfPoints() == numberOfSamples;
+    for( size_t i = 0; same && i < numberOfSamples; ++i )
+      {
+      same = rebuilt->GetPoints()->ElementAt( i ) == sample->GetPoints()->ElementAt( i )
+        && rebuilt->GetPointData()->ElementAt( i ) == sample->GetPointData()->ElementAt( i );
+      }
+    if( !same )
+      {
+      std::cerr << "The sample differs when it is built again" << std::endl;
+      allPassed = false;
+      }
+
+    // Writes through the buffers leave the modified times unchanged.
+    const FixedImageType::IndexType changedIndex = { { 20, 18, 12 } };
+    fixedImage->GetBufferPointer()[fixedImage->ComputeOffset( changedIndex )] += 1.0F;
+    const PointSetType::ConstPointer afterFixedWrite =
+      SamplingCacheType::GetSampledPointSet( fixedImage, mask, SamplingPercentage );
+    if( afterFixedWrite == rebuilt )
+      {
+      std::cerr << "A stale sample is returned after the fixed pixels changed in place" << std::endl;
+      allPassed = false;
+      }
+    maskImage->GetBufferPointer()[maskImage->ComputeOffset( changedIndex )] = 0;
+    if( SamplingCacheType::GetSampledPointSet( fixedImage, mask, SamplingPercentage ) == afterFixedWrite )
+      {
+      std::cerr << "A stale sample is returned after the mask pixels changed in place" << std::endl;
+      allPassed = false;
+      }
+    SamplingCacheType::Clear();
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
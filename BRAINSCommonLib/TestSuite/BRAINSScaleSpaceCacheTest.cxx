@@ -0,0 +1,223 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Compares the results of BRAINSScaleSpaceCache with the ITK filters they
+// stand for, on an anisotropic image:
+//  - a sigma that is at most MaximumFIRSigma voxels along every axis uses the
+//    FIR path, which must match DiscreteGaussianImageFilter (maximum error
+//    0.01, at most 32 taps), and its gradient the central difference of that
+//    result away from the image border;
+//  - a sigma wider than MaximumFIRSigma voxels along every axis uses the IIR
+//    path, which must match RecursiveGaussianImageFilter run along each axis,
+//    first order along the axis of a gradient component.
+// Both paths accumulate in float in a different order than ITK, so values
+// must agree to 1e-4 of the intensity range.
+//
+// The cache must return the cached result for the same pixels, and a new
+// one after the pixels are changed through the buffer pointer.
+//
+
+#include "BRAINSScaleSpaceCache.h"
+#include "itkCastImageFilter.h"
+#include "itkDiscreteGaussianImageFilter.h"
+#include "itkGradientImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkRecursiveGaussianImageFilter.h"
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace
+{
+using InputImageType = itk::Image<short, 3>;
+using ScaleSpaceType = BRAINSScaleSpaceCache<InputImageType>;
+using RealImageType = ScaleSpaceType::RealImageType;
+using GradientImageType = ScaleSpaceType::GradientImageType;
+
+constexpr double IntensityRange = 1000.0;
+constexpr double Tolerance = 1e-4;
+
+InputImageType::Pointer
+CreateInputImage()
+{
+  InputImageType::SizeType size;
+  size[0] = 40;
+  size[1] = 36;
+  size[2] = 24;
+  InputImageType::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 0.75;
+  spacing[2] = 2.5;
+  InputImageType::Pointer image = InputImageType::New();
+  image->SetRegions( size );
+  image->SetSpacing( spacing );
+  image->Allocate();
+
+  // Smooth structure plus noise, within [0, IntensityRange]
+  std::mt19937                           generator( 1 );
+  std::uniform_real_distribution<double> noise( -100.0, 100.0 );
+  for( itk::ImageRegionIteratorWithIndex<InputImageType> it( image, image->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const InputImageType::IndexType index = it.GetIndex();
+    const double                    value = 500.0 + 200.0 * std::sin( 0.3 * index[0] ) * std::cos( 0.2 * index[1] )
+      + 150.0 * std::sin( 0.5 * index[2] ) + noise( generator );
+    it.Set( static_cast<short>( value ) );
+    }
+  return image;
+}
+
+RealImageType::Pointer
+CastToReal(const InputImageType *image)
+{
+  using CastFilterType = itk::CastImageFilter<InputImageType, RealImageType>;
+  CastFilterType::Pointer caster = CastFilterType::New();
+  caster->SetInput( image );
+  caster->Update();
+  return caster->GetOutput();
+}
+
+/** image filtered by RecursiveGaussianImageFilter along every axis, first
+ * order along derivativeAxis (none when it is 3) */
+RealImageType::Pointer
+RecursiveGaussian(const RealImageType *image, const double sigma, const unsigned int derivativeAxis)
+{
+  using RecursiveFilterType = itk::RecursiveGaussianImageFilter<RealImageType, RealImageType>;
+  RealImageType::Pointer result = const_cast<RealImageType *>( image );
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    RecursiveFilterType::Pointer filter = RecursiveFilterType::New();
+    filter->SetInput( result );
+    filter->SetDirection( d );
+    filter->SetSigma( sigma );
+    filter->SetNormalizeAcrossScale( false );
+    filter->SetOrder( d == derivativeAxis ? RecursiveFilterType::FirstOrder : RecursiveFilterType::ZeroOrder );
+    filter->Update();
+    result = filter->GetOutput();
+    }
+  return result;
+}
+
+/** Compare component of actual (a stride of numberOfComponents floats) with
+ * expected over the voxels at least border voxels away from the image border */
+bool
+CompareBuffers(const std::string & caseName, const float *actual, const unsigned int numberOfComponents,
+               const RealImageType *expected, const unsigned int border)
+{
+  RealImageType::RegionType region = expected->GetLargestPossibleRegion();
+  region.ShrinkByRadius( border );
+
+  double maximumDifference = 0.0;
+  for( itk::ImageRegionConstIteratorWithIndex<RealImageType> it( expected, region ); !it.IsAtEnd(); ++it )
+    {
+    const size_t offset = expected->ComputeOffset( it.GetIndex() );
+    maximumDifference = std::max( maximumDifference,
+                                  std::abs( static_cast<double>( actual[offset * numberOfComponents] ) - it.Get() ) );
+    }
+  const bool passed = maximumDifference <= Tolerance * IntensityRange;
+  std::cout << caseName << ": largest difference " << maximumDifference << ( passed ? " passed" : " FAILED" )
+            << std::endl;
+  return passed;
+}
+} // end namespace
+
+int main(int, char *[])
+{
+  const InputImageType::Pointer inputImage = CreateInputImage();
+  const RealImageType::Pointer  realImage = CastToReal( inputImage );
+  bool                          allPassed = true;
+
+  try
+    {
+    // At most 2 voxels along every axis: FIR
+    const double firSigma = 1.5;
+    using DiscreteGaussianFilterType = itk::DiscreteGaussianImageFilter<RealImageType, RealImageType>;
+    DiscreteGaussianFilterType::Pointer discreteGaussian = DiscreteGaussianFilterType::New();
+    discreteGaussian->SetInput( realImage );
+    discreteGaussian->SetVariance( firSigma * firSigma );
+    discreteGaussian->SetMaximumError( 0.01 );
+    discreteGaussian->SetMaximumKernelWidth( 32 );
+    discreteGaussian->SetUseImageSpacing( true );
+    discreteGaussian->Update();
+    allPassed &= CompareBuffers( "FIR smoothing",
+                                 ScaleSpaceType::ComputeSmoothedImage( inputImage, firSigma )->GetBufferPointer(),
+                                 1, discreteGaussian->GetOutput(), 0 );
+
+    using GradientFilterType = itk::GradientImageFilter<RealImageType, float, float>;
+    GradientFilterType::Pointer centralDifference = GradientFilterType::New();
+    centralDifference->SetInput( discreteGaussian->GetOutput() );
+    centralDifference->SetUseImageSpacing( true );
+    centralDifference->SetUseImageDirection( false );
+    centralDifference->Update();
+    const GradientImageType::ConstPointer firGradient = ScaleSpaceType::ComputeGradientImage( inputImage, firSigma );
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      // The gradient filter output, one component at a time
+      RealImageType::Pointer component = RealImageType::New();
+      component->CopyInformation( realImage );
+      component->SetRegions( realImage->GetLargestPossibleRegion() );
+      component->Allocate();
+      const size_t numberOfPixels = component->GetBufferedRegion().GetNumberOfPixels();
+      for( size_t p = 0; p < numberOfPixels; ++p )
+        {
+        component->GetBufferPointer()[p] = centralDifference->GetOutput()->GetBufferPointer()[p][d];
+        }
+      allPassed &= CompareBuffers( "FIR gradient " + std::to_string( d ),
+                                   firGradient->GetBufferPointer()->GetDataPointer() + d, 3, component, 1 );
+      }
+
+    // More than 2 voxels along every axis: IIR
+    const double iirSigma = 6.0;
+    allPassed &= CompareBuffers( "IIR smoothing",
+                                 ScaleSpaceType::ComputeSmoothedImage( inputImage, iirSigma )->GetBufferPointer(),
+                                 1, RecursiveGaussian( realImage, iirSigma, 3 ), 0 );
+    const GradientImageType::ConstPointer iirGradient = ScaleSpaceType::ComputeGradientImage( inputImage, iirSigma );
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      allPassed &= CompareBuffers( "IIR gradient " + std::to_string( d ),
+                                   iirGradient->GetBufferPointer()->GetDataPointer() + d, 3,
+                                   RecursiveGaussian( realImage, iirSigma, d ), 0 );
+      }
+
+    // The same pixels give the cached result, a write through the buffer a new one.
+    ScaleSpaceType::Clear();
+    const RealImageType::ConstPointer cached = ScaleSpaceType::GetSmoothedImage( inputImage, firSigma );
+    if( ScaleSpaceType::GetSmoothedImage( inputImage, firSigma ) != cached )
+      {
+      std::cerr << "The cached result is not reused" << std::endl;
+      allPassed = false;
+      }
+    inputImage->GetBufferPointer()[0] += 100;
+    const RealImageType::ConstPointer changed = ScaleSpaceType::GetSmoothedImage( inputImage, firSigma );
+    if( changed == cached || changed->GetBufferPointer()[0] == cached->GetBufferPointer()[0] )
+      {
+      std::cerr << "A stale result is returned after the pixels changed in place" << std::endl;
+      allPassed = false;
+      }
+    ScaleSpaceType::Clear();
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,233 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Builds a noise free DWI of two baselines and 30 gradient directions at
+// b = 1000 from a known tensor per voxel, a prolate tensor whose size and
+// orientation change across the image, and fits it with
+// DiffusionTensor3DReconstructionWithMaskImageFilter:
+//  - LinearLeastSquares, WeightedLinearLeastSquares and
+//    IterativeWeightedLinearLeastSquares must each recover the tensor of
+//    every unmasked voxel within TensorTolerance of its norm, with one and
+//    with several threads (the image is not a multiple of BatchSize voxels,
+//    so the last batch of a thread is partial);
+//  - the masked voxels must be null tensors;
+//  - PrintSelf must report the fitting method and the number of iterations.
+//
+
+#include "itkDiffusionTensor3DReconstructionWithMaskImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "vnl/vnl_matrix_fixed.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+using TensorFilterType = itk::DiffusionTensor3DReconstructionWithMaskImageFilter<float, float, double>;
+using GradientImagesType = TensorFilterType::GradientImagesType;
+using MaskImageType = TensorFilterType::MaskImageType;
+using TensorImageType = TensorFilterType::TensorImageType;
+using TensorPixelType = TensorFilterType::TensorPixelType;
+using GradientDirectionType = TensorFilterType::GradientDirectionType;
+using GradientDirectionContainerType = TensorFilterType::GradientDirectionContainerType;
+
+constexpr unsigned int NumberOfBaselines = 2;
+constexpr unsigned int NumberOfGradients = 30;
+constexpr double       BValue = 1000.0;
+constexpr double       TensorTolerance = 1e-4;
+
+/** Baselines first, then gradients spread over a hemisphere on a spiral */
+GradientDirectionContainerType::Pointer
+CreateGradientDirections()
+{
+  GradientDirectionContainerType::Pointer directions = GradientDirectionContainerType::New();
+  for( unsigned int i = 0; i < NumberOfBaselines; ++i )
+    {
+    directions->InsertElement( i, GradientDirectionType( 0.0 ) );
+    }
+  const double goldenAngle = itk::Math::pi * ( 3.0 - std::sqrt( 5.0 ) );
+  for( unsigned int i = 0; i < NumberOfGradients; ++i )
+    {
+    const double          z = 1.0 - ( i + 0.5 ) / NumberOfGradients;
+    const double          radius = std::sqrt( 1.0 - z * z );
+    GradientDirectionType direction;
+    direction[0] = radius * std::cos( goldenAngle * i );
+    direction[1] = radius * std::sin( goldenAngle * i );
+    direction[2] = z;
+    directions->InsertElement( NumberOfBaselines + i, direction );
+    }
+  return directions;
+}
+
+/** The tensor of a voxel: eigenvalues (1.7, 0.4, 0.2) x 1e-3 scaled with x,
+ * turned about z by an angle growing with y, then about x by one growing
+ * with z. */
+vnl_matrix_fixed<double, 3, 3>
+KnownTensor(const GradientImagesType::IndexType & index)
+{
+  const double                   scale = 0.6 + 0.1 * index[0];
+  const double                   heading = 0.35 * index[1];
+  const double                   tilt = 0.4 * index[2];
+  vnl_matrix_fixed<double, 3, 3> aboutZ;
+  aboutZ.set_identity();
+  aboutZ(0, 0) = std::cos( heading );
+  aboutZ(0, 1) = -std::sin( heading );
+  aboutZ(1, 0) = std::sin( heading );
+  aboutZ(1, 1) = std::cos( heading );
+  vnl_matrix_fixed<double, 3, 3> aboutX;
+  aboutX.set_identity();
+  aboutX(1, 1) = std::cos( tilt );
+  aboutX(1, 2) = -std::sin( tilt );
+  aboutX(2, 1) = std::sin( tilt );
+  aboutX(2, 2) = std::cos( tilt );
+  vnl_matrix_fixed<double, 3, 3> eigenvalues( 0.0 );
+  eigenvalues(0, 0) = 1.7e-3 * scale;
+  eigenvalues(1, 1) = 0.4e-3 * scale;
+  eigenvalues(2, 2) = 0.2e-3 * scale;
+  const vnl_matrix_fixed<double, 3, 3> rotation = aboutX * aboutZ;
+  return rotation * eigenvalues * rotation.transpose();
+}
+
+GradientImagesType::Pointer
+CreateDWI(const GradientDirectionContainerType *directions)
+{
+  GradientImagesType::SizeType size;
+  size[0] = 9;
+  size[1] = 8;
+  size[2] = 5;
+  GradientImagesType::Pointer dwi = GradientImagesType::New();
+  dwi->SetRegions( size );
+  dwi->SetVectorLength( NumberOfBaselines + NumberOfGradients );
+  dwi->Allocate();
+  for( itk::ImageRegionIteratorWithIndex<GradientImagesType> it( dwi, dwi->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const vnl_matrix_fixed<double, 3, 3> tensor = KnownTensor( it.GetIndex() );
+    const double                         s0 = 800.0 + 10.0 * it.GetIndex()[1];
+    GradientImagesType::PixelType        signal( NumberOfBaselines + NumberOfGradients );
+    for( unsigned int i = 0; i < NumberOfBaselines + NumberOfGradients; ++i )
+      {
+      const GradientDirectionType g = directions->ElementAt( i );
+      signal[i] = static_cast<float>( s0 * std::exp( -BValue * dot_product( g, tensor * g ) ) );
+      }
+    it.Set( signal );
+    }
+  return dwi;
+}
+
+/** Masks out the x = 0 and y = 0 faces */
+MaskImageType::Pointer
+CreateMask(const GradientImagesType *dwi)
+{
+  MaskImageType::Pointer mask = MaskImageType::New();
+  mask->CopyInformation( dwi );
+  mask->SetRegions( dwi->GetLargestPossibleRegion() );
+  mask->Allocate();
+  for( itk::ImageRegionIteratorWithIndex<MaskImageType> it( mask, mask->GetLargestPossibleRegion() ); !it.IsAtEnd();
+       ++it )
+    {
+    it.Set( ( it.GetIndex()[0] == 0 || it.GetIndex()[1] == 0 ) ? 0 : 1 );
+    }
+  return mask;
+}
+
+bool
+TestFittingMethod(const std::string & methodName, const TensorFilterType::FittingMethodEnumeration method,
+                  const unsigned int numberOfThreads, GradientDirectionContainerType *directions,
+                  const GradientImagesType *dwi, const MaskImageType *mask)
+{
+  TensorFilterType::Pointer filter = TensorFilterType::New();
+  filter->SetGradientImage( directions, dwi );
+  filter->SetMaskImage( mask );
+  filter->SetBValue( BValue );
+  filter->SetFittingMethod( method );
+  filter->SetNumberOfIterations( 4 );
+  filter->SetNumberOfWorkUnits( numberOfThreads );
+  filter->Update();
+  const TensorImageType *output = filter->GetOutput();
+
+  double       largestError = 0.0;
+  unsigned int nonNullMaskedVoxels = 0;
+  for( itk::ImageRegionConstIteratorWithIndex<TensorImageType> it( output, output->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const TensorPixelType                tensor = it.Get();
+    const bool                           masked = mask->GetPixel( it.GetIndex() ) == 0;
+    const vnl_matrix_fixed<double, 3, 3> known = KnownTensor( it.GetIndex() );
+    double                               error = 0.0;
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      for( unsigned int c = 0; c < 3; ++c )
+        {
+        const double expected = masked ? 0.0 : known(r, c);
+        error += ( tensor(r, c) - expected ) * ( tensor(r, c) - expected );
+        }
+      }
+    if( masked )
+      {
+      nonNullMaskedVoxels += error != 0.0 ? 1 : 0;
+      continue;
+      }
+    largestError = std::max( largestError, std::sqrt( error ) / known.frobenius_norm() );
+    }
+
+  std::ostringstream printed;
+  filter->Print( printed );
+  const bool reported = printed.str().find( "FittingMethod: " + methodName + "\n" ) != std::string::npos
+    && printed.str().find( "NumberOfIterations: 4" ) != std::string::npos;
+
+  const bool passed = largestError <= TensorTolerance && nonNullMaskedVoxels == 0 && reported;
+  std::cout << methodName << " with " << numberOfThreads << " threads: largest relative error " << largestError
+            << ", " << nonNullMaskedVoxels << " non null masked voxels" << ( reported ? "" : ", not printed" )
+            << ( passed ? " passed" : " FAILED" ) << std::endl;
+  return passed;
+}
+} // end namespace
+
+int main(int, char *[])
+{
+  bool allPassed = true;
+  try
+    {
+    const GradientDirectionContainerType::Pointer directions = CreateGradientDirections();
+    const GradientImagesType::Pointer             dwi = CreateDWI( directions );
+    const MaskImageType::Pointer                  mask = CreateMask( dwi );
+
+    for( const unsigned int numberOfThreads : { 1U, 4U } )
+      {
+      allPassed &= TestFittingMethod( "LinearLeastSquares", TensorFilterType::LinearLeastSquares,
+                                      numberOfThreads, directions, dwi, mask );
+      allPassed &= TestFittingMethod( "WeightedLinearLeastSquares", TensorFilterType::WeightedLinearLeastSquares,
+                                      numberOfThreads, directions, dwi, mask );
+      allPassed &= TestFittingMethod( "IterativeWeightedLinearLeastSquares",
+                                      TensorFilterType::IterativeWeightedLinearLeastSquares, numberOfThreads,
+                                      directions, dwi, mask );
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,239 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Writes an anisotropic image with a permuted and flipped direction, once
+// as uncompressed NRRD (streamed) and once as compressed NIfTI (decoded
+// whole), and reads the physical box spanned by the continuous indices
+// (5.3, 4.4, 3.2) and (17.6, 14.7, 11.5) back with itkUtil:
+//  - ReadImagePhysicalRegion must return the index region
+//    [4, 19] x [3, 16] x [2, 13] (the box plus one voxel) re-based to index
+//    0, with the origin of its first voxel in the file and the pixels of a
+//    full read;
+//  - ReadImagePhysicalRegionAndOrient must hold the same number of voxels,
+//    each equal to the voxel at the same physical point of
+//    ReadImageAndOrient;
+//  - a box that does not touch the image must throw.
+//
+
+#include "itkIO.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+namespace
+{
+using ImageType = itk::Image<float, 3>;
+
+ImageType::Pointer
+CreateImage()
+{
+  ImageType::SizeType size;
+  size[0] = 30;
+  size[1] = 26;
+  size[2] = 20;
+  ImageType::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 1.5;
+  spacing[2] = 2.0;
+  ImageType::PointType origin;
+  origin[0] = -10.0;
+  origin[1] = 5.0;
+  origin[2] = 3.0;
+  ImageType::DirectionType direction;
+  direction.Fill(0.0);
+  direction[0][1] = 1.0;
+  direction[1][0] = -1.0;
+  direction[2][2] = 1.0;
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions(size);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(direction);
+  image->Allocate();
+  const size_t numberOfPixels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+  for( size_t p = 0; p < numberOfPixels; ++p )
+    {
+    image->GetBufferPointer()[p] = static_cast<float>( p );
+    }
+  return image;
+}
+
+bool
+TestFile(const std::string & fileName, const ImageType *written)
+{
+  bool passed = true;
+
+  itk::ContinuousIndex<double, 3> firstCorner;
+  itk::ContinuousIndex<double, 3> secondCorner;
+  firstCorner[0] = 5.3;
+  firstCorner[1] = 4.4;
+  firstCorner[2] = 3.2;
+  secondCorner[0] = 17.6;
+  secondCorner[1] = 14.7;
+  secondCorner[2] = 11.5;
+  ImageType::PointType firstPoint;
+  ImageType::PointType secondPoint;
+  written->TransformContinuousIndexToPhysicalPoint(firstCorner, firstPoint);
+  written->TransformContinuousIndexToPhysicalPoint(secondCorner, secondPoint);
+  ImageType::PointType lowerPoint;
+  ImageType::PointType upperPoint;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    lowerPoint[d] = std::min(firstPoint[d], secondPoint[d]);
+    upperPoint[d] = std::max(firstPoint[d], secondPoint[d]);
+    }
+
+  ImageType::IndexType expectedStart;
+  expectedStart[0] = 4;
+  expectedStart[1] = 3;
+  expectedStart[2] = 2;
+  ImageType::SizeType expectedSize;
+  expectedSize[0] = 16;
+  expectedSize[1] = 14;
+  expectedSize[2] = 12;
+
+  const ImageType::Pointer full = itkUtil::ReadImage<ImageType>(fileName);
+  const ImageType::Pointer region = itkUtil::ReadImagePhysicalRegion<ImageType>(fileName, lowerPoint, upperPoint);
+  ImageType::PointType     expectedOrigin;
+  full->TransformIndexToPhysicalPoint(expectedStart, expectedOrigin);
+  if( region->GetLargestPossibleRegion() != region->GetBufferedRegion()
+      || region->GetLargestPossibleRegion().GetIndex() != ImageType::IndexType::Filled(0)
+      || region->GetLargestPossibleRegion().GetSize() != expectedSize )
+    {
+    std::cerr << fileName << ": read region " << region->GetBufferedRegion() << " instead of size " << expectedSize
+              << " at index 0" << std::endl;
+    return false;
+    }
+  if( expectedOrigin.EuclideanDistanceTo(region->GetOrigin() ) > 1e-6 || region->GetSpacing() != full->GetSpacing()
+      || region->GetDirection() != full->GetDirection() )
+    {
+    std::cerr << fileName << ": origin " << region->GetOrigin() << " instead of " << expectedOrigin << std::endl;
+    passed = false;
+    }
+  size_t differentPixels = 0;
+  for( itk::ImageRegionConstIteratorWithIndex<ImageType> it(region, region->GetBufferedRegion() ); !it.IsAtEnd();
+       ++it )
+    {
+    ImageType::IndexType fullIndex;
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      fullIndex[d] = expectedStart[d] + it.GetIndex()[d];
+      }
+    differentPixels += it.Get() != full->GetPixel(fullIndex) ? 1 : 0;
+    }
+  if( differentPixels > 0 )
+    {
+    std::cerr << fileName << ": " << differentPixels << " pixels differ from the full read" << std::endl;
+    passed = false;
+    }
+
+  const ImageType::Pointer fullOriented = itkUtil::ReadImageAndOrient<ImageType>(
+      fileName, itk::SpatialOrientation::ITK_COORDINATE_ORIENTATION_RAI);
+  const ImageType::Pointer regionOriented = itkUtil::ReadImagePhysicalRegionAndOrient<ImageType>(
+      fileName, lowerPoint, upperPoint, itk::SpatialOrientation::ITK_COORDINATE_ORIENTATION_RAI);
+  if( regionOriented->GetBufferedRegion().GetNumberOfPixels() != region->GetBufferedRegion().GetNumberOfPixels()
+      || regionOriented->GetDirection() != fullOriented->GetDirection() )
+    {
+    std::cerr << fileName << ": the oriented region has " << regionOriented->GetBufferedRegion() << std::endl;
+    return false;
+    }
+  differentPixels = 0;
+  for( itk::ImageRegionConstIteratorWithIndex<ImageType> it(regionOriented, regionOriented->GetBufferedRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    ImageType::PointType point;
+    regionOriented->TransformIndexToPhysicalPoint(it.GetIndex(), point);
+    ImageType::IndexType fullIndex;
+    if( !fullOriented->TransformPhysicalPointToIndex(point, fullIndex)
+        || it.Get() != fullOriented->GetPixel(fullIndex) )
+      {
+      ++differentPixels;
+      }
+    }
+  if( differentPixels > 0 )
+    {
+    std::cerr << fileName << ": " << differentPixels << " oriented pixels differ from the full oriented read"
+              << std::endl;
+    passed = false;
+    }
+
+  ImageType::PointType outsideLowerPoint;
+  ImageType::PointType outsideUpperPoint;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    outsideLowerPoint[d] = 1000.0;
+    outsideUpperPoint[d] = 1010.0;
+    }
+  bool threw = false;
+  try
+    {
+    itkUtil::ReadImagePhysicalRegion<ImageType>(fileName, outsideLowerPoint, outsideUpperPoint);
+    }
+  catch( itk::ExceptionObject & )
+    {
+    threw = true;
+    }
+  if( !threw )
+    {
+    std::cerr << fileName << ": a box outside of the image did not throw" << std::endl;
+    passed = false;
+    }
+
+  std::cout << fileName << ( passed ? " passed" : " FAILED" ) << std::endl;
+  return passed;
+}
+} // end namespace
+
+int main(int argc, char *argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string outputDirectory = argv[1];
+
+  bool allPassed = true;
+  try
+    {
+    const ImageType::Pointer image = CreateImage();
+
+    const std::string streamedFileName = outputDirectory + "/ReadImagePhysicalRegionTest.nrrd";
+    using WriterType = itk::ImageFileWriter<ImageType>;
+    WriterType::Pointer writer = WriterType::New();
+    writer->UseCompressionOff();
+    writer->SetFileName(streamedFileName);
+    writer->SetInput(image);
+    writer->Update();
+    allPassed &= TestFile(streamedFileName, image);
+
+    const std::string compressedFileName = outputDirectory + "/ReadImagePhysicalRegionTest.nii.gz";
+    itkUtil::WriteImage<ImageType>(image, compressedFileName);
+    allPassed &= TestFile(compressedFileName, image);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
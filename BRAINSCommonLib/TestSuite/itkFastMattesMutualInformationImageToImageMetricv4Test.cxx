@@ -0,0 +1,379 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Compares the value and derivative of
+// FastMattesMutualInformationImageToImageMetricv4 with those of
+// itk::MattesMutualInformationImageToImageMetricv4, configured the way
+// BRAINSFit configures them, on a real image pair and for the linear
+// transforms BRAINSFit optimizes.  The cubic BSpline cases compare the block
+// sparse derivative of the fast metric with the dense derivative of the ITK
+// metric, on an 8x8x8 and a 14x14x14 control point grid, with the BSpline
+// alone and behind a rigid transform as in the BRAINSFit BSpline stage.
+//
+// Every transform, linear or BSpline, is compared in five configurations:
+// dense without masks, on the BRAINSFitSamplingCache sample of the fixed
+// image, with an ellipsoidal fixed mask, with an ellipsoidal moving mask,
+// and with both masks on the sample drawn inside the fixed mask, as
+// BRAINSFit runs with masks and Random sampling.  Both metrics get the same
+// point set and the same ImageMaskSpatialObjects.
+//
+// The two metrics sum the same terms in a different order, so they agree up
+// to round-off:  the values must agree to a relative tolerance of 1e-6 and
+// every derivative component to 1e-5 of the largest derivative component.
+//
+
+#include "itkFastMattesMutualInformationImageToImageMetricv4.h"
+#include "BRAINSFitSamplingCache.h"
+#include "itkMattesMutualInformationImageToImageMetricv4.h"
+#include "itkImageFileReader.h"
+#include "itkVersorRigid3DTransform.h"
+#include "itkScaleVersor3DTransform.h"
+#include "itkAffineTransform.h"
+#include "itkBSplineTransform.h"
+#include "itkBSplineTransformInitializer.h"
+#include "itkCompositeTransform.h"
+#include "itkImageMaskSpatialObject.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+using ImageType = itk::Image<float, 3>;
+using TransformBaseType = itk::Transform<double, 3, 3>;
+using FastMetricType = itk::FastMattesMutualInformationImageToImageMetricv4<ImageType, ImageType, ImageType, double>;
+using ReferenceMetricType = itk::MattesMutualInformationImageToImageMetricv4<ImageType, ImageType, ImageType, double>;
+using MaskType = itk::SpatialObject<3>;
+using MaskSpatialObjectType = itk::ImageMaskSpatialObject<3>;
+using SamplingCacheType = BRAINSFitSamplingCache<ImageType>;
+using PointSetType = SamplingCacheType::PointSetType;
+
+constexpr double       ValueTolerance = 1e-6;
+constexpr double       DerivativeTolerance = 1e-5;
+constexpr unsigned int NumberOfHistogramBins = 50;
+// The dense ITK derivative of a 14x14x14 grid needs one joint PDF per
+// parameter; fewer bins keep it in a test sized amount of memory.
+constexpr unsigned int NumberOfBSplineHistogramBins = 32;
+constexpr double       SamplingPercentage = 0.1;
+
+/** The samples and masks the metrics are evaluated with, null for none */
+struct Configuration
+  {
+  std::string          Name;
+  const PointSetType * SampledPointSet;
+  const MaskType *     FixedMask;
+  const MaskType *     MovingMask;
+  };
+
+template <typename TMetric>
+void
+SetupMetric(TMetric *metric, const ImageType *fixedImage, const ImageType *movingImage, TransformBaseType *transform,
+            unsigned int numberOfHistogramBins, const Configuration & configuration)
+{
+  metric->SetNumberOfHistogramBins(numberOfHistogramBins);
+  metric->SetUseMovingImageGradientFilter(false);
+  metric->SetUseFixedImageGradientFilter(false);
+  metric->SetUseSampledPointSet(configuration.SampledPointSet != nullptr);
+  if( configuration.SampledPointSet != nullptr )
+    {
+    metric->SetFixedSampledPointSet(configuration.SampledPointSet);
+    }
+  metric->SetFixedImageMask(configuration.FixedMask);
+  metric->SetMovingImageMask(configuration.MovingMask);
+  metric->SetFixedImage(fixedImage);
+  metric->SetMovingImage(movingImage);
+  metric->SetMovingTransform(transform);
+  metric->Initialize();
+}
+
+bool
+CompareMetrics(const std::string & transformName, const ImageType *fixedImage, const ImageType *movingImage,
+               TransformBaseType *transform, FastMetricType::FastPathType expectedFastPath,
+               const Configuration & configuration)
+{
+  const std::string caseName = transformName + ", " + configuration.Name;
+  const unsigned int numberOfHistogramBins =
+    ( expectedFastPath == FastMetricType::BSplineFastPath ) ? NumberOfBSplineHistogramBins : NumberOfHistogramBins;
+  FastMetricType::Pointer fastMetric = FastMetricType::New();
+  SetupMetric(fastMetric.GetPointer(), fixedImage, movingImage, transform, numberOfHistogramBins, configuration);
+  if( fastMetric->GetFastPathType() != expectedFastPath )
+    {
+    std::cerr << caseName << ": the expected fast path is not used" << std::endl;
+    return false;
+    }
+  ReferenceMetricType::Pointer referenceMetric = ReferenceMetricType::New();
+  SetupMetric(referenceMetric.GetPointer(), fixedImage, movingImage, transform, numberOfHistogramBins, configuration);
+
+  FastMetricType::MeasureType         fastValue;
+  FastMetricType::DerivativeType      fastDerivative;
+  ReferenceMetricType::MeasureType    referenceValue;
+  ReferenceMetricType::DerivativeType referenceDerivative;
+  fastMetric->GetValueAndDerivative(fastValue, fastDerivative);
+  referenceMetric->GetValueAndDerivative(referenceValue, referenceDerivative);
+
+  bool passed = true;
+  if( std::abs(fastValue - referenceValue) > ValueTolerance * std::abs(referenceValue) )
+    {
+    std::cerr << caseName << ": value " << fastValue << " differs from " << referenceValue << std::endl;
+    passed = false;
+    }
+  if( fastDerivative.GetSize() != referenceDerivative.GetSize() )
+    {
+    std::cerr << caseName << ": derivative has " << fastDerivative.GetSize() << " parameters instead of "
+              << referenceDerivative.GetSize() << std::endl;
+    return false;
+    }
+  double largestComponent = 0.0;
+  for( unsigned int p = 0; p < referenceDerivative.GetSize(); ++p )
+    {
+    largestComponent = std::max(largestComponent, std::abs(referenceDerivative[p]) );
+    }
+  for( unsigned int p = 0; p < referenceDerivative.GetSize(); ++p )
+    {
+    if( std::abs(fastDerivative[p] - referenceDerivative[p]) > DerivativeTolerance * largestComponent )
+      {
+      std::cerr << caseName << ": derivative[" << p << "] " << fastDerivative[p] << " differs from "
+                << referenceDerivative[p] << std::endl;
+      passed = false;
+      }
+    }
+  std::cout << caseName << ": value " << fastValue << " (reference " << referenceValue << ")"
+            << ( passed ? " passed" : " FAILED" ) << std::endl;
+  return passed;
+}
+
+bool
+CompareMetricsInConfigurations(const std::string & transformName, const ImageType *fixedImage,
+                               const ImageType *movingImage, TransformBaseType *transform,
+                               FastMetricType::FastPathType expectedFastPath,
+                               const std::vector<Configuration> & configurations)
+{
+  bool passed = true;
+  for( const Configuration & configuration : configurations )
+    {
+    passed &= CompareMetrics(transformName, fixedImage, movingImage, transform, expectedFastPath, configuration);
+    }
+  return passed;
+}
+
+/** An ImageMaskSpatialObject over image of the ellipsoid with semi-axes of
+ * 0.4 of the image extent, centered at centerShift of the extent along the
+ * first axis from the image center */
+MaskSpatialObjectType::Pointer
+CreateEllipsoidMask(const ImageType *image, double centerShift)
+{
+  using MaskImageType = MaskSpatialObjectType::ImageType;
+  const ImageType::RegionType region = image->GetLargestPossibleRegion();
+  MaskImageType::Pointer      maskImage = MaskImageType::New();
+  maskImage->CopyInformation(image);
+  maskImage->SetRegions(region);
+  maskImage->Allocate();
+  for( itk::ImageRegionIteratorWithIndex<MaskImageType> it(maskImage, region); !it.IsAtEnd(); ++it )
+    {
+    double distance = 0.0;
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      const double extent = region.GetSize()[d];
+      const double center = region.GetIndex()[d] + ( d == 0 ? 0.5 + centerShift : 0.5 ) * extent;
+      const double x = ( it.GetIndex()[d] - center ) / ( 0.4 * extent );
+      distance += x * x;
+      }
+    it.Set(distance <= 1.0 ? 1 : 0);
+    }
+  MaskSpatialObjectType::Pointer mask = MaskSpatialObjectType::New();
+  mask->SetImage(maskImage);
+  mask->Update();
+  return mask;
+}
+
+/** The physical center of the image, used as center of rotation */
+itk::Point<double, 3>
+ImageCenter(const ImageType *image)
+{
+  const ImageType::RegionType region = image->GetLargestPossibleRegion();
+  itk::ContinuousIndex<double, 3> centerIndex;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    centerIndex[d] = region.GetIndex()[d] + 0.5 * ( region.GetSize()[d] - 1 );
+    }
+  itk::Point<double, 3> center;
+  image->TransformContinuousIndexToPhysicalPoint(centerIndex, center);
+  return center;
+}
+
+using BSplineTransformType = itk::BSplineTransform<double, 3, 3>;
+
+/** A cubic BSpline over the fixed image with a mesh of meshSize cells per
+ * dimension (meshSize + 3 control points) and coefficients of up to 1.5 mm */
+BSplineTransformType::Pointer
+CreateBSplineTransform(const ImageType *fixedImage, unsigned int meshSize)
+{
+  BSplineTransformType::Pointer bspline = BSplineTransformType::New();
+
+  using InitializerType = itk::BSplineTransformInitializer<BSplineTransformType, ImageType>;
+  InitializerType::Pointer initializer = InitializerType::New();
+  BSplineTransformType::MeshSizeType meshSizeType;
+  meshSizeType.Fill(meshSize);
+  initializer->SetTransform(bspline);
+  initializer->SetImage(fixedImage);
+  initializer->SetTransformDomainMeshSize(meshSizeType);
+  initializer->InitializeTransform();
+
+  BSplineTransformType::ParametersType parameters( bspline->GetNumberOfParameters() );
+  for( unsigned int p = 0; p < parameters.GetSize(); ++p )
+    {
+    parameters[p] = 1.5 * std::sin(0.37 * p + 0.11 * meshSize);
+    }
+  bspline->SetParametersByValue(parameters);
+  return bspline;
+}
+} // end namespace
+
+int main(int argc, char *argv[])
+{
+  if( argc < 3 )
+    {
+    std::cerr << "Usage: " << argv[0] << " fixedImage movingImage" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  ImageType::Pointer fixedImage;
+  ImageType::Pointer movingImage;
+  try
+    {
+    using ReaderType = itk::ImageFileReader<ImageType>;
+    ReaderType::Pointer fixedReader = ReaderType::New();
+    fixedReader->SetFileName(argv[1]);
+    fixedReader->Update();
+    fixedImage = fixedReader->GetOutput();
+    ReaderType::Pointer movingReader = ReaderType::New();
+    movingReader->SetFileName(argv[2]);
+    movingReader->Update();
+    movingImage = movingReader->GetOutput();
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+  const itk::Point<double, 3> center = ImageCenter(fixedImage);
+
+  MaskSpatialObjectType::Pointer fixedMask;
+  MaskSpatialObjectType::Pointer movingMask;
+  PointSetType::ConstPointer     sampledPointSet;
+  PointSetType::ConstPointer     maskedSampledPointSet;
+  try
+    {
+    fixedMask = CreateEllipsoidMask(fixedImage, 0.0);
+    movingMask = CreateEllipsoidMask(movingImage, 0.15);
+    sampledPointSet = SamplingCacheType::GetSampledPointSet(fixedImage, nullptr, SamplingPercentage);
+    maskedSampledPointSet = SamplingCacheType::GetSampledPointSet(fixedImage, fixedMask, SamplingPercentage);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::vector<Configuration> configurations;
+  configurations.push_back( { "dense", nullptr, nullptr, nullptr } );
+  configurations.push_back( { "sampled", sampledPointSet.GetPointer(), nullptr, nullptr } );
+  configurations.push_back( { "fixed mask", nullptr, fixedMask.GetPointer(), nullptr } );
+  configurations.push_back( { "moving mask", nullptr, nullptr, movingMask.GetPointer() } );
+  configurations.push_back( { "sampled in masks", maskedSampledPointSet.GetPointer(), fixedMask.GetPointer(),
+                              movingMask.GetPointer() } );
+
+  itk::Vector<double, 3> translation;
+  translation[0] = 1.5;
+  translation[1] = -2.0;
+  translation[2] = 0.75;
+  itk::Versor<double> rotation;
+  itk::Versor<double>::VectorType axis;
+  axis[0] = 0.2;
+  axis[1] = -0.5;
+  axis[2] = 1.0;
+  rotation.Set(axis, 0.05);
+
+  bool allPassed = true;
+  try
+    {
+    using VersorRigidTransformType = itk::VersorRigid3DTransform<double>;
+    VersorRigidTransformType::Pointer versorRigid = VersorRigidTransformType::New();
+    versorRigid->SetCenter(center);
+    versorRigid->SetRotation(rotation);
+    versorRigid->SetTranslation(translation);
+    allPassed &= CompareMetricsInConfigurations("VersorRigid3D", fixedImage, movingImage, versorRigid.GetPointer(),
+                                                FastMetricType::LinearFastPath, configurations);
+
+    using ScaleVersorTransformType = itk::ScaleVersor3DTransform<double>;
+    ScaleVersorTransformType::Pointer scaleVersor = ScaleVersorTransformType::New();
+    ScaleVersorTransformType::ScaleVectorType scale;
+    scale[0] = 1.04;
+    scale[1] = 0.97;
+    scale[2] = 1.02;
+    scaleVersor->SetCenter(center);
+    scaleVersor->SetRotation(rotation);
+    scaleVersor->SetScale(scale);
+    scaleVersor->SetTranslation(translation);
+    allPassed &= CompareMetricsInConfigurations("ScaleVersor3D", fixedImage, movingImage, scaleVersor.GetPointer(),
+                                                FastMetricType::LinearFastPath, configurations);
+
+    using AffineTransformType = itk::AffineTransform<double, 3>;
+    AffineTransformType::Pointer affine = AffineTransformType::New();
+    AffineTransformType::MatrixType matrix = scaleVersor->GetMatrix();
+    matrix[0][1] += 0.03;
+    matrix[2][0] -= 0.02;
+    affine->SetCenter(center);
+    affine->SetMatrix(matrix);
+    affine->SetTranslation(translation);
+    allPassed &= CompareMetricsInConfigurations("Affine", fixedImage, movingImage, affine.GetPointer(),
+                                                FastMetricType::LinearFastPath, configurations);
+
+    const unsigned int meshSizes[] = { 5, 11 };
+    for( const unsigned int meshSize : meshSizes )
+      {
+      const std::string gridName = std::to_string(meshSize + 3) + "x" + std::to_string(meshSize + 3) + "x"
+        + std::to_string(meshSize + 3);
+      BSplineTransformType::Pointer bspline = CreateBSplineTransform(fixedImage, meshSize);
+      allPassed &= CompareMetricsInConfigurations("BSpline " + gridName, fixedImage, movingImage,
+                                                  bspline.GetPointer(), FastMetricType::BSplineFastPath,
+                                                  configurations);
+
+      // The BSpline stage optimizes the BSpline behind the linear transforms
+      // of the earlier stages.
+      using CompositeTransformType = itk::CompositeTransform<double, 3>;
+      CompositeTransformType::Pointer composite = CompositeTransformType::New();
+      composite->AddTransform(versorRigid);
+      composite->AddTransform(bspline);
+      composite->SetOnlyMostRecentTransformToOptimizeOn();
+      allPassed &= CompareMetricsInConfigurations("Rigid and BSpline " + gridName, fixedImage, movingImage,
+                                                  composite.GetPointer(), FastMetricType::BSplineFastPath,
+                                                  configurations);
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,260 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Compares LargestForegroundFilledMaskImageFilter with the closing it stands
+// for, on an anisotropic two valued image: the largest component, dilated
+// and then eroded by a BinaryBallStructuringElement of ClosingSize / spacing
+// voxels along each axis (rounded up), with the holes that do not reach the
+// image corners filled.
+//
+// With UseResultCache on, a second request for the same pixels must be a
+// copy of the first mask (the filter does not threshold again), and a write
+// through the buffer pointer, which leaves the modified time unchanged, must
+// give a new mask.
+//
+
+#include "itkLargestForegroundFilledMaskImageFilter.h"
+#include "itkBinaryBallStructuringElement.h"
+#include "itkBinaryDilateImageFilter.h"
+#include "itkBinaryErodeImageFilter.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkConnectedComponentImageFilter.h"
+#include "itkConnectedThresholdImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkRelabelComponentImageFilter.h"
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+using ImageType = itk::Image<short, 3>;
+using MaskImageType = itk::Image<unsigned char, 3>;
+using IntegerImageType = itk::Image<unsigned short, 3>;
+using MaskFilterType = itk::LargestForegroundFilledMaskImageFilter<ImageType, MaskImageType>;
+
+constexpr double ClosingSize = 3.0;
+
+/** A shell with a closed cavity and a notch narrower than the closing ball,
+ * and a small separate blob, at 100 on a background of 0. */
+ImageType::Pointer
+CreateInputImage()
+{
+  ImageType::SizeType size;
+  size[0] = 48;
+  size[1] = 44;
+  size[2] = 30;
+  ImageType::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 1.0;
+  spacing[2] = 2.0;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->SetSpacing( spacing );
+  image->Allocate();
+
+  for( itk::ImageRegionIteratorWithIndex<ImageType> it( image, image->GetLargestPossibleRegion() ); !it.IsAtEnd();
+       ++it )
+    {
+    const ImageType::IndexType index = it.GetIndex();
+    const double               x = ( index[0] - 22.0 ) / 14.0;
+    const double               y = ( index[1] - 21.0 ) / 12.0;
+    const double               z = ( index[2] - 15.0 ) / 8.0;
+    const double               r = x * x + y * y + z * z;
+    const bool                 shell = r <= 1.0 && r >= 0.3;
+    const bool                 notch = index[0] >= 21 && index[0] <= 22 && index[1] > 21;
+    const bool                 blob = ( index[0] - 42 ) * ( index[0] - 42 ) + ( index[1] - 5 ) * ( index[1] - 5 )
+      + ( index[2] - 4 ) * ( index[2] - 4 ) <= 4;
+    it.Set( ( shell && !notch ) || blob ? 100 : 0 );
+    }
+  return image;
+}
+
+/** The largest component of image >= 100 closed by a ball and hole filled */
+MaskImageType::Pointer
+ReferenceMask(const ImageType *image)
+{
+  using ThresholdType = itk::BinaryThresholdImageFilter<ImageType, IntegerImageType>;
+  ThresholdType::Pointer threshold = ThresholdType::New();
+  threshold->SetInput( image );
+  threshold->SetLowerThreshold( 100 );
+  threshold->SetInsideValue( 1 );
+  threshold->SetOutsideValue( 0 );
+
+  using ComponentsType = itk::ConnectedComponentImageFilter<IntegerImageType, IntegerImageType>;
+  ComponentsType::Pointer components = ComponentsType::New();
+  components->SetInput( threshold->GetOutput() );
+  using RelabelType = itk::RelabelComponentImageFilter<IntegerImageType, IntegerImageType>;
+  RelabelType::Pointer relabel = RelabelType::New();
+  relabel->SetInput( components->GetOutput() );
+  using LargestType = itk::BinaryThresholdImageFilter<IntegerImageType, IntegerImageType>;
+  LargestType::Pointer largest = LargestType::New();
+  largest->SetInput( relabel->GetOutput() );
+  largest->SetLowerThreshold( 1 );
+  largest->SetUpperThreshold( 1 );
+  largest->SetInsideValue( 1 );
+  largest->SetOutsideValue( 0 );
+
+  using BallType = itk::BinaryBallStructuringElement<IntegerImageType::PixelType, 3>;
+  BallType            ball;
+  BallType::SizeType  ballRadius;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    ballRadius[d] = static_cast<itk::SizeValueType>( std::ceil( ClosingSize / image->GetSpacing()[d] ) );
+    }
+  ball.SetRadius( ballRadius );
+  ball.CreateStructuringElement();
+  using DilateType = itk::BinaryDilateImageFilter<IntegerImageType, IntegerImageType, BallType>;
+  DilateType::Pointer dilate = DilateType::New();
+  dilate->SetInput( largest->GetOutput() );
+  dilate->SetKernel( ball );
+  dilate->SetDilateValue( 1 );
+  using ErodeType = itk::BinaryErodeImageFilter<IntegerImageType, IntegerImageType, BallType>;
+  ErodeType::Pointer erode = ErodeType::New();
+  erode->SetInput( dilate->GetOutput() );
+  erode->SetKernel( ball );
+  erode->SetErodeValue( 1 );
+
+  using FillType = itk::ConnectedThresholdImageFilter<IntegerImageType, IntegerImageType>;
+  FillType::Pointer outside = FillType::New();
+  outside->SetInput( erode->GetOutput() );
+  const ImageType::RegionType region = image->GetLargestPossibleRegion();
+  for( unsigned int corner = 0; corner < 8; ++corner )
+    {
+    IntegerImageType::IndexType seed = region.GetIndex();
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      if( corner & ( 1U << d ) )
+        {
+        seed[d] = region.GetUpperIndex()[d];
+        }
+      }
+    outside->AddSeed( seed );
+    }
+  outside->SetLower( 0 );
+  outside->SetUpper( 0 );
+  outside->SetReplaceValue( 100 );
+  outside->Update();
+
+  MaskImageType::Pointer mask = MaskImageType::New();
+  mask->CopyInformation( image );
+  mask->SetRegions( region );
+  mask->Allocate();
+  itk::ImageRegionConstIterator<IntegerImageType> outsideIt( outside->GetOutput(), region );
+  for( itk::ImageRegionIterator<MaskImageType> it( mask, region ); !it.IsAtEnd(); ++it, ++outsideIt )
+    {
+    it.Set( outsideIt.Get() == 100 ? 0 : 1 );
+    }
+  return mask;
+}
+
+/** The mask of image, and whether the filter computed it (it prints its
+ * thresholds) rather than copying it from the cache */
+MaskImageType::Pointer
+ComputeMask(const ImageType *image, const bool useResultCache, bool & computed)
+{
+  MaskFilterType::Pointer filter = MaskFilterType::New();
+  filter->SetInput( image );
+  filter->SetClosingSize( ClosingSize );
+  filter->SetUseResultCache( useResultCache );
+
+  std::ostringstream report;
+  std::streambuf *   coutBuffer = std::cout.rdbuf( report.rdbuf() );
+  try
+    {
+    filter->Update();
+    }
+  catch( ... )
+    {
+    std::cout.rdbuf( coutBuffer );
+    throw;
+    }
+  std::cout.rdbuf( coutBuffer );
+  computed = report.str().find( "LowHigh Thresholds" ) != std::string::npos;
+  return filter->GetOutput();
+}
+
+itk::SizeValueType
+CountDifferences(const MaskImageType *a, const MaskImageType *b)
+{
+  itk::SizeValueType                           differences = 0;
+  itk::ImageRegionConstIterator<MaskImageType> bIt( b, b->GetLargestPossibleRegion() );
+  for( itk::ImageRegionConstIterator<MaskImageType> aIt( a, a->GetLargestPossibleRegion() ); !aIt.IsAtEnd();
+       ++aIt, ++bIt )
+    {
+    differences += ( aIt.Get() != 0 ) != ( bIt.Get() != 0 ) ? 1 : 0;
+    }
+  return differences;
+}
+} // end namespace
+
+int main(int, char *[])
+{
+  bool allPassed = true;
+  try
+    {
+    const ImageType::Pointer image = CreateInputImage();
+    bool                     computed = false;
+
+    const MaskImageType::Pointer uncached = ComputeMask( image, false, computed );
+    const itk::SizeValueType     closingDifferences = CountDifferences( uncached, ReferenceMask( image ) );
+    std::cout << "Closing: " << closingDifferences << " voxels differ from the ball closing" << std::endl;
+    allPassed &= closingDifferences == 0;
+
+    const MaskImageType::Pointer first = ComputeMask( image, true, computed );
+    const MaskImageType::Pointer second = ComputeMask( image, true, computed );
+    if( computed || CountDifferences( first, second ) != 0 || CountDifferences( first, uncached ) != 0 )
+      {
+      std::cerr << "The cached mask is not reused for the same pixels" << std::endl;
+      allPassed = false;
+      }
+
+    // Remove the top of the shell in place, opening the cavity.
+    const itk::ModifiedTimeType mtime = image->GetMTime();
+    for( itk::ImageRegionIteratorWithIndex<ImageType> it( image, image->GetLargestPossibleRegion() ); !it.IsAtEnd();
+         ++it )
+      {
+      if( it.GetIndex()[2] >= 17 )
+        {
+        it.Set( 0 );
+        }
+      }
+    const MaskImageType::Pointer changed = ComputeMask( image, true, computed );
+    if( image->GetMTime() != mtime )
+      {
+      std::cerr << "Writing the pixels changed the modified time, the test is not meaningful" << std::endl;
+      allPassed = false;
+      }
+    if( !computed || CountDifferences( changed, ComputeMask( image, false, computed ) ) != 0
+        || CountDifferences( changed, first ) == 0 )
+      {
+      std::cerr << "A stale mask is returned after the pixels changed in place" << std::endl;
+      allPassed = false;
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,205 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __VectorImageComponents_h
+#define __VectorImageComponents_h
+
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * Component access for vector (DWI) images without a filter per component.
+ *
+ * A ComponentView addresses one component of a fully buffered image in
+ * place: component c of a VectorImage starts at buffer + c with a stride of
+ * the vector length, volume c of a 4D scalar series starts at
+ * buffer + c * volumeSize with a stride of 1.  GatherComponents and
+ * AverageComponents read any list of views in a single pass over the
+ * pixels and write an interleaved (VectorImage layout) destination, so
+ * selecting, concatenating or averaging gradient volumes copies each voxel
+ * once.
+ */
+namespace BRAINSUtils
+{
+template <typename TPixel>
+struct ComponentView
+  {
+  const TPixel *Buffer;
+  size_t        Stride;
+  };
+
+/** Pixels processed by one task of the gather kernels */
+constexpr size_t ComponentBlockSize = 4096;
+
+/** View of component index of a fully buffered VectorImage */
+template <typename TPixel, unsigned int VDimension>
+ComponentView<TPixel>
+GetComponentView(const itk::VectorImage<TPixel, VDimension> *image, const unsigned int index)
+{
+  if( index >= image->GetNumberOfComponentsPerPixel() )
+    {
+    itkGenericExceptionMacro(<< "Component " << index << " requested from an image with "
+                             << image->GetNumberOfComponentsPerPixel() << " components");
+    }
+  if( image->GetBufferedRegion() != image->GetLargestPossibleRegion() )
+    {
+    itkGenericExceptionMacro(<< "Components can only be viewed in a fully buffered image");
+    }
+  ComponentView<TPixel> view;
+  view.Buffer = image->GetBufferPointer() + index;
+  view.Stride = image->GetNumberOfComponentsPerPixel();
+  return view;
+}
+
+/** Views of every component of a fully buffered VectorImage, in order */
+template <typename TPixel, unsigned int VDimension>
+std::vector<ComponentView<TPixel> >
+GetComponentViews(const itk::VectorImage<TPixel, VDimension> *image)
+{
+  std::vector<ComponentView<TPixel> > views;
+  for( unsigned int i = 0; i < image->GetNumberOfComponentsPerPixel(); ++i )
+    {
+    views.push_back( GetComponentView(image, i) );
+    }
+  return views;
+}
+
+/** destination[p * N + k] = views[k] at pixel p, with N = views.size().
+ * With a single view the destination is a scalar image buffer. */
+template <typename TPixel, typename TOutputPixel>
+void
+GatherComponents(const std::vector<ComponentView<TPixel> > & views, const size_t numberOfPixels,
+                 TOutputPixel *destination)
+{
+  const size_t numberOfComponents = views.size();
+  const size_t numberOfBlocks = ( numberOfPixels + ComponentBlockSize - 1 ) / ComponentBlockSize;
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfBlocks,
+                        [&](itk::SizeValueType block)
+                          {
+                            const size_t start = block * ComponentBlockSize;
+                            const size_t end = std::min( numberOfPixels, start + ComponentBlockSize );
+                            for( size_t k = 0; k < numberOfComponents; ++k )
+                              {
+                              const TPixel *source = views[k].Buffer + start * views[k].Stride;
+                              const size_t  stride = views[k].Stride;
+                              TOutputPixel *out = destination + start * numberOfComponents + k;
+                              for( size_t p = start; p < end; ++p, source += stride, out += numberOfComponents )
+                                {
+                                *out = static_cast<TOutputPixel>( *source );
+                                }
+                              }
+                          },
+                        nullptr );
+}
+
+/** destination[p * N + g] is the mean of the views of groups[g] at pixel p,
+ * summed in TAccumulate in the order they are listed. */
+template <typename TAccumulate, typename TPixel, typename TOutputPixel>
+void
+AverageComponents(const std::vector<std::vector<ComponentView<TPixel> > > & groups, const size_t numberOfPixels,
+                  TOutputPixel *destination)
+{
+  const size_t numberOfGroups = groups.size();
+  const size_t numberOfBlocks = ( numberOfPixels + ComponentBlockSize - 1 ) / ComponentBlockSize;
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfBlocks,
+                        [&](itk::SizeValueType block)
+                          {
+                            const size_t start = block * ComponentBlockSize;
+                            const size_t end = std::min( numberOfPixels, start + ComponentBlockSize );
+                            std::vector<TAccumulate> sums( end - start );
+                            for( size_t g = 0; g < numberOfGroups; ++g )
+                              {
+                              std::fill( sums.begin(), sums.end(), TAccumulate( 0 ) );
+                              for( const auto & view : groups[g] )
+                                {
+                                const TPixel *source = view.Buffer + start * view.Stride;
+                                for( size_t p = 0; p < sums.size(); ++p, source += view.Stride )
+                                  {
+                                  sums[p] += static_cast<TAccumulate>( *source );
+                                  }
+                                }
+                              const TAccumulate count = static_cast<TAccumulate>( groups[g].size() );
+                              TOutputPixel *    out = destination + start * numberOfGroups + g;
+                              for( size_t p = 0; p < sums.size(); ++p, out += numberOfGroups )
+                                {
+                                *out = static_cast<TOutputPixel>( sums[p] / count );
+                                }
+                              }
+                          },
+                        nullptr );
+}
+
+/** Volume index of a fully buffered series (the last axis indexes the
+ * volumes), as an image that shares the series buffer.  The series must
+ * outlive the returned image.  Like ExtractImageFilter with
+ * DirectionCollapseToIdentity, the volume keeps the spacing, origin and
+ * start index of the first VDimension axes and has an identity direction. */
+template <typename TPixel, unsigned int VDimension>
+typename itk::Image<TPixel, VDimension>::Pointer
+GetSeriesVolume(const itk::Image<TPixel, VDimension + 1> *series, const itk::IndexValueType index)
+{
+  using SeriesType = itk::Image<TPixel, VDimension + 1>;
+  using VolumeType = itk::Image<TPixel, VDimension>;
+
+  const typename SeriesType::RegionType & seriesRegion = series->GetBufferedRegion();
+  if( seriesRegion != series->GetLargestPossibleRegion() )
+    {
+    itkGenericExceptionMacro(<< "Series volumes can only be viewed in a fully buffered series");
+    }
+  const itk::IndexValueType firstVolume = seriesRegion.GetIndex()[VDimension];
+  const itk::IndexValueType numberOfVolumes = seriesRegion.GetSize()[VDimension];
+  if( index < firstVolume || index >= firstVolume + numberOfVolumes )
+    {
+    itkGenericExceptionMacro(<< "Volume " << index << " is outside the series");
+    }
+
+  typename VolumeType::RegionType    region;
+  typename VolumeType::SpacingType   spacing;
+  typename VolumeType::PointType     origin;
+  typename VolumeType::DirectionType direction;
+  direction.SetIdentity();
+  for( unsigned int d = 0; d < VDimension; ++d )
+    {
+    region.SetIndex( d, seriesRegion.GetIndex()[d] );
+    region.SetSize( d, seriesRegion.GetSize()[d] );
+    spacing[d] = series->GetSpacing()[d];
+    origin[d] = series->GetOrigin()[d];
+    }
+
+  const size_t                 volumeSize = region.GetNumberOfPixels();
+  typename VolumeType::Pointer volume = VolumeType::New();
+  volume->SetRegions( region );
+  volume->SetSpacing( spacing );
+  volume->SetOrigin( origin );
+  volume->SetDirection( direction );
+  // The volume does not own the memory, the series buffer is not released with it.
+  volume->GetPixelContainer()->SetImportPointer(
+    const_cast<TPixel *>( series->GetBufferPointer() ) + ( index - firstVolume ) * volumeSize, volumeSize, false );
+  return volume;
+}
+} // end namespace BRAINSUtils
+
+#endif // __VectorImageComponents_h
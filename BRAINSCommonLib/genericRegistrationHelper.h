@@ -34,6 +34,7 @@
 #define __genericRegistrationHelper_h
 
 #include "BRAINSCommonLib.h"
+#include "BRAINSMacro.h"
 
 #include "itkImageToImageMetricv4.h"
 #include "itkMattesMutualInformationImageToImageMetricv4.h"
@@ -493,6 +494,14 @@ public:
   itkSetMacro(SamplingStrategy,SamplingStrategyType);
   itkGetConstMacro(SamplingStrategy,SamplingStrategyType);
 
+  /** Shrink factors and smoothing sigmas (in mm) of the resolution levels,
+    * coarsest first.  Both must have the same length, the default is a
+    * single full resolution level. */
+  VECTORitkSetMacro(ShrinkFactors, std::vector<unsigned int> );
+  VECTORitkGetConstMacro(ShrinkFactors, std::vector<unsigned int> );
+  VECTORitkSetMacro(SmoothingSigmas, std::vector<double> );
+  VECTORitkGetConstMacro(SmoothingSigmas, std::vector<double> );
+
   /** Returns the transform resulting from the registration process  */
   const TransformOutputType * GetOutput() const;
 
@@ -550,6 +559,9 @@ private:
 
   SamplingStrategyType m_SamplingStrategy;
 
+  std::vector<unsigned int> m_ShrinkFactors;
+  std::vector<double>       m_SmoothingSigmas;
+
   ModifiedTimeType m_InternalTransformTime;
 };
 } // end namespace itk
@@ -91,6 +91,8 @@ MultiModal3DMutualRegistrationHelper<TTransformType, TOptimizer, TFixedImage,
   m_FinalMetricValue(0),
   m_ObserveIterations(true),
   m_SamplingStrategy(AffineRegistrationType::NONE),
+  m_ShrinkFactors(1, 1),
+  m_SmoothingSigmas(1, 0.0),
   m_InternalTransformTime(0)
 {
   this->SetNumberOfRequiredOutputs(1);    // for the Transform
@@ -305,47 +307,31 @@ MultiModal3DMutualRegistrationHelper<TTransformType, TOptimizer, TFixedImage,
   m_Registration->SetMetric(this->m_CostMetricObject);
   m_Registration->SetOptimizer(optimizer);
 
-////////////////////////HARD CODED PART//////////////////////
-  constexpr unsigned int numberOfLevels = 1;
+  if( m_ShrinkFactors.empty() || m_ShrinkFactors.size() != m_SmoothingSigmas.size() )
+    {
+    itkExceptionMacro(<< "ShrinkFactors and SmoothingSigmas must have the same, non zero, number of levels");
+    }
+  const unsigned int numberOfLevels = m_ShrinkFactors.size();
 
   m_Registration->SetNumberOfLevels( numberOfLevels );
 
-  std::vector<unsigned int>  factors( numberOfLevels );
-  factors[0] = 1;
   using ShrinkFactorsPerDimensionContainerType = typename RegistrationType::ShrinkFactorsPerDimensionContainerType;
-  std::vector<ShrinkFactorsPerDimensionContainerType> shrinkFactorsPerDimensionForAllLevels;
-  for( unsigned int n = 0; n < numberOfLevels; n++ )
-    {
-    ShrinkFactorsPerDimensionContainerType shrinkFactorsPerDimension(3);
-    shrinkFactorsPerDimension.Fill(0);
-    for (unsigned int d = 0; d <  3; ++d) // here we set all dimensions have the same shrink factor
-      {
-      shrinkFactorsPerDimension[d] = factors[n];
-      }
-    shrinkFactorsPerDimensionForAllLevels.push_back( shrinkFactorsPerDimension );
-#if 0
-    std::cout << "  Shrink factors (level " << n+1 << " out of " << numberOfLevels << "): " << shrinkFactorsPerDimension << std::endl;
-#endif
-    }
-
-   // Get smoothing sigmas
-  std::vector<float> sigmas( numberOfLevels );
-  sigmas[0] = 0;
   typename RegistrationType::SmoothingSigmasArrayType smoothingSigmasPerLevel;
-  smoothingSigmasPerLevel.SetSize( sigmas.size() );
-  for( unsigned int n = 0; n < smoothingSigmasPerLevel.Size(); n++ )
-    {
-    smoothingSigmasPerLevel[n] = sigmas[n];
-    }
-
-  // set smoothing sigma and shrink factors
+  smoothingSigmasPerLevel.SetSize( numberOfLevels );
   for( unsigned int level = 0; level < numberOfLevels; ++level )
     {
-    m_Registration->SetShrinkFactorsPerDimension( level, shrinkFactorsPerDimensionForAllLevels[level] );
+    if( m_ShrinkFactors[level] < 1 || m_SmoothingSigmas[level] < 0.0 )
+      {
+      itkExceptionMacro(<< "Invalid shrink factor " << m_ShrinkFactors[level]
+                        << " or smoothing sigma " << m_SmoothingSigmas[level] << " at level " << level);
+      }
+    ShrinkFactorsPerDimensionContainerType shrinkFactorsPerDimension;
+    shrinkFactorsPerDimension.Fill( m_ShrinkFactors[level] );
+    m_Registration->SetShrinkFactorsPerDimension( level, shrinkFactorsPerDimension );
+    smoothingSigmasPerLevel[level] = m_SmoothingSigmas[level];
     }
   m_Registration->SetSmoothingSigmasPerLevel( smoothingSigmasPerLevel );
   m_Registration->SetSmoothingSigmasAreSpecifiedInPhysicalUnits( true );
-////////////////////////////////////////////////////////////
 
   m_Registration->SetMetricSamplingStrategy(
                 static_cast<typename RegistrationType::MetricSamplingStrategyType>( m_SamplingStrategy ));
@@ -687,6 +673,18 @@ MultiModal3DMutualRegistrationHelper<TTransformType, TOptimizer, TFixedImage,
     os << indent << "Fixed Image2: IS NULL" << std::endl;
     os << indent << "Moving Image2: IS NULL" << std::endl;
     }
+  os << indent << "ShrinkFactors:";
+  for( const auto & factor : m_ShrinkFactors )
+    {
+    os << " " << factor;
+    }
+  os << std::endl;
+  os << indent << "SmoothingSigmas:";
+  for( const auto & sigma : m_SmoothingSigmas )
+    {
+    os << " " << sigma;
+    }
+  os << std::endl;
 }
 } // end namespace itk
 
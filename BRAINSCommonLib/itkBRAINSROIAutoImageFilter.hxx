@@ -72,6 +72,8 @@ BRAINSROIAutoImageFilter<TInputImage, TOutputImage>
   LFF->SetClosingSize(m_ClosingSize);
   LFF->SetDilateSize(m_DilateSize);
   LFF->SetThresholdCorrectionFactor(m_ThresholdCorrectionFactor);
+  // BRAINSABC and the registration helpers ask for the same ROI repeatedly.
+  LFF->UseResultCacheOn();
   LFF->Update();
   this->GraftOutput( LFF->GetOutput() );
 }
@@ -89,14 +89,20 @@ namespace itk
  * \li<a href="splweb.bwh.harvard.edu:8000/pages/papers/westin/ISMRM2002.pdf">[2]</a>
  * <em>A Dual Tensor Basis Solution to the Stejskal-Tanner Equations for DT-MRI</em>
  *
- * \par WARNING:
- * Although this filter has been written to support multiple threads, please
- * set the number of threads to 1.
- * \code
- *         filter->SetNumberOfWorkUnits(1);
- * \endcode
- * This is due to buggy code in netlib/dsvdc, that is called by vnl_svd.
- * (used to compute the psudo-inverse to find the dual tensor basis).
+ * \par Fitting methods
+ * \li LinearLeastSquares - the default, log-linear least squares fit.
+ * \li WeightedLinearLeastSquares - the log-linear fit weighted by the squared
+ * signal predicted from the linear fit (WLLS, Salvador et al. 2005).
+ * \li IterativeWeightedLinearLeastSquares - WLLS repeated
+ * NumberOfIterations times, re-estimating the weights from the previous fit.
+ *
+ * \par Implementation
+ * The pseudo-inverse of the design matrix is computed once (vnl_svd is only
+ * called from BeforeThreadedGenerateData, so the filter is safe to run with
+ * multiple threads).  Each thread collects BatchSize unmasked voxels and
+ * solves them together with one small matrix product; the weighted fits form
+ * their 6x6 normal equations for the whole batch with matrix products as well,
+ * leaving only a 6x6 Cholesky solve per voxel.
  *
  * \author Thanks to Xiaodong Tao, GE, for contributing parts of this class. Also
  * thanks to Casey Goodlet, UNC for patches to support multiple baseline images
@@ -247,6 +253,24 @@ public:
 #endif
   itkGetConstReferenceMacro( BValue, TTensorPixelType);
 
+  /** Estimator used to fit the tensor to the log signal */
+  typedef enum
+    {
+    LinearLeastSquares = 0,
+    WeightedLinearLeastSquares,
+    IterativeWeightedLinearLeastSquares
+    } FittingMethodEnumeration;
+
+  itkSetMacro( FittingMethod, FittingMethodEnumeration );
+  itkGetConstMacro( FittingMethod, FittingMethodEnumeration );
+
+  /** Number of weight updates for IterativeWeightedLinearLeastSquares */
+  itkSetMacro( NumberOfIterations, unsigned int );
+  itkGetConstMacro( NumberOfIterations, unsigned int );
+
+  /** Number of voxels fitted together by one matrix product */
+  static constexpr unsigned int BatchSize = 64;
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Begin concept checking */
   itkConceptMacro(ReferenceEqualityComparableCheck,
@@ -280,6 +304,16 @@ protected:
   void ThreadedGenerateData( const
                              OutputImageRegionType &outputRegionForThread, ThreadIdType ) override;
 
+  /** Fit the first numberOfVoxels columns of logSignal (one column of
+   * -log(S/S0)/b per voxel) and store the tensors through targets. */
+  void FitBatch( const vnl_matrix<double> & logSignal, unsigned int numberOfVoxels,
+                 TensorPixelType * const *targets ) const;
+
+  /** Solve the symmetric positive definite 6x6 system given by its packed
+   * upper triangle.  Returns false, leaving solution untouched, when the
+   * matrix is not positive definite. */
+  static bool SolveNormalEquations( const double *packed, const double *rhs, double *solution );
+
   /** enum to indicate if the gradient image is specified as a single multi-
    * component image or as several separate images */
   typedef enum
@@ -295,6 +329,17 @@ private:
 
   CoefficientMatrixType m_BMatrix;
 
+  /** Transposed (N x 6) pseudo-inverse of the design matrix, factored once
+   * per update */
+  CoefficientMatrixType m_PseudoInverse;
+
+  /** N x 6 design matrix, one row per gradient direction */
+  CoefficientMatrixType m_DesignMatrix;
+
+  /** N x 21 upper triangles of the per-gradient outer products b_i b_i^T,
+   * used to build the weighted normal equations for a batch */
+  CoefficientMatrixType m_BOuterProducts;
+
   /** container to hold gradient directions */
   GradientDirectionContainerType::Pointer m_GradientDirectionContainer;
 
@@ -313,6 +358,10 @@ private:
   /** Gradient image was specified in a single image or in multiple images */
   GradientImageTypeEnumeration m_GradientImageTypeEnumeration;
 
+  FittingMethodEnumeration m_FittingMethod;
+
+  unsigned int m_NumberOfIterations;
+
   /** Mask Image */
   MaskImageType::ConstPointer m_MaskImage;
 };
@@ -25,6 +25,7 @@
 #include "itkImageRegionIterator.h"
 #include "itkArray.h"
 #include "vnl/vnl_vector.h"
+#include <algorithm>
 
 namespace itk
 {
@@ -38,16 +39,15 @@ DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType,
   m_NumberOfBaselineImages(1),
   m_Threshold(NumericTraits<ReferencePixelType>::min() ),
   m_BValue(1.0),
-  m_GradientImageTypeEnumeration(Else)
+  m_GradientImageTypeEnumeration(Else),
+  m_FittingMethod(LinearLeastSquares),
+  m_NumberOfIterations(3)
 {
   // At least 1 inputs is necessary for a vector image.
   // For images added one at a time we need at least six
   this->SetNumberOfRequiredInputs( 1 );
   m_TensorBasis.set_identity();
-
-  // This is due to buggy code in netlib/dsvdc, that is called by vnl_svd.
-  // (used to compute the psudo-inverse to find the dual tensor basis).
-  this->SetNumberOfWorkUnits(1);
+  this->DynamicMultiThreadingOff();  //NEEDED FOR ITKv5 backwards compatibility
 }
 
 template <typename TReferenceImagePixelType,
@@ -117,10 +117,6 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
   this->ComputeTensorBasis();
 }
 
-// POTENTIAL WARNING:
-//
-// Until we fix netlib svd routines, we will need to set the number of thread
-// to 1.
 template <typename TReferenceImagePixelType,
           typename TGradientImagePixelType, typename TTensorPixelType>
 void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType,
@@ -134,8 +130,32 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
   ImageRegionIterator<OutputImageType> oit(outputImage, outputRegionForThread);
   oit.GoToBegin();
 
-  vnl_vector<double> B(m_NumberOfGradientDirections);
-  vnl_vector<double> D(6);
+  const unsigned int numberOfGradients = m_NumberOfGradientDirections;
+  const double       inverseBValue = 1.0 / this->m_BValue;
+
+  // Unmasked voxels are gathered one row per voxel and fitted BatchSize at a
+  // time.  ratios holds S/S0 for the voxel being gathered.
+  vnl_matrix<double>  logSignal(BatchSize, numberOfGradients);
+  std::vector<double> ratios(numberOfGradients);
+  TensorPixelType *   targets[BatchSize];
+  unsigned int        batchCount = 0;
+
+  const TensorPixelType zeroTensor(0.0);
+  auto                  addVoxel = [&]()
+    {
+      // Contiguous loop over one row, so the log is vectorizable.
+      double *row = logSignal[batchCount];
+      for( unsigned int i = 0; i < numberOfGradients; ++i )
+        {
+        row[i] = ( ratios[i] > 0.0 ) ? -std::log(ratios[i]) * inverseBValue : 0.0;
+        }
+      targets[batchCount] = &( oit.Value() );
+      if( ++batchCount == BatchSize )
+        {
+        this->FitBatch(logSignal, batchCount, targets);
+        batchCount = 0;
+        }
+    };
 
   // if a mask is present, iterate through mask image and skip zero voxels
   bool useMask(this->m_MaskImage.IsNotNull() );
@@ -164,8 +184,9 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
     it.GoToBegin();
 
     using GradientIteratorType = ImageRegionConstIterator<GradientImageType>;
-    std::vector<GradientIteratorType *> gradientItContainer;
-    for( unsigned int i = 1; i <= m_NumberOfGradientDirections; ++i )
+    std::vector<GradientIteratorType> gradientItContainer;
+    gradientItContainer.reserve(numberOfGradients);
+    for( unsigned int i = 1; i <= numberOfGradients; ++i )
       {
       // Would have liked a dynamic_cast here, but seems SGI doesn't like it
       // The enum will ensure that an inappropriate cast is not done
@@ -176,10 +197,8 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
         itkGenericExceptionMacro(<< "Failed conversion to Gradient Image");
         }
 
-      GradientIteratorType *git = new GradientIteratorType(
-          gradientImagePointer, outputRegionForThread );
-      git->GoToBegin();
-      gradientItContainer.push_back(git);
+      gradientItContainer.emplace_back( gradientImagePointer, outputRegionForThread );
+      gradientItContainer.back().GoToBegin();
       }
 
     // Iterate over the reference and gradient images and solve the steskal
@@ -204,59 +223,23 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
           }
         ++maskIt;
         }
-      TensorPixelType tensor(0.0);
 
+      oit.Set( zeroTensor );
       if( (b0 != 0) && unmaskedPixel && (b0 >= m_Threshold) )
         {
-        for( unsigned int i = 0; i < m_NumberOfGradientDirections; ++i )
-          {
-          GradientPixelType b = gradientItContainer[i]->Get();
-
-          if( b == 0 )
-            {
-            B[i] = 0;
-            }
-          else
-            {
-            B[i] = -std::log( static_cast<double>(b) / static_cast<double>(b0) ) / this->m_BValue;
-            }
-
-          ++(*gradientItContainer[i]);
-          }
-
-        vnl_svd<double> pseudoInverseSolver( m_TensorBasis );
-        if( m_NumberOfGradientDirections > 6 )
-          {
-          D = pseudoInverseSolver.solve( m_BMatrix * B );
-          }
-        else
+        for( unsigned int i = 0; i < numberOfGradients; ++i )
           {
-          D = pseudoInverseSolver.solve( B );
+          ratios[i] = static_cast<double>( gradientItContainer[i].Get() ) / static_cast<double>(b0);
           }
-
-        tensor(0, 0) = D[0];
-        tensor(0, 1) = D[1];
-        tensor(0, 2) = D[2];
-        tensor(1, 1) = D[3];
-        tensor(1, 2) = D[4];
-        tensor(2, 2) = D[5];
+        addVoxel();
         }
-      else
+      for( unsigned int i = 0; i < numberOfGradients; ++i )
         {
-        for( unsigned int i = 0; i < m_NumberOfGradientDirections; ++i )
-          {
-          ++(*gradientItContainer[i]);
-          }
+        ++gradientItContainer[i];
         }
-
-      oit.Set( tensor );
       ++oit;
       ++it;
       }
-    for( unsigned int i = 0; i < gradientItContainer.size(); ++i )
-      {
-      delete gradientItContainer[i];
-      }
     }
   // The gradients are specified in a single multi-component image
   else if( m_GradientImageTypeEnumeration == GradientIsInASingleImage )
@@ -293,7 +276,7 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
 
     while( !git.IsAtEnd() )
       {
-      GradientVectorType b = git.Get();
+      const GradientVectorType b = git.Get();
 
       typename NumericTraits<ReferencePixelType>::AccumulateType b0 = NumericTraits<ReferencePixelType>::ZeroValue();
       // Average the baseline image pixels
@@ -303,8 +286,6 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
         }
       b0 /= this->m_NumberOfBaselineImages;
 
-      TensorPixelType tensor(0.0);
-
       //
       // if a mask is present, and we don't have a zero pixel
       // look up the voxel in the mask image corresponding to
@@ -319,43 +300,150 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
         ++maskIt;
         }
 
+      oit.Set( zeroTensor );
       if( (b0 != 0) && unmaskedPixel && (b0 >= m_Threshold) )
         {
-        for( unsigned int i = 0; i < m_NumberOfGradientDirections; ++i )
+        const double inverseB0 = 1.0 / static_cast<double>(b0);
+        for( unsigned int i = 0; i < numberOfGradients; ++i )
           {
-          if( b[gradientind[i]] == 0 )
-            {
-            B[i] = 0;
-            }
-          else
-            {
-            B[i] = -std::log( static_cast<double>(b[gradientind[i]]) / static_cast<double>(b0) ) / this->m_BValue;
-            }
+          ratios[i] = static_cast<double>(b[gradientind[i]]) * inverseB0;
           }
+        addVoxel();
+        }
 
-        vnl_svd<double> pseudoInverseSolver( m_TensorBasis );
-        if( m_NumberOfGradientDirections > 6 )
-          {
-          D = pseudoInverseSolver.solve( m_BMatrix * B );
-          }
-        else
+      ++oit; // Output (reconstructed tensor image) iterator
+      ++git; // Gradient  image iterator
+      }
+    }
+  if( batchCount > 0 )
+    {
+    this->FitBatch(logSignal, batchCount, targets);
+    }
+}
+
+template <typename TReferenceImagePixelType,
+          typename TGradientImagePixelType, typename TTensorPixelType>
+void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType,
+                                                        TGradientImagePixelType, TTensorPixelType>
+::FitBatch( const vnl_matrix<double> & logSignal, unsigned int numberOfVoxels,
+            TensorPixelType * const *targets ) const
+{
+  const unsigned int numberOfGradients = m_NumberOfGradientDirections;
+
+  vnl_matrix<double>         partial;
+  const vnl_matrix<double> & Y = ( numberOfVoxels == logSignal.rows() )
+    ? logSignal
+    : ( partial = logSignal.extract(numberOfVoxels, numberOfGradients) );
+
+  // Linear least squares for the whole batch: D = Y * pinv(B)^T
+  vnl_matrix<double> D = Y * m_PseudoInverse;
+
+  if( m_FittingMethod != LinearLeastSquares )
+    {
+    const unsigned int numberOfIterations =
+      ( m_FittingMethod == IterativeWeightedLinearLeastSquares ) ? std::max(m_NumberOfIterations, 1U) : 1U;
+    const double twoBValue = 2.0 * this->m_BValue;
+
+    vnl_matrix<double> weights(numberOfVoxels, numberOfGradients);
+    vnl_matrix<double> weightedSignal(numberOfVoxels, numberOfGradients);
+    for( unsigned int iteration = 0; iteration < numberOfIterations; ++iteration )
+      {
+      // The weights are the squared predicted signals, (S/S0)^2 = exp(-2 b y).
+      // The common S0^2 factor does not change the per voxel solution.
+      const vnl_matrix<double> predicted = D * m_BMatrix;
+      for( unsigned int v = 0; v < numberOfVoxels; ++v )
+        {
+        for( unsigned int i = 0; i < numberOfGradients; ++i )
           {
-          D = pseudoInverseSolver.solve( B );
+          const double exponent = std::max(std::min(-twoBValue * predicted[v][i], 700.0), -700.0);
+          weights[v][i] = std::exp(exponent);
+          weightedSignal[v][i] = weights[v][i] * Y[v][i];
           }
+        }
+      // Normal equations for every voxel of the batch:
+      // B^T W B as packed upper triangles, and B^T W y.
+      const vnl_matrix<double> normal = weights * m_BOuterProducts;
+      const vnl_matrix<double> rhs = weightedSignal * m_DesignMatrix;
+      for( unsigned int v = 0; v < numberOfVoxels; ++v )
+        {
+        // Keep the previous estimate if the weighted system is degenerate
+        SolveNormalEquations(normal[v], rhs[v], D[v]);
+        }
+      }
+    }
+
+  for( unsigned int v = 0; v < numberOfVoxels; ++v )
+    {
+    TensorPixelType & tensor = *( targets[v] );
+    const double *    d = D[v];
+    tensor(0, 0) = d[0];
+    tensor(0, 1) = d[1];
+    tensor(0, 2) = d[2];
+    tensor(1, 1) = d[3];
+    tensor(1, 2) = d[4];
+    tensor(2, 2) = d[5];
+    }
+}
+
+template <typename TReferenceImagePixelType,
+          typename TGradientImagePixelType, typename TTensorPixelType>
+bool DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType,
+                                                        TGradientImagePixelType, TTensorPixelType>
+::SolveNormalEquations( const double *packed, const double *rhs, double *solution )
+{
+  double A[6][6];
+  for( unsigned int r = 0, k = 0; r < 6; ++r )
+    {
+    for( unsigned int c = r; c < 6; ++c, ++k )
+      {
+      A[r][c] = A[c][r] = packed[k];
+      }
+    }
 
-        tensor(0, 0) = D[0];
-        tensor(0, 1) = D[1];
-        tensor(0, 2) = D[2];
-        tensor(1, 1) = D[3];
-        tensor(1, 2) = D[4];
-        tensor(2, 2) = D[5];
+  // Cholesky factorization A = L L^T, L stored in the lower triangle of A
+  for( unsigned int j = 0; j < 6; ++j )
+    {
+    double diagonal = A[j][j];
+    for( unsigned int k = 0; k < j; ++k )
+      {
+      diagonal -= A[j][k] * A[j][k];
+      }
+    if( !( diagonal > 0.0 ) )
+      {
+      return false;
+      }
+    A[j][j] = std::sqrt(diagonal);
+    for( unsigned int i = j + 1; i < 6; ++i )
+      {
+      double value = A[i][j];
+      for( unsigned int k = 0; k < j; ++k )
+        {
+        value -= A[i][k] * A[j][k];
         }
+      A[i][j] = value / A[j][j];
+      }
+    }
 
-      oit.Set( tensor );
-      ++oit; // Output (reconstructed tensor image) iterator
-      ++git; // Gradient  image iterator
+  double y[6];
+  for( unsigned int i = 0; i < 6; ++i )
+    {
+    double value = rhs[i];
+    for( unsigned int k = 0; k < i; ++k )
+      {
+      value -= A[i][k] * y[k];
+      }
+    y[i] = value / A[i][i];
+    }
+  for( int i = 5; i >= 0; --i )
+    {
+    double value = y[i];
+    for( unsigned int k = i + 1; k < 6; ++k )
+      {
+      value -= A[k][i] * solution[k];
       }
+    solution[i] = value / A[i][i];
     }
+  return true;
 }
 
 template <typename TReferenceImagePixelType,
@@ -407,6 +495,32 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
     m_TensorBasis = m_BMatrix;
     }
 
+  // Factor the design matrix once for all voxels.  m_PseudoInverse is
+  // stored transposed (N x 6) so a batch of voxel rows is fitted with a
+  // single product.
+  vnl_svd<double> pseudoInverseSolver( m_TensorBasis );
+  if( m_NumberOfGradientDirections > 6 )
+    {
+    m_PseudoInverse = ( pseudoInverseSolver.pinverse() * m_BMatrix.transpose() ).transpose();
+    }
+  else
+    {
+    m_PseudoInverse = pseudoInverseSolver.pinverse().transpose();
+    }
+
+  m_DesignMatrix = m_BMatrix;
+  m_BOuterProducts.set_size( m_NumberOfGradientDirections, 21 );
+  for( unsigned int m = 0; m < m_NumberOfGradientDirections; ++m )
+    {
+    for( unsigned int r = 0, k = 0; r < 6; ++r )
+      {
+      for( unsigned int c = r; c < 6; ++c, ++k )
+        {
+        m_BOuterProducts[m][k] = m_BMatrix[m][r] * m_BMatrix[m][c];
+        }
+      }
+    }
+
   m_BMatrix.inplace_transpose();
 }
 
@@ -515,6 +629,22 @@ void DiffusionTensor3DReconstructionWithMaskImageFilter<TReferenceImagePixelType
      << m_NumberOfBaselineImages << std::endl;
   os << indent << "Threshold for reference B0 image: " << m_Threshold << std::endl;
   os << indent << "BValue: " << m_BValue << std::endl;
+  os << indent << "FittingMethod: ";
+  switch( m_FittingMethod )
+    {
+    case LinearLeastSquares:
+      os << "LinearLeastSquares" << std::endl;
+      break;
+    case WeightedLinearLeastSquares:
+      os << "WeightedLinearLeastSquares" << std::endl;
+      break;
+    case IterativeWeightedLinearLeastSquares:
+      os << "IterativeWeightedLinearLeastSquares" << std::endl;
+      break;
+    default:
+      os << static_cast<int>( m_FittingMethod ) << std::endl;
+    }
+  os << indent << "NumberOfIterations: " << m_NumberOfIterations << std::endl;
   if( this->m_GradientImageTypeEnumeration == GradientIsInManyImages )
     {
     os << indent << "Gradient images have been supplied " << std::endl;
@@ -0,0 +1,280 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkFastMattesMutualInformationImageToImageMetricv4_h
+#define __itkFastMattesMutualInformationImageToImageMetricv4_h
+
+#include "itkMattesMutualInformationImageToImageMetricv4.h"
+#include "itkBSplineTransform.h"
+
+#include <vector>
+
+namespace itk
+{
+/**
+ * \class FastMattesMutualInformationImageToImageMetricv4
+ *
+ * Mattes mutual information with a specialized evaluation for the transforms
+ * BRAINSFit optimizes with it.  The moving transform is the optimized
+ * transform, possibly behind a composite of fixed linear transforms that are
+ * applied after it.  The linear transforms are collapsed to one matrix per
+ * evaluation, and fixed and moving values and the central difference moving
+ * gradient are interpolated trilinearly straight from the pixel buffers.
+ *
+ * When the optimized transform is a matrix and offset (Euler, VersorRigid,
+ * ScaleVersor, ScaleSkewVersor, Affine) samples are mapped in small batches
+ * with the matrix inlined, and the joint PDF and its derivative are
+ * accumulated in one pass, in per work unit histograms that are summed in a
+ * fixed order.  The transform Jacobian of these transforms is affine in the
+ * point, so the PDF derivative is accumulated against the 12 affine terms and
+ * the Jacobian is only evaluated at four points per iteration.
+ *
+ * When the optimized transform is a cubic BSplineTransform the first pass
+ * builds the joint PDF and keeps, for every valid sample, its bins, gradient,
+ * and the start and separable weights of its 4x4x4 support.  The second pass
+ * scatters each sample into the control points of its support only, in per
+ * work unit accumulators that are allocated by blocks of control points, so
+ * memory and reduction costs follow the support touched by each work unit
+ * rather than the size of the grid.
+ *
+ * Value and derivative match MattesMutualInformationImageToImageMetricv4 up to
+ * round-off.  Anything else (displacement field transforms, a moving image
+ * gradient filter, non linear interpolators) is evaluated by the superclass.
+ */
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage = TFixedImage,
+          typename TInternalComputationValueType = double,
+          typename TMetricTraits = DefaultImageToImageMetricTraitsv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                                     TInternalComputationValueType> >
+class FastMattesMutualInformationImageToImageMetricv4 :
+  public MattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                     TInternalComputationValueType, TMetricTraits>
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(FastMattesMutualInformationImageToImageMetricv4);
+
+  /** Standard class type alias. */
+  using Self = FastMattesMutualInformationImageToImageMetricv4;
+  using Superclass = MattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                                 TInternalComputationValueType, TMetricTraits>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(FastMattesMutualInformationImageToImageMetricv4, MattesMutualInformationImageToImageMetricv4);
+
+  using MeasureType = typename Superclass::MeasureType;
+  using DerivativeType = typename Superclass::DerivativeType;
+  using FixedImageType = typename Superclass::FixedImageType;
+  using MovingImageType = typename Superclass::MovingImageType;
+  using VirtualImageType = typename Superclass::VirtualImageType;
+  using VirtualPointType = typename Superclass::VirtualPointType;
+  using FixedImagePointType = typename Superclass::FixedImagePointType;
+  using MovingImagePointType = typename Superclass::MovingImagePointType;
+  using CoordinateRepresentationType = typename Superclass::CoordinateRepresentationType;
+  using NumberOfParametersType = typename Superclass::NumberOfParametersType;
+
+  static constexpr unsigned int ImageDimension = TVirtualImage::ImageDimension;
+
+  /** Kind of specialized evaluation allowed by the current transforms */
+  enum FastPathType { NoFastPath = 0, LinearFastPath, BSplineFastPath };
+
+  /** Use the specialized evaluation when the transforms allow it (on by
+   * default).  Turning it off always evaluates with the superclass. */
+  itkSetMacro(UseFastPath, bool);
+  itkGetConstMacro(UseFastPath, bool);
+  itkBooleanMacro(UseFastPath);
+
+  /** The specialized evaluation used with the current transforms and
+   * settings, NoFastPath when the superclass evaluates the metric. */
+  FastPathType GetFastPathType() const;
+
+  bool CanUseFastPath() const
+  {
+    return this->GetFastPathType() != NoFastPath;
+  }
+
+  MeasureType GetValue() const override;
+
+  void GetDerivative(DerivativeType & derivative) const override;
+
+  void GetValueAndDerivative(MeasureType & value, DerivativeType & derivative) const override;
+
+protected:
+  FastMattesMutualInformationImageToImageMetricv4();
+  ~FastMattesMutualInformationImageToImageMetricv4() override = default;
+  void PrintSelf(std::ostream & os, Indent indent) const override;
+
+private:
+  using TransformBaseType = Transform<TInternalComputationValueType, ImageDimension, ImageDimension>;
+  using BSplineTransformType = BSplineTransform<TInternalComputationValueType, ImageDimension, 3>;
+
+  /** y = Matrix x + Offset for a linear transform.  For the moving transform,
+   * ActiveTransform is the optimized transform (applied first) and
+   * PostMatrix, PostOffset collapse the transforms applied after it. */
+  struct TransformMappingType
+    {
+    double                   Matrix[3][3];
+    double                   Offset[3];
+    double                   PostMatrix[3][3];
+    double                   PostOffset[3];
+    const TransformBaseType *ActiveTransform;
+    };
+
+  /** Geometry and pixels of one image, in the form the kernel reads them */
+  template <typename TImage>
+  struct ImageBufferType
+    {
+    const typename TImage::PixelType *Buffer;
+    OffsetValueType                   Start[3];
+    OffsetValueType                   End[3];
+    OffsetValueType                   Stride[3];
+    double                            ContinuousStart[3];
+    double                            ContinuousEnd[3];
+    double                            Origin[3];
+    double                            PhysicalToIndex[3][3];
+    };
+
+  /** Everything a work unit needs to map and evaluate samples */
+  struct EvaluationContextType
+    {
+    ImageBufferType<FixedImageType>   FixedBuffer;
+    ImageBufferType<MovingImageType>  MovingBuffer;
+    ImageBufferType<VirtualImageType> VirtualDomain;
+    TransformMappingType              FixedMapping;
+    TransformMappingType              MovingMapping;
+    double                            FixedIndexMatrix[3][3];
+    double                            FixedIndexOffset[3];
+    double                            GradientStep[3][3];
+    double                            HalfInverseSpacing[3];
+    double                            VirtualOrigin[3];
+    double                            VirtualIndexToPhysical[3][3];
+    const typename Superclass::FixedImageMaskType *                  FixedMask;
+    const typename Superclass::MovingImageMaskType *                 MovingMask;
+    const typename Superclass::VirtualPointSetType::PointsContainer *SampledPoints;
+    typename VirtualImageType::RegionType                            VirtualRegion;
+    SizeValueType                                                    NumberOfSamples;
+    SizeValueType                                                    NumberOfBatches;
+    SizeValueType                                                    NumberOfWorkUnits;
+    };
+
+  /** One valid sample: its bins and the physical moving image gradient */
+  struct SampleType
+    {
+    OffsetValueType FixedBin;
+    OffsetValueType PDFMovingIndex;
+    double          FirstArgument;
+    double          Gradient[3];
+    };
+
+  /** A BSpline stage sample kept between the two passes.  Gradient is
+   * pulled back through PostMatrix, SupportStart is the linear index of the
+   * first control point of the support (-1 outside the valid region). */
+  struct BSplineSampleType
+    {
+    OffsetValueType FixedBin;
+    OffsetValueType PDFMovingIndex;
+    double          FirstArgument;
+    double          Gradient[3];
+    OffsetValueType SupportStart;
+    double          Weights[3][4];
+    };
+
+  /** Per work unit histograms and BSpline pass state */
+  struct AccumulatorType
+    {
+    std::vector<double>              JointPDF;
+    std::vector<double>              FixedMarginalPDF;
+    std::vector<double>              JointPDFDerivatives;
+    SizeValueType                    NumberOfValidPoints;
+    std::vector<BSplineSampleType>   BSplineSamples;
+    std::vector<std::vector<double> > ParameterBlocks;
+    std::vector<unsigned char>       BlockTouched;
+    std::vector<SizeValueType>       TouchedBlocks;
+    };
+
+  /** Number of affine terms accumulated per joint PDF bin */
+  static constexpr unsigned int NumberOfAffineTerms = 12;
+
+  /** Number of samples mapped together */
+  static constexpr unsigned int SampleBatchSize = 64;
+
+  /** Number of BSpline control points per accumulator block */
+  static constexpr unsigned int ControlPointBlockSize = 512;
+
+  /** BSpline samples are kept between the two passes up to this count, and
+   * mapped again in the second pass above it. */
+  static constexpr SizeValueType MaximumNumberOfCachedSamples = 1 << 21;
+
+  static FastPathType ComputeTransformMapping(const TransformBaseType *transform, bool isMovingTransform,
+                                              TransformMappingType & mapping);
+
+  template <typename TImage>
+  static void InitializeImageBuffer(const TImage *image, const typename TImage::RegionType & region,
+                                    ImageBufferType<TImage> & buffer);
+
+  template <typename TImage>
+  static bool IsInsideBuffer(const ImageBufferType<TImage> & buffer, const double cindex[3]);
+
+  template <typename TImage>
+  static double Interpolate(const ImageBufferType<TImage> & buffer, const double cindex[3]);
+
+  static double CubicBSpline(double u);
+
+  static double CubicBSplineDerivative(double u);
+
+  void InitializeEvaluationContext(EvaluationContextType & context, bool computeDerivative) const;
+
+  /** Physical virtual points of samples [batchStart, batchStart + batchSize) */
+  void GetVirtualPoints(const EvaluationContextType & context, SizeValueType batchStart, unsigned int batchSize,
+                        double points[][3]) const;
+
+  /** Test and evaluate one sample, given its virtual point, fixed continuous
+   * index, and moving point and continuous index.  Returns false for a sample that does not count. */
+  bool EvaluateSample(const EvaluationContextType & context, const double virtualPoint[3],
+                      const double fixedIndex[3], const double movingPoint[3], const double movingIndex[3],
+                      bool computeGradient, SampleType & sample) const;
+
+  /** Run processWorkUnit(unit) for every work unit */
+  template <typename TFunction>
+  void ParallelizeWorkUnits(const EvaluationContextType & context, TFunction processWorkUnit) const;
+
+  /** Sum the work unit histograms into value.  When binWeights is not null it
+   * receives, per joint PDF bin, the factor of the PDF derivative in the
+   * metric derivative.  Returns false when no sample was valid. */
+  bool ComputeMutualInformation(const EvaluationContextType & context, MeasureType & value,
+                                std::vector<double> *binWeights) const;
+
+  /** Evaluate the metric, and its derivative when derivative is not null */
+  void ComputeLinearValueAndDerivative(MeasureType & value, DerivativeType *derivative) const;
+
+  void ComputeBSplineValueAndDerivative(MeasureType & value, DerivativeType *derivative) const;
+
+  bool m_UseFastPath;
+
+  mutable std::vector<AccumulatorType> m_Accumulators;
+};
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkFastMattesMutualInformationImageToImageMetricv4.hxx"
+#endif
+
+#endif
@@ -0,0 +1,1252 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkFastMattesMutualInformationImageToImageMetricv4_hxx
+#define __itkFastMattesMutualInformationImageToImageMetricv4_hxx
+#include "itkFastMattesMutualInformationImageToImageMetricv4.h"
+
+#include "itkCompositeTransform.h"
+#include "itkIdentityTransform.h"
+#include "itkMatrixOffsetTransformBase.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkMultiThreaderBase.h"
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace itk
+{
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::FastMattesMutualInformationImageToImageMetricv4() :
+  m_UseFastPath(true)
+{
+  static_assert( ImageDimension == 3, "FastMattesMutualInformationImageToImageMetricv4 only supports 3D images" );
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+typename FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                         TInternalComputationValueType, TMetricTraits>::FastPathType
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::ComputeTransformMapping(const TransformBaseType *transform, bool isMovingTransform,
+                          TransformMappingType & mapping)
+{
+  using MatrixOffsetTransformType =
+    MatrixOffsetTransformBase<TInternalComputationValueType, ImageDimension, ImageDimension>;
+  using IdentityTransformType = IdentityTransform<TInternalComputationValueType, ImageDimension>;
+  using CompositeTransformType = CompositeTransform<TInternalComputationValueType, ImageDimension>;
+
+  if( transform == nullptr )
+    {
+    return NoFastPath;
+    }
+
+  // Flatten the queue (one level of nesting, as BRAINSFit passes its current
+  // composite as the moving initial transform).  The queue is applied back to
+  // front, transforms.back() first.
+  std::vector<const TransformBaseType *> transforms;
+  std::vector<bool>                      optimized;
+  const CompositeTransformType *         composite = dynamic_cast<const CompositeTransformType *>( transform );
+  if( composite != nullptr )
+    {
+    for( SizeValueType i = 0; i < composite->GetNumberOfTransforms(); ++i )
+      {
+      const TransformBaseType *     entry = composite->GetNthTransformConstPointer(i);
+      const bool                    entryOptimized = composite->GetNthTransformToOptimize(i);
+      const CompositeTransformType *nested = dynamic_cast<const CompositeTransformType *>( entry );
+      if( nested == nullptr )
+        {
+        transforms.push_back(entry);
+        optimized.push_back(entryOptimized);
+        continue;
+        }
+      for( SizeValueType j = 0; j < nested->GetNumberOfTransforms(); ++j )
+        {
+        if( dynamic_cast<const CompositeTransformType *>( nested->GetNthTransformConstPointer(j) ) != nullptr )
+          {
+          return NoFastPath;
+          }
+        transforms.push_back( nested->GetNthTransformConstPointer(j) );
+        optimized.push_back(entryOptimized);
+        }
+      }
+    }
+  else
+    {
+    transforms.push_back(transform);
+    optimized.push_back(true);
+    }
+
+  size_t numberOfPostTransforms = transforms.size();
+  mapping.ActiveTransform = nullptr;
+  if( isMovingTransform )
+    {
+    if( transforms.empty() || !optimized.back()
+        || std::count(optimized.begin(), optimized.end(), true) != 1 )
+      {
+      return NoFastPath;
+      }
+    mapping.ActiveTransform = transforms.back();
+    numberOfPostTransforms = transforms.size() - 1;
+    }
+
+  for( unsigned int r = 0; r < 3; ++r )
+    {
+    for( unsigned int c = 0; c < 3; ++c )
+      {
+      mapping.PostMatrix[r][c] = ( r == c ) ? 1.0 : 0.0;
+      }
+    mapping.PostOffset[r] = 0.0;
+    }
+  for( size_t i = numberOfPostTransforms; i-- > 0; )
+    {
+    if( dynamic_cast<const IdentityTransformType *>( transforms[i] ) != nullptr )
+      {
+      continue;
+      }
+    const MatrixOffsetTransformType *linear = dynamic_cast<const MatrixOffsetTransformType *>( transforms[i] );
+    if( linear == nullptr )
+      {
+      return NoFastPath;
+      }
+    const typename MatrixOffsetTransformType::MatrixType & a = linear->GetMatrix();
+    const typename MatrixOffsetTransformType::OffsetType & b = linear->GetOffset();
+    double                                                 matrix[3][3];
+    double                                                 offset[3];
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      offset[r] = b[r];
+      for( unsigned int c = 0; c < 3; ++c )
+        {
+        matrix[r][c] = 0.0;
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          matrix[r][c] += a[r][k] * mapping.PostMatrix[k][c];
+          }
+        offset[r] += a[r][c] * mapping.PostOffset[c];
+        }
+      }
+    std::copy(&matrix[0][0], &matrix[0][0] + 9, &mapping.PostMatrix[0][0]);
+    std::copy(offset, offset + 3, mapping.PostOffset);
+    }
+
+  if( !isMovingTransform )
+    {
+    std::copy(&mapping.PostMatrix[0][0], &mapping.PostMatrix[0][0] + 9, &mapping.Matrix[0][0]);
+    std::copy(mapping.PostOffset, mapping.PostOffset + 3, mapping.Offset);
+    return LinearFastPath;
+    }
+
+  const MatrixOffsetTransformType *active = dynamic_cast<const MatrixOffsetTransformType *>( mapping.ActiveTransform );
+  if( active != nullptr )
+    {
+    const typename MatrixOffsetTransformType::MatrixType & a = active->GetMatrix();
+    const typename MatrixOffsetTransformType::OffsetType & b = active->GetOffset();
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      mapping.Offset[r] = mapping.PostOffset[r];
+      for( unsigned int c = 0; c < 3; ++c )
+        {
+        mapping.Matrix[r][c] = 0.0;
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          mapping.Matrix[r][c] += mapping.PostMatrix[r][k] * a[k][c];
+          }
+        mapping.Offset[r] += mapping.PostMatrix[r][c] * b[c];
+        }
+      }
+    return LinearFastPath;
+    }
+  if( dynamic_cast<const BSplineTransformType *>( mapping.ActiveTransform ) != nullptr )
+    {
+    std::copy(&mapping.PostMatrix[0][0], &mapping.PostMatrix[0][0] + 9, &mapping.Matrix[0][0]);
+    std::copy(mapping.PostOffset, mapping.PostOffset + 3, mapping.Offset);
+    return BSplineFastPath;
+    }
+  return NoFastPath;
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+template <typename TImage>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::InitializeImageBuffer(const TImage *image, const typename TImage::RegionType & region,
+                        ImageBufferType<TImage> & buffer)
+{
+  buffer.Buffer = image->GetBufferPointer();
+  const OffsetValueType *offsetTable = image->GetOffsetTable();
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    buffer.Start[d] = region.GetIndex()[d];
+    buffer.End[d] = buffer.Start[d] + static_cast<OffsetValueType>( region.GetSize()[d] ) - 1;
+    buffer.Stride[d] = offsetTable[d];
+    buffer.ContinuousStart[d] = buffer.Start[d] - 0.5;
+    buffer.ContinuousEnd[d] = buffer.End[d] + 0.5;
+    buffer.Origin[d] = image->GetOrigin()[d];
+    for( unsigned int c = 0; c < 3; ++c )
+      {
+      buffer.PhysicalToIndex[d][c] = image->GetPhysicalPointToIndex()[d][c];
+      }
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+template <typename TImage>
+inline bool
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::IsInsideBuffer(const ImageBufferType<TImage> & buffer, const double cindex[3])
+{
+  // Same test as InterpolateImageFunction::IsInsideBuffer, false for NaN.
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    if( !( cindex[d] >= buffer.ContinuousStart[d] && cindex[d] < buffer.ContinuousEnd[d] ) )
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+template <typename TImage>
+inline double
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::Interpolate(const ImageBufferType<TImage> & buffer, const double cindex[3])
+{
+  // Trilinear, with the neighbors clamped to the buffer as
+  // LinearInterpolateImageFunction does.
+  OffsetValueType lower[3];
+  OffsetValueType upper[3];
+  double          distance[3];
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    OffsetValueType base = Math::Floor<OffsetValueType>(cindex[d]);
+    if( base < buffer.Start[d] )
+      {
+      base = buffer.Start[d];
+      }
+    distance[d] = std::max(cindex[d] - static_cast<double>( base ), 0.0);
+    const OffsetValueType next = ( base < buffer.End[d] ) ? base + 1 : base;
+    lower[d] = ( base - buffer.Start[d] ) * buffer.Stride[d];
+    upper[d] = ( next - buffer.Start[d] ) * buffer.Stride[d];
+    }
+  const typename TImage::PixelType *p = buffer.Buffer;
+  const double                      v000 = p[lower[0] + lower[1] + lower[2]];
+  const double                      v100 = p[upper[0] + lower[1] + lower[2]];
+  const double                      v010 = p[lower[0] + upper[1] + lower[2]];
+  const double                      v110 = p[upper[0] + upper[1] + lower[2]];
+  const double                      v001 = p[lower[0] + lower[1] + upper[2]];
+  const double                      v101 = p[upper[0] + lower[1] + upper[2]];
+  const double                      v011 = p[lower[0] + upper[1] + upper[2]];
+  const double                      v111 = p[upper[0] + upper[1] + upper[2]];
+
+  const double v00 = v000 + ( v100 - v000 ) * distance[0];
+  const double v10 = v010 + ( v110 - v010 ) * distance[0];
+  const double v01 = v001 + ( v101 - v001 ) * distance[0];
+  const double v11 = v011 + ( v111 - v011 ) * distance[0];
+  const double v0 = v00 + ( v10 - v00 ) * distance[1];
+  const double v1 = v01 + ( v11 - v01 ) * distance[1];
+  return v0 + ( v1 - v0 ) * distance[2];
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+inline double
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::CubicBSpline(double u)
+{
+  const double absU = std::abs(u);
+  if( absU < 1.0 )
+    {
+    return ( 4.0 - 6.0 * absU * absU + 3.0 * absU * absU * absU ) / 6.0;
+    }
+  if( absU < 2.0 )
+    {
+    const double t = 2.0 - absU;
+    return t * t * t / 6.0;
+    }
+  return 0.0;
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+inline double
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::CubicBSplineDerivative(double u)
+{
+  const double absU = std::abs(u);
+  if( absU < 1.0 )
+    {
+    return -2.0 * u + 1.5 * u * absU;
+    }
+  if( absU < 2.0 )
+    {
+    const double t = 2.0 - absU;
+    return ( u < 0.0 ) ? 0.5 * t * t : -0.5 * t * t;
+    }
+  return 0.0;
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+typename FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                         TInternalComputationValueType, TMetricTraits>::FastPathType
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::GetFastPathType() const
+{
+  using FixedLinearInterpolatorType = LinearInterpolateImageFunction<FixedImageType, CoordinateRepresentationType>;
+  using MovingLinearInterpolatorType = LinearInterpolateImageFunction<MovingImageType, CoordinateRepresentationType>;
+
+  if( !this->m_UseFastPath || this->GetUseMovingImageGradientFilter() )
+    {
+    return NoFastPath;
+    }
+  if( this->m_FixedImage.IsNull() || this->m_MovingImage.IsNull()
+      || this->m_FixedImage->GetBufferPointer() == nullptr || this->m_MovingImage->GetBufferPointer() == nullptr )
+    {
+    return NoFastPath;
+    }
+  if( dynamic_cast<const FixedLinearInterpolatorType *>( this->m_FixedInterpolator.GetPointer() ) == nullptr
+      || dynamic_cast<const MovingLinearInterpolatorType *>( this->m_MovingInterpolator.GetPointer() ) == nullptr )
+    {
+    return NoFastPath;
+    }
+  if( this->GetNumberOfLocalParameters() != this->GetNumberOfParameters() )
+    {
+    return NoFastPath;
+    }
+  if( this->GetUseSampledPointSet() && this->m_VirtualSampledPointSet.IsNull() )
+    {
+    return NoFastPath;
+    }
+  TransformMappingType mapping;
+  if( ComputeTransformMapping(this->m_FixedTransform.GetPointer(), false, mapping) == NoFastPath )
+    {
+    return NoFastPath;
+    }
+  return ComputeTransformMapping(this->m_MovingTransform.GetPointer(), true, mapping);
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+typename FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                         TInternalComputationValueType, TMetricTraits>::MeasureType
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::GetValue() const
+{
+  MeasureType value;
+  switch( this->GetFastPathType() )
+    {
+    case LinearFastPath:
+      this->ComputeLinearValueAndDerivative(value, nullptr);
+      return value;
+    case BSplineFastPath:
+      this->ComputeBSplineValueAndDerivative(value, nullptr);
+      return value;
+    default:
+      return Superclass::GetValue();
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::GetDerivative(DerivativeType & derivative) const
+{
+  MeasureType value;
+  this->GetValueAndDerivative(value, derivative);
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::GetValueAndDerivative(MeasureType & value, DerivativeType & derivative) const
+{
+  switch( this->GetFastPathType() )
+    {
+    case LinearFastPath:
+      this->ComputeLinearValueAndDerivative(value, &derivative);
+      break;
+    case BSplineFastPath:
+      this->ComputeBSplineValueAndDerivative(value, &derivative);
+      break;
+    default:
+      Superclass::GetValueAndDerivative(value, derivative);
+      break;
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::InitializeEvaluationContext(EvaluationContextType & context, bool computeDerivative) const
+{
+  ComputeTransformMapping(this->m_FixedTransform.GetPointer(), false, context.FixedMapping);
+  ComputeTransformMapping(this->m_MovingTransform.GetPointer(), true, context.MovingMapping);
+
+  const FixedImageType *  fixedImage = this->m_FixedImage.GetPointer();
+  const MovingImageType * movingImage = this->m_MovingImage.GetPointer();
+  const VirtualImageType *virtualImage = this->GetVirtualImage();
+  InitializeImageBuffer(fixedImage, fixedImage->GetBufferedRegion(), context.FixedBuffer);
+  InitializeImageBuffer(movingImage, movingImage->GetBufferedRegion(), context.MovingBuffer);
+  InitializeImageBuffer(virtualImage, this->GetVirtualRegion(), context.VirtualDomain);
+
+  // Fold the fixed transform and the physical to index mapping of the fixed
+  // image, so a virtual point goes to a continuous index in one step.
+  for( unsigned int r = 0; r < 3; ++r )
+    {
+    context.FixedIndexOffset[r] = 0.0;
+    for( unsigned int c = 0; c < 3; ++c )
+      {
+      context.FixedIndexMatrix[r][c] = 0.0;
+      for( unsigned int k = 0; k < 3; ++k )
+        {
+        context.FixedIndexMatrix[r][c] += context.FixedBuffer.PhysicalToIndex[r][k] * context.FixedMapping.Matrix[k][c];
+        }
+      context.FixedIndexOffset[r] +=
+        context.FixedBuffer.PhysicalToIndex[r][c] * ( context.FixedMapping.Offset[c] - context.FixedBuffer.Origin[c] );
+      }
+    }
+
+  // The moving gradient is a central difference of one spacing along each
+  // physical axis, as CentralDifferenceImageFunction::Evaluate.
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    context.HalfInverseSpacing[d] = 0.5 / movingImage->GetSpacing()[d];
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      context.GradientStep[d][r] = context.MovingBuffer.PhysicalToIndex[r][d] * movingImage->GetSpacing()[d];
+      }
+    }
+
+  for( unsigned int r = 0; r < 3; ++r )
+    {
+    context.VirtualOrigin[r] = virtualImage->GetOrigin()[r];
+    for( unsigned int c = 0; c < 3; ++c )
+      {
+      context.VirtualIndexToPhysical[r][c] = virtualImage->GetIndexToPhysicalPoint()[r][c];
+      }
+    }
+
+  context.FixedMask = this->m_FixedImageMask.GetPointer();
+  context.MovingMask = this->m_MovingImageMask.GetPointer();
+  context.SampledPoints = this->GetUseSampledPointSet() ? this->m_VirtualSampledPointSet->GetPoints() : nullptr;
+  context.VirtualRegion = this->GetVirtualRegion();
+  context.NumberOfSamples =
+    ( context.SampledPoints != nullptr ) ? context.SampledPoints->Size() : context.VirtualRegion.GetNumberOfPixels();
+  context.NumberOfBatches = ( context.NumberOfSamples + SampleBatchSize - 1 ) / SampleBatchSize;
+  context.NumberOfWorkUnits =
+    std::max<SizeValueType>( 1, std::min<SizeValueType>( this->GetMaximumNumberOfWorkUnits(), context.NumberOfBatches ) );
+
+  if( m_Accumulators.size() < context.NumberOfWorkUnits )
+    {
+    m_Accumulators.resize(context.NumberOfWorkUnits);
+    }
+  const SizeValueType numberOfBins = this->GetNumberOfHistogramBins();
+  for( SizeValueType unit = 0; unit < context.NumberOfWorkUnits; ++unit )
+    {
+    AccumulatorType & accumulator = m_Accumulators[unit];
+    accumulator.JointPDF.assign(numberOfBins * numberOfBins, 0.0);
+    accumulator.FixedMarginalPDF.assign(numberOfBins, 0.0);
+    accumulator.NumberOfValidPoints = 0;
+    accumulator.JointPDFDerivatives.clear();
+    accumulator.BSplineSamples.clear();
+    if( computeDerivative && context.MovingMapping.ActiveTransform != nullptr
+        && dynamic_cast<const BSplineTransformType *>( context.MovingMapping.ActiveTransform ) == nullptr )
+      {
+      accumulator.JointPDFDerivatives.assign(numberOfBins * numberOfBins * NumberOfAffineTerms, 0.0);
+      }
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::GetVirtualPoints(const EvaluationContextType & context, SizeValueType batchStart, unsigned int batchSize,
+                   double points[][3]) const
+{
+  if( context.SampledPoints != nullptr )
+    {
+    for( unsigned int b = 0; b < batchSize; ++b )
+      {
+      const VirtualPointType & point = context.SampledPoints->ElementAt(batchStart + b);
+      for( unsigned int d = 0; d < 3; ++d )
+        {
+        points[b][d] = point[d];
+        }
+      }
+    return;
+    }
+  for( unsigned int b = 0; b < batchSize; ++b )
+    {
+    SizeValueType linear = batchStart + b;
+    double        index[3];
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      index[d] = context.VirtualRegion.GetIndex()[d]
+        + static_cast<double>( linear % context.VirtualRegion.GetSize()[d] );
+      linear /= context.VirtualRegion.GetSize()[d];
+      }
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      points[b][r] = context.VirtualOrigin[r] + context.VirtualIndexToPhysical[r][0] * index[0]
+        + context.VirtualIndexToPhysical[r][1] * index[1] + context.VirtualIndexToPhysical[r][2] * index[2];
+      }
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+inline bool
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::EvaluateSample(const EvaluationContextType & context, const double virtualPoint[3],
+                 const double fixedIndex[3], const double movingPoint[3], const double movingIndex[3],
+                 bool computeGradient, SampleType & sample) const
+{
+  using MaskPointType = typename Superclass::FixedImageMaskType::PointType;
+
+  if( context.SampledPoints != nullptr )
+    {
+    // Sampled points outside the virtual domain are skipped, as the sparse
+    // threader does.
+    double virtualIndex[3];
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      virtualIndex[r] = 0.0;
+      for( unsigned int c = 0; c < 3; ++c )
+        {
+        virtualIndex[r] +=
+          context.VirtualDomain.PhysicalToIndex[r][c] * ( virtualPoint[c] - context.VirtualDomain.Origin[c] );
+        }
+      }
+    if( !IsInsideBuffer(context.VirtualDomain, virtualIndex) )
+      {
+      return false;
+      }
+    }
+  if( !IsInsideBuffer(context.FixedBuffer, fixedIndex) || !IsInsideBuffer(context.MovingBuffer, movingIndex) )
+    {
+    return false;
+    }
+  if( context.FixedMask != nullptr )
+    {
+    MaskPointType fixedPoint;
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      fixedPoint[r] = context.FixedMapping.Offset[r] + context.FixedMapping.Matrix[r][0] * virtualPoint[0]
+        + context.FixedMapping.Matrix[r][1] * virtualPoint[1] + context.FixedMapping.Matrix[r][2] * virtualPoint[2];
+      }
+    if( !context.FixedMask->IsInsideInWorldSpace(fixedPoint) )
+      {
+      return false;
+      }
+    }
+  if( context.MovingMask != nullptr )
+    {
+    MaskPointType point;
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      point[r] = movingPoint[r];
+      }
+    if( !context.MovingMask->IsInsideInWorldSpace(point) )
+      {
+      return false;
+      }
+    }
+
+  const double movingValue = Interpolate(context.MovingBuffer, movingIndex);
+  if( movingValue < this->m_MovingImageTrueMin || movingValue > this->m_MovingImageTrueMax )
+    {
+    return false;
+    }
+  const double fixedValue = Interpolate(context.FixedBuffer, fixedIndex);
+
+  const OffsetValueType numberOfBins = static_cast<OffsetValueType>( this->GetNumberOfHistogramBins() );
+  auto                  clampBin = [numberOfBins](OffsetValueType bin) -> OffsetValueType
+    {
+      return std::min(std::max(bin, OffsetValueType(2) ), numberOfBins - 3);
+    };
+  sample.FixedBin =
+    clampBin( static_cast<OffsetValueType>( fixedValue / this->m_FixedImageBinSize - this->m_FixedImageNormalizedMin ) );
+  const double movingTerm = movingValue / this->m_MovingImageBinSize - this->m_MovingImageNormalizedMin;
+  sample.PDFMovingIndex = clampBin( static_cast<OffsetValueType>( movingTerm ) ) - 1;
+  sample.FirstArgument = static_cast<double>( sample.PDFMovingIndex ) - movingTerm;
+
+  if( computeGradient )
+    {
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      double plus[3];
+      double minus[3];
+      for( unsigned int r = 0; r < 3; ++r )
+        {
+        plus[r] = movingIndex[r] + context.GradientStep[d][r];
+        minus[r] = movingIndex[r] - context.GradientStep[d][r];
+        }
+      sample.Gradient[d] = ( IsInsideBuffer(context.MovingBuffer, plus) && IsInsideBuffer(context.MovingBuffer, minus) )
+        ? ( Interpolate(context.MovingBuffer, plus) - Interpolate(context.MovingBuffer, minus) )
+        * context.HalfInverseSpacing[d]
+        : 0.0;
+      }
+    }
+  return true;
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+template <typename TFunction>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::ParallelizeWorkUnits(const EvaluationContextType & context, TFunction processWorkUnit) const
+{
+  if( context.NumberOfWorkUnits == 1 )
+    {
+    processWorkUnit(0);
+    return;
+    }
+  MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+  mt->SetNumberOfWorkUnits(context.NumberOfWorkUnits);
+  mt->ParallelizeArray(0, context.NumberOfWorkUnits, processWorkUnit, nullptr);
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+bool
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::ComputeMutualInformation(const EvaluationContextType & context, MeasureType & value,
+                           std::vector<double> *binWeights) const
+{
+  const OffsetValueType numberOfBins = static_cast<OffsetValueType>( this->GetNumberOfHistogramBins() );
+
+  // Sum the work units in order so the result does not depend on scheduling.
+  std::vector<double> jointPDF(numberOfBins * numberOfBins, 0.0);
+  std::vector<double> fixedMarginalPDF(numberOfBins, 0.0);
+  SizeValueType       numberOfValidPoints = 0;
+  for( SizeValueType unit = 0; unit < context.NumberOfWorkUnits; ++unit )
+    {
+    const AccumulatorType & accumulator = m_Accumulators[unit];
+    for( size_t i = 0; i < jointPDF.size(); ++i )
+      {
+      jointPDF[i] += accumulator.JointPDF[i];
+      }
+    for( size_t i = 0; i < fixedMarginalPDF.size(); ++i )
+      {
+      fixedMarginalPDF[i] += accumulator.FixedMarginalPDF[i];
+      }
+    numberOfValidPoints += accumulator.NumberOfValidPoints;
+    }
+
+  this->m_NumberOfValidPoints = numberOfValidPoints;
+  if( numberOfValidPoints == 0 )
+    {
+    value = NumericTraits<MeasureType>::max();
+    this->m_Value = value;
+    itkWarningMacro("No valid points were found during metric evaluation.");
+    return false;
+    }
+
+  double jointPDFSum = 0.0;
+  for( const double p : jointPDF )
+    {
+    jointPDFSum += p;
+    }
+  for( double & p : jointPDF )
+    {
+    p /= jointPDFSum;
+    }
+  double fixedPDFSum = 0.0;
+  for( const double p : fixedMarginalPDF )
+    {
+    fixedPDFSum += p;
+    }
+  for( double & p : fixedMarginalPDF )
+    {
+    p /= fixedPDFSum;
+    }
+  std::vector<double> movingMarginalPDF(numberOfBins, 0.0);
+  for( OffsetValueType f = 0; f < numberOfBins; ++f )
+    {
+    for( OffsetValueType m = 0; m < numberOfBins; ++m )
+      {
+      movingMarginalPDF[m] += jointPDF[f * numberOfBins + m];
+      }
+    }
+
+  const double closeToZero = std::numeric_limits<double>::epsilon();
+  const double normalizationFactor = 1.0 / ( this->m_MovingImageBinSize * numberOfValidPoints );
+  if( binWeights != nullptr )
+    {
+    binWeights->assign(jointPDF.size(), 0.0);
+    }
+  double sum = 0.0;
+  for( OffsetValueType f = 0; f < numberOfBins; ++f )
+    {
+    for( OffsetValueType m = 0; m < numberOfBins; ++m )
+      {
+      const OffsetValueType bin = f * numberOfBins + m;
+      if( jointPDF[bin] > closeToZero && movingMarginalPDF[m] > closeToZero )
+        {
+        const double pRatio = std::log(jointPDF[bin] / movingMarginalPDF[m]);
+        if( fixedMarginalPDF[f] > closeToZero )
+          {
+          sum += jointPDF[bin] * ( pRatio - std::log(fixedMarginalPDF[f]) );
+          }
+        if( binWeights != nullptr )
+          {
+          ( *binWeights )[bin] = pRatio * normalizationFactor;
+          }
+        }
+      }
+    }
+  value = -sum;
+  this->m_Value = value;
+  return true;
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::ComputeLinearValueAndDerivative(MeasureType & value, DerivativeType *derivative) const
+{
+  using MatrixOffsetTransformType =
+    MatrixOffsetTransformBase<TInternalComputationValueType, ImageDimension, ImageDimension>;
+
+  const bool            computeDerivative = ( derivative != nullptr );
+  EvaluationContextType context;
+  this->InitializeEvaluationContext(context, computeDerivative);
+  const TransformMappingType & movingMapping = context.MovingMapping;
+
+  double movingIndexMatrix[3][3];
+  double movingIndexOffset[3];
+  for( unsigned int r = 0; r < 3; ++r )
+    {
+    movingIndexOffset[r] = 0.0;
+    for( unsigned int c = 0; c < 3; ++c )
+      {
+      movingIndexMatrix[r][c] = 0.0;
+      for( unsigned int k = 0; k < 3; ++k )
+        {
+        movingIndexMatrix[r][c] += context.MovingBuffer.PhysicalToIndex[r][k] * movingMapping.Matrix[k][c];
+        }
+      movingIndexOffset[r] +=
+        context.MovingBuffer.PhysicalToIndex[r][c] * ( movingMapping.Offset[c] - context.MovingBuffer.Origin[c] );
+      }
+    }
+
+  // Jacobian terms are taken relative to the center of the optimized transform.
+  const MatrixOffsetTransformType *activeTransform =
+    dynamic_cast<const MatrixOffsetTransformType *>( movingMapping.ActiveTransform );
+  double reference[3];
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    reference[d] = activeTransform->GetCenter()[d];
+    }
+
+  const OffsetValueType numberOfBins = static_cast<OffsetValueType>( this->GetNumberOfHistogramBins() );
+  auto                  processWorkUnit = [&](SizeValueType unit)
+    {
+      AccumulatorType & accumulator = m_Accumulators[unit];
+      double            virtualPoints[SampleBatchSize][3];
+      double            fixedIndices[SampleBatchSize][3];
+      double            movingPoints[SampleBatchSize][3];
+      double            movingIndices[SampleBatchSize][3];
+
+      const SizeValueType firstBatch = context.NumberOfBatches * unit / context.NumberOfWorkUnits;
+      const SizeValueType lastBatch = context.NumberOfBatches * ( unit + 1 ) / context.NumberOfWorkUnits;
+      for( SizeValueType batch = firstBatch; batch < lastBatch; ++batch )
+        {
+        const SizeValueType batchStart = batch * SampleBatchSize;
+        const unsigned int  batchSize =
+          static_cast<unsigned int>( std::min<SizeValueType>( SampleBatchSize, context.NumberOfSamples - batchStart ) );
+        this->GetVirtualPoints(context, batchStart, batchSize, virtualPoints);
+
+        // Map the whole batch, these loops have no dependencies between samples.
+        for( unsigned int b = 0; b < batchSize; ++b )
+          {
+          const double *x = virtualPoints[b];
+          for( unsigned int r = 0; r < 3; ++r )
+            {
+            fixedIndices[b][r] = context.FixedIndexOffset[r] + context.FixedIndexMatrix[r][0] * x[0]
+              + context.FixedIndexMatrix[r][1] * x[1] + context.FixedIndexMatrix[r][2] * x[2];
+            movingPoints[b][r] = movingMapping.Offset[r] + movingMapping.Matrix[r][0] * x[0]
+              + movingMapping.Matrix[r][1] * x[1] + movingMapping.Matrix[r][2] * x[2];
+            movingIndices[b][r] = movingIndexOffset[r] + movingIndexMatrix[r][0] * x[0]
+              + movingIndexMatrix[r][1] * x[1] + movingIndexMatrix[r][2] * x[2];
+            }
+          }
+
+        for( unsigned int b = 0; b < batchSize; ++b )
+          {
+          SampleType sample;
+          if( !this->EvaluateSample(context, virtualPoints[b], fixedIndices[b], movingPoints[b], movingIndices[b],
+                                    computeDerivative, sample) )
+            {
+            continue;
+            }
+          accumulator.FixedMarginalPDF[sample.FixedBin] += 1.0;
+          ++accumulator.NumberOfValidPoints;
+          const OffsetValueType firstBin = sample.FixedBin * numberOfBins + sample.PDFMovingIndex;
+          double *              jointPDF = &accumulator.JointPDF[firstBin];
+          if( !computeDerivative )
+            {
+            for( unsigned int k = 0; k < 4; ++k )
+              {
+              jointPDF[k] += CubicBSpline(sample.FirstArgument + k);
+              }
+            continue;
+            }
+
+          // gradient^T PostMatrix J(x), with J(x) = J(reference) + sum_j (x_j - reference_j) dJ/dx_j
+          double terms[NumberOfAffineTerms];
+          for( unsigned int c = 0; c < 3; ++c )
+            {
+            terms[c] = movingMapping.PostMatrix[0][c] * sample.Gradient[0]
+              + movingMapping.PostMatrix[1][c] * sample.Gradient[1]
+              + movingMapping.PostMatrix[2][c] * sample.Gradient[2];
+            }
+          for( unsigned int j = 0; j < 3; ++j )
+            {
+            const double dx = virtualPoints[b][j] - reference[j];
+            for( unsigned int c = 0; c < 3; ++c )
+              {
+              terms[3 + 3 * j + c] = terms[c] * dx;
+              }
+            }
+
+          double *jointPDFDerivatives = &accumulator.JointPDFDerivatives[firstBin * NumberOfAffineTerms];
+          for( unsigned int k = 0; k < 4; ++k, jointPDFDerivatives += NumberOfAffineTerms )
+            {
+            jointPDF[k] += CubicBSpline(sample.FirstArgument + k);
+            const double weight = -CubicBSplineDerivative(sample.FirstArgument + k);
+            for( unsigned int t = 0; t < NumberOfAffineTerms; ++t )
+              {
+              jointPDFDerivatives[t] += weight * terms[t];
+              }
+            }
+          }
+        }
+    };
+  this->ParallelizeWorkUnits(context, processWorkUnit);
+
+  std::vector<double> binWeights;
+  const bool          valid = this->ComputeMutualInformation(context, value, computeDerivative ? &binWeights : nullptr);
+  if( !computeDerivative )
+    {
+    return;
+    }
+
+  const NumberOfParametersType numberOfParameters = this->GetNumberOfParameters();
+  if( derivative->GetSize() != numberOfParameters )
+    {
+    derivative->SetSize(numberOfParameters);
+    }
+  derivative->Fill(NumericTraits<typename DerivativeType::ValueType>::ZeroValue() );
+  if( !valid )
+    {
+    return;
+    }
+
+  double affineDerivative[NumberOfAffineTerms] = {};
+  for( SizeValueType unit = 0; unit < context.NumberOfWorkUnits; ++unit )
+    {
+    const double *jointPDFDerivatives = m_Accumulators[unit].JointPDFDerivatives.data();
+    for( size_t bin = 0; bin < binWeights.size(); ++bin, jointPDFDerivatives += NumberOfAffineTerms )
+      {
+      if( binWeights[bin] != 0.0 )
+        {
+        for( unsigned int t = 0; t < NumberOfAffineTerms; ++t )
+          {
+          affineDerivative[t] += binWeights[bin] * jointPDFDerivatives[t];
+          }
+        }
+      }
+    }
+
+  // Chain to the optimized parameters with the Jacobian at the reference
+  // point and one unit along each axis.
+  typename TransformBaseType::InputPointType point;
+  typename TransformBaseType::JacobianType   referenceJacobian;
+  typename TransformBaseType::JacobianType   jacobian;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    point[d] = reference[d];
+    }
+  activeTransform->ComputeJacobianWithRespectToParameters(point, referenceJacobian);
+  for( NumberOfParametersType mu = 0; mu < numberOfParameters; ++mu )
+    {
+    for( unsigned int r = 0; r < 3; ++r )
+      {
+      ( *derivative )[mu] += affineDerivative[r] * referenceJacobian(r, mu);
+      }
+    }
+  for( unsigned int j = 0; j < 3; ++j )
+    {
+    point[j] = reference[j] + 1.0;
+    activeTransform->ComputeJacobianWithRespectToParameters(point, jacobian);
+    point[j] = reference[j];
+    for( NumberOfParametersType mu = 0; mu < numberOfParameters; ++mu )
+      {
+      for( unsigned int r = 0; r < 3; ++r )
+        {
+        ( *derivative )[mu] += affineDerivative[3 + 3 * j + r] * ( jacobian(r, mu) - referenceJacobian(r, mu) );
+        }
+      }
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::ComputeBSplineValueAndDerivative(MeasureType & value, DerivativeType *derivative) const
+{
+  using CoefficientImageType = typename BSplineTransformType::ImageType;
+
+  const bool            computeDerivative = ( derivative != nullptr );
+  EvaluationContextType context;
+  this->InitializeEvaluationContext(context, computeDerivative);
+  const TransformMappingType & movingMapping = context.MovingMapping;
+  const BSplineTransformType * bspline = dynamic_cast<const BSplineTransformType *>( movingMapping.ActiveTransform );
+
+  // Control point grid, the coefficient images share its geometry.
+  const typename BSplineTransformType::CoefficientImageArray coefficientImages = bspline->GetCoefficientImages();
+  ImageBufferType<CoefficientImageType>                      grid;
+  InitializeImageBuffer(coefficientImages[0].GetPointer(), coefficientImages[0]->GetLargestPossibleRegion(), grid);
+  const typename CoefficientImageType::PixelType *coefficients[3];
+  OffsetValueType                                 gridSize[3];
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    coefficients[d] = coefficientImages[d]->GetBufferPointer();
+    gridSize[d] = grid.End[d] - grid.Start[d] + 1;
+    }
+  const OffsetValueType numberOfControlPoints = gridSize[0] * gridSize[1] * gridSize[2];
+  const OffsetValueType gridStride[3] = { 1, gridSize[0], gridSize[0] * gridSize[1] };
+
+  double movingIndexMatrix[3][3];
+  double movingIndexOffset[3];
+  for( unsigned int r = 0; r < 3; ++r )
+    {
+    movingIndexOffset[r] = 0.0;
+    for( unsigned int c = 0; c < 3; ++c )
+      {
+      movingIndexMatrix[r][c] = 0.0;
+      for( unsigned int k = 0; k < 3; ++k )
+        {
+        movingIndexMatrix[r][c] += context.MovingBuffer.PhysicalToIndex[r][k] * movingMapping.PostMatrix[k][c];
+        }
+      movingIndexOffset[r] +=
+        context.MovingBuffer.PhysicalToIndex[r][c] * ( movingMapping.PostOffset[c] - context.MovingBuffer.Origin[c] );
+      }
+    }
+
+  // Map one virtual point through the BSpline and the post transforms, and
+  // evaluate it.  Outside the valid region the BSpline is the identity and
+  // contributes no derivative, as BSplineTransform::TransformPoint.
+  auto evaluateBSplineSample = [&](const double x[3], const double fixedIndex[3], BSplineSampleType & record) -> bool
+    {
+      double gridIndex[3];
+      bool   inside = true;
+      for( unsigned int r = 0; r < 3; ++r )
+        {
+        gridIndex[r] = 0.0;
+        for( unsigned int c = 0; c < 3; ++c )
+          {
+          gridIndex[r] += grid.PhysicalToIndex[r][c] * ( x[c] - grid.Origin[c] );
+          }
+        inside = inside && gridIndex[r] >= 1.0 && gridIndex[r] < static_cast<double>( gridSize[r] ) - 2.0;
+        }
+
+      double z[3] = { x[0], x[1], x[2] };
+      record.SupportStart = -1;
+      if( inside )
+        {
+        record.SupportStart = 0;
+        for( unsigned int d = 0; d < 3; ++d )
+          {
+          const OffsetValueType start = Math::Floor<OffsetValueType>(gridIndex[d]) - 1;
+          for( unsigned int k = 0; k < 4; ++k )
+            {
+            record.Weights[d][k] = CubicBSpline(gridIndex[d] - static_cast<double>( start + k ) );
+            }
+          record.SupportStart += start * gridStride[d];
+          }
+        for( unsigned int k2 = 0; k2 < 4; ++k2 )
+          {
+          for( unsigned int k1 = 0; k1 < 4; ++k1 )
+            {
+            const double          w21 = record.Weights[2][k2] * record.Weights[1][k1];
+            const OffsetValueType row = record.SupportStart + k2 * gridStride[2] + k1 * gridStride[1];
+            for( unsigned int k0 = 0; k0 < 4; ++k0 )
+              {
+              const double w = w21 * record.Weights[0][k0];
+              z[0] += w * coefficients[0][row + k0];
+              z[1] += w * coefficients[1][row + k0];
+              z[2] += w * coefficients[2][row + k0];
+              }
+            }
+          }
+        }
+
+      double movingPoint[3];
+      double movingIndex[3];
+      for( unsigned int r = 0; r < 3; ++r )
+        {
+        movingPoint[r] = movingMapping.PostOffset[r] + movingMapping.PostMatrix[r][0] * z[0]
+          + movingMapping.PostMatrix[r][1] * z[1] + movingMapping.PostMatrix[r][2] * z[2];
+        movingIndex[r] = movingIndexOffset[r] + movingIndexMatrix[r][0] * z[0]
+          + movingIndexMatrix[r][1] * z[1] + movingIndexMatrix[r][2] * z[2];
+        }
+
+      SampleType sample;
+      if( !this->EvaluateSample(context, x, fixedIndex, movingPoint, movingIndex, computeDerivative, sample) )
+        {
+        return false;
+        }
+      record.FixedBin = sample.FixedBin;
+      record.PDFMovingIndex = sample.PDFMovingIndex;
+      record.FirstArgument = sample.FirstArgument;
+      if( computeDerivative )
+        {
+        for( unsigned int c = 0; c < 3; ++c )
+          {
+          record.Gradient[c] = movingMapping.PostMatrix[0][c] * sample.Gradient[0]
+            + movingMapping.PostMatrix[1][c] * sample.Gradient[1]
+            + movingMapping.PostMatrix[2][c] * sample.Gradient[2];
+          }
+        }
+      return true;
+    };
+
+  auto forEachSample = [&](SizeValueType unit, const std::function<void(const BSplineSampleType &)> & function)
+    {
+      double              virtualPoints[SampleBatchSize][3];
+      double              fixedIndices[SampleBatchSize][3];
+      const SizeValueType firstBatch = context.NumberOfBatches * unit / context.NumberOfWorkUnits;
+      const SizeValueType lastBatch = context.NumberOfBatches * ( unit + 1 ) / context.NumberOfWorkUnits;
+      for( SizeValueType batch = firstBatch; batch < lastBatch; ++batch )
+        {
+        const SizeValueType batchStart = batch * SampleBatchSize;
+        const unsigned int  batchSize =
+          static_cast<unsigned int>( std::min<SizeValueType>( SampleBatchSize, context.NumberOfSamples - batchStart ) );
+        this->GetVirtualPoints(context, batchStart, batchSize, virtualPoints);
+        for( unsigned int b = 0; b < batchSize; ++b )
+          {
+          for( unsigned int r = 0; r < 3; ++r )
+            {
+            fixedIndices[b][r] = context.FixedIndexOffset[r] + context.FixedIndexMatrix[r][0] * virtualPoints[b][0]
+              + context.FixedIndexMatrix[r][1] * virtualPoints[b][1]
+              + context.FixedIndexMatrix[r][2] * virtualPoints[b][2];
+            }
+          }
+        for( unsigned int b = 0; b < batchSize; ++b )
+          {
+          BSplineSampleType record;
+          if( evaluateBSplineSample(virtualPoints[b], fixedIndices[b], record) )
+            {
+            function(record);
+            }
+          }
+        }
+    };
+
+  // Pass 1: joint PDF, keeping the samples for the derivative pass.
+  const OffsetValueType numberOfBins = static_cast<OffsetValueType>( this->GetNumberOfHistogramBins() );
+  const bool            cacheSamples = computeDerivative && context.NumberOfSamples <= MaximumNumberOfCachedSamples;
+  this->ParallelizeWorkUnits(context, [&](SizeValueType unit)
+    {
+      AccumulatorType & accumulator = m_Accumulators[unit];
+      forEachSample(unit, [&](const BSplineSampleType & record)
+        {
+          accumulator.FixedMarginalPDF[record.FixedBin] += 1.0;
+          ++accumulator.NumberOfValidPoints;
+          double *jointPDF = &accumulator.JointPDF[record.FixedBin * numberOfBins + record.PDFMovingIndex];
+          for( unsigned int k = 0; k < 4; ++k )
+            {
+            jointPDF[k] += CubicBSpline(record.FirstArgument + k);
+            }
+          if( cacheSamples )
+            {
+            accumulator.BSplineSamples.push_back(record);
+            }
+        });
+    });
+
+  std::vector<double> binWeights;
+  const bool          valid = this->ComputeMutualInformation(context, value, computeDerivative ? &binWeights : nullptr);
+  if( !computeDerivative )
+    {
+    return;
+    }
+
+  const NumberOfParametersType numberOfParameters = this->GetNumberOfParameters();
+  if( derivative->GetSize() != numberOfParameters )
+    {
+    derivative->SetSize(numberOfParameters);
+    }
+  derivative->Fill(NumericTraits<typename DerivativeType::ValueType>::ZeroValue() );
+  if( !valid )
+    {
+    return;
+    }
+
+  // Pass 2: scatter every sample into the 4x4x4 control points of its
+  // support.  Accumulator blocks are allocated on first touch and kept for
+  // the next iteration.
+  const SizeValueType numberOfBlocks = ( numberOfControlPoints + ControlPointBlockSize - 1 ) / ControlPointBlockSize;
+  this->ParallelizeWorkUnits(context, [&](SizeValueType unit)
+    {
+      AccumulatorType & accumulator = m_Accumulators[unit];
+      if( accumulator.ParameterBlocks.size() != numberOfBlocks )
+        {
+        accumulator.ParameterBlocks.assign(numberOfBlocks, std::vector<double>() );
+        accumulator.BlockTouched.assign(numberOfBlocks, 0);
+        accumulator.TouchedBlocks.clear();
+        }
+      for( const SizeValueType block : accumulator.TouchedBlocks )
+        {
+        std::fill(accumulator.ParameterBlocks[block].begin(), accumulator.ParameterBlocks[block].end(), 0.0);
+        accumulator.BlockTouched[block] = 0;
+        }
+      accumulator.TouchedBlocks.clear();
+
+      auto scatter = [&](const BSplineSampleType & record)
+        {
+          if( record.SupportStart < 0 )
+            {
+            return;
+            }
+          const OffsetValueType firstBin = record.FixedBin * numberOfBins + record.PDFMovingIndex;
+          double                factor = 0.0;
+          for( unsigned int k = 0; k < 4; ++k )
+            {
+            factor -= binWeights[firstBin + k] * CubicBSplineDerivative(record.FirstArgument + k);
+            }
+          if( factor == 0.0 )
+            {
+            return;
+            }
+          for( unsigned int k2 = 0; k2 < 4; ++k2 )
+            {
+            for( unsigned int k1 = 0; k1 < 4; ++k1 )
+              {
+              const double          w21 = factor * record.Weights[2][k2] * record.Weights[1][k1];
+              const OffsetValueType row = record.SupportStart + k2 * gridStride[2] + k1 * gridStride[1];
+              for( unsigned int k0 = 0; k0 < 4; ++k0 )
+                {
+                const SizeValueType node = static_cast<SizeValueType>( row + k0 );
+                const SizeValueType block = node / ControlPointBlockSize;
+                if( !accumulator.BlockTouched[block] )
+                  {
+                  if( accumulator.ParameterBlocks[block].empty() )
+                    {
+                    accumulator.ParameterBlocks[block].assign(3 * ControlPointBlockSize, 0.0);
+                    }
+                  accumulator.BlockTouched[block] = 1;
+                  accumulator.TouchedBlocks.push_back(block);
+                  }
+                const double w = w21 * record.Weights[0][k0];
+                double *     p = &accumulator.ParameterBlocks[block][node % ControlPointBlockSize];
+                p[0] += w * record.Gradient[0];
+                p[ControlPointBlockSize] += w * record.Gradient[1];
+                p[2 * ControlPointBlockSize] += w * record.Gradient[2];
+                }
+              }
+            }
+        };
+
+      if( cacheSamples )
+        {
+        for( const BSplineSampleType & record : accumulator.BSplineSamples )
+          {
+          scatter(record);
+          }
+        }
+      else
+        {
+        forEachSample(unit, scatter);
+        }
+    });
+
+  // Reduce the touched blocks in work unit order.  BSplineTransform stores
+  // all the x coefficients, then all y, then all z.
+  for( SizeValueType unit = 0; unit < context.NumberOfWorkUnits; ++unit )
+    {
+    const AccumulatorType & accumulator = m_Accumulators[unit];
+    for( const SizeValueType block : accumulator.TouchedBlocks )
+      {
+      const double *      values = accumulator.ParameterBlocks[block].data();
+      const SizeValueType firstNode = block * ControlPointBlockSize;
+      const SizeValueType lastNode =
+        std::min<SizeValueType>( firstNode + ControlPointBlockSize, numberOfControlPoints );
+      for( unsigned int d = 0; d < 3; ++d )
+        {
+        for( SizeValueType node = firstNode; node < lastNode; ++node )
+          {
+          ( *derivative )[d * numberOfControlPoints + node] +=
+            values[d * ControlPointBlockSize + node - firstNode];
+          }
+        }
+      }
+    }
+}
+
+template <typename TFixedImage, typename TMovingImage, typename TVirtualImage,
+          typename TInternalComputationValueType, typename TMetricTraits>
+void
+FastMattesMutualInformationImageToImageMetricv4<TFixedImage, TMovingImage, TVirtualImage,
+                                                TInternalComputationValueType, TMetricTraits>
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "UseFastPath: " << m_UseFastPath << std::endl;
+  os << indent << "FastPathType: " << this->GetFastPathType() << std::endl;
+}
+} // end namespace itk
+
+#endif
@@ -32,6 +32,8 @@
 #include "itkThinPlateR2LogRSplineKernelTransform.h"
 #include "itkResampleImageFilter.h"
 #include "itkImageDuplicator.h"
+#include "itkContinuousIndex.h"
+#include "itkMath.h"
 #include "Imgmath.h"
 #include "itkGDCMSeriesFileNames.h"
 #include "itkImageSeriesReader.h"
@@ -216,6 +218,183 @@ typename TReadImageType::Pointer ReadImageCoronal(const std::string & fileName)
   return ReadImageAndOrient<TReadImageType>(fileName, CORdir);
 }
 
+/**
+  * Re-base an image that has only a sub-region buffered so that the
+  * buffered region becomes the whole image, starting at index 0.  The
+  * origin is moved to the physical location of the first buffered voxel,
+  * so physical coordinates are unchanged.  The pixel container is shared,
+  * no pixel data is copied.
+  */
+template <typename TImage>
+typename TImage::Pointer
+MakeBufferedRegionLargest(const typename TImage::Pointer & input)
+{
+  const typename TImage::RegionType & buffered = input->GetBufferedRegion();
+  typename TImage::PointType          origin;
+  input->TransformIndexToPhysicalPoint(buffered.GetIndex(), origin);
+
+  typename TImage::RegionType region;
+  region.SetSize( buffered.GetSize() );
+
+  typename TImage::Pointer image = TImage::New();
+  image->CopyInformation(input);
+  image->SetOrigin(origin);
+  image->SetRegions(region);
+  image->SetPixelContainer( input->GetPixelContainer() );
+  image->SetMetaDataDictionary( input->GetMetaDataDictionary() );
+  return image;
+}
+
+/**
+  * Compute the file index region that covers the axis aligned physical
+  * bounding box [lowerPoint, upperPoint], padded by padVoxels on every side
+  * so the result can be interpolated anywhere inside the box.  The region is
+  * cropped to imageInfo's largest possible region; an empty region (size 0)
+  * is returned when the box does not touch the image.
+  *
+  * Physical space is not changed by re-orientation, so bounds expressed for
+  * an oriented image map directly onto the on-disk voxel grid.
+  */
+template <typename TImage>
+typename TImage::RegionType
+PhysicalBoundsToIndexRegion(const TImage *imageInfo,
+                            const typename TImage::PointType & lowerPoint,
+                            const typename TImage::PointType & upperPoint,
+                            const unsigned int padVoxels = 1)
+{
+  constexpr unsigned int Dimension = TImage::ImageDimension;
+  using ContinuousIndexType = itk::ContinuousIndex<double, Dimension>;
+
+  double lower[Dimension];
+  double upper[Dimension];
+  for( unsigned int d = 0; d < Dimension; ++d )
+    {
+    lower[d] = itk::NumericTraits<double>::max();
+    upper[d] = itk::NumericTraits<double>::NonpositiveMin();
+    }
+  // The box corners span the box in index space for any direction matrix.
+  for( unsigned int corner = 0; corner < ( 1U << Dimension ); ++corner )
+    {
+    typename TImage::PointType point;
+    for( unsigned int d = 0; d < Dimension; ++d )
+      {
+      point[d] = ( corner & ( 1U << d ) ) ? upperPoint[d] : lowerPoint[d];
+      }
+    ContinuousIndexType cindex;
+    imageInfo->TransformPhysicalPointToContinuousIndex(point, cindex);
+    for( unsigned int d = 0; d < Dimension; ++d )
+      {
+      lower[d] = std::min(lower[d], cindex[d]);
+      upper[d] = std::max(upper[d], cindex[d]);
+      }
+    }
+
+  const typename TImage::RegionType & largest = imageInfo->GetLargestPossibleRegion();
+  typename TImage::RegionType         region;
+  for( unsigned int d = 0; d < Dimension; ++d )
+    {
+    const itk::IndexValueType first = itk::Math::Floor<itk::IndexValueType>(lower[d]) - padVoxels;
+    const itk::IndexValueType last = itk::Math::Ceil<itk::IndexValueType>(upper[d]) + padVoxels;
+    region.SetIndex(d, first);
+    region.SetSize(d, static_cast<itk::SizeValueType>( last - first + 1 ) );
+    }
+  if( !region.Crop(largest) )
+    {
+    region.SetIndex( largest.GetIndex() );
+    region.GetModifiableSize().Fill(0);
+    }
+  return region;
+}
+
+/**
+  * Read only the requested index region of an image file.
+  *
+  * For image IOs that support streamed reading (uncompressed NRRD, NIfTI,
+  * MetaImage, ...) only the bytes of the requested region are read from
+  * disk.  Compressed files are not seekable, so for those the IO decodes
+  * the whole file once and the region is extracted from it; write the
+  * volume uncompressed to benefit from streaming.
+  *
+  * The returned image holds just the requested region, re-based to start at
+  * index 0 with the origin adjusted so physical coordinates are preserved.
+  */
+template <typename TImage>
+typename TImage::Pointer
+ReadImageRegion(const std::string & fileName,
+                const typename TImage::RegionType & requestedRegion)
+{
+  using ReaderType = itk::ImageFileReader<TImage>;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName.c_str() );
+  typename TImage::Pointer image;
+  try
+    {
+    reader->UpdateOutputInformation();
+    typename TImage::RegionType region = requestedRegion;
+    if( !region.Crop( reader->GetOutput()->GetLargestPossibleRegion() ) )
+      {
+      itkGenericExceptionMacro( << "Requested region " << requestedRegion
+                                << " is outside of image " << fileName );
+      }
+    reader->GetOutput()->SetRequestedRegion(region);
+    reader->Update();
+    image = reader->GetOutput();
+    image->DisconnectPipeline();
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cout << "Caught an exception: " << std::endl;
+    std::cout << err << " " << __FILE__ << " " << __LINE__ << std::endl;
+    throw;
+    }
+  return MakeBufferedRegionLargest<TImage>(image);
+}
+
+/**
+  * Read the part of an image file that covers the axis aligned physical
+  * bounding box [lowerPoint, upperPoint] (plus padVoxels of margin).
+  * See ReadImageRegion for the streaming behavior.
+  */
+template <typename TImage>
+typename TImage::Pointer
+ReadImagePhysicalRegion(const std::string & fileName,
+                        const typename TImage::PointType & lowerPoint,
+                        const typename TImage::PointType & upperPoint,
+                        const unsigned int padVoxels = 1)
+{
+  using ReaderType = itk::ImageFileReader<TImage>;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName.c_str() );
+  reader->UpdateOutputInformation();
+  const typename TImage::RegionType region =
+    PhysicalBoundsToIndexRegion<TImage>(reader->GetOutput(), lowerPoint, upperPoint, padVoxels);
+  if( region.GetNumberOfPixels() == 0 )
+    {
+    itkGenericExceptionMacro( << "Physical region [" << lowerPoint << ", " << upperPoint
+                              << "] does not overlap image " << fileName );
+    }
+  return ReadImageRegion<TImage>(fileName, region);
+}
+
+/**
+  * Region aware counterpart of ReadImageAndOrient.  The physical bounding
+  * box is the same before and after re-orientation, so only the covering
+  * part of the file is read and only that part is re-oriented; the full
+  * volume is never loaded or copied.
+  */
+template <typename ImageType>
+typename ImageType::Pointer
+ReadImagePhysicalRegionAndOrient(const std::string & filename,
+                                 const typename ImageType::PointType & lowerPoint,
+                                 const typename ImageType::PointType & upperPoint,
+                                 itk::SpatialOrientation::ValidCoordinateOrientationFlags orient,
+                                 const unsigned int padVoxels = 1)
+{
+  typename ImageType::Pointer img =
+    ReadImagePhysicalRegion<ImageType>(filename, lowerPoint, upperPoint, padVoxels);
+  return OrientImage<ImageType>(img, orient);
+}
+
 /*
  * This is the prefered ABI for Writing images.
  * We know that the image is not going to change
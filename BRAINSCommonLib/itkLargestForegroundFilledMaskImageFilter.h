@@ -19,9 +19,13 @@
 #ifndef __itkLargestForegroundFilledMaskImageFilter_h
 #define __itkLargestForegroundFilledMaskImageFilter_h
 
+#include "BRAINSImageContentKey.h"
 #include <itkImage.h>
 #include <itkImageToImageFilter.h>
 #include <itkNumericTraits.h>
+#include <list>
+#include <mutex>
+#include <vector>
 
 namespace itk
 {
@@ -52,6 +56,19 @@ namespace itk
   *background
   * values specified by the user (defaults to 1 and 0 respectively).
   *
+  * The closing and dilation use the same ellipsoidal balls as
+  * BinaryBallStructuringElement, ClosingSize / spacing (or DilateSize /
+  * spacing) voxels along each axis rounded up, but are computed from
+  * distance maps, so their cost does not depend on the ball size.  They are
+  * only evaluated on the bounding box of the largest component padded by
+  * the ball radii.
+  *
+  * When UseResultCache is on, the mask is remembered for the lifetime of
+  * the process, keyed on the geometry of the input image, a hash of its
+  * pixels and the filter parameters, so repeated requests for the same
+  * mask are copies.  The hash is computed on every request, so a mask is
+  * not reused after the input pixels are changed in place.
+  *
   */
 template <typename TInputImage, typename TOutputImage = TInputImage>
 class LargestForegroundFilledMaskImageFilter :
@@ -119,6 +136,11 @@ public:
   itkGetMacro(OutsideValue, IntegerPixelType);
   itkSetMacro(ThresholdCorrectionFactor, double);
   itkGetConstMacro(ThresholdCorrectionFactor, double);
+  /** Reuse masks previously computed in this process for the same input
+    * and parameters */
+  itkSetMacro(UseResultCache, bool);
+  itkGetConstMacro(UseResultCache, bool);
+  itkBooleanMacro(UseResultCache);
 protected:
   LargestForegroundFilledMaskImageFilter();
   ~LargestForegroundFilledMaskImageFilter() override;
@@ -127,14 +149,36 @@ protected:
   void GenerateData() override;
 
 private:
-  /** Returns true if more than two bins of informaiton are found,
-    * returns false if only two bins of informaiton are found (i.e. found a
-    *binary image).
-    * Low and High are set to the ?????? */
-  unsigned int SetLowHigh(InputPixelType & low, InputPixelType & high);
-
   void ImageMinMax(InputPixelType & min, InputPixelType & max) const;
 
+  /** Compute the lower foreground threshold, sharing one pass over the
+    * input between the quantile histogram and the Otsu histogram. */
+  InputPixelType ComputeForegroundThreshold() const;
+
+  /** Radius in voxels of a ball of size mm, rounded up along each axis */
+  static typename IntegerImageType::SizeType BallRadius(double size,
+                                                        const typename IntegerImageType::SpacingType & spacing);
+
+  /** Dilation of the voxels equal to objectValue in the 0/1 valued mask by
+    * the BinaryBallStructuringElement of the given radius. */
+  typename IntegerImageType::Pointer DistanceDilate(const IntegerImageType *mask,
+                                                    IntegerPixelType objectValue,
+                                                    const typename IntegerImageType::SizeType & radius) const;
+
+  struct ResultCacheEntry
+    {
+    BRAINSUtils::ImageContentKey<InputImageType> Input;
+    std::vector<double>                          Parameters;
+    typename OutputImageType::Pointer            Mask;
+    };
+  using ResultCacheType = std::list<ResultCacheEntry>;
+
+  std::vector<double> GetCacheParameters() const;
+
+  static ResultCacheType & GetResultCache();
+
+  static std::mutex & GetResultCacheMutex();
+
   // No longer used  double m_OtsuPercentileThreshold;
   double           m_OtsuPercentileLowerThreshold;
   double           m_OtsuPercentileUpperThreshold;
@@ -143,6 +187,7 @@ private:
   double           m_DilateSize;
   IntegerPixelType m_InsideValue;
   IntegerPixelType m_OutsideValue;
+  bool             m_UseResultCache;
 };
 } // end namespace itk
 
@@ -25,11 +25,15 @@
 #include <itkRelabelComponentImageFilter.h>
 #include <itkBinaryThresholdImageFilter.h>
 #include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
 // #include <itkSimpleFilterWatcher.h>
-#include <itkImageRegionIterator.h>
 #include <itkBinaryBallStructuringElement.h>
 #include <itkBinaryDilateImageFilter.h>
 #include <itkBinaryErodeImageFilter.h>
+#include <itkExtractImageFilter.h>
+#include <itkSignedMaurerDistanceMapImageFilter.h>
+#include <itkImageAlgorithm.h>
+#include <itkMultiThreaderBase.h>
 #include <vnl/vnl_sample.h>
 #include <itkMath.h>
 #include <itkConnectedThresholdImageFilter.h>
@@ -39,8 +43,10 @@
 #include <itkScalarImageToHistogramGenerator.h>
 // Not this:   #include <itkOtsuMultipleThresholdsCalculator.h>
 #include <itkImageToHistogramFilter.h>
+#include <itkHistogram.h>
 #include <itkOtsuThresholdCalculator.h>
 #include <itkCastImageFilter.h>
+#include <algorithm>
 
 namespace itk
 {
@@ -53,7 +59,8 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
   m_ClosingSize(9.0),
   m_DilateSize(0.0),
   m_InsideValue(NumericTraits<typename IntegerImageType::PixelType>::OneValue()),
-  m_OutsideValue(NumericTraits<typename IntegerImageType::PixelType>::ZeroValue())
+  m_OutsideValue(NumericTraits<typename IntegerImageType::PixelType>::ZeroValue()),
+  m_UseResultCache(false)
 {
 }
 
@@ -79,7 +86,9 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
      << "InsideValue "
      << m_InsideValue << " "
      << "OutsideValue "
-     << m_OutsideValue << std::endl;
+     << m_OutsideValue << " "
+     << "UseResultCache "
+     << m_UseResultCache << std::endl;
 }
 
 template <typename TInputImage, typename TOutputImage>
@@ -96,6 +105,196 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
   imageMin = minmaxFilter->GetMinimum();
 }
 
+template <typename TInputImage, typename TOutputImage>
+typename LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>::ResultCacheType &
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::GetResultCache()
+{
+  static ResultCacheType cache;
+  return cache;
+}
+
+template <typename TInputImage, typename TOutputImage>
+std::mutex &
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::GetResultCacheMutex()
+{
+  static std::mutex cacheMutex;
+  return cacheMutex;
+}
+
+template <typename TInputImage, typename TOutputImage>
+std::vector<double>
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::GetCacheParameters() const
+{
+  std::vector<double> parameters;
+  parameters.push_back(m_OtsuPercentileLowerThreshold);
+  parameters.push_back(m_OtsuPercentileUpperThreshold);
+  parameters.push_back(m_ThresholdCorrectionFactor);
+  parameters.push_back(m_ClosingSize);
+  parameters.push_back(m_DilateSize);
+  parameters.push_back(m_InsideValue);
+  parameters.push_back(m_OutsideValue);
+  return parameters;
+}
+
+template <typename TInputImage, typename TOutputImage>
+typename TInputImage::PixelType
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::ComputeForegroundThreshold() const
+{
+  InputPixelType imageMin;
+  InputPixelType imageMax;
+  this->ImageMinMax(imageMin, imageMax);
+
+  // The quantile histogram has unit width bins over [min,max] (as in
+  // ComputeHistogramQuantileThresholds), and is only needed to count the
+  // occupied bins.  The Otsu histogram has 128 bins with the same upper margin
+  // as ImageToHistogramFilter's automatic minimum and maximum.
+  const double rangeMin = static_cast<double>( imageMin );
+  const double rangeMax = static_cast<double>( imageMax );
+  const SizeValueType numberOfUnitBins =
+    std::max<SizeValueType>( 1, static_cast<SizeValueType>( rangeMax - rangeMin + 1.0 ) );
+  const double unitBinWidth = ( rangeMax - rangeMin ) / numberOfUnitBins;
+
+  constexpr SizeValueType numberOfOtsuBins = 128; // V3 itkOtsuThresholdImageCalculator.hxx m_NumberOfHistogramBins = 128
+  const double otsuUpper = rangeMax + ( ( rangeMax - rangeMin ) / numberOfOtsuBins ) / 100.0;
+  const double otsuBinWidth = ( otsuUpper - rangeMin ) / numberOfOtsuBins;
+
+  std::vector<unsigned char> occupiedUnitBins(numberOfUnitBins, 0);
+  std::vector<double>        otsuFrequencies(numberOfOtsuBins, 0.0);
+  std::mutex                 mergeMutex;
+
+  const InputImageType *inputImage = this->GetInput();
+  MultiThreaderBase::Pointer threader = MultiThreaderBase::New();
+  threader->ParallelizeImageRegion<InputImageType::ImageDimension>(
+    inputImage->GetBufferedRegion(),
+    [&](const InputImageRegionType & region)
+    {
+      std::vector<unsigned char> localOccupied(numberOfUnitBins, 0);
+      std::vector<double>        localFrequencies(numberOfOtsuBins, 0.0);
+      for( ImageRegionConstIterator<InputImageType> it(inputImage, region); !it.IsAtEnd(); ++it )
+        {
+        const double value = static_cast<double>( it.Get() );
+        if( unitBinWidth > 0.0 )
+          {
+          const SizeValueType unitBin = static_cast<SizeValueType>( ( value - rangeMin ) / unitBinWidth );
+          localOccupied[std::min(unitBin, numberOfUnitBins - 1)] = 1;
+          }
+        else
+          {
+          localOccupied[0] = 1;
+          }
+        if( otsuBinWidth > 0.0 )
+          {
+          const SizeValueType otsuBin = static_cast<SizeValueType>( ( value - rangeMin ) / otsuBinWidth );
+          localFrequencies[std::min(otsuBin, numberOfOtsuBins - 1)] += 1.0;
+          }
+        }
+      std::lock_guard<std::mutex> lock(mergeMutex);
+      for( SizeValueType i = 0; i < numberOfUnitBins; ++i )
+        {
+        occupiedUnitBins[i] |= localOccupied[i];
+        }
+      for( SizeValueType i = 0; i < numberOfOtsuBins; ++i )
+        {
+        otsuFrequencies[i] += localFrequencies[i];
+        }
+    },
+    nullptr);
+
+  const unsigned int numNonZeroHistogramBins =
+    static_cast<unsigned int>( std::count(occupiedUnitBins.begin(), occupiedUnitBins.end(), 1) );
+  if( numNonZeroHistogramBins <= 2 )
+    {
+    std::cout << "Image handled with only two catgegories; effectively, binary thresholding."
+              << std::endl;
+    return imageMax;
+    }
+
+  using HistogramType = Statistics::Histogram<double>;
+  typename HistogramType::Pointer histogram = HistogramType::New();
+  histogram->SetMeasurementVectorSize(1);
+  typename HistogramType::SizeType histogramSize(1);
+  histogramSize[0] = numberOfOtsuBins;
+  typename HistogramType::MeasurementVectorType lowerBound(1);
+  typename HistogramType::MeasurementVectorType upperBound(1);
+  lowerBound[0] = rangeMin;
+  upperBound[0] = otsuUpper;
+  histogram->Initialize(histogramSize, lowerBound, upperBound);
+  for( SizeValueType i = 0; i < numberOfOtsuBins; ++i )
+    {
+    histogram->SetFrequency(i, otsuFrequencies[i]);
+    }
+
+  using OtsuImageCalcType = itk::OtsuThresholdCalculator<HistogramType>;
+  typename OtsuImageCalcType::Pointer OtsuImageCalc = OtsuImageCalcType::New();
+  OtsuImageCalc->SetInput( histogram );
+  OtsuImageCalc->Update();
+  const double otsuThreshold = OtsuImageCalc->GetThreshold();
+
+  return static_cast<InputPixelType>( m_ThresholdCorrectionFactor * otsuThreshold );
+}
+
+template <typename TInputImage, typename TOutputImage>
+typename LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>::IntegerImageType::SizeType
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::BallRadius(double size, const typename IntegerImageType::SpacingType & spacing)
+{
+  typename IntegerImageType::SizeType radius;
+  for( unsigned int d = 0; d < IntegerImageType::ImageDimension; ++d )
+    {
+    radius[d] = static_cast<SizeValueType>( itk::Math::ceil( std::max( size, 0.0 ) / spacing[d] ) );
+    }
+  return radius;
+}
+
+template <typename TInputImage, typename TOutputImage>
+typename LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>::IntegerImageType::Pointer
+LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
+::DistanceDilate(const IntegerImageType *mask, IntegerPixelType objectValue,
+                 const typename IntegerImageType::SizeType & radius) const
+{
+  // BinaryBallStructuringElement of this radius holds the offsets o with
+  // sum_d ( o[d] / ( radius[d] + 0.5 ) )^2 <= 1.  On a grid with spacing
+  // 1 / ( radius[d] + 0.5 ) those are the offsets within distance 1.
+  typename IntegerImageType::Pointer ballGridMask = IntegerImageType::New();
+  ballGridMask->Graft(mask);
+  typename IntegerImageType::SpacingType ballGridSpacing;
+  for( unsigned int d = 0; d < IntegerImageType::ImageDimension; ++d )
+    {
+    ballGridSpacing[d] = 1.0 / ( radius[d] + 0.5 );
+    }
+  ballGridMask->SetSpacing(ballGridSpacing);
+
+  using DistanceImageType = Image<float, IntegerImageType::ImageDimension>;
+  using DistanceFilterType = SignedMaurerDistanceMapImageFilter<IntegerImageType, DistanceImageType>;
+  typename DistanceFilterType::Pointer distanceFilter = DistanceFilterType::New();
+  distanceFilter->SetInput(ballGridMask);
+  distanceFilter->SetBackgroundValue( objectValue == 0 ? 1 : 0 );
+  distanceFilter->SetUseImageSpacing(true);
+  distanceFilter->SetSquaredDistance(true);
+  distanceFilter->SetInsideIsPositive(false);
+  distanceFilter->Update();
+
+  // Points inside the object have negative distances, points outside have the
+  // squared distance to the closest object voxel.
+  constexpr float ballSquared = 1.0F + 1e-6F;
+
+  typename IntegerImageType::Pointer dilated = IntegerImageType::New();
+  dilated->CopyInformation(mask);
+  dilated->SetRegions( mask->GetLargestPossibleRegion() );
+  dilated->Allocate();
+  ImageRegionConstIterator<DistanceImageType> distIt( distanceFilter->GetOutput(), dilated->GetLargestPossibleRegion() );
+  ImageRegionIterator<IntegerImageType>       outIt( dilated, dilated->GetLargestPossibleRegion() );
+  for( ; !outIt.IsAtEnd(); ++outIt, ++distIt )
+    {
+    outIt.Set( distIt.Get() <= ballSquared ? 1 : 0 );
+    }
+  return dilated;
+}
+
 template <typename TInputImage, typename TOutputImage>
 void
 LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
@@ -128,63 +327,36 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
     }
   this->AllocateOutputs();
 
-  // This is to help with noisy data that has a few spurious very high/ very low values.
-  using ImageCalcType = ComputeHistogramQuantileThresholds<TInputImage, TOutputImage>;
-  typename ImageCalcType::Pointer ImageCalc = ImageCalcType::New();
-  ImageCalc->SetImage( this->GetInput() );
-
-  ImageCalc->SetQuantileLowerThreshold(m_OtsuPercentileLowerThreshold);
-  ImageCalc->SetQuantileUpperThreshold(m_OtsuPercentileUpperThreshold);
-
-  ImageCalc->Calculate();
-
-  typename TInputImage::PixelType threshold_low_foreground;
-  typename TInputImage::PixelType threshold_hi  = ImageCalc->GetUpperIntensityThresholdValue();
-  const unsigned int numNonZeroHistogramBins = ImageCalc->GetNumberOfValidHistogramsEntries();
-
-  if( numNonZeroHistogramBins <= 2 )
-    {
-    threshold_low_foreground = threshold_hi;
-    }
-  else
+  const InputImageType *inputImage = this->GetInput();
+  OutputImageType *     outputImage = this->GetOutput();
+  BRAINSUtils::ImageContentKey<InputImageType> inputKey;
+  if( m_UseResultCache )
     {
-    // ##The Otsu thresholding stuff below should not be part of the new class,
-    // it shout really be a separate function.
-    using HistogramGeneratorType = itk::Statistics::ImageToHistogramFilter<TInputImage>;
-    using HistogramType = typename HistogramGeneratorType::HistogramType;
-
-    typename HistogramGeneratorType::Pointer histGenerator = HistogramGeneratorType::New();
-    histGenerator->SetInput( this->GetInput() );
-    typename HistogramGeneratorType::HistogramSizeType hsize(1);
-    hsize[0] = 128;  // V3 itkOtsuThresholdImageCalculator.hxx m_NumberOfHistogramBins = 128
-    histGenerator->SetHistogramSize( hsize );
-    histGenerator->SetAutoMinimumMaximum( true );
-
-    using OtsuImageCalcType = itk::OtsuThresholdCalculator<HistogramType>;
-    typename OtsuImageCalcType::Pointer OtsuImageCalc = OtsuImageCalcType::New();
-    OtsuImageCalc->SetInput( histGenerator->GetOutput() );
-    OtsuImageCalc->Update();
-    typename TInputImage::PixelType otsuThreshold = OtsuImageCalc->GetThreshold();
-    // std::cout << "whole-image-based otsuThreshold was: " << otsuThreshold <<
-    // std::endl;
-
-    const typename TInputImage::PixelType & otsuThresholdResult =
-      static_cast<typename TInputImage::PixelType>( m_ThresholdCorrectionFactor * otsuThreshold );
-    threshold_low_foreground = otsuThresholdResult;
+    inputKey = BRAINSUtils::GetImageContentKey(inputImage);
+    std::lock_guard<std::mutex> lock( GetResultCacheMutex() );
+    for( const auto & entry : GetResultCache() )
+      {
+      if( entry.Input == inputKey && entry.Parameters == this->GetCacheParameters() )
+        {
+        ImageAlgorithm::Copy( entry.Mask.GetPointer(), outputImage,
+                              outputImage->GetLargestPossibleRegion(), outputImage->GetLargestPossibleRegion() );
+        return;
+        }
+      }
     }
 
+  const InputPixelType threshold_low_foreground = this->ComputeForegroundThreshold();
+
   using InputThresholdFilterType = BinaryThresholdImageFilter<TInputImage,
                                      IntegerImageType>;
   typename InputThresholdFilterType::Pointer threshold =
     InputThresholdFilterType::New();
-  threshold->SetInput( this->GetInput() );
-  threshold->SetInsideValue(this->m_InsideValue);
-  threshold->SetOutsideValue(this->m_OutsideValue);
+  threshold->SetInput( inputImage );
+  threshold->SetInsideValue(1);
+  threshold->SetOutsideValue(0);
   threshold->SetLowerThreshold(threshold_low_foreground);
   const typename TInputImage::PixelType threshold_hi_foreground = NumericTraits<typename TInputImage::PixelType>::max();
   threshold->SetUpperThreshold(threshold_hi_foreground);
-  threshold->Update();
-//  typename TInputImage::PixelType threshold_low = ImageCalc->GetLowerIntensityThresholdValue();
   std::cout << "LowHigh Thresholds: ["
             << static_cast<int>( threshold_low_foreground ) << ","
             << static_cast<int>( threshold_hi_foreground ) << "]"
@@ -193,10 +365,7 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
   using FilterType = ConnectedComponentImageFilter<IntegerImageType,
                                         IntegerImageType>;
   typename FilterType::Pointer labelConnectedComponentsFilter = FilterType::New();
-  //  SimpleFilterWatcher watcher(labelConnectedComponentsFilter);
-  //  watcher.QuietOn();
   labelConnectedComponentsFilter->SetInput( threshold->GetOutput() );
-  // labelConnectedComponentsFilter->Update();
 
   using RelabelType = RelabelComponentImageFilter<IntegerImageType,
                                       IntegerImageType>;
@@ -213,178 +382,140 @@ LargestForegroundFilledMaskImageFilter<TInputImage, TOutputImage>
     std::cerr << excep << std::endl;
     }
 
-  using ThresholdFilterType = BinaryThresholdImageFilter<IntegerImageType,
-                                     IntegerImageType>;
-  // unsigned short numObjects = relabel->GetNumberOfObjects();
-  // std::cout << "Removed " << numObjects - 1 << " smaller objects." <<
-  // std::endl;
-  typename ThresholdFilterType::Pointer LargestFilter =
-    ThresholdFilterType::New();
-  LargestFilter->SetInput( relabel->GetOutput() );
-  LargestFilter->SetInsideValue(this->m_InsideValue);
-  LargestFilter->SetOutsideValue(this->m_OutsideValue);
-  LargestFilter->SetLowerThreshold(1);
-  LargestFilter->SetUpperThreshold(1);
-  LargestFilter->Update();
-
-  using myKernelType = BinaryBallStructuringElement<typename IntegerImageType::
-                                       PixelType,
-                                       IntegerImageType::ImageDimension>;
-
-  using ErodeFilterType = BinaryErodeImageFilter<IntegerImageType, IntegerImageType,
-                                 myKernelType>;
-  typename ErodeFilterType::Pointer ErodeFilter = ErodeFilterType::New();
+  // All the morphology below is confined to the bounding box of the largest
+  // component, padded by the closing and dilation radii so that the box
+  // border is background after the closing.
+  const typename IntegerImageType::RegionType imageRegion = relabel->GetOutput()->GetLargestPossibleRegion();
+  typename IntegerImageType::IndexType        boxLower = imageRegion.GetUpperIndex();
+  typename IntegerImageType::IndexType        boxUpper = imageRegion.GetIndex();
+  bool                                        foundLargest = false;
+  for( ImageRegionConstIteratorWithIndex<IntegerImageType> it(relabel->GetOutput(), imageRegion); !it.IsAtEnd(); ++it )
+    {
+    if( it.Get() == 1 )
+      {
+      const typename IntegerImageType::IndexType & idx = it.GetIndex();
+      for( unsigned int d = 0; d < IntegerImageType::ImageDimension; ++d )
+        {
+        boxLower[d] = std::min(boxLower[d], idx[d]);
+        boxUpper[d] = std::max(boxUpper[d], idx[d]);
+        }
+      foundLargest = true;
+      }
+    }
+
+  outputImage->FillBuffer( static_cast<OutputPixelType>( m_OutsideValue ) );
+  if( foundLargest )
     {
-    myKernelType dilateBall;
-    myKernelType erodeBall;
-    typename myKernelType::SizeType dilateBallSize;
-    typename myKernelType::SizeType erodeBallSize;
-    for( unsigned int d = 0; d < 3; ++d )
+    const typename IntegerImageType::SpacingType & spacing = relabel->GetOutput()->GetSpacing();
+    const typename IntegerImageType::SizeType      closingRadius = BallRadius(m_ClosingSize, spacing);
+    const typename IntegerImageType::SizeType      dilateRadius = BallRadius(m_DilateSize, spacing);
+    typename IntegerImageType::RegionType          cropRegion;
+    for( unsigned int d = 0; d < IntegerImageType::ImageDimension; ++d )
       {
-      const unsigned int ClosingVoxels = itk::Math::ceil ( m_ClosingSize / ( relabel->GetOutput()->GetSpacing()[d] ) );
-      if( ClosingVoxels > 20 )
+      if( closingRadius[d] > 20 )
         {
         std::cout << "WARNING:  Attempting to close with a very large number of voxels:  "
-                  << m_ClosingSize << " / " << ( relabel->GetOutput()->GetSpacing()[d] ) << " = " << ClosingVoxels
+                  << m_ClosingSize << " / " << spacing[d] << " = " << closingRadius[d]
                   << std::endl;
         std::cout << "Perhaps there is a mis-match between the voxel spacing"
                   << " and the assumption that  ClosingSize is given in mm"
                   << std::endl;
         }
-      dilateBallSize[d] = ClosingVoxels;
-      erodeBallSize[d]  = ClosingVoxels;
+      const IndexValueType padVoxels = static_cast<IndexValueType>( closingRadius[d] + dilateRadius[d] ) + 2;
+      cropRegion.SetIndex(d, boxLower[d] - padVoxels);
+      cropRegion.SetSize(d, boxUpper[d] - boxLower[d] + 1 + 2 * padVoxels);
+      }
+    cropRegion.Crop(imageRegion);
+
+    using ExtractFilterType = ExtractImageFilter<IntegerImageType, IntegerImageType>;
+    typename ExtractFilterType::Pointer extract = ExtractFilterType::New();
+    extract->SetInput( relabel->GetOutput() );
+    extract->SetExtractionRegion(cropRegion);
+    extract->Update();
+    typename IntegerImageType::Pointer largest = extract->GetOutput();
+    for( ImageRegionIterator<IntegerImageType> it(largest, cropRegion); !it.IsAtEnd(); ++it )
+      {
+      it.Set( it.Get() == 1 ? 1 : 0 );
       }
-    dilateBall.SetRadius(dilateBallSize);
-    dilateBall.CreateStructuringElement();
-    erodeBall.SetRadius(erodeBallSize);
-    erodeBall.CreateStructuringElement();
-
-    using DilateFilterType = BinaryDilateImageFilter<IntegerImageType, IntegerImageType,
-                                    myKernelType>;
-    typename DilateFilterType::Pointer DilateFilter = DilateFilterType::New();
-
-    // DilateFilter->SetForegroundValue(1);
-    DilateFilter->SetDilateValue(1);
-    DilateFilter->SetBackgroundValue(0);
-    DilateFilter->SetInput( LargestFilter->GetOutput() );
-    DilateFilter->SetKernel(dilateBall);
-    DilateFilter->Update();
-
-    // ErodeFilter->SetForegroundValue(1);
-    ErodeFilter->SetErodeValue(1);
-    ErodeFilter->SetBackgroundValue(0);
-    ErodeFilter->SetInput( DilateFilter->GetOutput() );
-    ErodeFilter->SetKernel(erodeBall);
-    ErodeFilter->Update();
-    }
-
-  // silence warnings by converting the size to index
-  typename IntegerImageType::IndexType IndImageSize;
-  for(unsigned int _i = 0; _i < IntegerImageType::ImageDimension; ++_i)
-    {
-    IndImageSize[_i] = static_cast<typename IntegerImageType::IndexValueType>
-      (ErodeFilter->GetOutput()->GetLargestPossibleRegion().GetSize()[_i]);
-    }
-  // NOTE:  The most robust way to do this would be to find the largest
-  // background labeled image, and then choose one of those locations as the
-  // seed.
-  // For now just choose all the corners as seed points
-  using seededConnectedThresholdFilterType = ConnectedThresholdImageFilter<IntegerImageType,
-                                        IntegerImageType>;
-  typename seededConnectedThresholdFilterType::Pointer
-  seededConnectedThresholdFilter = seededConnectedThresholdFilterType::New();
 
+    // Closing = dilation of the object followed by dilation of the background.
+    typename IntegerImageType::Pointer closed = this->DistanceDilate(largest, 1, closingRadius);
     {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, 0, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation = { { IndImageSize[0] - 1, 0, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, IndImageSize[1] - 1, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation = { { IndImageSize[0] - 1, IndImageSize[1] - 1, 0 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, 0, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation = { { IndImageSize[0] - 1, 0, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation = { { 0, IndImageSize[1] - 1, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
-    }
-    {
-    const typename IntegerImageType::IndexType SeedLocation =
-      { { IndImageSize[0] - 1, IndImageSize[1] - 1, IndImageSize[2] - 1 } };
-    seededConnectedThresholdFilter->SetSeed(SeedLocation);
+    typename IntegerImageType::Pointer dilatedBackground = this->DistanceDilate(closed, 0, closingRadius);
+    ImageRegionConstIterator<IntegerImageType> bgIt(dilatedBackground, cropRegion);
+    for( ImageRegionIterator<IntegerImageType> it(closed, cropRegion); !it.IsAtEnd(); ++it, ++bgIt )
+      {
+      it.Set( bgIt.Get() ? 0 : 1 );
+      }
     }
 
-  seededConnectedThresholdFilter->SetReplaceValue(100);
-  seededConnectedThresholdFilter->SetUpper(0);
-  seededConnectedThresholdFilter->SetLower(0);
-  seededConnectedThresholdFilter->SetInput( ErodeFilter->GetOutput() );
-  seededConnectedThresholdFilter->Update();
-
-  typename IntegerImageType::Pointer dilateMask = nullptr;
-    {
-    typename ThresholdFilterType::Pointer FinalThreshold =
-      ThresholdFilterType::New();
-    FinalThreshold->SetInput( seededConnectedThresholdFilter->GetOutput() );
-    FinalThreshold->SetInsideValue(this->m_OutsideValue);
-    FinalThreshold->SetOutsideValue(this->m_InsideValue);
-    FinalThreshold->SetLowerThreshold(100);
-    FinalThreshold->SetUpperThreshold(100);
-    FinalThreshold->Update();
+    // NOTE:  The most robust way to do this would be to find the largest
+    // background labeled image, and then choose one of those locations as the
+    // seed.
+    // For now just choose all the corners of the padded box as seed points
+    using seededConnectedThresholdFilterType = ConnectedThresholdImageFilter<IntegerImageType,
+                                          IntegerImageType>;
+    typename seededConnectedThresholdFilterType::Pointer
+    seededConnectedThresholdFilter = seededConnectedThresholdFilterType::New();
+    for( unsigned int corner = 0; corner < ( 1U << IntegerImageType::ImageDimension ); ++corner )
+      {
+      typename IntegerImageType::IndexType SeedLocation = cropRegion.GetIndex();
+      for( unsigned int d = 0; d < IntegerImageType::ImageDimension; ++d )
+        {
+        if( corner & ( 1U << d ) )
+          {
+          SeedLocation[d] = cropRegion.GetUpperIndex()[d];
+          }
+        }
+      seededConnectedThresholdFilter->AddSeed(SeedLocation);
+      }
+    seededConnectedThresholdFilter->SetReplaceValue(100);
+    seededConnectedThresholdFilter->SetUpper(0);
+    seededConnectedThresholdFilter->SetLower(0);
+    seededConnectedThresholdFilter->SetInput( closed );
+    seededConnectedThresholdFilter->Update();
+
+    typename IntegerImageType::Pointer filled = seededConnectedThresholdFilter->GetOutput();
+    for( ImageRegionIterator<IntegerImageType> it(filled, cropRegion); !it.IsAtEnd(); ++it )
+      {
+      it.Set( it.Get() == 100 ? 0 : 1 );
+      }
 
     if( m_DilateSize > 0.0 )
       {
       // Dilate to get some background to better drive BSplineRegistration
-      using DilateType = itk::BinaryDilateImageFilter<IntegerImageType, IntegerImageType,
-                                           myKernelType>;
-
-      myKernelType dilateBall;
-      typename myKernelType::SizeType dilateBallSize;
-      for( unsigned int d = 0; d < 3; ++d )
-        {
-        const unsigned int DilateVoxels =
-          itk::Math::ceil ( m_DilateSize / ( FinalThreshold->GetOutput()->GetSpacing()[d] ) );
-        dilateBallSize[d] = DilateVoxels;
-        }
-      dilateBall.SetRadius(dilateBallSize);
-      dilateBall.CreateStructuringElement();
-
-      typename DilateType::Pointer dil = DilateType::New();
-      dil->SetDilateValue(this->m_InsideValue);
-      dil->SetKernel(dilateBall);
-      dil->SetInput( FinalThreshold->GetOutput() );
-      dil->Update();
-      dilateMask = dil->GetOutput();
+      filled = this->DistanceDilate(filled, 1, dilateRadius);
       }
-    else
+
+    ImageRegionConstIterator<IntegerImageType> filledIt(filled, cropRegion);
+    for( ImageRegionIterator<OutputImageType> outIt(outputImage, cropRegion); !outIt.IsAtEnd(); ++outIt, ++filledIt )
       {
-      dilateMask = FinalThreshold->GetOutput();
+      outIt.Set( static_cast<OutputPixelType>( filledIt.Get() ? m_InsideValue : m_OutsideValue ) );
       }
     }
 
-  using outputCasterType = CastImageFilter<IntegerImageType, OutputImageType>;
-  typename outputCasterType::Pointer outputCaster = outputCasterType::New();
-  outputCaster->SetInput(dilateMask);
-
-  outputCaster->GraftOutput( this->GetOutput() );
-  outputCaster->Update();
-  this->GraftOutput( outputCaster->GetOutput() );
-  //  typename OutputImageType::Pointer outputMaskImage =
-  // outputCaster->GetOutput();
-  //  return outputMaskImage;
+  if( m_UseResultCache )
+    {
+    ResultCacheEntry entry;
+    entry.Input = inputKey;
+    entry.Parameters = this->GetCacheParameters();
+    entry.Mask = OutputImageType::New();
+    entry.Mask->CopyInformation(outputImage);
+    entry.Mask->SetRegions( outputImage->GetLargestPossibleRegion() );
+    entry.Mask->Allocate();
+    ImageAlgorithm::Copy( outputImage, entry.Mask.GetPointer(),
+                          outputImage->GetLargestPossibleRegion(), outputImage->GetLargestPossibleRegion() );
+
+    // Only a few masks are kept, the callers ask for the same one repeatedly.
+    constexpr size_t MaximumCachedMasks = 4;
+    std::lock_guard<std::mutex> lock( GetResultCacheMutex() );
+    ResultCacheType & cache = GetResultCache();
+    cache.push_front(entry);
+    while( cache.size() > MaximumCachedMasks )
+      {
+      cache.pop_back();
+      }
+    }
 }
 }
 #endif // itkLargestForegroundFilledMaskImageFilter_hxx
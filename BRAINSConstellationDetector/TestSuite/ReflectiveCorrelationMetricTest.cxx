@@ -0,0 +1,162 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Compares the sampled mode of Rigid3DCenterReflectorFunctor with the full
+// resampling of the output box, on the quarter resolution level of a T1
+// image, over a grid of heading angles, bank angles and LR offsets.  With
+// 20000 samples the quarter level box is sampled with one point per 2x2x2
+// stratum, so the two modes see different points of the same lattice:
+//  - the metric values must agree within ValueTolerance;
+//  - the full metric at the grid minimum of the sampled metric must be
+//    within MinimumTolerance of the full metric minimum.
+// The functor is only optimized with Powell and must refuse a derivative.
+//
+
+#include "itkIO.h"
+#include "itkFindCenterOfBrainFilter.h"
+#include "itkPowellOptimizerv4.h"
+#include "../src/landmarksConstellationCommon.h"
+#include "../src/itkReflectiveCorrelationCenterToImageMetric.h"
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+using ReflectionFunctorType = Rigid3DCenterReflectorFunctor<itk::PowellOptimizerv4<double> >;
+using ParametersType = ReflectionFunctorType::ParametersType;
+
+constexpr double ValueTolerance = 0.02;
+constexpr double MinimumTolerance = 0.005;
+
+ReflectionFunctorType::Pointer
+CreateFunctor(SImageType::Pointer & image, SImageType::Pointer & level, const SImageType::PointType & center,
+              const bool useSampledMetric)
+{
+  ReflectionFunctorType::Pointer functor = ReflectionFunctorType::New();
+  functor->SetCenterOfHeadMass(center);
+  functor->InitializeImage(image);
+  functor->SetDownSampledReferenceImage(level);
+  functor->SetNumberOfSamples(20000);
+  functor->SetUseSampledMetric(useSampledMetric);
+  return functor;
+}
+
+double
+Evaluate(ReflectionFunctorType * functor, ParametersType parameters)
+{
+  functor->SetParameters(parameters);
+  return functor->GetValue();
+}
+} // end namespace
+
+int main(int argc, char *argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " inputVolume" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  bool allPassed = true;
+  try
+    {
+    SImageType::Pointer image = itkUtil::ReadImage<SImageType>(argv[1]);
+
+    using FindCenterFilter = itk::FindCenterOfBrainFilter<SImageType>;
+    FindCenterFilter::Pointer findCenterFilter = FindCenterFilter::New();
+    findCenterFilter->SetInput(image);
+    findCenterFilter->SetAxis(2);
+    findCenterFilter->SetOtsuPercentileThreshold(0.01);
+    findCenterFilter->SetClosingSize(7);
+    findCenterFilter->SetHeadSizeLimit(700);
+    findCenterFilter->SetBackgroundValue(0);
+    findCenterFilter->Update();
+    const SImageType::PointType center = findCenterFilter->GetCenterOfBrain();
+
+    PyramidFilterType::Pointer pyramid = MakeThreeLevelPyramid(image);
+    SImageType::Pointer        quarterImage = pyramid->GetOutput(1);
+
+    ReflectionFunctorType::Pointer sampled = CreateFunctor(image, quarterImage, center, true);
+    ReflectionFunctorType::Pointer full = CreateFunctor(image, quarterImage, center, false);
+
+    const double   degree = itk::Math::pi / 180.0;
+    ParametersType parameters(ReflectionFunctorType::SpaceDimension);
+    ParametersType sampledMinimumParameters(ReflectionFunctorType::SpaceDimension);
+    double         sampledMinimum = itk::NumericTraits<double>::max();
+    double         fullMinimum = itk::NumericTraits<double>::max();
+    double         largestDifference = 0.0;
+    for( int ha = -10; ha <= 10; ha += 5 )
+      {
+      for( int ba = -5; ba <= 5; ba += 5 )
+        {
+        for( int lr = -6; lr <= 6; lr += 6 )
+          {
+          parameters[0] = ha * degree;
+          parameters[1] = ba * degree;
+          parameters[2] = lr;
+          const double sampledValue = Evaluate(sampled, parameters);
+          const double fullValue = Evaluate(full, parameters);
+          largestDifference = std::max(largestDifference, std::abs(sampledValue - fullValue) );
+          if( sampledValue < sampledMinimum )
+            {
+            sampledMinimum = sampledValue;
+            sampledMinimumParameters = parameters;
+            }
+          fullMinimum = std::min(fullMinimum, fullValue);
+          }
+        }
+      }
+    const double fullAtSampledMinimum = Evaluate(full, sampledMinimumParameters);
+    std::cout << "Largest difference " << largestDifference << ", full metric minimum " << fullMinimum
+              << ", full metric at the sampled minimum " << fullAtSampledMinimum << std::endl;
+    if( largestDifference > ValueTolerance )
+      {
+      std::cerr << "The sampled metric differs from the full metric" << std::endl;
+      allPassed = false;
+      }
+    if( fullAtSampledMinimum - fullMinimum > MinimumTolerance )
+      {
+      std::cerr << "The sampled metric has its minimum at " << sampledMinimumParameters << std::endl;
+      allPassed = false;
+      }
+
+    bool threw = false;
+    try
+      {
+      ReflectionFunctorType::DerivativeType derivative;
+      sampled->GetDerivative(derivative);
+      }
+    catch( itk::ExceptionObject & )
+      {
+      threw = true;
+      }
+    if( !threw )
+      {
+      std::cerr << "GetDerivative did not throw" << std::endl;
+      allPassed = false;
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
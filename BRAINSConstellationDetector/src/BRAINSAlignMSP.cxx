@@ -66,6 +66,7 @@ int main(int argc, char *argv[])
   const BRAINSUtils::StackPushITKDefaultNumberOfThreads TempDefaultNumberOfThreadsHolder(numberOfThreads);
 
   LMC::globalverboseFlag = verbose;
+  LMC::globalUseSampledMSPMetric = useSampledMSPMetric;
 
   globalResultsDir = resultsDir;
   globalImagedebugLevel = writedebuggingImagesLevel;
@@ -32,6 +32,7 @@ int main( int argc, char *argv[] )
   PARSE_ARGS;
   FFTWInit(""); //Initialize for FFTW in order to improve performance of subsequent runs
   BRAINSRegisterAlternateIO();
+  LMC::globalUseSampledMSPMetric = useSampledMSPMetric;
 
   const std::string Version(BCDVersionString);
   std::cout << "Run BRAINSConstellationDetector Version: " << Version << std::endl;
@@ -63,7 +63,7 @@
 #include "itkEllipseSpatialObject.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkDiscreteGaussianImageFilter.h"
-#include "itkGaussianDerivativeImageFunction.h"
+#include "BRAINSScaleSpaceCache.h"
 #include "itkMinimumMaximumImageCalculator.h"
 #include "itkCastImageFilter.h"
 #include <itkGaussianDistribution.h>
@@ -88,6 +88,20 @@ namespace itk
  * point and votes on a small region defined using the minimum and maximum
  * radius given by the user, and fill in the array of radii.
  *
+ * The gradient is the derivative of Gaussian of scale SigmaGradient of the
+ * whole input, computed once by BRAINSScaleSpaceCache: the discrete Gaussian
+ * kernel of DiscreteGaussianImageFilter (maximum error 0.01) for narrow
+ * scales, RecursiveGaussianImageFilter for wide ones, then a central
+ * difference.  It used to be a GaussianDerivativeImageFunction evaluated at
+ * every voting point, which samples a different truncated kernel.  Both
+ * estimate the same derivative, but their directions differ slightly: a
+ * vote centre, truncated to a voxel, can move by one voxel, and the
+ * detected centres by a fraction of a voxel.  Their magnitudes differ too,
+ * so a nonzero GradientThreshold (on the squared magnitude, in squared
+ * intensity per physical unit) selects a different set of voting points;
+ * with the threshold of 0 used by BRAINSHoughEyeDetector only flat points
+ * are skipped, as before.
+ *
  * \ingroup ImageFeatureExtraction
  * \todo Update the doxygen documentation!!!
  * */
@@ -154,11 +168,11 @@ public:
   using GaussianFunctionType = itk::Statistics::GaussianDistribution;
   using GaussianFunctionPointer = typename GaussianFunctionType::Pointer;
 
-  using DoGFunctionType = GaussianDerivativeImageFunction<InputImageType, InputCoordType>;
-  typedef typename DoGFunctionType::Pointer
-    DoGFunctionPointer;
-  typedef typename DoGFunctionType::VectorType
-    DoGVectorType;
+  /** The DoG gradient of the input, shared with other users of the same scale */
+  using ScaleSpaceType = BRAINSScaleSpaceCache<InputImageType>;
+  using DoGImageType = typename ScaleSpaceType::GradientImageType;
+  using DoGImageConstPointer = typename DoGImageType::ConstPointer;
+  using DoGVectorType = typename DoGImageType::PixelType;
 
   using MinMaxCalculatorType = MinimumMaximumImageCalculator<InternalImageType>;
   using MinMaxCalculatorPointer = typename MinMaxCalculatorType::Pointer;
@@ -279,6 +293,7 @@ protected:
   double               m_SamplingRatio;
   InternalImagePointer m_RadiusImage;
   InternalImagePointer m_AccumulatorImage;
+  DoGImageConstPointer m_GradientImage;
   SpheresListType      m_SpheresList;
   unsigned int         m_NumberOfSpheres;
   unsigned long        m_OldModifiedTime;
@@ -78,6 +78,7 @@ HoughTransformRadialVotingImageFilter<TInputImage, TOutputImage>
   m_SamplingRatio(1.0),
   m_RadiusImage(nullptr),
   m_AccumulatorImage(nullptr),
+  m_GradientImage(nullptr),
   m_SpheresList(),
   m_NumberOfSpheres(1),
   m_OldModifiedTime(0),
@@ -147,6 +148,9 @@ HoughTransformRadialVotingImageFilter<TInputImage, TOutputImage>
   m_AccumulatorImage->Allocate();
   m_AccumulatorImage->FillBuffer(0);
 
+  // DoG gradient of the whole input, read at the voting voxels
+  m_GradientImage = ScaleSpaceType::GetGradientImage(inputImage, m_SigmaGradient);
+
   m_RadiusImage = InternalImageType::New();
   m_RadiusImage->CopyInformation( inputImage );
   m_RadiusImage->SetRegions( inputImage->GetLargestPossibleRegion() );
@@ -160,6 +164,7 @@ HoughTransformRadialVotingImageFilter<TInputImage, TOutputImage>
 ::AfterThreadedGenerateData()
 {
   ComputeMeanRadiusImage();
+  m_GradientImage = nullptr;
 
   // Copy the typecast m_AccumulatorImage to Output image
   InternalIteratorType iIt( m_AccumulatorImage, this->GetOutput()->GetRequestedRegion() );
@@ -187,12 +192,6 @@ HoughTransformRadialVotingImageFilter<TInputImage, TOutputImage>::ThreadedGenera
   const InputImageConstPointer inputImage = this->GetInput();
   const InputSpacingType       spacing = inputImage->GetSpacing();
 
-  DoGFunctionPointer DoGFunction = DoGFunctionType::New();
-  DoGFunction->SetUseImageSpacing(true);
-
-  DoGFunction->SetInputImage(inputImage);
-  DoGFunction->SetSigma(m_SigmaGradient);
-
   GaussianFunctionPointer GaussianFunction = GaussianFunctionType::New();
 
   const InputCoordType averageRadius = 0.5 * ( m_MinimumRadius + m_MaximumRadius );
@@ -211,7 +210,7 @@ HoughTransformRadialVotingImageFilter<TInputImage, TOutputImage>::ThreadedGenera
     if( image_it.Get() > m_Threshold )
       {
       const Index<ImageDimension> index = image_it.GetIndex();
-      DoGVectorType               grad = DoGFunction->EvaluateAtIndex(index);
+      DoGVectorType               grad = m_GradientImage->GetPixel(index);
 
       // if the gradient is not flat
       typename DoGVectorType::ValueType norm2 = grad.GetSquaredNorm();
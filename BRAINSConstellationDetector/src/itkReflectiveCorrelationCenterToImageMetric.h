@@ -34,6 +34,9 @@
 #include "itkStatisticsImageFilter.h"
 #include "itkNumberToString.h"
 #include "itkCompensatedSummation.h"
+#include "itkMultiThreaderBase.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include <vector>
 
 // Optimize the A,B,C vector
 template<typename TOptimizerType>
@@ -66,7 +69,9 @@ public:
   m_DoPowell(true),
   m_imInterp(nullptr),
   m_cc(0.0),
-  m_HasLocalSupport(false)
+  m_HasLocalSupport(false),
+  m_UseSampledMetric(LMC::globalUseSampledMSPMetric),
+  m_NumberOfSamples(100000)
   {
     this->m_Optimizer = OptimizerType::New();
     this->m_Optimizer->SetMetric( &( *this ) );
@@ -156,8 +161,10 @@ public:
     return f(this->m_params);
   }
 
+  /** The metric is only optimized with Powell, it has no derivative. */
   void GetDerivative( DerivativeType & ) const override
   {
+    itkGenericExceptionMacro(<< "Rigid3DCenterReflectorFunctor does not compute a derivative");
   }
 
   void GetValueAndDerivative( MeasureType & value,
@@ -283,7 +290,9 @@ public:
     std::cout << "WARNING: ESTIMATED ROTATIONS ARE WAY TOO BIG SO GIVING A HIGH COST" << std::endl;
     return 1;
     }
-  const double cc = -CenterImageReflection_crossCorrelation(params);
+  const double cc = this->m_UseSampledMetric ?
+    -SampledReflection_crossCorrelation(params) :
+    -CenterImageReflection_crossCorrelation(params);
 
   const double cost_of_motion = ( std::abs(DistanceFromCenterOfMass) < MaxUnpenalizedAllowedDistance ) ? 0 :
   ( std::abs(DistanceFromCenterOfMass - MaxUnpenalizedAllowedDistance) * .1 );
@@ -432,6 +441,8 @@ public:
     this->m_ResamplerReferenceImage->SetSpacing(outputImageSpacing);
     this->m_ResamplerReferenceImage->SetRegions(outputImageRegion);
     this->m_ResamplerReferenceImage->Allocate();
+
+    this->InitializeSamplePoints();
   }
 
   /* -- */
@@ -525,6 +536,306 @@ public:
     return cc;
   }
 
+  /** Choose between resampling the full output box for every evaluation and
+   * evaluating the reflection on a fixed set of sample points. */
+  void SetUseSampledMetric(const bool useSampledMetric)
+  {
+    this->m_UseSampledMetric = useSampledMetric;
+    this->InitializeSamplePoints();
+  }
+  itkGetConstMacro(UseSampledMetric, bool);
+
+  /** Approximate number of left-half lattice points used in sampled mode */
+  void SetNumberOfSamples(const unsigned int numberOfSamples)
+  {
+    this->m_NumberOfSamples = numberOfSamples;
+    this->InitializeSamplePoints();
+  }
+  itkGetConstMacro(NumberOfSamples, unsigned int);
+
+  /** Stratified subset of the left half of the resampler output box, the same
+   * lattice that CenterImageReflection_crossCorrelation visits.  One point is
+   * drawn from each cubic stratum, and points that can not map into the image
+   * under any searched rotation or offset are dropped.  The coordinates of the
+   * points and their reflections are kept as separate arrays. */
+  void InitializeSamplePoints(void)
+  {
+    this->m_SampleX.clear();
+    this->m_SampleY.clear();
+    this->m_SampleZ.clear();
+    this->m_ReflectedSampleX.clear();
+    if( !this->m_UseSampledMetric || this->m_ResamplerReferenceImage.IsNull() || this->m_OriginalImage.IsNull() )
+      {
+      return;
+      }
+
+    const SImageType::SizeType    boxSize = this->m_ResamplerReferenceImage->GetLargestPossibleRegion().GetSize();
+    const SImageType::SpacingType boxSpacing = this->m_ResamplerReferenceImage->GetSpacing();
+    const SImageType::PointType   boxOrigin = this->m_ResamplerReferenceImage->GetOrigin();
+    const SImageType::SizeType::SizeValueType xMaxIndexResampleSize = boxSize[0] - 1;
+    SImageType::SizeType halfSize = boxSize;
+    halfSize[0] /= 2;
+
+    const double halfCount = static_cast<double>( halfSize[0] ) * halfSize[1] * halfSize[2];
+    unsigned int stratumEdge = 1;
+    while( halfCount / ( static_cast<double>( stratumEdge ) * stratumEdge * stratumEdge ) > this->m_NumberOfSamples )
+      {
+      ++stratumEdge;
+      }
+
+    // Rotations about the center of head mass preserve distances to it, so
+    // only the largest searched offset has to be added to the image extent.
+    const SImageType::PointType & center = this->GetCenterOfHeadMass();
+    double maxRadius = 0.0;
+      {
+      const SImageType::RegionType imageRegion = this->m_OriginalImage->GetLargestPossibleRegion();
+      for( unsigned int corner = 0; corner < 8; ++corner )
+        {
+        SImageType::IndexType cornerIndex = imageRegion.GetIndex();
+        for( unsigned int d = 0; d < 3; ++d )
+          {
+          if( corner & ( 1U << d ) )
+            {
+            cornerIndex[d] = imageRegion.GetUpperIndex()[d];
+            }
+          }
+        SImageType::PointType cornerPoint;
+        this->m_OriginalImage->TransformIndexToPhysicalPoint(cornerIndex, cornerPoint);
+        maxRadius = std::max(maxRadius, cornerPoint.EuclideanDistanceTo(center) );
+        }
+      maxRadius += 20.0;
+      }
+
+    using RandomGeneratorType = itk::Statistics::MersenneTwisterRandomVariateGenerator;
+    RandomGeneratorType::Pointer randomGenerator = RandomGeneratorType::New();
+    randomGenerator->SetSeed(121212);
+
+    for( SImageType::SizeValueType kz = 0; kz < halfSize[2]; kz += stratumEdge )
+      {
+      for( SImageType::SizeValueType ky = 0; ky < halfSize[1]; ky += stratumEdge )
+        {
+        for( SImageType::SizeValueType kx = 0; kx < halfSize[0]; kx += stratumEdge )
+          {
+          const SImageType::SizeValueType stratumStart[3] = { kx, ky, kz };
+          SImageType::SizeValueType       sampleIndex[3];
+          for( unsigned int d = 0; d < 3; ++d )
+            {
+            const SImageType::SizeValueType extent = std::min<SImageType::SizeValueType>(stratumEdge,
+                                                                                         halfSize[d] - stratumStart[d]);
+            sampleIndex[d] = stratumStart[d] + randomGenerator->GetIntegerVariate( extent - 1 );
+            }
+          const double x = boxOrigin[0] + sampleIndex[0] * boxSpacing[0];
+          const double y = boxOrigin[1] + sampleIndex[1] * boxSpacing[1];
+          const double z = boxOrigin[2] + sampleIndex[2] * boxSpacing[2];
+          const double reflectedX = boxOrigin[0] + ( xMaxIndexResampleSize - sampleIndex[0] ) * boxSpacing[0];
+          const double dy2 = ( y - center[1] ) * ( y - center[1] ) + ( z - center[2] ) * ( z - center[2] );
+          if( ( x - center[0] ) * ( x - center[0] ) + dy2 > maxRadius * maxRadius
+              && ( reflectedX - center[0] ) * ( reflectedX - center[0] ) + dy2 > maxRadius * maxRadius )
+            {
+            continue;
+            }
+          this->m_SampleX.push_back(x);
+          this->m_SampleY.push_back(y);
+          this->m_SampleZ.push_back(z);
+          this->m_ReflectedSampleX.push_back(reflectedX);
+          }
+        }
+      }
+    if( LMC::globalverboseFlag )
+      {
+      std::cout << "Reflective correlation metric uses " << this->m_SampleX.size()
+                << " sample points (stratum edge " << stratumEdge << ")" << std::endl;
+      }
+  }
+
+  /** Trilinear interpolation on the raw buffer of m_OriginalImage.  Points
+   * outside the buffer are 0 like the default pixel value of
+   * GetResampledImageToOutputBox. */
+  double Interpolate(const double cindex[3]) const
+  {
+    const SImageType::SizeType & size = this->m_OriginalImage->GetBufferedRegion().GetSize();
+    long   base[3];
+    double frac[3];
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      if( cindex[d] < -0.5 || cindex[d] > static_cast<double>( size[d] ) - 0.5 )
+        {
+        return 0.0;
+        }
+      const double fl = std::floor(cindex[d]);
+      base[d] = static_cast<long>( fl );
+      frac[d] = cindex[d] - fl;
+      }
+    long lo[3];
+    long hi[3];
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      const long maxIndex = static_cast<long>( size[d] ) - 1;
+      lo[d] = std::min(std::max(base[d], 0L), maxIndex);
+      hi[d] = std::min(std::max(base[d] + 1, 0L), maxIndex);
+      }
+    const SImageType::PixelType * buffer = this->m_OriginalImage->GetBufferPointer();
+    const long                    strideY = static_cast<long>( size[0] );
+    const long                    strideZ = strideY * static_cast<long>( size[1] );
+    const double c000 = buffer[lo[2] * strideZ + lo[1] * strideY + lo[0]];
+    const double c100 = buffer[lo[2] * strideZ + lo[1] * strideY + hi[0]];
+    const double c010 = buffer[lo[2] * strideZ + hi[1] * strideY + lo[0]];
+    const double c110 = buffer[lo[2] * strideZ + hi[1] * strideY + hi[0]];
+    const double c001 = buffer[hi[2] * strideZ + lo[1] * strideY + lo[0]];
+    const double c101 = buffer[hi[2] * strideZ + lo[1] * strideY + hi[0]];
+    const double c011 = buffer[hi[2] * strideZ + hi[1] * strideY + lo[0]];
+    const double c111 = buffer[hi[2] * strideZ + hi[1] * strideY + hi[0]];
+
+    const double fx = frac[0];
+    const double fy = frac[1];
+    const double fz = frac[2];
+    const double c00 = c000 + fx * ( c100 - c000 );
+    const double c10 = c010 + fx * ( c110 - c010 );
+    const double c01 = c001 + fx * ( c101 - c001 );
+    const double c11 = c011 + fx * ( c111 - c011 );
+    const double c0 = c00 + fy * ( c10 - c00 );
+    const double c1 = c01 + fy * ( c11 - c01 );
+    return c0 + fz * ( c1 - c0 );
+  }
+
+  /** Sampled counterpart of CenterImageReflection_crossCorrelation */
+  double SampledReflection_crossCorrelation(ParametersType const & params) const
+  {
+    const size_t numberOfSamples = this->m_SampleX.size();
+    if( numberOfSamples == 0 )
+      {
+      return 0.0;
+      }
+
+    // Physical point y = Rz(HA) Ry(BA) (p - c) + c + (LR,0,0), the Euler3D ZXY
+    // convention of GetTransformFromParams, mapped to continuous index by
+    // diag(1/spacing) * inverse(direction) * (y - origin).
+    const double cz = std::cos(params[0]);
+    const double sz = std::sin(params[0]);
+    const double cy = std::cos(params[1]);
+    const double sy = std::sin(params[1]);
+    const double Rz[3][3] = { { cz, -sz, 0 }, { sz, cz, 0 }, { 0, 0, 1 } };
+    const double Ry[3][3] = { { cy, 0, sy }, { 0, 1, 0 }, { -sy, 0, cy } };
+
+    const SImageType::DirectionType & inverseDirection = this->m_OriginalImage->GetInverseDirection();
+    const SImageType::SpacingType &   spacing = this->m_OriginalImage->GetSpacing();
+    const SImageType::PointType &     origin = this->m_OriginalImage->GetOrigin();
+    const SImageType::PointType &     center = this->GetCenterOfHeadMass();
+    SImageType::IndexType             bufferStart = this->m_OriginalImage->GetBufferedRegion().GetIndex();
+
+    double toIndex[3][3];
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = 0; j < 3; ++j )
+        {
+        toIndex[i][j] = inverseDirection[i][j] / spacing[i];
+        }
+      }
+    double A[3][3];
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = 0; j < 3; ++j )
+        {
+        A[i][j] = 0.0;
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          A[i][j] += Rz[i][k] * Ry[k][j];
+          }
+        }
+      }
+    double translation[3];
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      translation[i] = center[i] + ( i == 0 ? params[2] : 0.0 ) - origin[i];
+      }
+    // Fold the index mapping into the rotation.
+    double M[3][3];
+    double b[3];
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      b[i] = -bufferStart[i];
+      for( unsigned int j = 0; j < 3; ++j )
+        {
+        M[i][j] = 0.0;
+        b[i] += toIndex[i][j] * translation[j];
+        for( unsigned int k = 0; k < 3; ++k )
+          {
+          M[i][j] += toIndex[i][k] * A[k][j];
+          }
+        }
+      }
+
+    constexpr size_t ChunkSize = 4096;
+    enum { F = 0, G, FG, FF, GG, COUNT, NumberOfSums };
+    const size_t numberOfChunks = ( numberOfSamples + ChunkSize - 1 ) / ChunkSize;
+    std::vector<double> chunkSums(numberOfChunks * NumberOfSums, 0.0);
+    const double background = this->m_BackgroundValue;
+
+    itk::MultiThreaderBase::Pointer threader = itk::MultiThreaderBase::New();
+    threader->ParallelizeArray(
+      0, numberOfChunks,
+      [&](itk::SizeValueType chunk)
+      {
+        double * sums = &chunkSums[chunk * NumberOfSums];
+        const size_t last = std::min(numberOfSamples, static_cast<size_t>( chunk + 1 ) * ChunkSize);
+        for( size_t n = static_cast<size_t>( chunk ) * ChunkSize; n < last; ++n )
+          {
+          const double p[3] = { this->m_SampleX[n] - center[0], this->m_SampleY[n] - center[1],
+                                this->m_SampleZ[n] - center[2] };
+          const double q[3] = { this->m_ReflectedSampleX[n] - center[0], p[1], p[2] };
+          double pIndex[3];
+          double qIndex[3];
+          for( unsigned int i = 0; i < 3; ++i )
+            {
+            pIndex[i] = b[i] + M[i][0] * p[0] + M[i][1] * p[1] + M[i][2] * p[2];
+            qIndex[i] = b[i] + M[i][0] * q[0] + M[i][1] * q[1] + M[i][2] * q[2];
+            }
+          const double _f = this->Interpolate(pIndex);
+          if( _f < background )  // don't worry about background voxels.
+            {
+            continue;
+            }
+          const double g = this->Interpolate(qIndex);
+          if( g < background )
+            {
+            continue;
+            }
+          sums[F] += _f;
+          sums[G] += g;
+          sums[FG] += _f * g;
+          sums[FF] += _f * _f;
+          sums[GG] += g * g;
+          sums[COUNT] += 1.0;
+          }
+      },
+      nullptr);
+
+    // Combine the chunks in a fixed order so the result does not depend on
+    // the number of threads.
+    CompensatedSummationType totals[NumberOfSums];
+    for( size_t chunk = 0; chunk < numberOfChunks; ++chunk )
+      {
+      for( unsigned int s = 0; s < NumberOfSums; ++s )
+        {
+        totals[s] += chunkSums[chunk * NumberOfSums + s];
+        }
+      }
+    const double N = totals[COUNT].GetSum();
+    const double sumVoxelValues = totals[F].GetSum();
+    const double sumVoxelValuesReflected = totals[G].GetSum();
+    const double covariance = totals[FG].GetSum() - sumVoxelValues * sumVoxelValuesReflected / N;
+    const double variance = totals[FF].GetSum() - sumVoxelValues * sumVoxelValues / N;
+    const double varianceReflected = totals[GG].GetSum() - sumVoxelValuesReflected * sumVoxelValuesReflected / N;
+    if( N == 0 || variance * varianceReflected == 0.0 )
+      {
+      return 0.0;
+      }
+    const double normalization = std::sqrt(variance * varianceReflected);
+    const double cc = covariance / normalization;
+
+    return cc;
+  }
+
   SImageType::Pointer GetMSPCenteredImage(void)
   {
     using StatisticsFilterType = itk::StatisticsImageFilter<SImageType>;
@@ -608,6 +919,12 @@ private:
   LinearInterpolatorType::Pointer   m_imInterp;
   double                            m_cc;
   bool                              m_HasLocalSupport;
+  bool                              m_UseSampledMetric;
+  unsigned int                      m_NumberOfSamples;
+  std::vector<double>               m_SampleX;
+  std::vector<double>               m_SampleY;
+  std::vector<double>               m_SampleZ;
+  std::vector<double>               m_ReflectedSampleX;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -35,6 +35,7 @@ namespace LMC
 {
 bool debug(false);
 bool globalverboseFlag(false);
+bool globalUseSampledMSPMetric(false);
 }
 
 std::string globalResultsDir(".");       // A global variable to define where
@@ -96,6 +96,7 @@ namespace LMC
 {
 extern bool debug;
 extern bool globalverboseFlag;
+extern bool globalUseSampledMSPMetric;
 }
 
 //
@@ -16,7 +16,13 @@
  *  limitations under the License.
  *
  *=========================================================================*/
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include "itkMedianImageFilter.h"
 #include "itkExtractImageFilter.h"
 #include "BRAINSCommonLib.h"
@@ -96,6 +102,82 @@ typename ImageType::Pointer DoMedian(typename ImageType::Pointer & input,
   return result;
 }
 
+template <typename TOutputPixel>
+void WriteResampledVolume(FixedVolumeType::Pointer & resampledImage,
+                          const std::string & fileName,
+                          const bool scaleOutputValues)
+{
+  using WriteOutImageType = itk::Image<TOutputPixel, FixedVolumeType::ImageDimension>;
+  typename WriteOutImageType::Pointer CastImage =
+    ( scaleOutputValues == true ) ?
+    ( itkUtil::PreserveCast<FixedVolumeType,
+                            WriteOutImageType>(resampledImage) ) :
+    ( itkUtil::TypeCast<FixedVolumeType,
+                        WriteOutImageType>(resampledImage) );
+  itkUtil::WriteImage<WriteOutImageType>(CastImage, fileName);
+}
+
+/** One moving image to register against the fixed image, and its outputs */
+struct RegistrationJobType
+  {
+  std::string movingVolume;
+  std::string movingBinaryVolume;
+  std::string outputTransform;
+  std::string strippedOutputTransform;
+  std::string outputVolume;
+  double      finalMetricValue = 0.0;
+  int         exitStatus = EXIT_FAILURE;
+  };
+
+/** Read a --registrationManifest file, one registration per line:
+ *    movingVolume,outputTransform[,outputVolume[,movingBinaryVolume]]
+ * Empty lines and lines starting with # are skipped. */
+std::vector<RegistrationJobType> ReadRegistrationManifest(const std::string & manifestFileName)
+{
+  std::ifstream manifest( manifestFileName.c_str() );
+  if( !manifest.is_open() )
+    {
+    itkGenericExceptionMacro(<< "Can not read the registration manifest " << manifestFileName);
+    }
+
+  std::vector<RegistrationJobType> jobs;
+  std::string                      line;
+  unsigned int                     lineNumber = 0;
+  while( std::getline(manifest, line) )
+    {
+    ++lineNumber;
+    line = itksys::SystemTools::TrimWhitespace(line);
+    if( line.empty() || line[0] == '#' )
+      {
+      continue;
+      }
+    std::vector<std::string> fields;
+    std::stringstream        lineStream(line);
+    std::string              field;
+    while( std::getline(lineStream, field, ',') )
+      {
+      fields.push_back( itksys::SystemTools::TrimWhitespace(field) );
+      }
+    fields.resize( std::max<size_t>( fields.size(), 4 ) );
+    if( fields.size() > 4 || fields[0].empty() || ( fields[1].empty() && fields[2].empty() ) )
+      {
+      itkGenericExceptionMacro(<< manifestFileName << ":" << lineNumber
+                               << ": expected movingVolume,outputTransform[,outputVolume[,movingBinaryVolume]]");
+      }
+    RegistrationJobType job;
+    job.movingVolume = fields[0];
+    job.outputTransform = fields[1];
+    job.outputVolume = fields[2];
+    job.movingBinaryVolume = fields[3];
+    jobs.push_back(job);
+    }
+  if( jobs.empty() )
+    {
+    itkGenericExceptionMacro(<< "The registration manifest " << manifestFileName << " lists no registration");
+    }
+  return jobs;
+}
+
 #ifdef USE_DebugImageViewer
 /*************************
  * Have a global variable to
@@ -259,7 +341,8 @@ int main(int argc, char *argv[])
 
   if( localOutputTransform.empty()
       && strippedOutputTransform.empty()
-      && outputVolume.empty() )
+      && outputVolume.empty()
+      && registrationManifest.empty() )
     {
     std::cout << "Error:  user requested neither localOutputTransform,"
               << " nor strippedOutputTransform,"
@@ -287,6 +370,19 @@ int main(int argc, char *argv[])
       }
     }
 
+  BRAINSFitHelper::ShrinkFactorsScheduleType   shrinkFactorsSchedule;
+  BRAINSFitHelper::SmoothingSigmasScheduleType smoothingSigmasSchedule;
+  try
+    {
+    BuildLevelSchedules(localTransformType, shrinkFactors, smoothingSigmas, shrinkFactorsSchedule,
+                        smoothingSigmasSchedule);
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err.GetDescription() << std::endl;
+    return EXIT_FAILURE;
+    }
+
   // Need to ensure that the order of transforms is from smallest to largest.
   if(localInitializeTransformMode == "Off")
   {
@@ -302,10 +398,41 @@ int main(int argc, char *argv[])
     }
   }
 
+  std::vector<RegistrationJobType> registrationJobs;
+  if( !registrationManifest.empty() )
+    {
+    if( !movingVolume.empty() || !movingBinaryVolume.empty() || !localOutputTransform.empty()
+        || !strippedOutputTransform.empty() || !outputVolume.empty()
+        || !fixedVolume2.empty() || !movingVolume2.empty() )
+      {
+      std::cerr << "ERROR: With --registrationManifest the moving volumes, moving masks and outputs"
+                << " are given by the manifest, and multi-modal registration is not supported." << std::endl;
+      return EXIT_FAILURE;
+      }
+    try
+      {
+      registrationJobs = ReadRegistrationManifest(registrationManifest);
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      std::cerr << err << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  else
+    {
+    RegistrationJobType job;
+    job.movingVolume = movingVolume;
+    job.movingBinaryVolume = movingBinaryVolume;
+    job.outputTransform = localOutputTransform;
+    job.strippedOutputTransform = strippedOutputTransform;
+    job.outputVolume = outputVolume;
+    registrationJobs.push_back(job);
+    }
+
   // Extracting a timeIndex cube from the fixed image goes here....
   // Also MedianFilter
   FixedVolumeType::Pointer  extractFixedVolume;
-  MovingVolumeType::Pointer extractMovingVolume;
   InputImageType::Pointer
     OriginalFixedVolume( itkUtil::ReadImage<InputImageType>(fixedVolume) );
 
@@ -317,21 +444,8 @@ int main(int argc, char *argv[])
    **********************/
   extractFixedVolume = ExtractImage<FixedVolumeType>(OriginalFixedVolume,
                                                      fixedVolumeTimeIndex);
-  // Extracting a timeIndex cube from the moving image goes here....
-
-  InputImageType::Pointer OriginalMovingVolume(
-    itkUtil::ReadImage<InputImageType>(movingVolume) );
-  // This default lets us treat 3D as 4D.
-  // const unsigned int movingVolumeTimeIndex;
-
-  /***********************
-   * Acquire Moving Image Index
-   **********************/
-  extractMovingVolume = ExtractImage<MovingVolumeType>(OriginalMovingVolume,
-                                                       movingVolumeTimeIndex);
   // Multimodal registration input setting
   FixedVolumeType::Pointer  extractFixedVolume2=nullptr;
-  MovingVolumeType::Pointer extractMovingVolume2=nullptr;
   if( fixedVolume2 != ""  && movingVolume2 != "" )
     {
     InputImageType::Pointer
@@ -340,57 +454,35 @@ int main(int argc, char *argv[])
               << OriginalFixedVolume2->GetOrigin() << std::endl;
     extractFixedVolume2= ExtractImage<FixedVolumeType>(OriginalFixedVolume2,
                                                        fixedVolumeTimeIndex);
-
-    InputImageType::Pointer
-      OriginalMovingVolume2( itkUtil::ReadImage<InputImageType>(movingVolume2) );
-    std::cout << "Second Moving image original origin"
-              << OriginalMovingVolume2->GetOrigin() << std::endl;
-    extractMovingVolume2= ExtractImage<MovingVolumeType>(OriginalMovingVolume2,
-                                                       movingVolumeTimeIndex);
-
-
     }
 
-#ifdef USE_DebugImageViewer
-  if( DebugImageDisplaySender.Enabled() )
-    {
-    DebugImageDisplaySender.SendImage<itk::Image<float, 3> >(extractFixedVolume, 0);
-    DebugImageDisplaySender.SendImage<itk::Image<float, 3> >(extractMovingVolume, 1);
-    }
-#endif
-
   // get median filter radius.
-  // const unsigned int MedianFilterRadius =
-  // command.GetValueAsInt(MedianFilterRadiusText, IntegerText);
   // Median Filter images if requested.
-  if( (medianFilterSize[0] > 0) || (medianFilterSize[1] > 0)
-      || (medianFilterSize[2] > 0) )
-    {
-    FixedVolumeType::SizeType indexRadius;
-    indexRadius[0] = static_cast<long int>( medianFilterSize[0] );   // radius
-                                                                     // along x
-    indexRadius[1] = static_cast<long int>( medianFilterSize[1] );   // radius
-                                                                     // along y
-    indexRadius[2] = static_cast<long int>( medianFilterSize[2] );   // radius
-                                                                     // along z
+  const bool useMedianFilter = (medianFilterSize[0] > 0) || (medianFilterSize[1] > 0)
+    || (medianFilterSize[2] > 0);
+  FixedVolumeType::SizeType indexRadius;
+  indexRadius[0] = static_cast<long int>( medianFilterSize[0] );   // radius
+                                                                   // along x
+  indexRadius[1] = static_cast<long int>( medianFilterSize[1] );   // radius
+                                                                   // along y
+  indexRadius[2] = static_cast<long int>( medianFilterSize[2] );   // radius
+                                                                   // along z
+  if( useMedianFilter )
+    {
     // DEBUG
     std::cout << "Median radius  " << indexRadius << std::endl;
     std::cout << "Fixed Image size     "  << extractFixedVolume->GetLargestPossibleRegion().GetSize() << std::endl;
-    std::cout << "Moving Image size     " << extractMovingVolume->GetLargestPossibleRegion().GetSize() << std::endl;
     extractFixedVolume = DoMedian<FixedVolumeType>(extractFixedVolume,
                                                    indexRadius);
-    extractMovingVolume = DoMedian<MovingVolumeType>(extractMovingVolume,
-                                                     indexRadius);
     }
 
   // If masks are associated with the images, then read them into the correct
   // orientation.
   // if they've been defined assign the masks...
   ImageMaskPointer fixedMask = nullptr;
-  ImageMaskPointer movingMask = nullptr;
   if( maskProcessingMode == "NOMASK" )
     {
-    if( fixedBinaryVolume != "" || movingBinaryVolume != "" )
+    if( fixedBinaryVolume != "" )
       {
       std::cout
         << "ERROR:  Can not specify mask file names when the default of NOMASK is used for the maskProcessingMode"
@@ -400,327 +492,392 @@ int main(int argc, char *argv[])
     }
   else if( maskProcessingMode == "ROIAUTO" )
     {
-    if( fixedBinaryVolume != "" || movingBinaryVolume != "" )
+    if( fixedBinaryVolume != "" )
       {
       std::cout
         << "ERROR:  Can not specify mask file names when ROIAUTO is used for the maskProcessingMode"
         << std::endl;
       return EXIT_FAILURE;
       }
-      {
-      using ROIAutoType = itk::BRAINSROIAutoImageFilter<FixedVolumeType, itk::Image<unsigned char, 3> >;
-      ROIAutoType::Pointer ROIFilter = ROIAutoType::New();
-      ROIFilter->SetInput(extractFixedVolume);
-      ROIFilter->SetClosingSize(ROIAutoClosingSize);
-      ROIFilter->SetDilateSize(ROIAutoDilateSize);
-      ROIFilter->Update();
-      fixedMask = ROIFilter->GetSpatialObjectROI();
-      }
-      {
-      using ROIAutoType = itk::BRAINSROIAutoImageFilter<MovingVolumeType, itk::Image<unsigned char, 3> >;
-      ROIAutoType::Pointer ROIFilter = ROIAutoType::New();
-      ROIFilter->SetInput(extractMovingVolume);
-      ROIFilter->SetClosingSize(ROIAutoClosingSize);
-      ROIFilter->SetDilateSize(ROIAutoDilateSize);
-      ROIFilter->Update();
-      movingMask = ROIFilter->GetSpatialObjectROI();
-      }
+    using ROIAutoType = itk::BRAINSROIAutoImageFilter<FixedVolumeType, itk::Image<unsigned char, 3> >;
+    ROIAutoType::Pointer ROIFilter = ROIAutoType::New();
+    ROIFilter->SetInput(extractFixedVolume);
+    ROIFilter->SetClosingSize(ROIAutoClosingSize);
+    ROIFilter->SetDilateSize(ROIAutoDilateSize);
+    ROIFilter->Update();
+    fixedMask = ROIFilter->GetSpatialObjectROI();
     }
   else if( maskProcessingMode == "ROI" )
     {
-    if( fixedBinaryVolume == "" && movingBinaryVolume == "" )
-      {
-      std::cout
-        <<
-        "ERROR:  Must specify mask file names when ROI is used for the maskProcessingMode"
-        << std::endl;
-      return EXIT_FAILURE;
-      }
     if( fixedBinaryVolume != "" )
       {
       fixedMask = ReadImageMask<SpatialObjectType, Dimension>(
           fixedBinaryVolume,
           extractFixedVolume.GetPointer() );
       }
-    else
-      {
-      fixedMask = nullptr;
-      }
-
-    if( movingBinaryVolume != "" )
-      {
-      movingMask = ReadImageMask<SpatialObjectType, Dimension>(
-          movingBinaryVolume,
-          extractMovingVolume.GetPointer() );
-      }
-    else
-      {
-      movingMask = nullptr;
-      }
     }
 
-  using CompositeTransformType = itk::CompositeTransform<double, 3>;
-  CompositeTransformType::Pointer            currentGenericTransform;
+  GenericTransformType::Pointer movingInitialTransform;
   if( initialTransform != "" )
     {
-    currentGenericTransform = CompositeTransformType::New();
-    GenericTransformType::Pointer movingInitialTransform = itk::ReadTransformFromDisk(initialTransform);
-    currentGenericTransform->AddTransform( movingInitialTransform );
+    movingInitialTransform = itk::ReadTransformFromDisk(initialTransform);
+    }
+
+  if(numberOfSamples > 0)
+    {
+    const unsigned long numberOfAllSamples = extractFixedVolume->GetBufferedRegion().GetNumberOfPixels();
+    samplingPercentage = static_cast<double>( numberOfSamples )/numberOfAllSamples;
+    std::cout << "WARNING --numberOfSamples is deprecated, please use --samplingPercentage instead " << std::endl;
+    std::cout << "WARNING: Replacing command line --samplingPercentage " << samplingPercentage << std::endl;
     }
 
-  FixedVolumeType::Pointer resampledImage;
   /*
-   *  Everything prior to this point is preprocessing
+   *  Everything prior to this point is preprocessing of the fixed image,
+   *  shared by every registration.
    *  Start Processing
    *
    */
+  using CompositeTransformType = itk::CompositeTransform<double, 3>;
+
+  // Concurrent registrations serialize their file reads and writes, the
+  // HDF5 image and transform IO is not thread safe.
+  std::mutex ioMutex;
 
+  auto registerMovingVolume = [&](RegistrationJobType & job) -> int
+  {
+    // Every registration sees the fixed pixels through an image object of
+    // its own, the pipelines it runs set the requested region of their inputs.
+    FixedVolumeType::Pointer jobFixedVolume = FixedVolumeType::New();
+    jobFixedVolume->Graft(extractFixedVolume);
+
+    MovingVolumeType::Pointer extractMovingVolume;
+    MovingVolumeType::Pointer extractMovingVolume2=nullptr;
     {
-    using HelperType = itk::BRAINSFitHelper;
-    HelperType::Pointer myHelper = HelperType::New();
-    myHelper->SetTransformType(localTransformType);
-    myHelper->SetFixedVolume( extractFixedVolume );
-    myHelper->SetMovingVolume( extractMovingVolume );
-    if( extractFixedVolume2.IsNotNull() &&
-        extractMovingVolume2.IsNotNull() )
-      {
-      myHelper->SetFixedVolume2( extractFixedVolume2 );
-      myHelper->SetMovingVolume2( extractMovingVolume2 );
-      }
-    myHelper->SetHistogramMatch(histogramMatch);
-    myHelper->SetRemoveIntensityOutliers(removeIntensityOutliers);
-    myHelper->SetNumberOfMatchPoints(numberOfMatchPoints);
-    myHelper->SetFixedBinaryVolume(fixedMask);
-    myHelper->SetMovingBinaryVolume(movingMask);
-    myHelper->SetOutputFixedVolumeROI(outputFixedVolumeROI);
-    myHelper->SetOutputMovingVolumeROI(outputMovingVolumeROI);
-    if(numberOfSamples > 0)
-      {
-        const unsigned long numberOfAllSamples = extractFixedVolume->GetBufferedRegion().GetNumberOfPixels();
-        samplingPercentage = static_cast<double>( numberOfSamples )/numberOfAllSamples;
-        std::cout << "WARNING --numberOfSamples is deprecated, please use --samplingPercentage instead " << std::endl;
-        std::cout << "WARNING: Replacing command line --samplingPercentage " << samplingPercentage << std::endl;
-      }
-    myHelper->SetSamplingPercentage(samplingPercentage);
-    myHelper->SetNumberOfHistogramBins(numberOfHistogramBins);
-    myHelper->SetNumberOfIterations(numberOfIterations);
-    myHelper->SetMaximumStepLength(maximumStepLength);
-    myHelper->SetMinimumStepLength(minimumStepLength);
-    myHelper->SetRelaxationFactor(relaxationFactor);
-    myHelper->SetTranslationScale(translationScale);
-    myHelper->SetReproportionScale(reproportionScale);
-    myHelper->SetSkewScale(skewScale);
-    myHelper->SetBackgroundFillValue(backgroundFillValue);
-    myHelper->SetInitializeTransformMode(localInitializeTransformMode);
-    myHelper->SetMaskInferiorCutOffFromCenter(maskInferiorCutOffFromCenter);
-    myHelper->SetCurrentGenericTransform(currentGenericTransform);
-    myHelper->SetSplineGridSize(BSplineGridSize);
-    myHelper->SetCostFunctionConvergenceFactor(costFunctionConvergenceFactor);
-    myHelper->SetProjectedGradientTolerance(projectedGradientTolerance);
-    myHelper->SetMaxBSplineDisplacement(maxBSplineDisplacement);
-    myHelper->SetDisplayDeformedImage(UseDebugImageViewer);
-    myHelper->SetPromptUserAfterDisplay(PromptAfterImageSend);
-    myHelper->SetDebugLevel(debugLevel);
-    myHelper->SetCostMetricName(costMetric);
-    myHelper->SetUseROIBSpline(useROIBSpline);
-    myHelper->SetSamplingStrategy(metricSamplingStrategy);
-    myHelper->SetInitializeRegistrationByCurrentGenericTransform(initializeRegistrationByCurrentGenericTransform);
-    myHelper->SetMaximumNumberOfEvaluations(maximumNumberOfEvaluations);
-    myHelper->SetMaximumNumberOfCorrections(maximumNumberOfCorrections);
-    myHelper->SetWriteOutputTransformInFloat(writeOutputTransformInFloat);
-
-    //HACK: create a flag for normalization
-    bool NormalizeInputImages = false;
-    myHelper->SetNormalizeInputImages(NormalizeInputImages);
-
-    if( debugLevel > 7 )
-      {
-      myHelper->PrintCommandLine(true, "BF");
+    std::lock_guard<std::mutex> ioLock(ioMutex);
+    InputImageType::Pointer OriginalMovingVolume(
+      itkUtil::ReadImage<InputImageType>(job.movingVolume) );
+    /***********************
+     * Acquire Moving Image Index
+     **********************/
+    extractMovingVolume = ExtractImage<MovingVolumeType>(OriginalMovingVolume,
+                                                         movingVolumeTimeIndex);
+    if( extractFixedVolume2.IsNotNull() )
+      {
+      InputImageType::Pointer
+        OriginalMovingVolume2( itkUtil::ReadImage<InputImageType>(movingVolume2) );
+      std::cout << "Second Moving image original origin"
+                << OriginalMovingVolume2->GetOrigin() << std::endl;
+      extractMovingVolume2= ExtractImage<MovingVolumeType>(OriginalMovingVolume2,
+                                                           movingVolumeTimeIndex);
       }
-    try
+    }
+
+#ifdef USE_DebugImageViewer
+    if( DebugImageDisplaySender.Enabled() )
       {
-      myHelper->Update();
+      DebugImageDisplaySender.SendImage<itk::Image<float, 3> >(jobFixedVolume, 0);
+      DebugImageDisplaySender.SendImage<itk::Image<float, 3> >(extractMovingVolume, 1);
       }
-    catch( itk::ExceptionObject & err )
+#endif
+
+    if( useMedianFilter )
       {
-      std::cerr << "Exception during registration: " << std::endl;
-      std::cerr << err << std::endl;
-      return EXIT_FAILURE;
+      std::cout << "Moving Image size     " << extractMovingVolume->GetLargestPossibleRegion().GetSize() << std::endl;
+      extractMovingVolume = DoMedian<MovingVolumeType>(extractMovingVolume,
+                                                       indexRadius);
       }
-    currentGenericTransform = myHelper->GetCurrentGenericTransform();
 
-    std::string currentGenericTransformFileType;
-    if ( currentGenericTransform.IsNotNull() )
+    ImageMaskPointer movingMask = nullptr;
+    if( maskProcessingMode == "NOMASK" || maskProcessingMode == "ROIAUTO" )
       {
-      currentGenericTransformFileType = std::string( currentGenericTransform->GetNameOfClass() );
+      if( job.movingBinaryVolume != "" )
+        {
+        std::cout
+          << "ERROR:  Can not specify mask file names when " << maskProcessingMode
+          << " is used for the maskProcessingMode" << std::endl;
+        return EXIT_FAILURE;
+        }
+      if( maskProcessingMode == "ROIAUTO" )
+        {
+        using ROIAutoType = itk::BRAINSROIAutoImageFilter<MovingVolumeType, itk::Image<unsigned char, 3> >;
+        ROIAutoType::Pointer ROIFilter = ROIAutoType::New();
+        ROIFilter->SetInput(extractMovingVolume);
+        ROIFilter->SetClosingSize(ROIAutoClosingSize);
+        ROIFilter->SetDilateSize(ROIAutoDilateSize);
+        ROIFilter->Update();
+        movingMask = ROIFilter->GetSpatialObjectROI();
+        }
       }
-    if( currentGenericTransformFileType != "CompositeTransform" )
+    else if( maskProcessingMode == "ROI" )
       {
-      itkGenericExceptionMacro(<<"ERROR: Output transform is null.");
+      if( fixedMask.IsNull() && job.movingBinaryVolume == "" )
+        {
+        std::cout
+          <<
+          "ERROR:  Must specify mask file names when ROI is used for the maskProcessingMode"
+          << std::endl;
+        return EXIT_FAILURE;
+        }
+      if( job.movingBinaryVolume != "" )
+        {
+        std::lock_guard<std::mutex> ioLock(ioMutex);
+        movingMask = ReadImageMask<SpatialObjectType, Dimension>(
+            job.movingBinaryVolume,
+            extractMovingVolume.GetPointer() );
+        }
       }
-    CompositeTransformType::Pointer outputComposite = static_cast<CompositeTransformType *>( currentGenericTransform.GetPointer() );
 
-    MovingVolumeType::ConstPointer preprocessedMovingVolume = myHelper->GetPreprocessedMovingVolume();
-    if( NormalizeInputImages )
+    CompositeTransformType::Pointer currentGenericTransform;
+    if( movingInitialTransform.IsNotNull() )
       {
-      preprocessedMovingVolume = extractMovingVolume; // The resampled image should not be normalized
-                                                      // because it my be casted to zero later.
+      currentGenericTransform = CompositeTransformType::New();
+      currentGenericTransform->AddTransform( movingInitialTransform->Clone() );
       }
 
+    FixedVolumeType::Pointer resampledImage;
       {
-      using VectorComponentType = float;
-      using VectorPixelType = itk::Vector<VectorComponentType, 3>;
-      using DisplacementFieldType = itk::Image<VectorPixelType,  3>;
-
-      resampledImage = GenericTransformImage<MovingVolumeType, FixedVolumeType, DisplacementFieldType>(
-          preprocessedMovingVolume,
-          extractFixedVolume,
-          currentGenericTransform.GetPointer(),
-          backgroundFillValue,
-          interpolationMode,
-          false);
-      }
+      using HelperType = itk::BRAINSFitHelper;
+      HelperType::Pointer myHelper = HelperType::New();
+      myHelper->SetTransformType(localTransformType);
+      myHelper->SetFixedVolume( jobFixedVolume );
+      myHelper->SetMovingVolume( extractMovingVolume );
+      if( extractFixedVolume2.IsNotNull() &&
+          extractMovingVolume2.IsNotNull() )
+        {
+        myHelper->SetFixedVolume2( extractFixedVolume2 );
+        myHelper->SetMovingVolume2( extractMovingVolume2 );
+        }
+      myHelper->SetHistogramMatch(histogramMatch);
+      myHelper->SetRemoveIntensityOutliers(removeIntensityOutliers);
+      myHelper->SetNumberOfMatchPoints(numberOfMatchPoints);
+      myHelper->SetFixedBinaryVolume(fixedMask);
+      myHelper->SetMovingBinaryVolume(movingMask);
+      myHelper->SetOutputFixedVolumeROI(outputFixedVolumeROI);
+      myHelper->SetOutputMovingVolumeROI(outputMovingVolumeROI);
+      myHelper->SetSamplingPercentage(samplingPercentage);
+      myHelper->SetNumberOfHistogramBins(numberOfHistogramBins);
+      myHelper->SetNumberOfIterations(numberOfIterations);
+      myHelper->SetMaximumStepLength(maximumStepLength);
+      myHelper->SetMinimumStepLength(minimumStepLength);
+      myHelper->SetRelaxationFactor(relaxationFactor);
+      myHelper->SetTranslationScale(translationScale);
+      myHelper->SetReproportionScale(reproportionScale);
+      myHelper->SetSkewScale(skewScale);
+      myHelper->SetBackgroundFillValue(backgroundFillValue);
+      myHelper->SetInitializeTransformMode(localInitializeTransformMode);
+      myHelper->SetMaskInferiorCutOffFromCenter(maskInferiorCutOffFromCenter);
+      myHelper->SetCurrentGenericTransform(currentGenericTransform);
+      myHelper->SetSplineGridSize(BSplineGridSize);
+      myHelper->SetShrinkFactors(shrinkFactorsSchedule);
+      myHelper->SetSmoothingSigmas(smoothingSigmasSchedule);
+      myHelper->SetCostFunctionConvergenceFactor(costFunctionConvergenceFactor);
+      myHelper->SetProjectedGradientTolerance(projectedGradientTolerance);
+      myHelper->SetMaxBSplineDisplacement(maxBSplineDisplacement);
+      myHelper->SetDisplayDeformedImage(UseDebugImageViewer);
+      myHelper->SetPromptUserAfterDisplay(PromptAfterImageSend);
+      myHelper->SetDebugLevel(debugLevel);
+      myHelper->SetCostMetricName(costMetric);
+      myHelper->SetUseROIBSpline(useROIBSpline);
+      myHelper->SetSamplingStrategy(metricSamplingStrategy);
+      myHelper->SetInitializeRegistrationByCurrentGenericTransform(initializeRegistrationByCurrentGenericTransform);
+      myHelper->SetMaximumNumberOfEvaluations(maximumNumberOfEvaluations);
+      myHelper->SetMaximumNumberOfCorrections(maximumNumberOfCorrections);
+      myHelper->SetWriteOutputTransformInFloat(writeOutputTransformInFloat);
+
+      //HACK: create a flag for normalization
+      bool NormalizeInputImages = false;
+      myHelper->SetNormalizeInputImages(NormalizeInputImages);
+
+      if( debugLevel > 7 )
+        {
+        myHelper->PrintCommandLine(true, "BF");
+        }
+      try
+        {
+        myHelper->Update();
+        }
+      catch( itk::ExceptionObject & err )
+        {
+        std::cerr << "Exception during registration: " << std::endl;
+        std::cerr << err << std::endl;
+        return EXIT_FAILURE;
+        }
+      currentGenericTransform = myHelper->GetCurrentGenericTransform();
 
-      //If --logFileReport myReport.csv is specified on the command line, then write out this simple CSV file.
-    if( logFileReport != "" )
-      {
-      const double finalMetricValue = myHelper->GetFinalMetricValue();
-      std::stringstream myLogFileReportStream; // ( logFileReport );
-      myLogFileReportStream << "#MetricName,MetricValue,FixedImageName,FixedMaskName,MovingImageName,MovingMaskName" << std::endl;
-      myLogFileReportStream << costMetric << ",";
-      myLogFileReportStream << finalMetricValue << ",";
-      myLogFileReportStream << fixedVolume << ",";
-      myLogFileReportStream << fixedBinaryVolume << ",";
-      myLogFileReportStream << movingVolume << ",";
-      myLogFileReportStream << movingBinaryVolume << std::endl;
+      std::string currentGenericTransformFileType;
+      if ( currentGenericTransform.IsNotNull() )
+        {
+        currentGenericTransformFileType = std::string( currentGenericTransform->GetNameOfClass() );
+        }
+      if( currentGenericTransformFileType != "CompositeTransform" )
+        {
+        itkGenericExceptionMacro(<<"ERROR: Output transform is null.");
+        }
 
-      std::ofstream     LogScript;
-      LogScript.open( logFileReport.c_str() );
-      if( !LogScript.is_open() )
+      MovingVolumeType::ConstPointer preprocessedMovingVolume = myHelper->GetPreprocessedMovingVolume();
+      if( NormalizeInputImages )
         {
-        std::cerr << "Error: Can't write log file report file "
-        << logFileReport << std::endl;
-        std::cerr.flush();
-        return EXIT_FAILURE;
+        preprocessedMovingVolume = extractMovingVolume; // The resampled image should not be normalized
+                                                        // because it my be casted to zero later.
         }
-      LogScript << myLogFileReportStream.str();
-      LogScript.close();
-      }
 
-    }
-  /*
-   *  At this point we can save the resampled image.
-   */
+      if( job.outputVolume.size() > 0 )
+        {
+        using VectorComponentType = float;
+        using VectorPixelType = itk::Vector<VectorComponentType, 3>;
+        using DisplacementFieldType = itk::Image<VectorPixelType,  3>;
+
+        resampledImage = GenericTransformImage<MovingVolumeType, FixedVolumeType, DisplacementFieldType>(
+            preprocessedMovingVolume,
+            jobFixedVolume,
+            currentGenericTransform.GetPointer(),
+            backgroundFillValue,
+            interpolationMode,
+            false);
+        }
 
-  if( outputVolume.size() > 0 )
-    {
-    //      std::cout << "=========== resampledImage :\n" <<
-    // resampledImage->GetDirection() << std::endl;
-    // Set in PARSEARGS const bool scaleOutputValues=false;//TODO: Make this a
-    // command line parameter
-    if( outputVolumePixelType == "float" )
-      {
-      // itkUtil::WriteCastImage<itk::Image<float,
-      // FixedVolumeType::ImageDimension>,
-      // FixedVolumeType>(resampledImage,outputVolume);
-      using WriteOutImageType = itk::Image<float,
-                         FixedVolumeType::ImageDimension>;
-      WriteOutImageType::Pointer CastImage =
-        ( scaleOutputValues == true ) ?
-        ( itkUtil::PreserveCast<FixedVolumeType,
-                                WriteOutImageType>(resampledImage) ) :
-        ( itkUtil::TypeCast<FixedVolumeType,
-                            WriteOutImageType>(resampledImage) );
-      itkUtil::WriteImage<WriteOutImageType>(CastImage, outputVolume);
-      }
-    else if( outputVolumePixelType == "short" )
-      {
-      // itkUtil::WriteCastImage<itk::Image<signed short,
-      // FixedVolumeType::ImageDimension>,
-      // FixedVolumeType>(resampledImage,outputVolume);
-      using WriteOutImageType = itk::Image<signed short,
-                         FixedVolumeType::ImageDimension>;
-      WriteOutImageType::Pointer CastImage =
-        ( scaleOutputValues == true ) ?
-        ( itkUtil::PreserveCast<FixedVolumeType,
-                                WriteOutImageType>(resampledImage) ) :
-        ( itkUtil::TypeCast<FixedVolumeType,
-                            WriteOutImageType>(resampledImage) );
-      itkUtil::WriteImage<WriteOutImageType>(CastImage, outputVolume);
-      }
-    else if( outputVolumePixelType == "ushort" )
-      {
-      // itkUtil::WriteCastImage<itk::Image<unsigned short,
-      // FixedVolumeType::ImageDimension>,
-      // FixedVolumeType>(resampledImage,outputVolume);
-      using WriteOutImageType = itk::Image<unsigned short,
-                         FixedVolumeType::ImageDimension>;
-      WriteOutImageType::Pointer CastImage =
-        ( scaleOutputValues == true ) ?
-        ( itkUtil::PreserveCast<FixedVolumeType,
-                                WriteOutImageType>(resampledImage) ) :
-        ( itkUtil::TypeCast<FixedVolumeType,
-                            WriteOutImageType>(resampledImage) );
-      itkUtil::WriteImage<WriteOutImageType>(CastImage, outputVolume);
-      }
-    else if( outputVolumePixelType == "int" )
-      {
-      // itkUtil::WriteCastImage<itk::Image<signed int,
-      // FixedVolumeType::ImageDimension>,
-      // FixedVolumeType>(resampledImage,outputVolume);
-      using WriteOutImageType = itk::Image<signed int,
-                         FixedVolumeType::ImageDimension>;
-      WriteOutImageType::Pointer CastImage =
-        ( scaleOutputValues == true ) ?
-        ( itkUtil::PreserveCast<FixedVolumeType,
-                                WriteOutImageType>(resampledImage) ) :
-        ( itkUtil::TypeCast<FixedVolumeType,
-                            WriteOutImageType>(resampledImage) );
-      itkUtil::WriteImage<WriteOutImageType>(CastImage, outputVolume);
-      }
-    else if( outputVolumePixelType == "uint" )
-      {
-      // itkUtil::WriteCastImage<itk::Image<unsigned int,
-      // FixedVolumeType::ImageDimension>,
-      // FixedVolumeType>(resampledImage,outputVolume);
-      using WriteOutImageType = itk::Image<unsigned int,
-                         FixedVolumeType::ImageDimension>;
-      WriteOutImageType::Pointer CastImage =
-        ( scaleOutputValues == true ) ?
-        ( itkUtil::PreserveCast<FixedVolumeType,
-                                WriteOutImageType>(resampledImage) ) :
-        ( itkUtil::TypeCast<FixedVolumeType,
-                            WriteOutImageType>(resampledImage) );
-      itkUtil::WriteImage<WriteOutImageType>(CastImage, outputVolume);
-      }
-    else if( outputVolumePixelType == "uchar" )
-      {
-      // itkUtil::WriteCastImage<itk::Image<unsigned char,
-      // FixedVolumeType::ImageDimension>,
-      // FixedVolumeType>(resampledImage,outputVolume);
-      using WriteOutImageType = itk::Image<unsigned char,
-                         FixedVolumeType::ImageDimension>;
-      WriteOutImageType::Pointer CastImage =
-        ( scaleOutputValues == true ) ?
-        ( itkUtil::PreserveCast<FixedVolumeType,
-                                WriteOutImageType>(resampledImage) ) :
-        ( itkUtil::TypeCast<FixedVolumeType,
-                            WriteOutImageType>(resampledImage) );
-      itkUtil::WriteImage<WriteOutImageType>(CastImage, outputVolume);
+      job.finalMetricValue = myHelper->GetFinalMetricValue();
+      }
+    /*
+     *  At this point we can save the resampled image.
+     */
+    std::lock_guard<std::mutex> ioLock(ioMutex);
+    if( job.outputVolume.size() > 0 )
+      {
+      if( outputVolumePixelType == "float" )
+        {
+        WriteResampledVolume<float>(resampledImage, job.outputVolume, scaleOutputValues);
+        }
+      else if( outputVolumePixelType == "short" )
+        {
+        WriteResampledVolume<signed short>(resampledImage, job.outputVolume, scaleOutputValues);
+        }
+      else if( outputVolumePixelType == "ushort" )
+        {
+        WriteResampledVolume<unsigned short>(resampledImage, job.outputVolume, scaleOutputValues);
+        }
+      else if( outputVolumePixelType == "int" )
+        {
+        WriteResampledVolume<signed int>(resampledImage, job.outputVolume, scaleOutputValues);
+        }
+      else if( outputVolumePixelType == "uint" )
+        {
+        WriteResampledVolume<unsigned int>(resampledImage, job.outputVolume, scaleOutputValues);
+        }
+      else if( outputVolumePixelType == "uchar" )
+        {
+        WriteResampledVolume<unsigned char>(resampledImage, job.outputVolume, scaleOutputValues);
+        }
       }
-    }
     if( writeOutputTransformInFloat )
       {
       std::cout << "Write the output transform in single (float) precision..." << std::endl;
       itk::WriteBothTransformsToDisk<double,float>(currentGenericTransform.GetPointer(),
-                                                   localOutputTransform, strippedOutputTransform);
+                                                   job.outputTransform, job.strippedOutputTransform);
       }
     else
       {
       itk::WriteBothTransformsToDisk<double,double>(currentGenericTransform.GetPointer(),
-                                                    localOutputTransform, strippedOutputTransform);
+                                                    job.outputTransform, job.strippedOutputTransform);
       }
+    return EXIT_SUCCESS;
+  };
 
+  if( registrationManifest.empty() )
+    {
+    registrationJobs[0].exitStatus = registerMovingVolume( registrationJobs[0] );
+    if( registrationJobs[0].exitStatus != EXIT_SUCCESS )
+      {
+      return registrationJobs[0].exitStatus;
+      }
+    }
+  else
+    {
+    // The registrations run on their own threads, and share the ITK thread
+    // pool (numberOfThreads) for the work each of them parallelizes.
+    const unsigned int numberOfJobs = static_cast<unsigned int>( registrationJobs.size() );
+    unsigned int       numberOfWorkers = ( numberOfConcurrentRegistrations > 0 ) ?
+      static_cast<unsigned int>( numberOfConcurrentRegistrations ) :
+      itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+    numberOfWorkers = std::max( 1U, std::min( numberOfWorkers, numberOfJobs ) );
+    std::cout << "Running " << numberOfJobs << " registrations from " << registrationManifest
+              << ", " << numberOfWorkers << " at a time." << std::endl;
+
+    std::atomic<unsigned int> nextJob( 0 );
+    auto                      worker = [&]()
+    {
+      for( unsigned int j = nextJob++; j < numberOfJobs; j = nextJob++ )
+        {
+        RegistrationJobType & job = registrationJobs[j];
+        try
+          {
+          job.exitStatus = registerMovingVolume( job );
+          }
+        catch( itk::ExceptionObject & err )
+          {
+          std::cerr << "Exception while registering " << job.movingVolume << ": " << std::endl;
+          std::cerr << err << std::endl;
+          job.exitStatus = EXIT_FAILURE;
+          }
+        catch( std::exception & err )
+          {
+          std::cerr << "Exception while registering " << job.movingVolume << ": " << err.what() << std::endl;
+          job.exitStatus = EXIT_FAILURE;
+          }
+        }
+    };
+    std::vector<std::thread> workers;
+    for( unsigned int w = 1; w < numberOfWorkers; ++w )
+      {
+      workers.emplace_back( worker );
+      }
+    worker();
+    for( auto & workerThread : workers )
+      {
+      workerThread.join();
+      }
+    }
+
+  //If --logFileReport myReport.csv is specified on the command line, then write out this simple CSV file.
+  if( logFileReport != "" )
+    {
+    std::stringstream myLogFileReportStream; // ( logFileReport );
+    myLogFileReportStream << "#MetricName,MetricValue,FixedImageName,FixedMaskName,MovingImageName,MovingMaskName" << std::endl;
+    for( const auto & job : registrationJobs )
+      {
+      if( job.exitStatus != EXIT_SUCCESS )
+        {
+        continue;
+        }
+      myLogFileReportStream << costMetric << ",";
+      myLogFileReportStream << job.finalMetricValue << ",";
+      myLogFileReportStream << fixedVolume << ",";
+      myLogFileReportStream << fixedBinaryVolume << ",";
+      myLogFileReportStream << job.movingVolume << ",";
+      myLogFileReportStream << job.movingBinaryVolume << std::endl;
+      }
 
-  return 0;
+    std::ofstream     LogScript;
+    LogScript.open( logFileReport.c_str() );
+    if( !LogScript.is_open() )
+      {
+      std::cerr << "Error: Can't write log file report file "
+      << logFileReport << std::endl;
+      std::cerr.flush();
+      return EXIT_FAILURE;
+      }
+    LogScript << myLogFileReportStream.str();
+    LogScript.close();
+    }
+
+  unsigned int numberOfFailedJobs = 0;
+  for( const auto & job : registrationJobs )
+    {
+    if( job.exitStatus != EXIT_SUCCESS )
+      {
+      std::cerr << "ERROR: registration of " << job.movingVolume << " failed." << std::endl;
+      ++numberOfFailedJobs;
+      }
+    }
+  return ( numberOfFailedJobs == 0 ) ? 0 : EXIT_FAILURE;
 }
@@ -28,25 +28,34 @@ the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
 PURPOSE.  See the above copyright notices for more information.
 =========================================================================*/
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <map>
 #include <sstream>
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "itkImage.h"
-#include "itkLabelStatisticsImageFilter.h"
-#include "itkMinimumMaximumImageFilter.h"
 #include "itkImageFileReader.h"
+#include "itkMath.h"
+#include "itkMultiThreaderBase.h"
 #include "itkDOMNodeXMLReader.h"
 #include "itkDOMNode.h"
 
+#include "BRAINSThreadControl.h"
 #include "BRAINSLabelStatsCLP.h"
 
-std::string GetXmlLabelName( std::string fileName, int label )
+using ImageType = itk::Image<float, 3>;
+using LabelType = itk::Image<short, 3>;
+using LabelPixelType = LabelType::PixelType;
+using LabelNameMapType = std::map<int, std::string>;
+
+LabelNameMapType GetXmlLabelNames( const std::string & fileName )
 {
-  // Set default return value
-  std::string labelName = "Error";
+  LabelNameMapType labelNames;
 
   // Load the XML File
   itk::DOMNodeXMLReader::Pointer xmlReader = itk::DOMNodeXMLReader::New();
@@ -54,42 +63,32 @@ std::string GetXmlLabelName( std::string fileName, int label )
   xmlReader->SetFileName( fileName );
   xmlReader->Update();
 
-  // Find the labels and extract name of specified label
+  // Find the labels and extract the name of every label
   itk::DOMNode::Pointer  labelXmlInfo = xmlReader->GetOutput();
   itk::DOMNode::ChildrenListType elementList;
   labelXmlInfo->GetAllChildren(elementList);
   for( std::vector<itk::DOMNode *>::iterator it = elementList.begin(); it != elementList.end(); ++it )
     {
-    // std::cout << *it << std::endl;
-    // std::cout << (*it)->GetName() << std::endl;
-    // std::cout << (*it)->GetPath() << std::endl;
     if( (*it)->GetName() == "data" )
       {
       itk::DOMNode::ChildrenListType labelList;
       (*it)->GetAllChildren(labelList);
       for( std::vector<itk::DOMNode *>::iterator lt = labelList.begin(); lt != labelList.end(); ++lt )
         {
-        // std::cout << *lt << std::endl;
-        // std::cout << (*lt)->GetName() << std::endl;
-        // std::cout << (*lt)->GetPath() << std::endl;
         std::string attributeValue = (*lt)->GetAttribute("index");
         int         currentLabel = std::stoi( attributeValue.c_str() );
-        if( currentLabel == label )
-          {
-          itk::DOMTextNode::Pointer textNode = (*lt)->GetTextChild(0);
-          labelName = textNode->GetText();
-          }
+        itk::DOMTextNode::Pointer textNode = (*lt)->GetTextChild(0);
+        labelNames[currentLabel] = textNode->GetText();
         }
       }
     }
 
-  return labelName;
+  return labelNames;
 }
 
-std::string GetAntsLabelName( std::string fileName, int label )
+LabelNameMapType GetAntsLabelNames( const std::string & fileName )
 {
-  // Set default return value
-  std::string labelName = "Error";
+  LabelNameMapType labelNames;
 
   std::string value, txtLabel;
   std::string x1, x2, y1, y2, z1, z2;
@@ -98,56 +97,290 @@ std::string GetAntsLabelName( std::string fileName, int label )
 
   if( labelFile.is_open() )
     {
-    while( !labelFile.eof() )
+    while( labelFile >> value >> x1 >> y1 >> z1 >> x2 >> y2 >> z2 )
       {
-      labelFile >> value >> x1 >> y1 >> z1;
-      labelFile >> x2 >> y2 >> z2;
       std::getline(labelFile, txtLabel);
 
+      // The first line of a label wins
       int currentLabel = std::stoi( value.c_str() );
-      if( currentLabel == label )
+      if( labelNames.find( currentLabel ) == labelNames.end() )
         {
         unsigned first = txtLabel.find('"');
         unsigned last = txtLabel.rfind('"');
-        labelName = txtLabel.substr(first + 1, last - first - 1);
-        labelFile.close();
-        return labelName;
+        labelNames[currentLabel] = txtLabel.substr(first + 1, last - first - 1);
         }
       }
 
     labelFile.close();
     }
 
-  return labelName;
+  return labelNames;
 }
 
-std::string GetLabelName( int mode, std::string fileName, int label )
+/** Parse the label name file once */
+LabelNameMapType GetLabelNames( int mode, const std::string & fileName )
 {
   switch( mode )
     {
     case 1:
       {
-      return GetXmlLabelName(fileName, label);
+      return GetXmlLabelNames(fileName);
       }
       break;
     case 3:
       {
-      return GetAntsLabelName(fileName, label);
+      return GetAntsLabelNames(fileName);
       }
       break;
     default:
-      return "UNKNOWN";
+      return LabelNameMapType();
+    }
+
+  return LabelNameMapType();
+}
+
+std::string GetLabelName( int mode, const LabelNameMapType & labelNames, int label )
+{
+  if( mode != 1 && mode != 3 )
+    {
+    return "UNKNOWN";
+    }
+  LabelNameMapType::const_iterator it = labelNames.find( label );
+  return ( it != labelNames.end() ) ? it->second : "Error";
+}
+
+/** The labels present in a label map, in increasing order, and the voxels of
+ * each label grouped together.  Built once per label map and shared by every
+ * image measured in it. */
+struct LabelIndexType
+  {
+  std::vector<LabelPixelType> Labels;
+  std::vector<int>            DenseIndex;
+  std::vector<size_t>         VoxelStart;
+  std::vector<size_t>         VoxelOffsets;
+  };
+
+size_t LabelValueOffset( const LabelPixelType label )
+{
+  return static_cast<size_t>( static_cast<int>( label ) - std::numeric_limits<LabelPixelType>::min() );
+}
+
+LabelIndexType BuildLabelIndex( const LabelType *labelMap )
+{
+  const size_t          numberOfVoxels = labelMap->GetBufferedRegion().GetNumberOfPixels();
+  const LabelPixelType *labels = labelMap->GetBufferPointer();
+
+  std::vector<size_t> valueCount( LabelValueOffset( std::numeric_limits<LabelPixelType>::max() ) + 1, 0 );
+  for( size_t v = 0; v < numberOfVoxels; ++v )
+    {
+    ++valueCount[LabelValueOffset( labels[v] )];
+    }
+
+  LabelIndexType index;
+  index.DenseIndex.assign( valueCount.size(), -1 );
+  index.VoxelStart.push_back( 0 );
+  for( size_t value = 0; value < valueCount.size(); ++value )
+    {
+    if( valueCount[value] > 0 )
+      {
+      index.DenseIndex[value] = static_cast<int>( index.Labels.size() );
+      index.Labels.push_back( static_cast<LabelPixelType>( static_cast<int>( value )
+                                                           + std::numeric_limits<LabelPixelType>::min() ) );
+      index.VoxelStart.push_back( index.VoxelStart.back() + valueCount[value] );
+      }
     }
 
-  return "UNKNOWN";
+  std::vector<size_t> cursor( index.VoxelStart.begin(), index.VoxelStart.end() - 1 );
+  index.VoxelOffsets.resize( numberOfVoxels );
+  for( size_t v = 0; v < numberOfVoxels; ++v )
+    {
+    index.VoxelOffsets[cursor[index.DenseIndex[LabelValueOffset( labels[v] )]]++] = v;
+    }
+  return index;
+}
+
+/** Moments of the intensities of one label in one image */
+struct LabelMomentsType
+  {
+  itk::SizeValueType Count;
+  double             Sum;
+  double             SumOfSquares;
+  double             Minimum;
+  double             Maximum;
+  };
+
+/** Bins laid out as itk::Statistics::Histogram::Initialize does for the
+ * LabelStatisticsImageFilter histograms, so medians are unchanged. */
+class HistogramBinsType
+{
+public:
+  HistogramBinsType( const unsigned int numberOfBins, const double lowerBound, const double upperBound ) :
+    m_BinMin( numberOfBins ),
+    m_UpperBound( upperBound )
+  {
+    const float interval = ( static_cast<float>( upperBound ) - static_cast<float>( lowerBound ) )
+      / static_cast<double>( numberOfBins );
+    for( unsigned int j = 0; j < numberOfBins; ++j )
+      {
+      m_BinMin[j] = lowerBound + ( static_cast<float>( j ) * interval );
+      }
+  }
+
+  unsigned int GetNumberOfBins() const
+  {
+    return m_BinMin.size();
+  }
+
+  /** Bin of value, GetNumberOfBins() when it is outside of the histogram */
+  unsigned int GetBin( const double value ) const
+  {
+    if( !( value >= m_BinMin.front() ) )
+      {
+      return this->GetNumberOfBins();
+      }
+    if( value >= m_UpperBound )
+      {
+      return itk::Math::AlmostEquals( value, m_UpperBound ) ? this->GetNumberOfBins() - 1 : this->GetNumberOfBins();
+      }
+    return std::upper_bound( m_BinMin.begin(), m_BinMin.end(), value ) - m_BinMin.begin() - 1;
+  }
+
+  double GetBinCenter( const unsigned int bin ) const
+  {
+    const double binMax = ( bin + 1 < this->GetNumberOfBins() ) ? m_BinMin[bin + 1] : m_UpperBound;
+    return m_BinMin[bin] + ( binMax - m_BinMin[bin] ) / 2;
+  }
+
+private:
+  std::vector<double> m_BinMin;
+  double              m_UpperBound;
+};
+
+/** Statistics of every label of labelIndex in every image, in one threaded
+ * pass over the voxels with one set of accumulators per work unit.
+ * moments[image][label] receive the moments, imageMinimum and imageMaximum
+ * the range of each whole image. */
+void AccumulateLabelMoments( const std::vector<ImageType::Pointer> & images, const LabelType *labelMap,
+                             const LabelIndexType & labelIndex,
+                             std::vector<std::vector<LabelMomentsType> > & moments,
+                             std::vector<float> & imageMinimum, std::vector<float> & imageMaximum )
+{
+  const size_t          numberOfImages = images.size();
+  const size_t          numberOfLabels = labelIndex.Labels.size();
+  const size_t          numberOfVoxels = labelMap->GetBufferedRegion().GetNumberOfPixels();
+  const LabelPixelType *labels = labelMap->GetBufferPointer();
+
+  std::vector<const float *> buffers;
+  for( size_t i = 0; i < numberOfImages; ++i )
+    {
+    buffers.push_back( images[i]->GetBufferPointer() );
+    }
+
+  LabelMomentsType emptyMoments;
+  emptyMoments.Count = 0;
+  emptyMoments.Sum = 0.0;
+  emptyMoments.SumOfSquares = 0.0;
+  emptyMoments.Minimum = itk::NumericTraits<double>::max();
+  emptyMoments.Maximum = itk::NumericTraits<double>::NonpositiveMin();
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  const size_t                    numberOfWorkUnits =
+    std::max<size_t>( 1, std::min<size_t>( mt->GetNumberOfWorkUnits(), numberOfVoxels ) );
+
+  std::vector<std::vector<LabelMomentsType> > unitMoments( numberOfWorkUnits,
+                                                          std::vector<LabelMomentsType>( numberOfImages
+                                                                                         * numberOfLabels,
+                                                                                         emptyMoments ) );
+  std::vector<std::vector<float> > unitMinimum( numberOfWorkUnits,
+                                                std::vector<float>( numberOfImages,
+                                                                    itk::NumericTraits<float>::max() ) );
+  std::vector<std::vector<float> > unitMaximum( numberOfWorkUnits,
+                                                std::vector<float>( numberOfImages,
+                                                                    itk::NumericTraits<float>::NonpositiveMin() ) );
+
+  mt->SetNumberOfWorkUnits( numberOfWorkUnits );
+  mt->ParallelizeArray( 0, numberOfWorkUnits,
+                        [&](itk::SizeValueType unit)
+                          {
+                            const size_t       first = numberOfVoxels * unit / numberOfWorkUnits;
+                            const size_t       last = numberOfVoxels * ( unit + 1 ) / numberOfWorkUnits;
+                            LabelMomentsType * accumulators = unitMoments[unit].data();
+                            for( size_t v = first; v < last; ++v )
+                              {
+                              const int label = labelIndex.DenseIndex[LabelValueOffset( labels[v] )];
+                              for( size_t i = 0; i < numberOfImages; ++i )
+                                {
+                                const float        value = buffers[i][v];
+                                LabelMomentsType & m = accumulators[i * numberOfLabels + label];
+                                ++m.Count;
+                                m.Sum += value;
+                                m.SumOfSquares += static_cast<double>( value ) * value;
+                                m.Minimum = std::min<double>( m.Minimum, value );
+                                m.Maximum = std::max<double>( m.Maximum, value );
+                                unitMinimum[unit][i] = std::min( unitMinimum[unit][i], value );
+                                unitMaximum[unit][i] = std::max( unitMaximum[unit][i], value );
+                                }
+                              }
+                          },
+                        nullptr );
+
+  // Sum the work units in a fixed order
+  moments.assign( numberOfImages, std::vector<LabelMomentsType>( numberOfLabels, emptyMoments ) );
+  imageMinimum.assign( numberOfImages, itk::NumericTraits<float>::max() );
+  imageMaximum.assign( numberOfImages, itk::NumericTraits<float>::NonpositiveMin() );
+  for( size_t unit = 0; unit < numberOfWorkUnits; ++unit )
+    {
+    for( size_t i = 0; i < numberOfImages; ++i )
+      {
+      for( size_t l = 0; l < numberOfLabels; ++l )
+        {
+        const LabelMomentsType & u = unitMoments[unit][i * numberOfLabels + l];
+        LabelMomentsType &       m = moments[i][l];
+        m.Count += u.Count;
+        m.Sum += u.Sum;
+        m.SumOfSquares += u.SumOfSquares;
+        m.Minimum = std::min( m.Minimum, u.Minimum );
+        m.Maximum = std::max( m.Maximum, u.Maximum );
+        }
+      imageMinimum[i] = std::min( imageMinimum[i], unitMinimum[unit][i] );
+      imageMaximum[i] = std::max( imageMaximum[i], unitMaximum[unit][i] );
+      }
+    }
+}
+
+/** Center of the histogram bin that holds sample floor(quantile * count),
+ * for each quantile, as LabelStatisticsImageFilter::GetMedian does for 0.5.
+ * Samples outside of the histogram are counted but not binned. */
+std::vector<double> ComputeHistogramQuantiles( const ImageType *image, const LabelIndexType & labelIndex,
+                                               const size_t label, const HistogramBinsType & bins,
+                                               const std::vector<double> & quantileValues )
+{
+  const float *             values = image->GetBufferPointer();
+  const size_t              start = labelIndex.VoxelStart[label];
+  const size_t              count = labelIndex.VoxelStart[label + 1] - start;
+  std::vector<unsigned int> labelBins( count );
+  for( size_t v = 0; v < count; ++v )
+    {
+    labelBins[v] = bins.GetBin( values[labelIndex.VoxelOffsets[start + v]] );
+    }
+
+  std::vector<double> result;
+  for( const double q : quantileValues )
+    {
+    const size_t rank = std::min( count - 1, static_cast<size_t>( q * count ) );
+    std::nth_element( labelBins.begin(), labelBins.begin() + rank, labelBins.end() );
+    const unsigned int bin = std::min( labelBins[rank], bins.GetNumberOfBins() - 1 );
+    result.push_back( bins.GetBinCenter( bin ) );
+    }
+  return result;
 }
 
 int main(int argc, char *argv[])
 {
   PARSE_ARGS;
+  const BRAINSUtils::StackPushITKDefaultNumberOfThreads TempDefaultNumberOfThreadsHolder(numberOfThreads);
 
-  if( ( imageVolume.length() == 0 ) &&
-      ( labelVolume.length() == 0 ) )
+  if( imageVolume.empty() || labelVolume.empty() )
     {
     std::cout << "Error: Both the image and label must be specified" << std::endl;
     return EXIT_FAILURE;
@@ -159,6 +392,15 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE;
     }
 
+  for( size_t q = 0; q < quantiles.size(); ++q )
+    {
+    if( quantiles[q] < 0.0F || quantiles[q] > 1.0F )
+      {
+      std::cout << "Error: Quantiles must be between 0 and 1" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
   int mode = 0;
   if( labelFileType == "fslxml" )
     {
@@ -176,8 +418,14 @@ int main(int argc, char *argv[])
   if( echoSwitch )
     {
     std::cout << "=====================================================" << std::endl;
-    std::cout << "Image: " <<   imageVolume << std::endl;
-    std::cout << "Label Map: " <<   labelVolume << std::endl;
+    for( size_t i = 0; i < imageVolume.size(); ++i )
+      {
+      std::cout << "Image: " <<   imageVolume[i] << std::endl;
+      }
+    for( size_t i = 0; i < labelVolume.size(); ++i )
+      {
+      std::cout << "Label Map: " <<   labelVolume[i] << std::endl;
+      }
     std::cout << "Label Name File: " <<   labelNameFile << std::endl;
     std::cout << "Column Prefix Names: ";
     for( size_t i = 0; i < outputPrefixColumnNames.size(); ++i )
@@ -199,151 +447,162 @@ int main(int argc, char *argv[])
     std::cout << "=====================================================" << std::endl;
     }
 
-  using ImageType = itk::Image<float, 3>;
-  using ImageReaderType = itk::ImageFileReader<ImageType>;
-  ImageReaderType::Pointer imageReader = ImageReaderType::New();
-  imageReader->SetFileName( imageVolume );
-  imageReader->UpdateLargestPossibleRegion();
-
-  ImageType::RegionType  imageRegion;
-  ImageType::SizeType    imageSize;
-  ImageType::SpacingType imageSpacing;
-  ImageType::PointType   imageOrigin;
-  imageRegion = imageReader->GetOutput()->GetLargestPossibleRegion();
-  imageSize = imageRegion.GetSize();
-  imageSpacing = imageReader->GetOutput()->GetSpacing();
-  imageOrigin = imageReader->GetOutput()->GetOrigin();
-
-  using LabelType = itk::Image<short, 3>;
-  using LabelReaderType = itk::ImageFileReader<LabelType>;
-  LabelReaderType::Pointer labelReader = LabelReaderType::New();
-  labelReader->SetFileName( labelVolume );
-  labelReader->UpdateLargestPossibleRegion();
-
-  LabelType::RegionType  labelRegion;
-  LabelType::SizeType    labelSize;
-  LabelType::SpacingType labelSpacing;
-  LabelType::PointType   labelOrigin;
-  labelRegion = labelReader->GetOutput()->GetLargestPossibleRegion();
-  labelSize = labelRegion.GetSize();
-  labelSpacing = labelReader->GetOutput()->GetSpacing();
-  labelOrigin = labelReader->GetOutput()->GetOrigin();
-  // Check the Image and Label Map to Make sure they define the same space
-  for( size_t i = 0; i < 3; ++i )
-    {
-    if( imageSize[i] != labelSize[i] )
-      {
-      std::cout << "Error: Image and label size do not match" << std::endl;
-      std::cout << "Image: " << imageSize << std::endl;
-      std::cout << "Label: " << labelSize << std::endl;
-      return EXIT_FAILURE;
-      }
-    if( fabs(labelSpacing[i] - imageSpacing[i]) > 0.01 )
-      {
-      std::cout << "Error: Image and label spacing do not match" << std::endl;
-      std::cout << "Image: " << imageSpacing << std::endl;
-      std::cout << "Label: " << labelSpacing << std::endl;
-      return EXIT_FAILURE;
-      }
-    if( fabs(labelOrigin[i] - imageOrigin[i]) > 0.01 )
-      {
-      std::cout << "Error: Image and label origin do not match" << std::endl;
-      std::cout << "Image: " << imageOrigin << std::endl;
-      std::cout << "Label: " << labelOrigin << std::endl;
-      return EXIT_FAILURE;
-      }
-    }
-
-  float minValue;
-  float maxValue;
-  bool  computeGlobalHistogram = false;
-
-  if( minMaxType == "manual" )
-    {
-    minValue = userDefineMinimum;
-    maxValue = userDefineMaximum;
-    computeGlobalHistogram = true;
-    }
-  else if( minMaxType == "image" )
-    {
-    using MinMaxFilterType = itk::MinimumMaximumImageFilter<ImageType>;
-    MinMaxFilterType::Pointer minMaxFilter = MinMaxFilterType::New();
-    minMaxFilter->SetInput( imageReader->GetOutput() );
-    minMaxFilter->UpdateLargestPossibleRegion();
-    minValue = minMaxFilter->GetMinimum();
-    maxValue = minMaxFilter->GetMaximum();
-    computeGlobalHistogram = true;
-    }
-  else if( minMaxType == "label" )
+  if( minMaxType == "label" )
     {
     std::cerr << "ERROR:  label method not yet implemented." << std::endl;
     return EXIT_FAILURE;
     }
-  else
+  else if( minMaxType != "manual" && minMaxType != "image" )
     {
     std::cerr << "Invalid minMaxType provided" << std::endl;
     return EXIT_FAILURE;
     }
 
-  using StatsFilterType = itk::LabelStatisticsImageFilter<ImageType, LabelType>;
-  StatsFilterType::Pointer statsFilter = StatsFilterType::New();
-  statsFilter->SetInput( imageReader->GetOutput() );
-  statsFilter->SetLabelInput( labelReader->GetOutput() );
-  if( computeGlobalHistogram )
+  using ImageReaderType = itk::ImageFileReader<ImageType>;
+  std::vector<ImageType::Pointer> images;
+  for( size_t i = 0; i < imageVolume.size(); ++i )
     {
-    statsFilter->UseHistogramsOn();
-    statsFilter->SetHistogramParameters(numberOfHistogramBins, minValue, maxValue);
+    ImageReaderType::Pointer imageReader = ImageReaderType::New();
+    imageReader->SetFileName( imageVolume[i] );
+    imageReader->UpdateLargestPossibleRegion();
+    images.push_back( imageReader->GetOutput() );
     }
-  statsFilter->UpdateLargestPossibleRegion();
 
-  using ValidLabelValuesType = StatsFilterType::ValidLabelValuesContainerType;
-  using LabelPixelType = StatsFilterType::LabelPixelType;
+  const LabelNameMapType labelNames = GetLabelNames( mode, labelNameFile );
+
+  // The median is always reported, the requested quantiles follow the volume
+  std::vector<double> quantileValues( 1, 0.5 );
+  quantileValues.insert( quantileValues.end(), quantiles.begin(), quantiles.end() );
+
+  const bool reportVolumeNames = imageVolume.size() > 1 || labelVolume.size() > 1;
   for( size_t i = 0; i < outputPrefixColumnNames.size(); ++i )
     {
     std::cout << outputPrefixColumnNames[i] << ", ";
     }
-  std::cout << "Name, label, min, max, median, mean, stddev, var, sum, count" << std::endl;
-  for( ValidLabelValuesType::const_iterator vIt = statsFilter->GetValidLabelValues().begin();
-       vIt != statsFilter->GetValidLabelValues().end();
-       ++vIt )
+  if( reportVolumeNames )
     {
-    if( statsFilter->HasLabel(*vIt) )
-      {
-      LabelPixelType labelValue = *vIt;
+    std::cout << "image, labelMap, ";
+    }
+  std::cout << "Name, label, min, max, median, mean, stddev, var, sum, count, volume";
+  for( size_t q = 0; q < quantiles.size(); ++q )
+    {
+    std::cout << ", q" << quantiles[q];
+    }
+  std::cout << std::endl;
 
-      std::string labelName = GetLabelName(mode, labelNameFile, labelValue);
-      for( size_t i = 0; i < outputPrefixColumnValues.size(); ++i )
+  using LabelReaderType = itk::ImageFileReader<LabelType>;
+  for( size_t labelMapNumber = 0; labelMapNumber < labelVolume.size(); ++labelMapNumber )
+    {
+    LabelReaderType::Pointer labelReader = LabelReaderType::New();
+    labelReader->SetFileName( labelVolume[labelMapNumber] );
+    labelReader->UpdateLargestPossibleRegion();
+    const LabelType *labelMap = labelReader->GetOutput();
+
+    const LabelType::SizeType    labelSize = labelMap->GetLargestPossibleRegion().GetSize();
+    const LabelType::SpacingType labelSpacing = labelMap->GetSpacing();
+    const LabelType::PointType   labelOrigin = labelMap->GetOrigin();
+    // Check the Images and Label Map to Make sure they define the same space
+    for( size_t imageNumber = 0; imageNumber < images.size(); ++imageNumber )
+      {
+      const ImageType::SizeType    imageSize = images[imageNumber]->GetLargestPossibleRegion().GetSize();
+      const ImageType::SpacingType imageSpacing = images[imageNumber]->GetSpacing();
+      const ImageType::PointType   imageOrigin = images[imageNumber]->GetOrigin();
+      for( size_t i = 0; i < 3; ++i )
         {
-        std::cout << outputPrefixColumnValues[i] << ", ";
+        if( imageSize[i] != labelSize[i] )
+          {
+          std::cout << "Error: Image and label size do not match" << std::endl;
+          std::cout << "Image: " << imageSize << std::endl;
+          std::cout << "Label: " << labelSize << std::endl;
+          return EXIT_FAILURE;
+          }
+        if( fabs(labelSpacing[i] - imageSpacing[i]) > 0.01 )
+          {
+          std::cout << "Error: Image and label spacing do not match" << std::endl;
+          std::cout << "Image: " << imageSpacing << std::endl;
+          std::cout << "Label: " << labelSpacing << std::endl;
+          return EXIT_FAILURE;
+          }
+        if( fabs(labelOrigin[i] - imageOrigin[i]) > 0.01 )
+          {
+          std::cout << "Error: Image and label origin do not match" << std::endl;
+          std::cout << "Image: " << imageOrigin << std::endl;
+          std::cout << "Label: " << labelOrigin << std::endl;
+          return EXIT_FAILURE;
+          }
         }
-      std::cout << labelName << ", ";
-      std::cout << labelValue << ", ";
-      std::cout << statsFilter->GetMinimum( labelValue ) << ", ";
-      std::cout << statsFilter->GetMaximum( labelValue ) << ", ";
-      float medianValue;
+      }
 
-      if( !computeGlobalHistogram )
-        {
-        minValue = statsFilter->GetMinimum( labelValue );
-        maxValue = statsFilter->GetMaximum( labelValue );
-        StatsFilterType::Pointer labelStatsFilter = StatsFilterType::New();
-        labelStatsFilter->SetInput( imageReader->GetOutput() );
-        labelStatsFilter->SetLabelInput( labelReader->GetOutput() );
-        labelStatsFilter->UseHistogramsOn();
-        labelStatsFilter->SetHistogramParameters(numberOfHistogramBins, minValue, maxValue);
-        labelStatsFilter->UpdateLargestPossibleRegion();
-        medianValue = labelStatsFilter->GetMedian( labelValue );
-        }
-      else
+    const LabelIndexType labelIndex = BuildLabelIndex( labelMap );
+    const size_t         numberOfLabels = labelIndex.Labels.size();
+
+    std::vector<std::vector<LabelMomentsType> > moments;
+    std::vector<float>                          imageMinimum;
+    std::vector<float>                          imageMaximum;
+    AccumulateLabelMoments( images, labelMap, labelIndex, moments, imageMinimum, imageMaximum );
+
+    // Histogram quantiles of every label of every image, in parallel
+    std::vector<HistogramBinsType> bins;
+    for( size_t imageNumber = 0; imageNumber < images.size(); ++imageNumber )
+      {
+      const float minValue = ( minMaxType == "manual" ) ? userDefineMinimum : imageMinimum[imageNumber];
+      const float maxValue = ( minMaxType == "manual" ) ? userDefineMaximum : imageMaximum[imageNumber];
+      bins.push_back( HistogramBinsType( numberOfHistogramBins, minValue, maxValue ) );
+      }
+    std::vector<std::vector<double> > labelQuantiles( images.size() * numberOfLabels );
+    itk::MultiThreaderBase::Pointer   mt = itk::MultiThreaderBase::New();
+    mt->ParallelizeArray( 0, labelQuantiles.size(),
+                          [&](itk::SizeValueType task)
+                            {
+                              const size_t imageNumber = task / numberOfLabels;
+                              const size_t label = task % numberOfLabels;
+                              labelQuantiles[task] = ComputeHistogramQuantiles( images[imageNumber], labelIndex, label,
+                                                                                bins[imageNumber], quantileValues );
+                            },
+                          nullptr );
+
+    const double voxelVolume = labelSpacing[0] * labelSpacing[1] * labelSpacing[2];
+    for( size_t imageNumber = 0; imageNumber < images.size(); ++imageNumber )
+      {
+      for( size_t label = 0; label < numberOfLabels; ++label )
         {
-        medianValue = statsFilter->GetMedian( labelValue );
+        const LabelPixelType     labelValue = labelIndex.Labels[label];
+        const LabelMomentsType & m = moments[imageNumber][label];
+        const double             mean = m.Sum / static_cast<double>( m.Count );
+        double                   variance = 0.0;
+        if( m.Count > 1 )
+          {
+          // unbiased estimate of variance
+          const double count = static_cast<double>( m.Count );
+          variance = ( m.SumOfSquares - m.Sum * m.Sum / count ) / ( count - 1.0 );
+          }
+        const std::vector<double> & q = labelQuantiles[imageNumber * numberOfLabels + label];
+
+        for( size_t i = 0; i < outputPrefixColumnValues.size(); ++i )
+          {
+          std::cout << outputPrefixColumnValues[i] << ", ";
+          }
+        if( reportVolumeNames )
+          {
+          std::cout << imageVolume[imageNumber] << ", " << labelVolume[labelMapNumber] << ", ";
+          }
+        std::cout << GetLabelName(mode, labelNames, labelValue) << ", ";
+        std::cout << labelValue << ", ";
+        std::cout << m.Minimum << ", ";
+        std::cout << m.Maximum << ", ";
+        std::cout << static_cast<float>( q[0] ) << ", ";
+        std::cout << mean << ", ";
+        std::cout << std::sqrt( variance ) << ", ";
+        std::cout << variance << ", ";
+        std::cout << m.Sum << ", ";
+        std::cout << m.Count << ", ";
+        std::cout << m.Count * voxelVolume;
+        for( size_t i = 1; i < q.size(); ++i )
+          {
+          std::cout << ", " << static_cast<float>( q[i] );
+          }
+        std::cout << std::endl;
         }
-      std::cout << medianValue << ", ";
-      std::cout << statsFilter->GetMean( labelValue ) << ", ";
-      std::cout << statsFilter->GetSigma( labelValue ) << ", ";
-      std::cout << statsFilter->GetVariance( labelValue ) << ", ";
-      std::cout << statsFilter->GetSum( labelValue ) << ", ";
-      std::cout << statsFilter->GetCount( labelValue ) << std::endl;
       }
     }
   return EXIT_SUCCESS;
@@ -0,0 +1,244 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "itkBRAINSToolsTestMain.h"
+
+void RegisterTests()
+{
+  REGISTER_TEST(BRAINSLabelStatsTest);
+  REGISTER_TEST(BRAINSLabelStatsCompareTest);
+}
+
+#undef main
+#define main BRAINSLabelStatsTest
+#include "../BRAINSLabelStats.cxx"
+#undef main
+
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIterator.h"
+#include "itkLabelStatisticsImageFilter.h"
+#include "itkMinimumMaximumImageFilter.h"
+
+namespace
+{
+constexpr unsigned int NumberOfImages = 3;
+constexpr unsigned int NumberOfLabelMaps = 2;
+constexpr unsigned int NumberOfBins = 64;
+
+/** The values are printed with 6 significant digits */
+bool Matches( const double printed, const double expected )
+{
+  return std::abs( printed - expected ) <= 1e-5 * std::max( 1.0, std::abs( expected ) );
+}
+
+template <typename TImage>
+typename TImage::Pointer AllocateTestImage()
+{
+  typename TImage::SizeType size;
+  size[0] = 13;
+  size[1] = 11;
+  size[2] = 7;
+  typename TImage::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 1.5;
+  spacing[2] = 2.0;
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions( size );
+  image->SetSpacing( spacing );
+  image->Allocate();
+  return image;
+}
+
+template <typename TImage>
+void WriteTestImage( const TImage *image, const std::string & fileName )
+{
+  using WriterType = itk::ImageFileWriter<TImage>;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( image );
+  writer->SetFileName( fileName );
+  writer->Update();
+}
+
+std::vector<std::string> SplitRow( const std::string & row )
+{
+  std::vector<std::string> fields;
+  std::stringstream        rowStream( row );
+  std::string              field;
+  while( std::getline( rowStream, field, ',' ) )
+    {
+    const size_t first = field.find_first_not_of( ' ' );
+    fields.push_back( first == std::string::npos ? "" : field.substr( first ) );
+    }
+  return fields;
+}
+} // end namespace
+
+/** Runs BRAINSLabelStats on several images and label maps, and checks every
+ * row against LabelStatisticsImageFilter with the same histogram. */
+int BRAINSLabelStatsCompareTest( int argc, char *argv[] )
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string outputDirectory = argv[1];
+  std::mt19937      generator( 1 );
+
+  std::vector<std::string>        imageFiles;
+  std::vector<ImageType::Pointer> images;
+  for( unsigned int i = 0; i < NumberOfImages; ++i )
+    {
+    std::normal_distribution<float> intensity( 100.0F * ( i + 1 ), 20.0F );
+    ImageType::Pointer              image = AllocateTestImage<ImageType>();
+    for( itk::ImageRegionIterator<ImageType> it( image, image->GetLargestPossibleRegion() ); !it.IsAtEnd(); ++it )
+      {
+      it.Set( intensity( generator ) );
+      }
+    imageFiles.push_back( outputDirectory + "/BRAINSLabelStatsCompareTest_image" + std::to_string( i ) + ".nrrd" );
+    WriteTestImage<ImageType>( image, imageFiles.back() );
+    images.push_back( image );
+    }
+
+  // Labels include a negative value and labels that are in one map only.
+  const LabelPixelType               labelValues[NumberOfLabelMaps][4] = { { 0, 1, 2, 7 }, { -3, 0, 4, 12 } };
+  std::vector<std::string>           labelFiles;
+  std::vector<LabelType::Pointer>    labelMaps;
+  std::uniform_int_distribution<int>   pickLabel( 0, 3 );
+  for( unsigned int l = 0; l < NumberOfLabelMaps; ++l )
+    {
+    LabelType::Pointer labelMap = AllocateTestImage<LabelType>();
+    for( itk::ImageRegionIterator<LabelType> it( labelMap, labelMap->GetLargestPossibleRegion() ); !it.IsAtEnd(); ++it )
+      {
+      it.Set( labelValues[l][pickLabel( generator )] );
+      }
+    labelFiles.push_back( outputDirectory + "/BRAINSLabelStatsCompareTest_labels" + std::to_string( l ) + ".nrrd" );
+    WriteTestImage<LabelType>( labelMap, labelFiles.back() );
+    labelMaps.push_back( labelMap );
+    }
+
+  std::vector<std::string> arguments;
+  arguments.push_back( "BRAINSLabelStatsTest" );
+  for( const auto & imageFile : imageFiles )
+    {
+    arguments.push_back( "--imageVolume" );
+    arguments.push_back( imageFile );
+    }
+  for( const auto & labelFile : labelFiles )
+    {
+    arguments.push_back( "--labelVolume" );
+    arguments.push_back( labelFile );
+    }
+  arguments.push_back( "--numberOfHistogramBins" );
+  arguments.push_back( std::to_string( NumberOfBins ) );
+  std::vector<char *> argumentPointers;
+  for( auto & argument : arguments )
+    {
+    argumentPointers.push_back( &argument[0] );
+    }
+
+  std::ostringstream report;
+  std::streambuf *   coutBuffer = std::cout.rdbuf( report.rdbuf() );
+  const int          status = BRAINSLabelStatsTest( static_cast<int>( argumentPointers.size() ), argumentPointers.data() );
+  std::cout.rdbuf( coutBuffer );
+  std::cout << report.str();
+  if( status != EXIT_SUCCESS )
+    {
+    std::cerr << "BRAINSLabelStats failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::istringstream reportStream( report.str() );
+  std::string        row;
+  std::getline( reportStream, row );
+  if( row != "image, labelMap, Name, label, min, max, median, mean, stddev, var, sum, count, volume" )
+    {
+    std::cerr << "Unexpected header: " << row << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  bool         passed = true;
+  unsigned int numberOfRows = 0;
+  unsigned int expectedNumberOfRows = 0;
+  for( unsigned int l = 0; l < NumberOfLabelMaps; ++l )
+    {
+    for( unsigned int i = 0; i < NumberOfImages; ++i )
+      {
+      using MinMaxFilterType = itk::MinimumMaximumImageFilter<ImageType>;
+      MinMaxFilterType::Pointer minMax = MinMaxFilterType::New();
+      minMax->SetInput( images[i] );
+      minMax->Update();
+
+      using StatisticsFilterType = itk::LabelStatisticsImageFilter<ImageType, LabelType>;
+      StatisticsFilterType::Pointer statistics = StatisticsFilterType::New();
+      statistics->SetInput( images[i] );
+      statistics->SetLabelInput( labelMaps[l] );
+      statistics->UseHistogramsOn();
+      statistics->SetHistogramParameters( NumberOfBins, minMax->GetMinimum(), minMax->GetMaximum() );
+      statistics->Update();
+
+      std::vector<LabelPixelType> labels( statistics->GetValidLabelValues().begin(),
+                                          statistics->GetValidLabelValues().end() );
+      std::sort( labels.begin(), labels.end() );
+      expectedNumberOfRows += labels.size();
+      for( const LabelPixelType label : labels )
+        {
+        if( !std::getline( reportStream, row ) )
+          {
+          std::cerr << "Missing row for label " << label << " of " << imageFiles[i] << std::endl;
+          return EXIT_FAILURE;
+          }
+        ++numberOfRows;
+        const std::vector<std::string> fields = SplitRow( row );
+        if( fields.size() != 13 || fields[0] != imageFiles[i] || fields[1] != labelFiles[l]
+            || std::stoi( fields[3] ) != label )
+          {
+          std::cerr << "Unexpected row for label " << label << " of " << imageFiles[i] << ": " << row << std::endl;
+          passed = false;
+          continue;
+          }
+        const double count = statistics->GetCount( label );
+        const double expected[] = { statistics->GetMinimum( label ), statistics->GetMaximum( label ),
+                                    statistics->GetMedian( label ), statistics->GetMean( label ),
+                                    statistics->GetSigma( label ), statistics->GetVariance( label ),
+                                    statistics->GetSum( label ), count, count * 1.0 * 1.5 * 2.0 };
+        const char *names[] = { "min", "max", "median", "mean", "stddev", "var", "sum", "count", "volume" };
+        for( unsigned int c = 0; c < 9; ++c )
+          {
+          if( !Matches( std::stod( fields[4 + c] ), expected[c] ) )
+            {
+            std::cerr << names[c] << " of label " << label << " of " << imageFiles[i] << " in " << labelFiles[l]
+                      << " is " << fields[4 + c] << " instead of " << expected[c] << std::endl;
+            passed = false;
+            }
+          }
+        }
+      }
+    }
+  if( std::getline( reportStream, row ) && !row.empty() )
+    {
+    std::cerr << "Unexpected extra row: " << row << std::endl;
+    passed = false;
+    }
+  std::cout << numberOfRows << " of " << expectedNumberOfRows << " rows checked" << std::endl;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
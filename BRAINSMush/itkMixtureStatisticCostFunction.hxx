@@ -36,7 +36,9 @@
 #define _itkMixtureStatisticCostFunction_hxx
 
 #include "itkMixtureStatisticCostFunction.h"
+#include "itkMultiThreaderBase.h"
 #include <cassert>
+#include <vector>
 
 namespace itk
 {
@@ -122,18 +124,74 @@ MixtureStatisticCostFunction<TFirstImage, TSecondImage>
   m_Measure.SetSize(2);
   m_MeasurePointer->SetSize(2);
 
-  // measure each image and each squared image within the mask
+  // GetValue() only needs the additive statistics of the masked voxel pairs,
+  // so the images are visited once here.  The region is split into slabs
+  // along the slowest dimension that are reduced concurrently; the partial
+  // sums are combined in slab order so the result does not depend on the
+  // number of threads.
+  const typename ImageMaskType::RegionType maskRegion = m_ImageMask->GetRequestedRegion();
+  const typename FirstImageType::RegionType firstRegion = m_FirstImage->GetRequestedRegion();
+  const typename SecondImageType::RegionType secondRegion = m_SecondImage->GetRequestedRegion();
+  if( maskRegion.GetSize() != firstRegion.GetSize() || maskRegion.GetSize() != secondRegion.GetSize() )
+    {
+    itkExceptionMacro( << "Mask, first and second image regions must have the same size" );
+    }
 
-  using FirstConstIteratorType = typename itk::ImageRegionConstIterator<typename Self::FirstImageType>;
-  FirstConstIteratorType firstIt( m_FirstImage,
-                                  m_FirstImage->GetRequestedRegion() );
+  constexpr unsigned int SlabDimension = ImageMaskType::ImageDimension - 1;
+  const SizeValueType    numberOfSlabs = maskRegion.GetSize()[SlabDimension];
 
-  using SecondConstIteratorType = typename itk::ImageRegionConstIterator<typename Self::SecondImageType>;
-  SecondConstIteratorType secondIt( m_SecondImage,
-                                    m_SecondImage->GetRequestedRegion() );
+  struct SlabStatistics
+    {
+    double count = 0.0;
+    double sumFirst = 0.0;
+    double sumSecond = 0.0;
+    double sumSquaresFirst = 0.0;
+    double sumSquaresSecond = 0.0;
+    double sumFirstTimesSecond = 0.0;
+    };
+  std::vector<SlabStatistics> slabStatistics(numberOfSlabs);
 
+  using FirstConstIteratorType = typename itk::ImageRegionConstIterator<typename Self::FirstImageType>;
+  using SecondConstIteratorType = typename itk::ImageRegionConstIterator<typename Self::SecondImageType>;
   using MaskConstIteratorType = typename itk::ImageRegionConstIterator<typename Self::ImageMaskType>;
-  MaskConstIteratorType maskIt( m_ImageMask, m_ImageMask->GetRequestedRegion() );
+
+  MultiThreaderBase::Pointer threader = MultiThreaderBase::New();
+  threader->ParallelizeArray(
+    0, numberOfSlabs,
+    [&](SizeValueType slab)
+    {
+      typename ImageMaskType::RegionType maskSlab = maskRegion;
+      maskSlab.SetIndex(SlabDimension, maskRegion.GetIndex(SlabDimension) + slab);
+      maskSlab.SetSize(SlabDimension, 1);
+      typename FirstImageType::RegionType firstSlab = firstRegion;
+      firstSlab.SetIndex(SlabDimension, firstRegion.GetIndex(SlabDimension) + slab);
+      firstSlab.SetSize(SlabDimension, 1);
+      typename SecondImageType::RegionType secondSlab = secondRegion;
+      secondSlab.SetIndex(SlabDimension, secondRegion.GetIndex(SlabDimension) + slab);
+      secondSlab.SetSize(SlabDimension, 1);
+
+      MaskConstIteratorType   maskIt( m_ImageMask, maskSlab );
+      FirstConstIteratorType  firstIt( m_FirstImage, firstSlab );
+      SecondConstIteratorType secondIt( m_SecondImage, secondSlab );
+
+      SlabStatistics & stats = slabStatistics[slab];
+      for( ; !maskIt.IsAtEnd(); ++maskIt, ++firstIt, ++secondIt )
+        {
+        if( maskIt.Get() == label )
+          {
+          const double firstValue = firstIt.Get();
+          const double secondValue = secondIt.Get();
+
+          stats.count += 1.0;
+          stats.sumFirst += firstValue;
+          stats.sumSecond += secondValue;
+          stats.sumSquaresFirst += firstValue * firstValue;
+          stats.sumSquaresSecond += secondValue * secondValue;
+          stats.sumFirstTimesSecond += firstValue * secondValue;
+          }
+        }
+    },
+    nullptr);
 
   m_NumberOfMaskVoxels = 0.0;
   m_SumOfFirstMaskVoxels = 0.0;
@@ -141,22 +199,14 @@ MixtureStatisticCostFunction<TFirstImage, TSecondImage>
   m_SumSquaresOfFirstMaskVoxels = 0.0;
   m_SumSquaresOfSecondMaskVoxels = 0.0;
   m_SumOfFirstTimesSecondMaskVoxels = 0.0;
-  for( maskIt.GoToBegin(), firstIt.GoToBegin(), secondIt.GoToBegin();
-       !maskIt.IsAtEnd();
-       ++maskIt, ++firstIt, ++secondIt )
+  for( const auto & stats : slabStatistics )
     {
-    if( maskIt.Get() == label )
-      {
-      FirstImagePixelType  firstValue = firstIt.Get();
-      SecondImagePixelType secondValue = secondIt.Get();
-
-      m_NumberOfMaskVoxels += 1.0;
-      m_SumOfFirstMaskVoxels += firstValue;
-      m_SumOfSecondMaskVoxels += secondValue;
-      m_SumSquaresOfFirstMaskVoxels += firstValue * firstValue;
-      m_SumSquaresOfSecondMaskVoxels += secondValue * secondValue;
-      m_SumOfFirstTimesSecondMaskVoxels += firstValue * secondValue;
-      }
+    m_NumberOfMaskVoxels += stats.count;
+    m_SumOfFirstMaskVoxels += stats.sumFirst;
+    m_SumOfSecondMaskVoxels += stats.sumSecond;
+    m_SumSquaresOfFirstMaskVoxels += stats.sumSquaresFirst;
+    m_SumSquaresOfSecondMaskVoxels += stats.sumSquaresSecond;
+    m_SumOfFirstTimesSecondMaskVoxels += stats.sumFirstTimesSecond;
     }
 }
 
@@ -18,17 +18,15 @@
  *=========================================================================*/
 #include "BRAINSCommonLib.h"
 
+#include "itkIO.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkTestingExtractSliceImageFilter.h"
-#include "itkCastImageFilter.h"
-#include "itkRescaleIntensityImageFilter.h"
-#include "itkTileImageFilter.h"
 #include "itkFlipImageFilter.h"
-#include "itkLabelOverlayImageFilter.h"
-#include "itkComposeImageFilter.h"
-#include "itkResampleImageFilter.h"
-#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkLabelOverlayFunctor.h"
+#include "itkMultiThreaderBase.h"
+#include "itkRGBPixel.h"
+
+#include <algorithm>
 
 
 #include "BRAINSSnapShotWriterCLP.h"
@@ -43,9 +41,6 @@ using IndexType = std::vector<int>;
 using PercentIndexType = std::vector<int>;
 using PhysicalPointIndexType = std::vector<float>;
 
-constexpr size_t NN_INTERP = 0;
-constexpr size_t LINEAR_INTERP = 1;
-
 template<typename TImageType>
 ExtractIndexType GetSliceIndexToExtract(
   typename TImageType::Pointer referenceImage,
@@ -103,7 +98,7 @@ ExtractIndexType GetSliceIndexToExtract(
         << std::endl;
         exit(EXIT_FAILURE);
       }
-      unsigned int size = (referenceImage->GetBufferedRegion()).GetSize()[planes[i]];
+      unsigned int size = (referenceImage->GetLargestPossibleRegion()).GetSize()[planes[i]];
       unsigned int index =
         static_cast<unsigned int>((float) inputSliceToExtractInPercent[i] / 100.0F) * size;
 
@@ -118,194 +113,285 @@ ExtractIndexType GetSliceIndexToExtract(
   return sliceIndexToExtract;
 }
 
+
 /*
- * change orientation
+ * the volumes are shown flipped along the third axis; read the geometry of
+ * the flipped volume without reading any pixels
  */
 template<typename TImageType>
-// input parameter type
-typename TImageType::Pointer ChangeOrientOfImage(typename TImageType::Pointer imageVolume,
-                                                 itk::FixedArray<bool, 3> flipAxes)
+typename TImageType::Pointer ReadFlippedImageInformation(const std::string & filename)
 {
+  using ReaderType = itk::ImageFileReader<TImageType>;
   using FlipImageFilterType = itk::FlipImageFilter<TImageType>;
 
-  typename FlipImageFilterType::Pointer flipFilter =
-    FlipImageFilterType::New();
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename.c_str());
 
-  flipFilter->SetInput(imageVolume);
+  itk::FixedArray<bool, 3> flipAxes;
+  flipAxes[0] = 0;
+  flipAxes[1] = 0;
+  flipAxes[2] = 1;
+
+  typename FlipImageFilterType::Pointer flipFilter = FlipImageFilterType::New();
+  flipFilter->SetInput(reader->GetOutput());
   flipFilter->SetFlipAxes(flipAxes);
   try
   {
-    flipFilter->Update();
+    flipFilter->UpdateOutputInformation();
   }
   catch (...)
   {
-    std::cout << "ERROR: Fail to flip the image "
-    << std::endl;
+    std::cout << "ERROR:  Could not read image " << filename << "." << std::endl;
+    exit(EXIT_FAILURE);
   }
 
-  return flipFilter->GetOutput();
+  typename TImageType::Pointer imageInformation = flipFilter->GetOutput();
+  imageInformation->DisconnectPipeline();
+  return imageInformation;
+}
+
+/*
+ * volume axes along the width and the height of a slice of the given plane
+ */
+void GetSliceAxes(int plane, unsigned int & widthAxis, unsigned int & heightAxis)
+{
+  widthAxis = (plane == 0) ? 1 : 0;
+  heightAxis = (plane == 2) ? 1 : 2;
+}
+
+/*
+ * 2D slice, width is the fastest axis
+ */
+template<typename TPixelType>
+struct SliceType
+{
+  std::vector<TPixelType> Pixels;
+  size_t                  Width;
+  size_t                  Height;
+};
+
+/*
+ * whether regions of the file can be read without decoding the whole file;
+ * gzip compressed files are decoded from their start for every region
+ */
+bool CanReadSlicesSeparately(const std::string & filename)
+{
+  itk::ImageIOBase::Pointer imageIO =
+    itk::ImageIOFactory::CreateImageIO(filename.c_str(), itk::ImageIOFactory::ReadMode);
+  if (imageIO.IsNull())
+  {
+    return false;
+  }
+  const std::string extension = itksys::SystemTools::LowerCase(itksys::SystemTools::GetFilenameLastExtension(filename));
+  imageIO->SetFileName(filename);
+  imageIO->ReadImageInformation();
+  return imageIO->CanStreamRead() && extension != ".gz";
 }
 
 /*
- * template reading function
+ * file region of a slice of the flipped volume
  */
-template<typename TStringVectorType, // input parameter type
-  typename TReaderType,       // reader type
-  typename TImageVectorType>
-// return type
-TImageVectorType ReadImageVolumes(TStringVectorType filenameVector, const size_t interpType)
+template<typename TImageType>
+typename TImageType::RegionType
+GetSliceRegion(const std::string & filename,
+               const typename TImageType::RegionType & largestRegion,
+               int plane,
+               int sliceNumber)
 {
-  using ReaderPointer = typename TReaderType::Pointer;
-  using OutputImagePointerType = typename TReaderType::OutputImageType::Pointer;
-  using OutImageType = typename TReaderType::OutputImageType;
-  using ResampleType = itk::ResampleImageFilter<OutImageType, OutImageType>;
-
-  using NNIterpType = itk::NearestNeighborInterpolateImageFunction<OutImageType, double>;
-  typename NNIterpType::Pointer myNNIterp = NNIterpType::New();
-  using LinearIterpType = itk::LinearInterpolateImageFunction<OutImageType, double>;
-  typename LinearIterpType::Pointer myLinearIterp = LinearIterpType::New();
-  using TransformType = itk::IdentityTransform<double, 3>;
-  typename TransformType::Pointer myIdentityTransform = TransformType::New();
-
-  TImageVectorType imageVector;
-  for (unsigned int i = 0; i < filenameVector.size(); i++)
+  if (plane < 0 || plane > 2)
+  {
+    std::cout << "ERROR: Extracting plane should be between 0 and 2(0,1,or 2)" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const itk::IndexValueType sliceStart = largestRegion.GetIndex()[plane];
+  const itk::IndexValueType sliceCount = largestRegion.GetSize()[plane];
+  if (sliceNumber < sliceStart || sliceNumber >= sliceStart + sliceCount)
   {
-    std::cout << "Reading image " << i + 1 << ": " << filenameVector[i] << "...\n";
+    std::cout << "ERROR: Slice " << sliceNumber << " is outside of image " << filename << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
-    ReaderPointer reader = TReaderType::New();
-    reader->SetFileName(filenameVector[i].c_str());
+  // Slice k of the flipped third axis is slice 2 * start + size - 1 - k of
+  // the file.
+  typename TImageType::RegionType sliceRegion = largestRegion;
+  sliceRegion.SetSize(plane, 1);
+  sliceRegion.SetIndex(plane, (plane == 2) ? 2 * sliceStart + sliceCount - 1 - sliceNumber : sliceNumber);
+  return sliceRegion;
+}
 
-    try
-    {
-      reader->Update();
-    }
-    catch (...)
+/*
+ * copy the slice of a plane from a volume buffer that covers sliceRegion;
+ * slices of the planes other than the third are stored with their rows in
+ * reverse order
+ */
+template<typename TImageType>
+SliceType<typename TImageType::PixelType>
+CutSlice(const TImageType *volume,
+         const typename TImageType::RegionType & sliceRegion,
+         int plane)
+{
+  unsigned int widthAxis;
+  unsigned int heightAxis;
+  GetSliceAxes(plane, widthAxis, heightAxis);
+
+  SliceType<typename TImageType::PixelType> slice;
+  slice.Width = sliceRegion.GetSize()[widthAxis];
+  slice.Height = sliceRegion.GetSize()[heightAxis];
+  slice.Pixels.resize(slice.Width * slice.Height);
+
+  const typename TImageType::OffsetValueType *strides = volume->GetOffsetTable();
+  const typename TImageType::PixelType *first =
+    volume->GetBufferPointer() + volume->ComputeOffset(sliceRegion.GetIndex());
+  for (size_t row = 0; row < slice.Height; row++)
+  {
+    const size_t fileRow = (plane == 2) ? row : slice.Height - 1 - row;
+    const typename TImageType::PixelType *source = first + fileRow * strides[heightAxis];
+    typename TImageType::PixelType *destination = slice.Pixels.data() + row * slice.Width;
+    for (size_t column = 0; column < slice.Width; column++, source += strides[widthAxis])
     {
-      std::cout << "ERROR:  Could not read image " << filenameVector[i] << "." << std::endl;
-      exit(EXIT_FAILURE);
+      destination[column] = *source;
     }
+  }
+  return slice;
+}
 
-    OutputImagePointerType image = reader->GetOutput();
-
-    itk::FixedArray<bool, 3> flipAxes;
-    flipAxes[0] = 0;
-    flipAxes[1] = 0;
-    flipAxes[2] = 1;
-    OutputImagePointerType orientedImage =
-      ChangeOrientOfImage<OutImageType>(image, flipAxes);
-    if (i > 0)
+/*
+ * read the slices of the flipped volume that are drawn.  When the file can
+ * be read by region only those slices are read, else the volume is read
+ * once and every slice is cut from it.
+ */
+template<typename TImageType>
+std::vector<SliceType<typename TImageType::PixelType> >
+ReadSlices(const std::string & filename,
+           const typename TImageType::RegionType & largestRegion,
+           const std::vector<int> & planes,
+           const ExtractIndexType & sliceNumbers)
+{
+  std::vector<SliceType<typename TImageType::PixelType> > slices;
+  try
+  {
+    if (CanReadSlicesSeparately(filename))
     {
-      typename ResampleType::Pointer resampler = ResampleType::New();
-      resampler->SetTransform(myIdentityTransform);
-
-      if (interpType == NN_INTERP)
-      {
-        myNNIterp->SetInputImage(orientedImage);
-        //resampler->SetInterpolator(myNNIterp);
-      }
-      else
+      for (size_t i = 0; i < planes.size(); i++)
       {
-        myLinearIterp->SetInputImage(orientedImage);
-        //resampler->SetInterpolator(myLinearIterp);
-      }
-      resampler->SetNumberOfWorkUnits(1);
-      resampler->SetInput(orientedImage);
-      resampler->SetReferenceImage(imageVector[0]);
-      //std::cout << orientedImage << std::endl;
-      //std::cout << "XXXXXXXXXXXXXXX" << std::endl;
-      //std::cout << imageVector[0] << std::endl;
-#if 0  //Need to debug why this is not working
-      try {/
-
-      resampler->Update();
-      }
-      catch(...)
-      {
-        std::cout << "ERROR:  Could not resample image " << filenameVector[i] << "." << std::endl;
-        exit(EXIT_FAILURE);
+        typename TImageType::RegionType sliceRegion =
+          GetSliceRegion<TImageType>(filename, largestRegion, planes[i], sliceNumbers[i]);
+        // ReadImageRegion returns the slice re-based to start at index 0.
+        const typename TImageType::Pointer sliceImage = itkUtil::ReadImageRegion<TImageType>(filename, sliceRegion);
+        slices.push_back(CutSlice<TImageType>(sliceImage, sliceImage->GetLargestPossibleRegion(), planes[i]));
       }
-      imageVector.push_back(resampler->GetOutput());
-#else
-      imageVector.push_back(orientedImage);
-#endif
     }
     else
     {
-      imageVector.push_back(orientedImage);
+      const typename TImageType::Pointer volume = itkUtil::ReadImageRegion<TImageType>(filename, largestRegion);
+      for (size_t i = 0; i < planes.size(); i++)
+      {
+        // The volume is re-based to start at index 0 as well.
+        typename TImageType::RegionType sliceRegion =
+          GetSliceRegion<TImageType>(filename, largestRegion, planes[i], sliceNumbers[i]);
+        typename TImageType::IndexType sliceIndex = sliceRegion.GetIndex();
+        for (unsigned int d = 0; d < TImageType::ImageDimension; d++)
+        {
+          sliceIndex[d] -= largestRegion.GetIndex()[d];
+        }
+        sliceRegion.SetIndex(sliceIndex);
+        slices.push_back(CutSlice<TImageType>(volume, sliceRegion, planes[i]));
+      }
     }
   }
-
-  return imageVector;
+  catch (...)
+  {
+    std::cout << "ERROR:  Could not read image " << filename << "." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return slices;
 }
 
 /*
- * extract slices
+ * label of each pixel: the value of a single binary image, or one plus the
+ * index of the last of several binary images that is set (zero is grey)
  */
-template<typename TInputImageType,
-  typename TOutputImageType>
-typename TOutputImageType::Pointer
-ExtractSlice(typename TInputImageType::Pointer inputImage,
-             int plane,
-             int sliceNumber)
+SliceType<unsigned char> CombineBinarySlices(const std::vector<SliceType<unsigned char> > & binarySlices)
 {
-  if (plane < 0 || plane > 3)
+  SliceType<unsigned char> labelSlice = binarySlices[0];
+  if (binarySlices.size() > 1)
   {
-    std::cout << "ERROR: Extracting plane should be between 0 and 2(0,1,or 2)" << std::endl;
-    exit(EXIT_FAILURE);
+    std::fill(labelSlice.Pixels.begin(), labelSlice.Pixels.end(), 0);
+    for (size_t i = 0; i < binarySlices.size(); i++)
+    {
+      if (binarySlices[i].Width != labelSlice.Width || binarySlices[i].Height != labelSlice.Height)
+      {
+        std::cout << "ERROR:  Binary volumes have different sizes." << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      for (size_t p = 0; p < labelSlice.Pixels.size(); p++)
+      {
+        if (binarySlices[i].Pixels[p] > 0)
+        {
+          labelSlice.Pixels[p] = static_cast<unsigned char>(i + 1);
+        }
+      }
+    }
   }
-  /* extract 2D plain */
-  using ExtractVolumeFilterType = itk::Testing::ExtractSliceImageFilter<TInputImageType,
-    TOutputImageType>;
-
-  typename ExtractVolumeFilterType::Pointer extractVolumeFilter = ExtractVolumeFilterType::New();
-
-  typename TInputImageType::RegionType region = inputImage->GetBufferedRegion();
-
-  typename TInputImageType::SizeType size = region.GetSize();
-  size[plane] = 0;
-
-  typename TInputImageType::IndexType start = region.GetIndex();
-  start[plane] = sliceNumber;
-
-  typename TInputImageType::RegionType outputRegion;
-  outputRegion.SetSize(size);
-  outputRegion.SetIndex(start);
-
-  extractVolumeFilter->SetExtractionRegion(outputRegion);
-  extractVolumeFilter->SetInput(inputImage);
-  extractVolumeFilter->SetDirectionCollapseToGuess();
-  extractVolumeFilter->Update();
-
-  typename TOutputImageType::Pointer outputImage = extractVolumeFilter->GetOutput();
-  return outputImage;
+  return labelSlice;
 }
 
-/* scaling between 0-255 */
-template<typename TInputImage, typename TOutputImage>
-typename TOutputImage::Pointer
-Rescale(const typename TInputImage::Pointer inputImage,
-        const int min,
-        const int max)
+/*
+ * scale a grey slice between 0-255, overlay the labels (when given) at half
+ * opacity, and draw it on the canvas with its first pixel at (column, row)
+ */
+template<typename TRGBPixelType>
+void RenderTile(const SliceType<double> & greySlice,
+                const SliceType<unsigned char> *labelSlice,
+                TRGBPixelType *canvas,
+                size_t canvasWidth,
+                size_t column,
+                size_t row)
 {
-  using RescaleFilterType = itk::RescaleIntensityImageFilter<TInputImage,
-    TInputImage>;
-
-  typename RescaleFilterType::Pointer rescaler = RescaleFilterType::New();
-
-  rescaler->SetInput(inputImage);
-  rescaler->SetOutputMinimum(min);
-  rescaler->SetOutputMaximum(max);
-
-  using CastingFilterType = typename itk::CastImageFilter<TInputImage,
-    TOutputImage>;
-
-  typename CastingFilterType::Pointer caster = CastingFilterType::New();
-  caster->SetInput(rescaler->GetOutput());
-  caster->Update();
+  // Same mapping as RescaleIntensityImageFilter followed by a cast.
+  double minimum = itk::NumericTraits<double>::max();
+  double maximum = itk::NumericTraits<double>::NonpositiveMin();
+  for (const double value : greySlice.Pixels)
+  {
+    maximum = (value > maximum) ? value : maximum;
+    minimum = (value < minimum) ? value : minimum;
+  }
+  double scale = 0.0;
+  if (minimum != maximum)
+  {
+    scale = 255.0 / (maximum - minimum);
+  }
+  else if (maximum != 0.0)
+  {
+    scale = 255.0 / maximum;
+  }
+  const double shift = 0.0 - minimum * scale;
 
-  typename TOutputImage::Pointer outputImage = caster->GetOutput();
+  using OverlayFunctorType = itk::Functor::LabelOverlayFunctor<unsigned char, unsigned char, TRGBPixelType>;
+  OverlayFunctorType overlay;
+  overlay.SetOpacity(0.5);
+  overlay.SetBackgroundValue(0);
 
-  return outputImage;
+  for (size_t y = 0; y < greySlice.Height; y++)
+  {
+    const double *greyRow = greySlice.Pixels.data() + y * greySlice.Width;
+    TRGBPixelType *canvasRow = canvas + (row + y) * canvasWidth + column;
+    for (size_t x = 0; x < greySlice.Width; x++)
+    {
+      double value = greyRow[x] * scale + shift;
+      value = (value > 255.0) ? 255.0 : value;
+      value = (value < 0.0) ? 0.0 : value;
+      const unsigned char grey = static_cast<unsigned char>(value);
+      if (labelSlice != nullptr)
+      {
+        canvasRow[x] = overlay(grey, labelSlice->Pixels[y * greySlice.Width + x]);
+      }
+      else
+      {
+        canvasRow[x].Fill(grey);
+      }
+    }
+  }
 }
 
 /*
@@ -349,186 +435,152 @@ main(int argc, char **argv)
   }
 
   const size_t numberOfImgs = inputVolumes.size();
+  const size_t numberOfPlanes = inputPlaneDirection.size();
 
   /* type definition */
   using Image3DVolumeType = itk::Image<double, 3>;
-  using Image2DVolumeType = itk::Image<double, 2>;
   using Image3DBinaryType = itk::Image<unsigned char, 3>;
 
-  using ImageFilenameVectorType = std::vector<std::string>;
-  using Image3DVolumeVectorType = std::vector<Image3DVolumeType::Pointer>;
-  using Image3DBinaryVectorType = std::vector<Image3DBinaryType::Pointer>;
-
-  using Image3DVolumeReaderType = itk::ImageFileReader<Image3DVolumeType>;
-
-  using Image3DBinaryReaderType = itk::ImageFileReader<Image3DBinaryType>;
-
-  using OutputGreyImageType = itk::Image<unsigned char, 2>;
+  using GreySliceType = SliceType<double>;
+  using BinarySliceType = SliceType<unsigned char>;
 
   using RGBPixelType = itk::RGBPixel<unsigned char>;
   using OutputRGBImageType = itk::Image<RGBPixelType, 2>;
 
-  /* read in image volumes */
-  Image3DVolumeVectorType image3DVolumes = ReadImageVolumes<ImageFilenameVectorType,
-    Image3DVolumeReaderType,
-    Image3DVolumeVectorType>
-    (inputVolumes, LINEAR_INTERP);
-
-  /* read in binary volumes */
-  Image3DBinaryVectorType image3DBinaries = ReadImageVolumes<ImageFilenameVectorType,
-    Image3DBinaryReaderType,
-    Image3DBinaryVectorType>
-    (inputBinaryVolumes, NN_INTERP);
+  /* resolve the slices from the geometry of the first volume */
+  Image3DVolumeType::Pointer referenceImage =
+    ReadFlippedImageInformation<Image3DVolumeType>(inputVolumes[0]);
 
   ExtractIndexType extractingSlices =
-    GetSliceIndexToExtract<Image3DVolumeType>(image3DVolumes[0],
+    GetSliceIndexToExtract<Image3DVolumeType>(referenceImage,
                                               inputPlaneDirection,
                                               inputSliceToExtractInIndex,
                                               inputSliceToExtractInPercent,
                                               inputSliceToExtractInPhysicalPoint);
-
-  /* combine binary images */
-  Image3DVolumeType::Pointer labelMap = Image3DVolumeType::New();
-  if (!image3DBinaries.empty())
+  if (extractingSlices.size() < numberOfPlanes)
   {
-    labelMap->CopyInformation(image3DBinaries[0]);
-    labelMap->SetRegions(image3DVolumes[0]->GetBufferedRegion());
-    labelMap->Allocate();
-
-    itk::ImageRegionIterator<Image3DVolumeType> binaryIterator(
-      labelMap,
-      labelMap->GetBufferedRegion());
+    std::cout << "Number of input slice number should be equal input plane direction."
+    << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
-    itk::ImageRegionIterator<Image3DBinaryType> labelIterator(
-      image3DBinaries[0],
-      image3DBinaries[0]->GetBufferedRegion());
+  /* read in only the slices of the image volumes that are drawn */
+  std::vector<std::vector<GreySliceType> > greySlices(numberOfImgs);
+  for (size_t i = 0; i < numberOfImgs; i++)
+  {
+    std::cout << "Reading image " << i + 1 << ": " << inputVolumes[i] << "...\n";
+    Image3DVolumeType::Pointer imageInformation =
+      (i == 0) ? referenceImage : ReadFlippedImageInformation<Image3DVolumeType>(inputVolumes[i]);
+    greySlices[i] = ReadSlices<Image3DVolumeType>(inputVolumes[i],
+                                                  imageInformation->GetLargestPossibleRegion(),
+                                                  inputPlaneDirection,
+                                                  extractingSlices);
+  }
 
-    while (!binaryIterator.IsAtEnd() && !labelIterator.IsAtEnd())
+  /* read in the same slices of the binary volumes, and combine them */
+  std::vector<BinarySliceType> labelSlices;
+  if (!inputBinaryVolumes.empty())
+  {
+    std::vector<std::vector<BinarySliceType> > binarySlices(numberOfPlanes);
+    for (size_t b = 0; b < inputBinaryVolumes.size(); b++)
     {
-      /** itereate one image */
-      binaryIterator.Set(0);
-      if (image3DBinaries.size() == 1)
+      std::cout << "Reading image " << b + 1 << ": " << inputBinaryVolumes[b] << "...\n";
+      Image3DBinaryType::Pointer imageInformation =
+        ReadFlippedImageInformation<Image3DBinaryType>(inputBinaryVolumes[b]);
+      const std::vector<BinarySliceType> volumeSlices =
+        ReadSlices<Image3DBinaryType>(inputBinaryVolumes[b],
+                                      imageInformation->GetLargestPossibleRegion(),
+                                      inputPlaneDirection,
+                                      extractingSlices);
+      for (size_t plane = 0; plane < numberOfPlanes; plane++)
       {
-        binaryIterator.Set(labelIterator.Value()); // label color zero is grey
-        ++labelIterator;
+        binarySlices[plane].push_back(volumeSlices[plane]);
       }
-      else
+    }
+    for (size_t plane = 0; plane < numberOfPlanes; plane++)
+    {
+      labelSlices.push_back(CombineBinarySlices(binarySlices[plane]));
+      for (size_t i = 0; i < numberOfImgs; i++)
       {
-        for (unsigned int i = 0; i < image3DBinaries.size(); i++)
+        if (labelSlices[plane].Width != greySlices[i][plane].Width ||
+            labelSlices[plane].Height != greySlices[i][plane].Height)
         {
-          Image3DBinaryType::IndexType index = binaryIterator.GetIndex();
-          if (image3DBinaries[i]->GetPixel(index) > 0)
-          {
-            binaryIterator.Set(i + 1); // label color zero is grey
-          }
+          std::cout << "ERROR:  Binary volumes and image " << inputVolumes[i] << " have different sizes." << std::endl;
+          exit(EXIT_FAILURE);
         }
       }
-      /** add each binary values */
-      ++binaryIterator;
     }
   }
-  /* compose color image */
-  using LabelOverlayFilter = itk::LabelOverlayImageFilter<OutputGreyImageType,
-    OutputGreyImageType,
-    OutputRGBImageType>;
-
-  using RGBComposeFilter = itk::ComposeImageFilter<OutputGreyImageType,
-    OutputRGBImageType>;
 
-  using OutputRGBImageVectorType = std::vector<OutputRGBImageType::Pointer>;
-
-  OutputRGBImageVectorType rgbSlices;
-  for (unsigned int plane = 0; plane < inputPlaneDirection.size(); plane++)
+  /* lay out the tiles as TileImageFilter does: one row per plane, one
+   * column per image, each cell as large as the largest tile it lines up with */
+  std::vector<size_t> columnOffsets(numberOfImgs + 1, 0);
+  std::vector<size_t> rowOffsets(numberOfPlanes + 1, 0);
+  for (size_t i = 0; i < numberOfImgs; i++)
   {
-    for (unsigned int i = 0; i < numberOfImgs; i++)
+    size_t columnWidth = 0;
+    for (size_t plane = 0; plane < numberOfPlanes; plane++)
     {
-      /** get slicer */
-      Image3DVolumeType::Pointer current3DImage = image3DVolumes[i];
-      Image2DVolumeType::Pointer imageSlice =
-        ExtractSlice<Image3DVolumeType, Image2DVolumeType>(current3DImage,
-                                                           inputPlaneDirection[plane],
-                                                           extractingSlices[plane]);
-
-      OutputGreyImageType::Pointer greyScaleSlice =
-        Rescale<Image2DVolumeType, OutputGreyImageType>(imageSlice, 0, 255);
-
-      /** binaries */
-      OutputGreyImageType::Pointer labelSlice;
-      if (!image3DBinaries.empty())
-      {
-        /** rgb creator */
-        LabelOverlayFilter::Pointer rgbComposer = LabelOverlayFilter::New();
-
-        labelSlice =
-          ExtractSlice<Image3DVolumeType, OutputGreyImageType>(labelMap,
-                                                               inputPlaneDirection[plane],
-                                                               extractingSlices[plane]);
-        rgbComposer->SetLabelImage(labelSlice);
-        rgbComposer->SetInput(greyScaleSlice);
-        rgbComposer->SetOpacity(.5F);
-        try
-        {
-          rgbComposer->Update();
-        }
-        catch (itk::ExceptionObject &e)
-        {
-          std::cout << "ERROR:  Could not update image." << std::endl;
-          std::cout << "ERROR:  " << e.what() << std::endl;
-          exit(EXIT_FAILURE);
-        }
-
-        rgbSlices.push_back(rgbComposer->GetOutput());
-      }
-      else /** ----------------------------------------------------- */
-      {
-        RGBComposeFilter::Pointer rgbComposer = RGBComposeFilter::New();
-
-        rgbComposer->SetInput1(greyScaleSlice);
-        rgbComposer->SetInput2(greyScaleSlice);
-        rgbComposer->SetInput3(greyScaleSlice);
-
-        try
-        {
-          rgbComposer->Update();
-        }
-        catch (itk::ExceptionObject &e)
-        {
-          std::cout << "ERROR:  Could not update image." << std::endl;
-          std::cout << "ERROR:  " << e.what() << std::endl;
-          exit(EXIT_FAILURE);
-        }
-        rgbSlices.push_back(rgbComposer->GetOutput());
-      }
+      columnWidth = std::max(columnWidth, greySlices[i][plane].Width);
     }
+    columnOffsets[i + 1] = columnOffsets[i] + columnWidth;
   }
-
-  /* tile the images */
-  using TileFilterType = itk::TileImageFilter<OutputRGBImageType, OutputRGBImageType>;
-
-  TileFilterType::Pointer tileFilter = TileFilterType::New();
-
-  itk::FixedArray<unsigned int, 2> layout;
-
-  layout[0] = numberOfImgs;
-  layout[1] = 0; // inputPlaneDirection.size();
-
-  tileFilter->SetLayout(layout);
-  tileFilter->SetDefaultPixelValue(128);
-  for (unsigned int plane = 0; plane < extractingSlices.size(); plane++)
+  for (size_t plane = 0; plane < numberOfPlanes; plane++)
   {
-    for (unsigned int i = 0; i < numberOfImgs; i++)
+    size_t rowHeight = 0;
+    for (size_t i = 0; i < numberOfImgs; i++)
     {
-      OutputRGBImageType::Pointer img = rgbSlices[i + plane * numberOfImgs];
-      tileFilter->SetInput(i + plane * numberOfImgs, rgbSlices[i + plane * numberOfImgs]);
+      rowHeight = std::max(rowHeight, greySlices[i][plane].Height);
     }
+    rowOffsets[plane + 1] = rowOffsets[plane] + rowHeight;
   }
 
+  /* the canvas takes the spacing and origin of the first tile */
+  unsigned int widthAxis;
+  unsigned int heightAxis;
+  GetSliceAxes(inputPlaneDirection[0], widthAxis, heightAxis);
+
+  OutputRGBImageType::RegionType canvasRegion;
+  canvasRegion.SetSize(0, columnOffsets[numberOfImgs]);
+  canvasRegion.SetSize(1, rowOffsets[numberOfPlanes]);
+  OutputRGBImageType::SpacingType canvasSpacing;
+  canvasSpacing[0] = referenceImage->GetSpacing()[widthAxis];
+  canvasSpacing[1] = referenceImage->GetSpacing()[heightAxis];
+  OutputRGBImageType::PointType canvasOrigin;
+  canvasOrigin[0] = referenceImage->GetOrigin()[widthAxis];
+  canvasOrigin[1] = referenceImage->GetOrigin()[heightAxis];
+
+  OutputRGBImageType::Pointer canvas = OutputRGBImageType::New();
+  canvas->SetRegions(canvasRegion);
+  canvas->SetSpacing(canvasSpacing);
+  canvas->SetOrigin(canvasOrigin);
+  canvas->Allocate();
+  RGBPixelType defaultPixel;
+  defaultPixel.Fill(128);
+  canvas->FillBuffer(defaultPixel);
+
+  /* render every tile in one parallel pass */
+  const size_t                    canvasWidth = columnOffsets[numberOfImgs];
+  RGBPixelType *                  canvasBuffer = canvas->GetBufferPointer();
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, numberOfPlanes * numberOfImgs,
+                       [&](itk::SizeValueType tile)
+                         {
+                           const size_t plane = tile / numberOfImgs;
+                           const size_t i = tile % numberOfImgs;
+                           RenderTile<RGBPixelType>(greySlices[i][plane],
+                                                    labelSlices.empty() ? nullptr : &labelSlices[plane],
+                                                    canvasBuffer, canvasWidth,
+                                                    columnOffsets[i], rowOffsets[plane]);
+                         },
+                       nullptr);
+
   /* write out 2D image */
   using RGBFileWriterType = itk::ImageFileWriter<OutputRGBImageType>;
 
   RGBFileWriterType::Pointer rgbFileWriter = RGBFileWriterType::New();
 
-  rgbFileWriter->SetInput(tileFilter->GetOutput());
+  rgbFileWriter->SetInput(canvas);
   rgbFileWriter->SetFileName(outputFilename);
 
   try
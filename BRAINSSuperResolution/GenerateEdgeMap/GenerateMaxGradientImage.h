@@ -25,12 +25,13 @@
 #ifndef __GenerateMaxGradientImage_h
 #define __GenerateMaxGradientImage_h
 
-#include "itkGradientMagnitudeImageFilter.h"
+#include "itkCastImageFilter.h"
 #include "itkLabelStatisticsImageFilter.h"
 #include "itkMinimumMaximumImageCalculator.h"
 #include "itkIntensityWindowingImageFilter.h"
 #include "itkMaximumImageFilter.h"
 #include "itkTimeProbe.h"
+#include "BRAINSScaleSpaceCache.h"
 #include <vector>
 
 // Class to print the proper exception message
@@ -114,7 +115,8 @@ GenerateMaxGradientImage(const std::vector<typename InputImageType::Pointer> & i
   std::cout << "[LowerQuantile UpperQuantile] = [" << LowerPercentileMatching << " " << UpperPercentileMatching << "]" << std::endl;
   std::cout << "[minOutputRange maxOutputRange] [" << minOutputRange << " " << maxOutputRange << "]" << std::endl;
 
-  using GradientFilterType = itk::GradientMagnitudeImageFilter<InputImageType, InputImageType>;
+  using ScaleSpaceType = BRAINSScaleSpaceCache<InputImageType>;
+  using GradientCastType = itk::CastImageFilter<typename ScaleSpaceType::RealImageType, InputImageType>;
   using MinMaxCalculatorType = itk::MinimumMaximumImageCalculator<InputImageType>;
   using LabelStatisticsImageFilter = itk::LabelStatisticsImageFilter<InputImageType, MaskImageType>;
   using WindowRescalerType = typename itk::IntensityWindowingImageFilter<InputImageType,
@@ -147,8 +149,10 @@ GenerateMaxGradientImage(const std::vector<typename InputImageType::Pointer> & i
 
   for( size_t i = 0; i < numberOfImageModalities; i++ )
      {
-     typename GradientFilterType::Pointer gradientFilter = GradientFilterType::New();
-     gradientFilter->SetInput( inputImages[i] );
+     // Unsmoothed central difference gradient magnitude, as GradientMagnitudeImageFilter
+     typename GradientCastType::Pointer gradientFilter = GradientCastType::New();
+     gradientFilter->SetInput( ScaleSpaceType::ComputeGradientMagnitudeImage( inputImages[i].GetPointer(), 0.0 ) );
+     gradientFilter->InPlaceOff();
      gradientFilter->Update();
 
      typename MinMaxCalculatorType::Pointer myMinMax = MinMaxCalculatorType::New();
@@ -34,6 +34,10 @@
  * we might use the RescaleIntensityImageFilter to linearly
  * rescale the image values.
  *
+ * With --stream the image is converted in slabs, see ReadCastWriteImage,
+ * so that large 4D images can be converted with bounded memory.  The
+ * output is then written without compression.
+ *
  * Currently only supported are the SCALAR pixel types.
  * Input images can be in all file formats ITK supports and for which
  * the ImageFileReader works, and additionally single 3D dicom series
@@ -51,6 +55,7 @@
  */
 
 #include <iostream>
+#include <vector>
 #include "itkImageFileReader.h"
 
 /** DICOM headers. */
@@ -64,7 +69,7 @@
 
 extern int      FileConverterScalar(const std::string & inputPixelComponentType,
                                     const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                    const std::string & outputFileName, int inputDimension);
+                                    const std::string & outputFileName, int inputDimension, bool streaming);
 
 extern int DicomFileConverterScalar(const std::string & inputPixelComponentType,
                                     const std::string & outputPixelComponentType, const std::string & inputFileName,
@@ -91,10 +96,25 @@ int  main(  int  argc,  char *argv[] )
      * Check arguments.
      * *******************************************************************
      */
-    if( argc  < 3 || (strcmp(argv[1], "--help") == 0) )
+    /** Separate the --stream option from the positional arguments. */
+    bool                     streaming = false;
+    std::vector<std::string> arguments;
+    for( int i = 1; i < argc; i++ )
+      {
+      if( strcmp(argv[i], "--stream") == 0 )
+        {
+        streaming = true;
+        }
+      else
+        {
+        arguments.push_back( argv[i] );
+        }
+      }
+
+    if( arguments.size() < 2 || arguments[0] == "--help" )
       {
       std::cout << "Usage:"  << std::endl;
-      std::cout << "\tcastconvert inputfilename outputfilename [outputPixelComponentType]" << std::endl;
+      std::cout << "\tcastconvert inputfilename outputfilename [outputPixelComponentType] [--stream]" << std::endl;
       std::cout << "\tcastconvert dicomDirectory outputfilename [outputPixelComponentType]" << std::endl;
       std::cout << "\twhere outputPixelComponentType is one of:" << std::endl;
       std::cout << "\t\t- unsigned_char" << std::endl;
@@ -109,16 +129,18 @@ int  main(  int  argc,  char *argv[] )
       std::cout << "\t\t- double" << std::endl;
       std::cout << "\tprovided that the outputPixelComponentType is supported by the output file format." << std::endl;
       std::cout << "\tBy default the outputPixelComponentType is set to the inputPixelComponentType." << std::endl;
+      std::cout << "\t--stream converts the image in slabs, without compression, to bound the memory used" << std::endl;
+      std::cout << "\tfor file formats that can be streamed.  DICOM series are always read in one piece." << std::endl;
       return EXIT_FAILURE;
       }
 
     /**  Get  the  inputs. */
-    std::string input = argv[1];
-    std::string outputFileName = argv[2];
+    std::string input = arguments[0];
+    std::string outputFileName = arguments[1];
     std::string outputPixelComponentType = "";
-    if( argc >= 4 )
+    if( arguments.size() >= 3 )
       {
-      outputPixelComponentType = argv[3];
+      outputPixelComponentType = arguments[2];
       }
 
     /** Make sure last character of input != "/".
@@ -225,8 +247,8 @@ int  main(  int  argc,  char *argv[] )
     /** Get the component type, number of components, dimension and pixel type. */
     if( !isVTI )
       {
-      /** Generate all information. */
-      testReader->Update();
+      /** Read the header only. */
+      testReader->UpdateOutputInformation();
 
       /** Extract the ImageIO from the testReader. */
       ImageIOBaseType::Pointer testImageIOBase = testReader->GetModifiableImageIO();
@@ -300,7 +322,7 @@ int  main(  int  argc,  char *argv[] )
           {
           const int ret_value = FileConverterScalar(
             inputPixelComponentType, outputPixelComponentType, inputFileName,
-            outputFileName, inputDimension );
+            outputFileName, inputDimension, streaming );
           if( ret_value != 0 )
             {
             return ret_value;
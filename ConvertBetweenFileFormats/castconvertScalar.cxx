@@ -20,41 +20,41 @@
 
 extern int FileConverterScalar2D( const std::string & inputPixelComponentType,
                                   const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                  const std::string & outputFileName, int inputDimension );
+                                  const std::string & outputFileName, int inputDimension, bool streaming );
 
 extern int FileConverterScalar3D( const std::string & inputPixelComponentType,
                                   const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                  const std::string & outputFileName, int inputDimension );
+                                  const std::string & outputFileName, int inputDimension, bool streaming );
 
 extern int FileConverterScalar2DA( const std::string & inputPixelComponentType,
                                    const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                   const std::string & outputFileName, int inputDimension );
+                                   const std::string & outputFileName, int inputDimension, bool streaming );
 
 extern int FileConverterScalar3DA( const std::string & inputPixelComponentType,
                                    const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                   const std::string & outputFileName, int inputDimension );
+                                   const std::string & outputFileName, int inputDimension, bool streaming );
 
 extern int FileConverterScalar4D( const std::string & inputPixelComponentType,
                                   const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                  const std::string & outputFileName, int inputDimension );
+                                  const std::string & outputFileName, int inputDimension, bool streaming );
 
 extern int FileConverterScalar4DA( const std::string & inputPixelComponentType,
                                    const std::string & outputPixelComponentType, const std::string & inputFileName,
-                                   const std::string & outputFileName, int inputDimension );
+                                   const std::string & outputFileName, int inputDimension, bool streaming );
 
 int FileConverterScalar( const std::string & inputPixelComponentType,
                          const std::string & outputPixelComponentType, const std::string & inputFileName,
-                         const std::string & outputFileName, int inputDimension )
+                         const std::string & outputFileName, int inputDimension, bool streaming )
 {
   /** Support for 2D images. */
   if( inputDimension == 2 )
     {
     const int ret_value = FileConverterScalar2D(
         inputPixelComponentType, outputPixelComponentType,
-        inputFileName, outputFileName, inputDimension )
+        inputFileName, outputFileName, inputDimension, streaming )
       ||                  FileConverterScalar2DA(
         inputPixelComponentType, outputPixelComponentType,
-        inputFileName, outputFileName, inputDimension );
+        inputFileName, outputFileName, inputDimension, streaming );
     if( ret_value != 0 )
       {
       return ret_value;
@@ -64,10 +64,10 @@ int FileConverterScalar( const std::string & inputPixelComponentType,
     {
     const int ret_value = FileConverterScalar3D(
         inputPixelComponentType, outputPixelComponentType,
-        inputFileName, outputFileName, inputDimension )
+        inputFileName, outputFileName, inputDimension, streaming )
       ||                  FileConverterScalar3DA(
         inputPixelComponentType, outputPixelComponentType,
-        inputFileName, outputFileName, inputDimension );
+        inputFileName, outputFileName, inputDimension, streaming );
     if( ret_value != 0 )
       {
       return ret_value;
@@ -77,10 +77,10 @@ int FileConverterScalar( const std::string & inputPixelComponentType,
     {
     const int ret_value = FileConverterScalar4D(
         inputPixelComponentType, outputPixelComponentType,
-        inputFileName, outputFileName, inputDimension )
+        inputFileName, outputFileName, inputDimension, streaming )
       ||                  FileConverterScalar4DA(
         inputPixelComponentType, outputPixelComponentType,
-        inputFileName, outputFileName, inputDimension );
+        inputFileName, outputFileName, inputDimension, streaming );
     if( ret_value != 0 )
       {
       return ret_value;
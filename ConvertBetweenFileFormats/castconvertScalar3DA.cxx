@@ -20,7 +20,7 @@
 
 int FileConverterScalar3DA( const std::string & inputPixelComponentType,
                             const std::string & outputPixelComponentType, const std::string & inputFileName,
-                            const std::string & outputFileName, int inputDimension )
+                            const std::string & outputFileName, int inputDimension, bool streaming )
 {
   enum { ImageDims = 3 };
 
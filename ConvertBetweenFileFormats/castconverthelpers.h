@@ -21,6 +21,10 @@
 
 #include "castconvertConfigure.h"
 
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
 /** Basic Image support. */
 #include "itkImage.h"
 #include "itkImageIORegion.h"
@@ -32,7 +36,9 @@
 #include "itkImageFileReader.h"
 #include "itkImageSeriesReader.h"
 #include "itkImageFileWriter.h"
+#include "itkImageIOFactory.h"
 #include "itkImageRegionConstIterator.h"
+#include "itksys/SystemTools.hxx"
 
 /** DICOM headers. */
 #include "itkGDCMImageIO.h"
@@ -60,30 +66,24 @@ void PrintInfo( ReaderType reader, WriterType writer )
 {
   /** Typedef's. */
   using ImageIOBaseType = itk::ImageIOBase;
-  using ImageIORegionType = itk::ImageIORegion;
-  using SizeType = typename ImageIORegionType::SizeType;
 
   /** Get IOBase of the reader and extract information. */
   ImageIOBaseType::Pointer imageIOBaseIn = reader->GetModifiableImageIO();
-  ImageIORegionType        iORegionIn = imageIOBaseIn->GetIORegion();
 
   const char * fileNameIn = imageIOBaseIn->GetFileName();
   std::string  pixelTypeIn = imageIOBaseIn->GetPixelTypeAsString( imageIOBaseIn->GetPixelType() );
   unsigned int nocIn = imageIOBaseIn->GetNumberOfComponents();
   std::string  componentTypeIn = imageIOBaseIn->GetComponentTypeAsString( imageIOBaseIn->GetComponentType() );
   unsigned int dimensionIn = imageIOBaseIn->GetNumberOfDimensions();
-  SizeType     sizeIn = iORegionIn.GetSize();
 
   /**  Get  IOBase of  the  writer and extract information.  */
   ImageIOBaseType::Pointer imageIOBaseOut = writer->GetModifiableImageIO();
-  ImageIORegionType        iORegionOut = imageIOBaseOut->GetIORegion();
 
   const char * fileNameOut = imageIOBaseOut->GetFileName();
   std::string  pixelTypeOut = imageIOBaseOut->GetPixelTypeAsString( imageIOBaseOut->GetPixelType() );
   unsigned int nocOut = imageIOBaseOut->GetNumberOfComponents();
   std::string  componentTypeOut = imageIOBaseOut->GetComponentTypeAsString( imageIOBaseOut->GetComponentType() );
   unsigned int dimensionOut = imageIOBaseOut->GetNumberOfDimensions();
-  SizeType     sizeOut = iORegionOut.GetSize();
 
   /** Print information. */
   std::cout << "Information about the input image \"" << fileNameIn << "\":" << std::endl;
@@ -94,7 +94,7 @@ void PrintInfo( ReaderType reader, WriterType writer )
   std::cout << "\tsize:\t\t\t";
   for( unsigned int i = 0; i < dimensionIn; i++ )
     {
-    std::cout << sizeIn[i] << " ";
+    std::cout << imageIOBaseIn->GetDimensions( i ) << " ";
     }
   std::cout << std::endl;
 
@@ -108,7 +108,7 @@ void PrintInfo( ReaderType reader, WriterType writer )
   std::cout << "\tsize:\t\t\t";
   for( unsigned int i = 0; i < dimensionOut; i++ )
     {
-    std::cout << sizeOut[i] << " ";
+    std::cout << imageIOBaseOut->GetDimensions( i ) << " ";
     }
   std::cout << std::endl;
 }  // end PrintInfo
@@ -187,12 +187,39 @@ void ReadDicomSeriesCastWriteImage( std::string inputDirectoryName, std::string
   PrintInfo( seriesReader, writer );
 }  // end ReadDicomSeriesCastWriteImage
 
+/** The image that is written: the output of the caster, or its input when
+ * the pixel types are the same and the cast is the identity.
+ */
+template <typename TCaster>
+const typename TCaster::OutputImageType *
+GetImageToWrite( TCaster * caster, std::false_type )
+{
+  return caster->GetOutput();
+}
+
+template <typename TCaster>
+const typename TCaster::InputImageType *
+GetImageToWrite( TCaster * caster, std::true_type )
+{
+  return caster->GetInput();
+}
+
+/** Bytes of input and output pixels in memory per slab of a streamed conversion. */
+constexpr double StreamingSlabBytes = 64.0 * 1024.0 * 1024.0;
+
 /** The function that reads the input image and writes the output image.
  * This function is templated over the image types. In the main function
  * we have to make sure to call the right instantiation.
+ *
+ * When streaming, the image is read, cast and written in slabs along the
+ * slowest axis, without compression.  With input and output formats that
+ * can be streamed only one slab of the input and of the output is in memory.
+ * An input that can not be streamed (or is gzip compressed) is read once and
+ * only the output is written in slabs; an output format that can not be
+ * streamed is converted in one piece.
  */
 template <typename InputImageType, typename OutputImageType>
-void ReadCastWriteImage( std::string inputFileName, std::string outputFileName )
+void ReadCastWriteImage( std::string inputFileName, std::string outputFileName, bool streaming )
 {
   /**  Typedef the correct reader, caster and writer. */
   using ImageReaderType = typename itk::ImageFileReader<InputImageType>;
@@ -259,9 +286,55 @@ if( outputFileName.rfind(".vti") == (outputFileName.size() - 4) )
   }
 #endif
 
-  writer->UseCompressionOn();
   writer->SetFileName( outputFileName.c_str()  );
-  writer->SetInput( caster->GetOutput() );
+  writer->SetInput( GetImageToWrite( caster.GetPointer(), std::is_same<InputImageType, OutputImageType>() ) );
+  if( streaming )
+    {
+    /** Compressed files can not be written in pieces. */
+    writer->UseCompressionOff();
+
+    itk::ImageIOBase::Pointer outputIO =
+      itk::ImageIOFactory::CreateImageIO( outputFileName.c_str(), itk::ImageIOFactory::WriteMode );
+    bool canStreamWrite = false;
+    if( outputIO.IsNotNull() )
+      {
+      writer->SetImageIO( outputIO );
+      canStreamWrite = outputIO->CanStreamWrite();
+      }
+
+    /** gzip compressed files are decoded from their start for every region. */
+    caster->UpdateOutputInformation();
+    const std::string inputExtension =
+      itksys::SystemTools::LowerCase( itksys::SystemTools::GetFilenameLastExtension( inputFileName ) );
+    const bool inputIsRead = reader->GetModifiableImageIO() != nullptr;
+    const bool canStreamRead = inputIsRead && reader->GetModifiableImageIO()->CanStreamRead()
+      && inputExtension != ".gz";
+
+    /** Enough slabs to keep each under StreamingSlabBytes, at most one per slice. */
+    const typename OutputImageType::RegionType region = caster->GetOutput()->GetLargestPossibleRegion();
+    const double imageBytes = static_cast<double>( region.GetNumberOfPixels() )
+      * ( sizeof( typename InputImageType::PixelType ) + sizeof( typename OutputImageType::PixelType ) );
+    const double numberOfSlices = region.GetSize( OutputImageType::ImageDimension - 1 );
+    double       numberOfSlabs = std::max( std::min( std::ceil( imageBytes / StreamingSlabBytes ), numberOfSlices ),
+                                           1.0 );
+    if( !canStreamWrite )
+      {
+      std::cout << "The output file format can not be streamed, the image is converted in one piece." << std::endl;
+      numberOfSlabs = 1.0;
+      }
+    else if( inputIsRead && !canStreamRead && numberOfSlabs > 1.0 )
+      {
+      /** Read the input once; the slabs are then cast and written from the
+       * buffered input instead of reading the whole file for every slab. */
+      std::cout << "The input file can not be streamed, the input is read in one piece." << std::endl;
+      reader->UpdateLargestPossibleRegion();
+      }
+    writer->SetNumberOfStreamDivisions( static_cast<unsigned int>( numberOfSlabs ) );
+    }
+  else
+    {
+    writer->UseCompressionOn();
+    }
   writer->Update();
 
   if( inputFileName.rfind(".vti") != (inputFileName.size() - 4) )
@@ -300,7 +373,7 @@ ReadVTICastWriteImage( std::string inputFileName,
   using InputImageType = itk::Image<TInputPixelType,  3>;
   using OutputImageType = itk::Image<TOutputPixelType, 3>;
   ReadCastWriteImage<InputImageType, OutputImageType>(
-    inputFileName, outputFileName );
+    inputFileName, outputFileName, false );
   return 1;
 }
 
@@ -374,7 +447,7 @@ ReadVTICastWriteImage( std::string,
       { \
       using InputImageType = itk::Image<typeIn, dim>; \
       using OutputImageType = itk::Image<typeOut, dim>; \
-      ReadCastWriteImage<InputImageType, OutputImageType>( inputFileName, outputFileName ); \
+      ReadCastWriteImage<InputImageType, OutputImageType>( inputFileName, outputFileName, streaming ); \
       } \
     }
 
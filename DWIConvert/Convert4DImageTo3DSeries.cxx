@@ -23,8 +23,7 @@
 #include "itkImage.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkExtractImageFilter.h"
-#include "itkComposeImageFilter.h"
+#include "VectorImageComponents.h"
 
 #include <iomanip>
 
@@ -58,31 +57,16 @@ int main( int argc, char * argv[] )
     }
   Volume4DType::Pointer inputVol = image4DReader->GetOutput();
 
-  // "inputVol" is read as a 4D image. Here we extract each 3D component and write that to disk
+  // "inputVol" is read as a 4D image. Each 3D component is a contiguous block of its buffer,
+  // so every component is written straight from that buffer without an extraction copy.
   //
-  Volume4DType::SizeType inputSize =
-    inputVol->GetLargestPossibleRegion().GetSize();
-
-  Volume4DType::IndexType inputIndex =
-    inputVol->GetLargestPossibleRegion().GetIndex();
-
-  const unsigned int volumeCount = inputSize[3];
-
-  using ExtractFilterType = itk::ExtractImageFilter< Volume4DType, Volume3DType >;
+  const unsigned int        volumeCount = inputVol->GetLargestPossibleRegion().GetSize()[3];
+  const itk::IndexValueType firstVolume = inputVol->GetLargestPossibleRegion().GetIndex()[3];
 
   for( size_t componentNumber = 0; componentNumber < volumeCount; ++componentNumber )
     {
-    Volume4DType::SizeType extractSize = inputSize;
-    extractSize[3] = 0;
-    Volume4DType::IndexType extractIndex = inputIndex;
-    extractIndex[3] = componentNumber;
-    Volume4DType::RegionType extractRegion(extractIndex, extractSize);
-
-    ExtractFilterType::Pointer extracter = ExtractFilterType::New();
-    extracter->SetExtractionRegion( extractRegion );
-    extracter->SetInput( inputVol );
-    extracter->SetDirectionCollapseToIdentity();
-    extracter->Update();
+    Volume3DType::Pointer componentVolume =
+      BRAINSUtils::GetSeriesVolume<PixelValueType, 3>( inputVol.GetPointer(), firstVolume + componentNumber );
 
     // Need to zeropad to ensure that files are printed in order.
     std::stringstream fNumber("");
@@ -94,7 +78,7 @@ int main( int argc, char * argv[] )
     using Image3DWriterType = itk::ImageFileWriter<Volume3DType>;
     Image3DWriterType::Pointer image3DWriter = Image3DWriterType::New();
     image3DWriter->SetFileName( fn );
-    image3DWriter->SetInput( extracter->GetOutput() );
+    image3DWriter->SetInput( componentVolume );
     try
       {
       image3DWriter->Update();
@@ -27,7 +27,9 @@
 #include "itkMetaDataDictionary.h"
 #include "itkMetaDataObject.h"
 #include "itkVariableLengthVector.h"
+#include "itkMultiThreaderBase.h"
 #include <vcl_compiler.h>
+#include <algorithm>
 #include <iostream>
 #include "cmath"
 #include <iostream>
@@ -145,6 +147,21 @@ void PrintVec(const TVal & a);
 template <typename TVal>
 void PrintVec(const std::vector<TVal> & vec);
 
+/** Layout conversion between a pixel interleaved buffer (a VectorImage:
+ * the numberOfComponents values of a pixel are adjacent) and a volume
+ * interleaved one (a 4D image or the unwrapped DWI volume: component c of
+ * pixel p is at c * numberOfPixels + p).  Both are a transpose of the
+ * buffer, done in cache sized tiles spread over the ITK threads. */
+template <typename TPixel>
+void
+DeinterleaveComponents(const TPixel *pixelInterleaved, TPixel *volumeInterleaved,
+                       size_t numberOfPixels, size_t numberOfComponents);
+
+template <typename TPixel>
+void
+InterleaveComponents(const TPixel *volumeInterleaved, TPixel *pixelInterleaved,
+                     size_t numberOfPixels, size_t numberOfComponents);
+
 extern void PrintVec(const vnl_vector_fixed<double,3> & vec);
 extern void PrintVec(const DWIMetaDataDictionaryValidator::GradientTableType & vec);
 
@@ -370,4 +370,51 @@ void PrintVec(const std::vector<TVal> & vec)
   std::cerr << "]" << std::endl;
 }
 
+/** Transpose a rows x columns buffer.  Tiles of TileSize x TileSize keep
+ * both the strided reads and the strided writes of a tile in cache. */
+template <typename TPixel>
+void
+TransposeBuffer(const TPixel *source, TPixel *destination, const size_t rows, const size_t columns)
+{
+  constexpr size_t TileSize = 32;
+  const size_t     numberOfRowTiles = ( rows + TileSize - 1 ) / TileSize;
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfRowTiles,
+                        [&](itk::SizeValueType rowTile)
+                          {
+                            const size_t rowStart = rowTile * TileSize;
+                            const size_t rowEnd = std::min( rows, rowStart + TileSize );
+                            for( size_t columnStart = 0; columnStart < columns; columnStart += TileSize )
+                              {
+                              const size_t columnEnd = std::min( columns, columnStart + TileSize );
+                              for( size_t r = rowStart; r < rowEnd; ++r )
+                                {
+                                const TPixel *sourceRow = source + r * columns;
+                                for( size_t c = columnStart; c < columnEnd; ++c )
+                                  {
+                                  destination[c * rows + r] = sourceRow[c];
+                                  }
+                                }
+                              }
+                          },
+                        nullptr );
+}
+
+template <typename TPixel>
+void
+DeinterleaveComponents(const TPixel *pixelInterleaved, TPixel *volumeInterleaved,
+                       size_t numberOfPixels, size_t numberOfComponents)
+{
+  TransposeBuffer(pixelInterleaved, volumeInterleaved, numberOfPixels, numberOfComponents);
+}
+
+template <typename TPixel>
+void
+InterleaveComponents(const TPixel *volumeInterleaved, TPixel *pixelInterleaved,
+                     size_t numberOfPixels, size_t numberOfComponents)
+{
+  TransposeBuffer(volumeInterleaved, pixelInterleaved, numberOfComponents, numberOfPixels);
+}
+
 #endif //DWIConvertUtils
@@ -25,13 +25,10 @@
 #include "itksys/SystemTools.hxx"
 #include "itkMath.h"
 
-#include <itkExtractImageFilter.h>
-#include <itkComposeImageFilter.h>
 #include "DWIMetaDataDictionaryValidator.h"
 
 using PixelValueType = short;
 using Volume4DType = itk::Image<PixelValueType, 4>;
-using Volume3DType = itk::Image<PixelValueType, 3>;
 using VectorVolumeType = itk::VectorImage<PixelValueType, 3>;
 
 int
@@ -169,31 +166,27 @@ FSLToNrrd(const std::string & inputVolume,
   std::cout << "Spacing :" << inputSpacing << std::endl;
 
   ////////
-  // "inputVol" is read as a 4D image. Here we convert that to a VectorImageType:
+  // "inputVol" is read as a 4D image. Here we convert that to a VectorImageType,
+  // with the identity direction the per volume extraction used to give it.
   //
-  using ExtractFilterType = itk::ExtractImageFilter< Volume4DType, Volume3DType >;
-
-  using ComposeImageFilterType = itk::ComposeImageFilter<Volume3DType, VectorVolumeType>;
-  ComposeImageFilterType::Pointer composer= ComposeImageFilterType::New();
-
-  for( size_t componentNumber = 0; componentNumber < inputSize[3]; ++componentNumber )
-     {
-     Volume4DType::SizeType extractSize = inputSize;
-     extractSize[3] = 0;
-     Volume4DType::IndexType extractIndex = inputIndex;
-     extractIndex[3] = componentNumber;
-     Volume4DType::RegionType extractRegion(extractIndex, extractSize);
-
-     ExtractFilterType::Pointer extracter = ExtractFilterType::New();
-     extracter->SetExtractionRegion( extractRegion );
-     extracter->SetInput( inputVol );
-     extracter->SetDirectionCollapseToIdentity();
-     extracter->Update();
-
-     composer->SetInput(componentNumber,extracter->GetOutput());
-     }
-  composer->Update();
-  VectorVolumeType::Pointer nrrdVolume = composer->GetOutput();
+  VectorVolumeType::Pointer     nrrdVolume = VectorVolumeType::New();
+  VectorVolumeType::RegionType  nrrdRegion;
+  VectorVolumeType::SpacingType nrrdSpacing;
+  VectorVolumeType::PointType   nrrdOrigin;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    nrrdRegion.SetIndex( i, inputIndex[i] );
+    nrrdRegion.SetSize( i, inputSize[i] );
+    nrrdSpacing[i] = inputSpacing[i];
+    nrrdOrigin[i] = inputVol->GetOrigin()[i];
+    }
+  nrrdVolume->SetRegions( nrrdRegion );
+  nrrdVolume->SetSpacing( nrrdSpacing );
+  nrrdVolume->SetOrigin( nrrdOrigin );
+  nrrdVolume->SetVectorLength( inputSize[3] );
+  nrrdVolume->Allocate();
+  InterleaveComponents<PixelValueType>( inputVol->GetBufferPointer(), nrrdVolume->GetBufferPointer(),
+                                        nrrdRegion.GetNumberOfPixels(), inputSize[3] );
 
   const unsigned int nrrdNumOfComponents = nrrdVolume->GetNumberOfComponentsPerPixel();
   std::cout << "Number of components in converted Nrrd volume: " << nrrdNumOfComponents << std::endl;
@@ -53,27 +53,10 @@ NRRDDWIConverter::CreateVolume(VectorVolumeType::Pointer & vector3DVolume)
   fourDVolume->SetDirection(volDirection);
   fourDVolume->Allocate();
 
-  const Volume4DType::IndexType::IndexValueType vecLength = vector3DVolume->GetNumberOfComponentsPerPixel();
-
-  VectorVolumeType::IndexType vecIndex;
-  Volume4DType::IndexType       volIndex;
   // convert from vector image to 4D volume image
-  for( volIndex[3] = 0; volIndex[3] < vecLength; ++volIndex[3] )
-  {
-    for( volIndex[2] = 0; volIndex[2] < static_cast<Volume4DType::IndexType::IndexValueType>( inputSize[2] ); ++volIndex[2] )
-    {
-      vecIndex[2] = volIndex[2];
-      for( volIndex[1] = 0; volIndex[1] < static_cast<Volume4DType::IndexType::IndexValueType>( inputSize[1] ); ++volIndex[1] )
-      {
-        vecIndex[1] = volIndex[1];
-        for( volIndex[0] = 0; volIndex[0] < static_cast<Volume4DType::IndexType::IndexValueType>( inputSize[0] ); ++volIndex[0] )
-        {
-          vecIndex[0] = volIndex[0];
-          fourDVolume->SetPixel(volIndex, vector3DVolume->GetPixel(vecIndex)[volIndex[3]]);
-        }
-      }
-    }
-  }
+  DeinterleaveComponents<PixelValueType>( vector3DVolume->GetBufferPointer(), fourDVolume->GetBufferPointer(),
+                                          vector3DVolume->GetBufferedRegion().GetNumberOfPixels(),
+                                          vector3DVolume->GetNumberOfComponentsPerPixel() );
 
   fourDVolume->SetMetaDataDictionary(vector3DVolume->GetMetaDataDictionary());
   return fourDVolume;
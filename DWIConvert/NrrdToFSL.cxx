@@ -126,29 +126,11 @@ int NrrdToFSL(const std::string & inputVolume,
     {
     return EXIT_FAILURE;
     }
-  Volume4DType::Pointer                         niftiVolume = CreateVolume(inputVol);
-  const VectorVolume4DType::SizeType            inputSize( inputVol->GetLargestPossibleRegion().GetSize() );
-  const Volume4DType::IndexType::IndexValueType vecLength = inputVol->GetNumberOfComponentsPerPixel();
-
-  VectorVolume4DType::IndexType vecIndex;
-  Volume4DType::IndexType       volIndex;
+  Volume4DType::Pointer niftiVolume = CreateVolume(inputVol);
   // convert from vector image to 4D volume image
-  for( volIndex[3] = 0; volIndex[3] < vecLength; ++volIndex[3] )
-    {
-    for( volIndex[2] = 0; volIndex[2] < static_cast<Volume4DType::IndexType::IndexValueType>( inputSize[2] ); ++volIndex[2] )
-      {
-      vecIndex[2] = volIndex[2];
-      for( volIndex[1] = 0; volIndex[1] < static_cast<Volume4DType::IndexType::IndexValueType>( inputSize[1] ); ++volIndex[1] )
-        {
-        vecIndex[1] = volIndex[1];
-        for( volIndex[0] = 0; volIndex[0] < static_cast<Volume4DType::IndexType::IndexValueType>( inputSize[0] ); ++volIndex[0] )
-          {
-          vecIndex[0] = volIndex[0];
-          niftiVolume->SetPixel(volIndex, inputVol->GetPixel(vecIndex)[volIndex[3]]);
-          }
-        }
-      }
-    }
+  DeinterleaveComponents<PixelValueType>( inputVol->GetBufferPointer(), niftiVolume->GetBufferPointer(),
+                                          inputVol->GetBufferedRegion().GetNumberOfPixels(),
+                                          inputVol->GetNumberOfComponentsPerPixel() );
   if( WriteVolume<Volume4DType>(niftiVolume, outputVolume) != EXIT_SUCCESS )
     {
     return EXIT_FAILURE;
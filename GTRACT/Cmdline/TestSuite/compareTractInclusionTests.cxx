@@ -0,0 +1,172 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include <iostream>
+#include <random>
+#include "itkBRAINSToolsTestMain.h"
+
+void RegisterTests()
+{
+  REGISTER_TEST(compareTractInclusionTest);
+  REGISTER_TEST(compareTractInclusionFiberGridTest);
+}
+
+#undef main
+#define main compareTractInclusionTest
+#include "../compareTractInclusion.cxx"
+#undef main
+
+namespace
+{
+/** Append a polyline of numberOfPoints points, a jittered straight segment
+ * from start along direction. */
+void AddFiber(vtkPoints *points, vtkCellArray *lines, const double start[3], const double direction[3],
+              const int numberOfPoints, std::mt19937 & generator, const double jitter)
+{
+  std::uniform_real_distribution<double> noise(-jitter, jitter);
+  lines->InsertNextCell(numberOfPoints);
+  for( int i = 0; i < numberOfPoints; i++ )
+    {
+    const vtkIdType id = points->InsertNextPoint(start[0] + i * direction[0] + noise(generator),
+                                                 start[1] + i * direction[1] + noise(generator),
+                                                 start[2] + i * direction[2] + noise(generator) );
+    lines->InsertCellPoint(id);
+    }
+}
+
+/** A tract of numberOfFibers fibers in numberOfBundles bundles.  Every
+ * duplicateEvery-th fiber repeats the previous one, so the standard tract
+ * has exact ties. */
+vtkPolyData * MakeTract(const int numberOfFibers, const int numberOfBundles, const int numberOfPoints,
+                        const double bundleSpread, const int duplicateEvery, const unsigned int seed)
+{
+  std::mt19937                           generator(seed);
+  std::uniform_real_distribution<double> position(-bundleSpread, bundleSpread);
+  std::uniform_real_distribution<double> offset(-2.0, 2.0);
+
+  vtkPoints *   points = vtkPoints::New();
+  vtkCellArray *lines = vtkCellArray::New();
+  std::vector<double> bundleStarts;
+  for( int b = 0; b < 3 * numberOfBundles; b++ )
+    {
+    bundleStarts.push_back( position(generator) );
+    }
+  const double direction[3] = { 1.0, 0.5, 0.25 };
+  double       start[3] = { 0.0, 0.0, 0.0 };
+  for( int f = 0; f < numberOfFibers; f++ )
+    {
+    if( duplicateEvery == 0 || f % duplicateEvery != duplicateEvery - 1 )
+      {
+      const int bundle = f % numberOfBundles;
+      for( int p = 0; p < 3; p++ )
+        {
+        start[p] = bundleStarts[3 * bundle + p] + offset(generator);
+        }
+      }
+    AddFiber(points, lines, start, direction, numberOfPoints, generator, duplicateEvery > 0 ? 0.0 : 0.5);
+    }
+
+  vtkPolyData *tract = vtkPolyData::New();
+  tract->SetPoints(points);
+  tract->SetLines(lines);
+  points->Delete();
+  lines->Delete();
+  return tract;
+}
+
+/** Compare FiberCentroidGrid with the exhaustive search over all standard
+ * fibers: same distance and same fiber, the smallest id among ties. */
+bool CheckAgainstExhaustiveSearch(const std::string & caseName, vtkPolyData *testTract, vtkPolyData *standardTract,
+                                  const int numberOfPoints)
+{
+  FiberSetType testFibers;
+  FiberSetType standardFibers;
+  if( !GetFiberSet(testTract, numberOfPoints, testFibers) || !GetFiberSet(standardTract, numberOfPoints, standardFibers) )
+    {
+    std::cerr << caseName << ": could not gather the fibers" << std::endl;
+    return false;
+    }
+  const FiberCentroidGrid standardGrid(standardFibers, numberOfPoints);
+
+  bool   passed = true;
+  double maxDistance = 0.0;
+  for( size_t j = 0; j < testFibers.CellIds.size(); j++ )
+    {
+    double    expectedDistance = std::numeric_limits<double>::infinity();
+    vtkIdType expectedFiber = -1;
+    for( size_t f = 0; f < standardFibers.CellIds.size(); f++ )
+      {
+      const double dist = MeanPointDistance(&testFibers.Points[3 * numberOfPoints * j],
+                                            &standardFibers.Points[3 * numberOfPoints * f], numberOfPoints,
+                                            std::numeric_limits<double>::infinity() );
+      if( dist < expectedDistance )
+        {
+        expectedDistance = dist;
+        expectedFiber = standardFibers.CellIds[f];
+        }
+      }
+    double    gridDistance;
+    vtkIdType gridFiber;
+    standardGrid.FindClosestFiber(testFibers, j, gridDistance, gridFiber);
+    if( gridFiber != expectedFiber || gridDistance != expectedDistance )
+      {
+      std::cerr << caseName << ": test fiber " << testFibers.CellIds[j] << " paired with " << gridFiber << " at "
+                << gridDistance << " instead of " << expectedFiber << " at " << expectedDistance << std::endl;
+      passed = false;
+      }
+    maxDistance = std::max(maxDistance, expectedDistance);
+    }
+
+  const double pairedDistance = PairOffFibers(testTract, standardTract, numberOfPoints);
+  if( pairedDistance != maxDistance )
+    {
+    std::cerr << caseName << ": PairOffFibers returned " << pairedDistance << " instead of " << maxDistance
+              << std::endl;
+    passed = false;
+    }
+  std::cout << caseName << ( passed ? " passed" : " FAILED" ) << std::endl;
+  return passed;
+}
+} // end namespace
+
+int compareTractInclusionFiberGridTest(int, char *[])
+{
+  constexpr int numberOfPoints = 10;
+  bool          allPassed = true;
+
+  // Clustered bundles, with some test fibers far outside the standard grid.
+  vtkPolyData *standardTract = MakeTract(600, 12, numberOfPoints, 40.0, 7, 1);
+  vtkPolyData *testTract = MakeTract(300, 9, numberOfPoints, 60.0, 0, 2);
+  allPassed &= CheckAgainstExhaustiveSearch("Bundles", testTract, standardTract, numberOfPoints);
+
+  // The standard tract searched against itself: every fiber is at distance
+  // 0 from itself and from its duplicates, and the first of them wins.
+  allPassed &= CheckAgainstExhaustiveSearch("Self", standardTract, standardTract, numberOfPoints);
+  testTract->Delete();
+  standardTract->Delete();
+
+  // A single bundle of identical fibers: all centroids in one cell.
+  vtkPolyData *identicalTract = MakeTract(20, 1, numberOfPoints, 0.0, 1, 3);
+  testTract = MakeTract(30, 3, numberOfPoints, 10.0, 0, 4);
+  allPassed &= CheckAgainstExhaustiveSearch("Identical", testTract, identicalTract, numberOfPoints);
+  testTract->Delete();
+  identicalTract->Delete();
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
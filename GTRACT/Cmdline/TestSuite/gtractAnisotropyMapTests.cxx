@@ -0,0 +1,362 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include <iostream>
+#include "itkBRAINSToolsTestMain.h"
+
+void RegisterTests()
+{
+  REGISTER_TEST(gtractAnisotropyMapTest);
+  REGISTER_TEST(gtractAnisotropyMapEigenValuesTest);
+  REGISTER_TEST(gtractAnisotropyMapAdditionalOutputsTest);
+}
+
+#undef main
+#define main gtractAnisotropyMapTest
+#include "../gtractAnisotropyMap.cxx"
+#undef main
+
+#include "itkDiffusionTensor3D.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkVersor.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+using EigenMatrixType = vnl_matrix<double>;
+
+// Relative to the Frobenius norm of the tensor.  The trigonometric solution
+// loses about half of the digits on two nearly equal eigenvalues.
+constexpr double EigenValueTolerance = 1e-8;
+// The maps are written as float
+constexpr double MapTolerance = 1e-5;
+
+/** R diag(eigenValues) R^T, R the rotation of angle about axis */
+EigenMatrixType
+RotatedTensor(const double eigenValues[3], const itk::Vector<double, 3> & axis, const double angle)
+{
+  itk::Versor<double> versor;
+  versor.Set( axis, angle );
+  const vnl_matrix_fixed<double, 3, 3> rotation = versor.GetMatrix().GetVnlMatrix();
+  vnl_matrix_fixed<double, 3, 3>       diagonal( 0.0 );
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    diagonal(i, i) = eigenValues[i];
+    }
+  return ( rotation * diagonal * rotation.transpose() ).as_matrix();
+}
+
+/** Compares SymmetricEigenValues3 with vnl_symmetric_eigensystem and with the
+ * eigenvalues the tensor was built from, in ascending order */
+bool
+CheckEigenValues(const std::string & caseName, const EigenMatrixType & tensor, const double knownEigenValues[3])
+{
+  const double components[6] = { tensor(0, 0), tensor(0, 1), tensor(0, 2), tensor(1, 1), tensor(1, 2),
+                                  tensor(2, 2) };
+  double       eigenValues[3];
+  SymmetricEigenValues3( components, eigenValues );
+
+  const vnl_symmetric_eigensystem<double> eigenSystem( tensor );
+  double                                  sortedKnown[3] = { knownEigenValues[0], knownEigenValues[1],
+                                                             knownEigenValues[2] };
+  std::sort( sortedKnown, sortedKnown + 3 );
+
+  const double tolerance = EigenValueTolerance * tensor.frobenius_norm();
+  bool         passed = true;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    passed &= std::abs( eigenValues[i] - eigenSystem.get_eigenvalue(i) ) <= tolerance
+      && std::abs( eigenValues[i] - sortedKnown[i] ) <= tolerance;
+    }
+  if( !passed )
+    {
+    std::cerr << caseName << ": SymmetricEigenValues3 gives " << eigenValues[0] << " " << eigenValues[1] << " "
+              << eigenValues[2] << ", vnl " << eigenSystem.get_eigenvalue(0) << " "
+              << eigenSystem.get_eigenvalue(1) << " " << eigenSystem.get_eigenvalue(2) << ", expected "
+              << sortedKnown[0] << " " << sortedKnown[1] << " " << sortedKnown[2] << std::endl;
+    }
+  return passed;
+}
+
+using InputTensorImageType = itk::Image<itk::DiffusionTensor3D<double>, 3>;
+using MapImageType = itk::Image<float, 3>;
+
+/** A tensor image as gtractTensor writes it.  The tensors are prolate and
+ * turn across the image.  The x = 0 column is null, as masked voxels are,
+ * the rest of the z = 0 slice is isotropic, and the last x column has a small
+ * negative eigenvalue, as noisy fits give. */
+void WriteTestTensors(const std::string & fileName)
+{
+  InputTensorImageType::SizeType size;
+  size[0] = 11;
+  size[1] = 9;
+  size[2] = 7;
+  InputTensorImageType::Pointer image = InputTensorImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+  for( itk::ImageRegionIteratorWithIndex<InputTensorImageType> it( image, image->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    const InputTensorImageType::IndexType index = it.GetIndex();
+    const double                          scale = 0.5 + 0.1 * index[0];
+    double                                eigenValues[3] = { 1.7e-3 * scale, 0.4e-3 * scale, 0.2e-3 * scale };
+    if( index[0] == 0 )
+      {
+      std::fill( eigenValues, eigenValues + 3, 0.0 );
+      }
+    else if( index[2] == 0 )
+      {
+      std::fill( eigenValues, eigenValues + 3, 0.8e-3 );
+      }
+    else if( index[0] == static_cast<InputTensorImageType::IndexValueType>( size[0] - 1 ) )
+      {
+      eigenValues[2] = -0.1e-3;
+      }
+    itk::Vector<double, 3> axis;
+    axis[0] = 1.0;
+    axis[1] = 0.2 * index[1];
+    axis[2] = -0.3 * index[2];
+    const EigenMatrixType          tensor = RotatedTensor( eigenValues, axis, 0.3 * index[1] + 0.2 * index[2] );
+    itk::DiffusionTensor3D<double> pixel;
+    pixel[0] = tensor(0, 0);
+    pixel[1] = tensor(0, 1);
+    pixel[2] = tensor(0, 2);
+    pixel[3] = tensor(1, 1);
+    pixel[4] = tensor(1, 2);
+    pixel[5] = tensor(2, 2);
+    it.Set( pixel );
+    }
+
+  using WriterType = itk::ImageFileWriter<InputTensorImageType>;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( image );
+  writer->SetFileName( fileName );
+  writer->Update();
+}
+
+/** The map of a tensor, from the gtractDiffusionTensor3D pixel methods */
+double
+ExpectedMapValue(const std::string & mapType, const itk::gtractDiffusionTensor3D<double> & tensor)
+{
+  if( mapType == "ADC" )
+    {
+    return tensor.GetTrace() / 3.0;
+    }
+  if( mapType == "FA" )
+    {
+    return tensor.GetFractionalAnisotropy();
+    }
+  if( mapType == "RA" )
+    {
+    return tensor.GetRelativeAnisotropy();
+    }
+  if( mapType == "VR" )
+    {
+    return tensor.GetVolumeRatio();
+    }
+  if( mapType == "AD" )
+    {
+    return tensor.GetAxialDiffusivity();
+    }
+  if( mapType == "RD" )
+    {
+    return tensor.GetRadialDiffusivity();
+    }
+  return tensor.GetLatticeIndex();
+}
+
+int RunAnisotropyMap(const std::string & inputName, const std::string & mapType, const std::string & outputName,
+                     const std::string & additionalTypes, const std::string & additionalOutputNames)
+{
+  std::vector<std::string> arguments;
+  arguments.push_back( "gtractAnisotropyMapTest" );
+  arguments.push_back( "--inputTensorVolume" );
+  arguments.push_back( inputName );
+  arguments.push_back( "--anisotropyType" );
+  arguments.push_back( mapType );
+  arguments.push_back( "--outputVolume" );
+  arguments.push_back( outputName );
+  if( !additionalTypes.empty() )
+    {
+    arguments.push_back( "--additionalAnisotropyTypes" );
+    arguments.push_back( additionalTypes );
+    arguments.push_back( "--additionalOutputVolumes" );
+    arguments.push_back( additionalOutputNames );
+    }
+  arguments.push_back( "--numberOfThreads" );
+  arguments.push_back( "4" );
+  std::vector<char *> argumentPointers;
+  for( auto & argument : arguments )
+    {
+    argumentPointers.push_back( &argument[0] );
+    }
+  return gtractAnisotropyMapTest( static_cast<int>( argumentPointers.size() ), argumentPointers.data() );
+}
+
+MapImageType::Pointer
+ReadMap(const std::string & fileName)
+{
+  using ReaderType = itk::ImageFileReader<MapImageType>;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName );
+  reader->Update();
+  return reader->GetOutput();
+}
+
+/** Equal, or both not a number (VR of a null tensor) */
+bool
+SameMapValue(const float first, const float second)
+{
+  return first == second || ( std::isnan( first ) && std::isnan( second ) );
+}
+} // end namespace
+
+/** The eigenvalues of known symmetric matrices: diagonal ones in any order,
+ * null, isotropic, with two equal or nearly equal eigenvalues, negative and
+ * indefinite ones, each turned about several axes, must match
+ * vnl_symmetric_eigensystem and the eigenvalues they were built from. */
+int gtractAnisotropyMapEigenValuesTest(int, char *[])
+{
+  const double eigenValueSets[][3] = {
+      { 1.7e-3, 0.4e-3, 0.2e-3 },
+      { 3.0, -1.0, 2.0 },
+      { 0.0, 0.0, 0.0 },
+      { 2.0, 2.0, 2.0 },
+      { 1.0, 1.0, 4.0 },
+      { 1.0, 4.0, 4.0 },
+      { 1e-3, 1e-3 + 1e-12, 2e-3 },
+      { -3.0, -1.0, -0.5 },
+      { -2.0, 0.0, 5.0 },
+      { 1e4, 1e-4, 1.0 } };
+  const double axes[][3] = { { 0.0, 0.0, 1.0 }, { 1.0, 1.0, 0.0 }, { 0.3, -0.7, 1.1 }, { -2.0, 0.5, 0.1 } };
+  const double angles[] = { 0.0, 0.4, 1.3, -2.9 };
+
+  bool         passed = true;
+  unsigned int numberOfTensors = 0;
+  for( const auto & eigenValues : eigenValueSets )
+    {
+    for( const auto & axisComponents : axes )
+      {
+      const itk::Vector<double, 3> axis( axisComponents );
+      for( const double angle : angles )
+        {
+        std::ostringstream caseName;
+        caseName << "Eigenvalues " << eigenValues[0] << " " << eigenValues[1] << " " << eigenValues[2]
+                 << " turned by " << angle << " about " << axis;
+        passed &= CheckEigenValues( caseName.str(), RotatedTensor( eigenValues, axis, angle ), eigenValues );
+        ++numberOfTensors;
+        }
+      }
+    }
+  std::cout << numberOfTensors << " tensors" << ( passed ? " passed" : " FAILED" ) << std::endl;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/** Every map of a run with additional outputs must hold the value of the
+ * gtractDiffusionTensor3D pixel method at each voxel, and be the map a run
+ * of that type alone writes. */
+int gtractAnisotropyMapAdditionalOutputsTest(int argc, char *argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string outputDirectory = argv[1];
+  const std::string prefix = outputDirectory + "/gtractAnisotropyMapAdditionalOutputsTest";
+  const std::string inputName = prefix + "_tensor.nrrd";
+
+  const std::vector<std::string> mapTypes = { "FA", "ADC", "RA", "VR", "AD", "RD", "LI" };
+  std::string                    additionalTypes;
+  std::string                    additionalOutputNames;
+  for( size_t i = 1; i < mapTypes.size(); ++i )
+    {
+    additionalTypes += ( i > 1 ? "," : "" ) + mapTypes[i];
+    additionalOutputNames += ( i > 1 ? "," : "" ) + prefix + "_" + mapTypes[i] + ".nrrd";
+    }
+
+  bool passed = true;
+  try
+    {
+    WriteTestTensors( inputName );
+    if( RunAnisotropyMap( inputName, mapTypes[0], prefix + "_" + mapTypes[0] + ".nrrd", additionalTypes,
+                          additionalOutputNames ) != EXIT_SUCCESS )
+      {
+      std::cerr << "The run with additional outputs failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( RunAnisotropyMap( inputName, "FA", prefix + "_mismatched.nrrd", "AD,RD", prefix + "_AD.nrrd" )
+        != EXIT_FAILURE )
+      {
+      std::cerr << "More additional types than additional outputs are not rejected" << std::endl;
+      passed = false;
+      }
+
+    using ReaderType = itk::ImageFileReader<InputTensorImageType>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( inputName );
+    reader->Update();
+    const InputTensorImageType *tensors = reader->GetOutput();
+
+    for( const std::string & mapType : mapTypes )
+      {
+      const std::string           singleName = prefix + "_" + mapType + "_single.nrrd";
+      const MapImageType::Pointer map = ReadMap( prefix + "_" + mapType + ".nrrd" );
+      if( RunAnisotropyMap( inputName, mapType, singleName, "", "" ) != EXIT_SUCCESS )
+        {
+        std::cerr << "The " << mapType << " run failed" << std::endl;
+        return EXIT_FAILURE;
+        }
+      const MapImageType::Pointer singleMap = ReadMap( singleName );
+
+      unsigned int differentFromSingle = 0;
+      unsigned int differentFromTensor = 0;
+      for( itk::ImageRegionConstIteratorWithIndex<MapImageType> it( map, map->GetLargestPossibleRegion() );
+           !it.IsAtEnd(); ++it )
+        {
+        itk::gtractDiffusionTensor3D<double> tensor;
+        for( unsigned int c = 0; c < 6; ++c )
+          {
+          tensor[c] = tensors->GetPixel( it.GetIndex() )[c];
+          }
+        const double expected = ExpectedMapValue( mapType, tensor );
+        const float  value = it.Get();
+        differentFromSingle += SameMapValue( value, singleMap->GetPixel( it.GetIndex() ) ) ? 0 : 1;
+        if( !SameMapValue( value, static_cast<float>( expected ) )
+            && !( std::abs( value - expected ) <= MapTolerance * std::abs( expected ) ) )
+          {
+          ++differentFromTensor;
+          }
+        }
+      std::cout << mapType << ": " << differentFromTensor << " voxels differ from the tensor, "
+                << differentFromSingle << " from the single run" << std::endl;
+      passed &= differentFromSingle == 0 && differentFromTensor == 0;
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -23,8 +23,170 @@
 void RegisterTests()
 {
   REGISTER_TEST(gtractCoregBvaluesTest);
+  REGISTER_TEST(gtractCoregBvaluesGridTest);
 }
 
 #undef main
 #define main gtractCoregBvaluesTest
 #include "../gtractCoregBvalues.cxx"
+#undef main
+
+#include "itkImageRegionIteratorWithIndex.h"
+
+namespace
+{
+using TestDWIType = itk::VectorImage<signed short, 3>;
+constexpr unsigned int TestNumberOfGradients = 3;
+
+/** A DWI of a Gaussian blob, attenuated along each gradient, on a grid of
+ * size voxels. */
+void WriteTestDWI(const TestDWIType::SizeType & size, const std::string & fileName)
+{
+  TestDWIType::SpacingType spacing;
+  spacing[0] = 2.0;
+  spacing[1] = 2.0;
+  spacing[2] = 2.5;
+  TestDWIType::Pointer image = TestDWIType::New();
+  image->SetRegions( size );
+  image->SetSpacing( spacing );
+  image->SetVectorLength( TestNumberOfGradients );
+  image->Allocate();
+
+  itk::MetaDataDictionary & dictionary = image->GetMetaDataDictionary();
+  itk::EncapsulateMetaData<std::string>( dictionary, "modality", "DWMRI" );
+  itk::EncapsulateMetaData<std::string>( dictionary, "DWMRI_b-value", "1000" );
+  itk::EncapsulateMetaData<std::string>( dictionary, "DWMRI_gradient_0000", "0 0 0" );
+  itk::EncapsulateMetaData<std::string>( dictionary, "DWMRI_gradient_0001", "1 0 0" );
+  itk::EncapsulateMetaData<std::string>( dictionary, "DWMRI_gradient_0002", "0 1 0" );
+
+  for( itk::ImageRegionIteratorWithIndex<TestDWIType> it( image, image->GetLargestPossibleRegion() ); !it.IsAtEnd();
+       ++it )
+    {
+    double distance = 0.0;
+    for( unsigned int d = 0; d < 3; ++d )
+      {
+      const double offset = ( it.GetIndex()[d] - 0.5 * ( size[d] - 1 ) ) / ( 0.3 * size[d] );
+      distance += offset * offset;
+      }
+    TestDWIType::PixelType value( TestNumberOfGradients );
+    for( unsigned int g = 0; g < TestNumberOfGradients; ++g )
+      {
+      value[g] = static_cast<signed short>( 1000.0 * std::exp( -distance ) / ( 1.0 + 0.5 * g ) );
+      }
+    it.Set( value );
+    }
+
+  using WriterType = itk::ImageFileWriter<TestDWIType>;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( image );
+  writer->SetFileName( fileName );
+  writer->UseInputMetaDataDictionaryOn();
+  writer->Update();
+}
+
+int RunCoregBvalues(const std::string & fixedName, const std::string & movingName, const std::string & outputName,
+                    const std::string & transformName)
+{
+  std::vector<std::string> arguments;
+  arguments.push_back( "gtractCoregBvaluesTest" );
+  arguments.push_back( "--fixedVolume" );
+  arguments.push_back( fixedName );
+  arguments.push_back( "--movingVolume" );
+  arguments.push_back( movingName );
+  arguments.push_back( "--outputVolume" );
+  arguments.push_back( outputName );
+  arguments.push_back( "--outputTransform" );
+  arguments.push_back( transformName );
+  arguments.push_back( "--numberOfIterations" );
+  arguments.push_back( "50" );
+  arguments.push_back( "--numberOfSpatialSamples" );
+  arguments.push_back( "0" );
+  arguments.push_back( "--samplingPercentage" );
+  arguments.push_back( "0.5" );
+  arguments.push_back( "--numberOfConcurrentRegistrations" );
+  arguments.push_back( "2" );
+  std::vector<char *> argumentPointers;
+  for( auto & argument : arguments )
+    {
+    argumentPointers.push_back( &argument[0] );
+    }
+  return gtractCoregBvaluesTest( static_cast<int>( argumentPointers.size() ), argumentPointers.data() );
+}
+} // end namespace
+
+/** A fixed volume on a larger grid than the moving volume must be rejected
+ * instead of writing past the registered image.  On matching grids every
+ * gradient is registered into an image of the moving volume's region. */
+int gtractCoregBvaluesGridTest(int argc, char *argv[])
+{
+  if( argc < 2 )
+    {
+    std::cerr << "Usage: " << argv[0] << " outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string outputDirectory = argv[1];
+  const std::string movingName = outputDirectory + "/gtractCoregBvaluesGridTest_moving.nrrd";
+  const std::string largerName = outputDirectory + "/gtractCoregBvaluesGridTest_larger.nrrd";
+  const std::string outputName = outputDirectory + "/gtractCoregBvaluesGridTest.test.nrrd";
+  const std::string transformName = outputDirectory + "/gtractCoregBvaluesGridTest.h5";
+
+  TestDWIType::SizeType movingSize;
+  movingSize[0] = 24;
+  movingSize[1] = 20;
+  movingSize[2] = 16;
+  TestDWIType::SizeType largerSize = movingSize;
+  largerSize[0] += 8;
+  largerSize[1] += 4;
+  WriteTestDWI( movingSize, movingName );
+  WriteTestDWI( largerSize, largerName );
+
+  bool passed = true;
+  if( RunCoregBvalues( largerName, movingName, outputName, transformName ) != EXIT_FAILURE )
+    {
+    std::cerr << "A fixed volume larger than the moving volume is not rejected" << std::endl;
+    passed = false;
+    }
+  if( RunCoregBvalues( movingName, largerName, outputName, transformName ) != EXIT_FAILURE )
+    {
+    std::cerr << "A fixed volume smaller than the moving volume is not rejected" << std::endl;
+    passed = false;
+    }
+
+  try
+    {
+    if( RunCoregBvalues( movingName, movingName, outputName, transformName ) != EXIT_SUCCESS )
+      {
+      std::cerr << "Registering a volume to itself failed" << std::endl;
+      return EXIT_FAILURE;
+      }
+    using ReaderType = itk::ImageFileReader<TestDWIType>;
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( outputName );
+    reader->Update();
+    const TestDWIType *output = reader->GetOutput();
+    if( output->GetLargestPossibleRegion().GetSize() != movingSize
+        || output->GetNumberOfComponentsPerPixel() != TestNumberOfGradients )
+      {
+      std::cerr << "The registered image has region " << output->GetLargestPossibleRegion() << " and "
+                << output->GetNumberOfComponentsPerPixel() << " components" << std::endl;
+      passed = false;
+      }
+    for( unsigned int g = 0; g < TestNumberOfGradients; ++g )
+      {
+      char key[64];
+      sprintf( key, "DWMRI_gradient_%04u", g );
+      if( !output->GetMetaDataDictionary().HasKey( key ) )
+        {
+        std::cerr << "The registered image has no " << key << std::endl;
+        passed = false;
+        }
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -23,8 +23,214 @@
 void RegisterTests()
 {
   REGISTER_TEST(gtractResampleDWIInPlaceTest);
+  REGISTER_TEST(gtractResampleDWIInPlaceReferenceTest);
 }
 
 #undef main
 #define main gtractResampleDWIInPlaceTest
 #include "../gtractResampleDWIInPlace.cxx"
+#undef main
+
+#include "itkAffineTransform.h"
+#include "itkResampleImageFilter.h"
+#include "itkVectorIndexSelectionCastImageFilter.h"
+#include "itkVersor.h"
+
+/** Resamples a DWI to a reference volume of a different geometry through an
+ * affine --warpDWITransform.  Every gradient volume must match
+ * ResampleImageFilter run on that component alone, and the gradients must be
+ * rotated by the rotation of the warp. */
+int gtractResampleDWIInPlaceReferenceTest(int argc, char *argv[])
+{
+  if( argc < 3 )
+    {
+    std::cerr << "Usage: " << argv[0] << " inputDWI outputDirectory" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const std::string inputVolumeName = argv[1];
+  const std::string outputDirectory = argv[2];
+  const std::string warpName = outputDirectory + "/gtractResampleDWIInPlaceReferenceTest_warp.h5";
+  const std::string referenceName = outputDirectory + "/gtractResampleDWIInPlaceReferenceTest_reference.nrrd";
+  const std::string outputName = outputDirectory + "/gtractResampleDWIInPlaceReferenceTest.test.nrrd";
+
+  using DWIImageType = itk::VectorImage<signed short, 3>;
+  using ComponentImageType = itk::Image<signed short, 3>;
+  using DWIReaderType = itk::ImageFileReader<DWIImageType>;
+  using AffineTransformType = itk::AffineTransform<double, 3>;
+
+  DWIReaderType::Pointer inputReader = DWIReaderType::New();
+  inputReader->SetFileName( inputVolumeName );
+  inputReader->Update();
+  const DWIImageType::Pointer inputImage = inputReader->GetOutput();
+
+  // Warp = Rotation * Scale, so the rotation part of the warp is Rotation.
+  const DWIImageType::RegionType  inputRegion = inputImage->GetLargestPossibleRegion();
+  itk::ContinuousIndex<double, 3> centerIndex;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    centerIndex[d] = inputRegion.GetIndex()[d] + 0.5 * ( inputRegion.GetSize()[d] - 1 );
+    }
+  AffineTransformType::InputPointType center;
+  inputImage->TransformContinuousIndexToPhysicalPoint( centerIndex, center );
+  itk::Versor<double>             rotation;
+  itk::Versor<double>::VectorType axis;
+  axis[0] = 0.3;
+  axis[1] = -0.2;
+  axis[2] = 1.0;
+  rotation.Set( axis, 15.0 * itk::Math::pi / 180.0 );
+  AffineTransformType::MatrixType scale;
+  scale.SetIdentity();
+  scale[0][0] = 1.1;
+  scale[1][1] = 0.95;
+  AffineTransformType::OutputVectorType translation;
+  translation[0] = 2.0;
+  translation[1] = -1.0;
+  translation[2] = 0.5;
+  AffineTransformType::Pointer warp = AffineTransformType::New();
+  warp->SetCenter( center );
+  warp->SetMatrix( rotation.GetMatrix() * scale );
+  warp->SetTranslation( translation );
+  itk::TransformFileWriterTemplate<double>::Pointer warpWriter = itk::TransformFileWriterTemplate<double>::New();
+  warpWriter->SetInput( warp );
+  warpWriter->SetFileName( warpName );
+  warpWriter->Update();
+
+  // A coarser, tilted and shifted grid over the DWI
+  itk::Versor<double>             tilt;
+  itk::Versor<double>::VectorType tiltAxis;
+  tiltAxis[0] = 1.0;
+  tiltAxis[1] = 0.0;
+  tiltAxis[2] = 0.0;
+  tilt.Set( tiltAxis, 10.0 * itk::Math::pi / 180.0 );
+  ComponentImageType::SizeType    referenceSize;
+  ComponentImageType::SpacingType referenceSpacing;
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    referenceSpacing[d] = 1.25 * inputImage->GetSpacing()[d];
+    referenceSize[d] = static_cast<itk::SizeValueType>( inputRegion.GetSize()[d] / 1.25 ) + 2;
+    }
+  ComponentImageType::PointType referenceOrigin = inputImage->GetOrigin();
+  referenceOrigin[0] += 0.5 * inputImage->GetSpacing()[0];
+  referenceOrigin[1] -= 1.5 * inputImage->GetSpacing()[1];
+  ComponentImageType::Pointer referenceImage = ComponentImageType::New();
+  referenceImage->SetRegions( referenceSize );
+  referenceImage->SetSpacing( referenceSpacing );
+  referenceImage->SetOrigin( referenceOrigin );
+  referenceImage->SetDirection( inputImage->GetDirection() * tilt.GetMatrix() );
+  referenceImage->Allocate( true );
+  using ReferenceWriterType = itk::ImageFileWriter<ComponentImageType>;
+  ReferenceWriterType::Pointer referenceWriter = ReferenceWriterType::New();
+  referenceWriter->SetInput( referenceImage );
+  referenceWriter->SetFileName( referenceName );
+  referenceWriter->Update();
+
+  std::vector<std::string> arguments;
+  arguments.push_back( "gtractResampleDWIInPlaceTest" );
+  arguments.push_back( "--inputVolume" );
+  arguments.push_back( inputVolumeName );
+  arguments.push_back( "--inputTransform" );
+  arguments.push_back( "Identity" );
+  arguments.push_back( "--warpDWITransform" );
+  arguments.push_back( warpName );
+  arguments.push_back( "--referenceVolume" );
+  arguments.push_back( referenceName );
+  arguments.push_back( "--outputVolume" );
+  arguments.push_back( outputName );
+  std::vector<char *> argumentPointers;
+  for( auto & argument : arguments )
+    {
+    argumentPointers.push_back( &argument[0] );
+    }
+  if( gtractResampleDWIInPlaceTest( static_cast<int>( argumentPointers.size() ), argumentPointers.data() )
+      != EXIT_SUCCESS )
+    {
+    std::cerr << "gtractResampleDWIInPlace failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  DWIReaderType::Pointer outputReader = DWIReaderType::New();
+  outputReader->SetFileName( outputName );
+  outputReader->Update();
+  const DWIImageType::Pointer outputImage = outputReader->GetOutput();
+  bool                        passed = true;
+  if( outputImage->GetLargestPossibleRegion() != referenceImage->GetLargestPossibleRegion()
+      || !outputImage->GetSpacing().GetVnlVector().is_equal( referenceSpacing.GetVnlVector(), 1e-6 )
+      || !outputImage->GetOrigin().GetVnlVector().is_equal( referenceOrigin.GetVnlVector(), 1e-6 )
+      || !outputImage->GetDirection().GetVnlMatrix().is_equal( referenceImage->GetDirection().GetVnlMatrix(), 1e-6 )
+      || outputImage->GetNumberOfComponentsPerPixel() != inputImage->GetNumberOfComponentsPerPixel() )
+    {
+    std::cerr << "The output is not on the reference grid" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Round-off in the folded index mapping may move a value by one, or
+  // a voxel on the border of the DWI in or out of it.
+  const size_t numberOfPixels = referenceImage->GetLargestPossibleRegion().GetNumberOfPixels();
+  const size_t numberOfComponents = inputImage->GetNumberOfComponentsPerPixel();
+  const size_t allowedBorderDifferences = numberOfPixels / 1000;
+  for( unsigned int c = 0; c < numberOfComponents; ++c )
+    {
+    using SelectFilterType = itk::VectorIndexSelectionCastImageFilter<DWIImageType, ComponentImageType>;
+    SelectFilterType::Pointer select = SelectFilterType::New();
+    select->SetInput( inputImage );
+    select->SetIndex( c );
+    using ResampleFilterType = itk::ResampleImageFilter<ComponentImageType, ComponentImageType>;
+    ResampleFilterType::Pointer resample = ResampleFilterType::New();
+    resample->SetInput( select->GetOutput() );
+    resample->SetTransform( warp );
+    resample->SetOutputParametersFromImage( referenceImage );
+    resample->SetDefaultPixelValue( 0 );
+    resample->Update();
+
+    const signed short *expected = resample->GetOutput()->GetBufferPointer();
+    const signed short *actual = outputImage->GetBufferPointer() + c;
+    size_t              differences = 0;
+    for( size_t p = 0; p < numberOfPixels; ++p, actual += numberOfComponents )
+      {
+      if( std::abs( static_cast<int>( actual[0] ) - static_cast<int>( expected[p] ) ) > 1 )
+        {
+        ++differences;
+        }
+      }
+    if( differences > allowedBorderDifferences )
+      {
+      std::cerr << "Gradient volume " << c << " differs from ResampleImageFilter in " << differences << " voxels"
+                << std::endl;
+      passed = false;
+      }
+    }
+
+  // Identity rigid transform: gradient = Rotation^T * MeasurementFrame^-1 * input gradient
+  DWIMetaDataDictionaryValidator inputValidator;
+  inputValidator.SetMetaDataDictionary( inputImage->GetMetaDataDictionary() );
+  DWIMetaDataDictionaryValidator outputValidator;
+  outputValidator.SetMetaDataDictionary( outputImage->GetMetaDataDictionary() );
+  const DWIMetaDataDictionaryValidator::RotationMatrixType expectedRotation =
+    rotation.GetMatrix().GetTranspose() * inputValidator.GetMeasurementFrame().GetInverse();
+  const DWIMetaDataDictionaryValidator::GradientTableType inputGradients = inputValidator.GetGradientTable();
+  const DWIMetaDataDictionaryValidator::GradientTableType outputGradients = outputValidator.GetGradientTable();
+  if( outputGradients.size() != inputGradients.size() )
+    {
+    std::cerr << "The output has " << outputGradients.size() << " gradients instead of " << inputGradients.size()
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  for( size_t i = 0; i < inputGradients.size(); ++i )
+    {
+    const DWIMetaDataDictionaryValidator::GradientDirectionType expected =
+      expectedRotation.GetVnlMatrix() * inputGradients[i];
+    if( ( outputGradients[i] - expected ).inf_norm() > 1e-6 )
+      {
+      std::cerr << "Gradient " << i << " is " << outputGradients[i] << " instead of " << expected << std::endl;
+      passed = false;
+      }
+    }
+  DWIMetaDataDictionaryValidator::RotationMatrixType identity;
+  identity.SetIdentity();
+  if( !outputValidator.GetMeasurementFrame().GetVnlMatrix().is_equal( identity.GetVnlMatrix(), 1e-6 ) )
+    {
+    std::cerr << "The output measurement frame is not the identity" << std::endl;
+    passed = false;
+    }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,225 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+//
+// Inverts the displacement field of an affine map, x -> c + M (x - c), on an
+// anisotropic and oblique grid, and compares the result with the analytic
+// inverse y -> c + M^-1 (y - c).  The field is linear, so it is interpolated
+// exactly wherever the inverse maps a voxel at least one voxel inside the
+// grid.  At those voxels:
+//  - the inverse must match the analytic inverse, and the residual
+//    |u(y) + v(y + u(y))| of the analytic field must be below the error
+//    tolerance (M has singular values above 1, so the error of the inverse
+//    is below the residual);
+//  - the filter must report them converged, GetNumberOfUnconvergedPixels
+//    counts at most the voxels near the border.
+// With a single iteration and a tolerance below round-off, the filter must
+// report unconverged voxels and a maximum residual above that tolerance.
+//
+
+#include "itkGtractFixedPointInverseDisplacementFieldImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkVersor.h"
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+constexpr unsigned int Dimension = 3;
+using VectorPixelType = itk::Vector<float, Dimension>;
+using DisplacementFieldType = itk::Image<VectorPixelType, Dimension>;
+using InverseFilterType =
+  itk::GtractFixedPointInverseDisplacementFieldImageFilter<DisplacementFieldType, DisplacementFieldType>;
+using MatrixType = itk::Matrix<double, Dimension, Dimension>;
+using PointType = DisplacementFieldType::PointType;
+
+constexpr double ErrorTolerance = 1e-3;
+// The field is stored in float
+constexpr double RoundOffTolerance = 1e-5;
+
+/** v(x) = c + M (x - c) - x */
+itk::Vector<double, Dimension>
+AffineDisplacement(const MatrixType & matrix, const PointType & center, const PointType & point)
+{
+  return ( center + matrix * ( point - center ) ) - point;
+}
+} // end namespace
+
+int main(int, char *[])
+{
+  DisplacementFieldType::SizeType size;
+  size[0] = 32;
+  size[1] = 28;
+  size[2] = 24;
+  DisplacementFieldType::SpacingType spacing;
+  spacing[0] = 2.0;
+  spacing[1] = 2.0;
+  spacing[2] = 2.5;
+  PointType origin;
+  origin[0] = -30.0;
+  origin[1] = -25.0;
+  origin[2] = -20.0;
+  itk::Versor<double>             obliqueness;
+  itk::Versor<double>::VectorType obliqueAxis;
+  obliqueAxis[0] = 0.0;
+  obliqueAxis[1] = 0.0;
+  obliqueAxis[2] = 1.0;
+  obliqueness.Set( obliqueAxis, 10.0 * itk::Math::pi / 180.0 );
+
+  DisplacementFieldType::Pointer forwardField = DisplacementFieldType::New();
+  forwardField->SetRegions( size );
+  forwardField->SetSpacing( spacing );
+  forwardField->SetOrigin( origin );
+  forwardField->SetDirection( obliqueness.GetMatrix() );
+  forwardField->Allocate();
+
+  // A small rotation and an expansion about the center of the grid
+  itk::ContinuousIndex<double, Dimension> centerIndex;
+  for( unsigned int d = 0; d < Dimension; ++d )
+    {
+    centerIndex[d] = 0.5 * ( size[d] - 1 );
+    }
+  PointType center;
+  forwardField->TransformContinuousIndexToPhysicalPoint( centerIndex, center );
+  itk::Versor<double>             rotation;
+  itk::Versor<double>::VectorType axis;
+  axis[0] = 0.2;
+  axis[1] = 0.3;
+  axis[2] = 1.0;
+  rotation.Set( axis, 3.0 * itk::Math::pi / 180.0 );
+  MatrixType scale;
+  scale.SetIdentity();
+  scale[0][0] = 1.15;
+  scale[1][1] = 1.1;
+  scale[2][2] = 1.12;
+  const MatrixType matrix = rotation.GetMatrix() * scale;
+  const MatrixType inverseMatrix( matrix.GetInverse() );
+
+  for( itk::ImageRegionIteratorWithIndex<DisplacementFieldType> it( forwardField,
+                                                                    forwardField->GetLargestPossibleRegion() );
+       !it.IsAtEnd(); ++it )
+    {
+    PointType point;
+    forwardField->TransformIndexToPhysicalPoint( it.GetIndex(), point );
+    const itk::Vector<double, Dimension> displacement = AffineDisplacement( matrix, center, point );
+    VectorPixelType                      value;
+    for( unsigned int i = 0; i < Dimension; ++i )
+      {
+      value[i] = static_cast<float>( displacement[i] );
+      }
+    it.Set( value );
+    }
+
+  bool allPassed = true;
+  try
+    {
+    InverseFilterType::Pointer inverseFilter = InverseFilterType::New();
+    inverseFilter->SetInput( forwardField );
+    inverseFilter->SetErrorTolerance( ErrorTolerance );
+    inverseFilter->Update();
+    const DisplacementFieldType::Pointer inverseField = inverseFilter->GetOutput();
+
+    itk::SizeValueType numberOfInteriorPixels = 0;
+    itk::SizeValueType numberOfBorderPixels = 0;
+    double             maximumInverseError = 0.0;
+    double             maximumResidual = 0.0;
+    for( itk::ImageRegionIteratorWithIndex<DisplacementFieldType> it( inverseField,
+                                                                      inverseField->GetLargestPossibleRegion() );
+         !it.IsAtEnd(); ++it )
+      {
+      PointType point;
+      inverseField->TransformIndexToPhysicalPoint( it.GetIndex(), point );
+      const PointType                         preimage = center + inverseMatrix * ( point - center );
+      itk::ContinuousIndex<double, Dimension> preimageIndex;
+      forwardField->TransformPhysicalPointToContinuousIndex( preimage, preimageIndex );
+      bool interior = true;
+      for( unsigned int d = 0; d < Dimension; ++d )
+        {
+        interior = interior && preimageIndex[d] >= 1.0 && preimageIndex[d] <= size[d] - 2.0;
+        }
+      if( !interior )
+        {
+        ++numberOfBorderPixels;
+        continue;
+        }
+      ++numberOfInteriorPixels;
+
+      itk::Vector<double, Dimension> inverse;
+      for( unsigned int i = 0; i < Dimension; ++i )
+        {
+        inverse[i] = it.Get()[i];
+        }
+      maximumInverseError = std::max( maximumInverseError, ( point + inverse - preimage ).GetNorm() );
+      maximumResidual =
+        std::max( maximumResidual, ( inverse + AffineDisplacement( matrix, center, point + inverse ) ).GetNorm() );
+      }
+
+    std::cout << numberOfInteriorPixels << " interior and " << numberOfBorderPixels << " border voxels, "
+              << inverseFilter->GetNumberOfUnconvergedPixels() << " not converged" << std::endl;
+    std::cout << "Largest error of the inverse " << maximumInverseError << ", largest residual " << maximumResidual
+              << ", filter mean and max residual " << inverseFilter->GetMeanErrorNorm() << " "
+              << inverseFilter->GetMaxErrorNorm() << std::endl;
+    if( numberOfInteriorPixels < 3 * numberOfBorderPixels )
+      {
+      std::cerr << "Too few voxels are mapped inside the grid for the test to be meaningful" << std::endl;
+      allPassed = false;
+      }
+    if( maximumInverseError > ErrorTolerance + RoundOffTolerance )
+      {
+      std::cerr << "The inverse differs from the analytic inverse by " << maximumInverseError << std::endl;
+      allPassed = false;
+      }
+    if( maximumResidual > ErrorTolerance + RoundOffTolerance )
+      {
+      std::cerr << "The residual " << maximumResidual << " is above the tolerance" << std::endl;
+      allPassed = false;
+      }
+    if( inverseFilter->GetNumberOfUnconvergedPixels() > numberOfBorderPixels )
+      {
+      std::cerr << "Interior voxels are reported unconverged" << std::endl;
+      allPassed = false;
+      }
+    if( !( inverseFilter->GetMeanErrorNorm() <= inverseFilter->GetMaxErrorNorm() ) )
+      {
+      std::cerr << "The mean residual is above the max residual" << std::endl;
+      allPassed = false;
+      }
+
+    // One iteration can not reach a tolerance below round-off.
+    InverseFilterType::Pointer truncatedFilter = InverseFilterType::New();
+    truncatedFilter->SetInput( forwardField );
+    truncatedFilter->SetErrorTolerance( 1e-12 );
+    truncatedFilter->SetMaximumNumberOfIterations( 1 );
+    truncatedFilter->Update();
+    std::cout << "One iteration: " << truncatedFilter->GetNumberOfUnconvergedPixels() << " not converged, max residual "
+              << truncatedFilter->GetMaxErrorNorm() << std::endl;
+    if( truncatedFilter->GetNumberOfUnconvergedPixels() < numberOfInteriorPixels
+        || !( truncatedFilter->GetMaxErrorNorm() > 1e-12 ) )
+      {
+      std::cerr << "Unconverged voxels are not reported" << std::endl;
+      allPassed = false;
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return allPassed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
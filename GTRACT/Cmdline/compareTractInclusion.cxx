@@ -34,8 +34,12 @@
 
 =========================================================================*/
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <vector>
 
 #include <vtkPoints.h>
 #include <vtkFloatArray.h>
@@ -61,57 +65,293 @@
 #include "BRAINSThreadControl.h"
 #include <BRAINSCommonLib.h>
 
-double PairOffFibers(vtkPolyData *resampledTestFibers, vtkPolyData *resampledStandardFibers, int numberOfPoints)
+/** The polylines of a resampled tract, the first numberOfPoints points of
+ * each stored contiguously, with their centroids. */
+struct FiberSetType
+  {
+  std::vector<vtkIdType> CellIds;
+  std::vector<double>    Points;
+  std::vector<double>    Centroids;
+  };
+
+/** Two distances are compared with this relative slack, so the bounds below
+ * never reject a fiber that ties with the closest one after rounding. */
+const double FiberDistanceTolerance = 1.0e-12;
+
+bool GetFiberSet(vtkPolyData *fibers, const int numberOfPoints, FiberSetType & fiberSet)
 {
-  double maxDistances = 0.0;
+  vtkIdList *pointList = vtkIdList::New();
+  for( vtkIdType j = 0; j < fibers->GetNumberOfCells(); j++ )
+    {
+    if( fibers->GetCellType(j) != VTK_POLY_LINE )
+      {
+      continue;
+      }
+    fibers->GetCellPoints(j, pointList);
+    if( pointList->GetNumberOfIds() < numberOfPoints )
+      {
+      std::cout << "Fiber " << j << " has " << pointList->GetNumberOfIds() << " points, fewer than "
+                << numberOfPoints << std::endl;
+      pointList->Delete();
+      return false;
+      }
+    double centroid[3] = { 0.0, 0.0, 0.0 };
+    for( int i = 0; i < numberOfPoints; i++ )
+      {
+      double point[3];
+      fibers->GetPoint(pointList->GetId(i), point);
+      for( int p = 0; p < 3; p++ )
+        {
+        fiberSet.Points.push_back(point[p]);
+        centroid[p] += point[p];
+        }
+      }
+    for( int p = 0; p < 3; p++ )
+      {
+      fiberSet.Centroids.push_back(centroid[p] / numberOfPoints);
+      }
+    fiberSet.CellIds.push_back(j);
+    }
+  pointList->Delete();
+  return true;
+}
 
-  for( int j = 0; j < resampledTestFibers->GetNumberOfCells(); j++ )
+/** Mean distance of corresponding points, or infinity as soon as the
+ * partial sum shows it is larger than limit. */
+double MeanPointDistance(const double *testPoints, const double *standardPoints, const int numberOfPoints,
+                         const double limit)
+{
+  const double sumLimit = limit * numberOfPoints * ( 1.0 + FiberDistanceTolerance );
+  double       sumDist = 0.0;
+  for( int i = 0; i < numberOfPoints; i++ )
     {
-    if( resampledTestFibers->GetCellType(j) == VTK_POLY_LINE )
+    double sumSquares = 0.0;
+    for( int p = 0; p < 3; p++ )
+      {
+      double edge = testPoints[3 * i + p] - standardPoints[3 * i + p];
+      sumSquares += edge * edge;
+      }
+    sumDist += std::sqrt(sumSquares);
+    if( sumDist > sumLimit )
+      {
+      return std::numeric_limits<double>::infinity();
+      }
+    }
+  return sumDist / numberOfPoints;
+}
+
+/** Uniform grid of fiber centroids.  The mean distance of corresponding
+ * points of two fibers is at least the distance of their centroids, so the
+ * closest fiber is searched ring by ring of cells around the query centroid,
+ * skipping fibers whose centroid is farther than the closest fiber found so
+ * far, and stops once every remaining cell is farther than that. */
+class FiberCentroidGrid
+{
+public:
+  FiberCentroidGrid(const FiberSetType & fibers, const int numberOfPoints) :
+    m_Fibers(fibers),
+    m_NumberOfPoints(numberOfPoints),
+    m_CellSize(1.0)
+  {
+    const size_t numberOfFibers = fibers.CellIds.size();
+    double       upper[3];
+    for( int d = 0; d < 3; d++ )
+      {
+      m_Origin[d] = numberOfFibers > 0 ? fibers.Centroids[d] : 0.0;
+      upper[d] = m_Origin[d];
+      }
+    for( size_t f = 0; f < numberOfFibers; f++ )
       {
-      vtkIdList *testPointList = vtkIdList::New();
-      resampledTestFibers->GetCellPoints(j, testPointList);
-      double minDist = 1E200;
-      int    closestK = -1;
-      for( int k = 0; k < resampledStandardFibers->GetNumberOfCells(); k++ )
+      for( int d = 0; d < 3; d++ )
         {
-        if( resampledStandardFibers->GetCellType(k) == VTK_POLY_LINE )
+        m_Origin[d] = std::min(m_Origin[d], fibers.Centroids[3 * f + d]);
+        upper[d] = std::max(upper[d], fibers.Centroids[3 * f + d]);
+        }
+      }
+    // About one fiber per cell along the longest axis.
+    const double extent = std::max(upper[0] - m_Origin[0], std::max(upper[1] - m_Origin[1], upper[2] - m_Origin[2]) );
+    if( extent > 0.0 )
+      {
+      m_CellSize = extent / std::max(1.0, std::cbrt(static_cast<double>( numberOfFibers ) ) );
+      }
+    size_t numberOfCells = 1;
+    for( int d = 0; d < 3; d++ )
+      {
+      m_Size[d] = static_cast<int>( ( upper[d] - m_Origin[d] ) / m_CellSize ) + 1;
+      numberOfCells *= m_Size[d];
+      }
+
+    m_CellStart.assign(numberOfCells + 1, 0);
+    std::vector<size_t> fiberCell(numberOfFibers);
+    for( size_t f = 0; f < numberOfFibers; f++ )
+      {
+      int cellIndex[3];
+      this->GetCellIndex(&fibers.Centroids[3 * f], cellIndex);
+      fiberCell[f] = this->GetCellOffset(cellIndex[0], cellIndex[1], cellIndex[2]);
+      ++m_CellStart[fiberCell[f] + 1];
+      }
+    for( size_t c = 0; c < numberOfCells; c++ )
+      {
+      m_CellStart[c + 1] += m_CellStart[c];
+      }
+    m_CellFibers.resize(numberOfFibers);
+    std::vector<size_t> cellFill(m_CellStart.begin(), m_CellStart.end() - 1);
+    for( size_t f = 0; f < numberOfFibers; f++ )
+      {
+      m_CellFibers[cellFill[fiberCell[f]]++] = f;
+      }
+  }
+
+  /** Closest fiber to fiber testIndex of testFibers, the one with the
+   * smallest cell id among ties.  closest is -1 when there are no fibers. */
+  void FindClosestFiber(const FiberSetType & testFibers, const size_t testIndex, double & minDist,
+                        vtkIdType & closest) const
+  {
+    minDist = 1E200;
+    closest = -1;
+    if( m_Fibers.CellIds.empty() )
+      {
+      return;
+      }
+    const double *testCentroid = &testFibers.Centroids[3 * testIndex];
+    const double *testPoints = &testFibers.Points[3 * m_NumberOfPoints * testIndex];
+    int           center[3];
+    this->GetCellIndex(testCentroid, center);
+
+    auto visitCell = [&](const int x, const int y, const int z)
+      {
+        if( x < 0 || y < 0 || z < 0 || x >= m_Size[0] || y >= m_Size[1] || z >= m_Size[2] )
+          {
+          return;
+          }
+        const size_t cell = this->GetCellOffset(x, y, z);
+        for( size_t c = m_CellStart[cell]; c < m_CellStart[cell + 1]; c++ )
           {
-          vtkIdList *standardPointList = vtkIdList::New();
-          resampledStandardFibers->GetCellPoints(k, standardPointList);
-          double sumDist = 0.0;
-          for( int i = 0; i < numberOfPoints; i++ )
+          const size_t f = m_CellFibers[c];
+          double       centroidSquares = 0.0;
+          for( int p = 0; p < 3; p++ )
             {
-            double testPoint[3];
-            resampledTestFibers->GetPoint(testPointList->GetId(i), testPoint);
-
-            double standardPoint[3];
-            resampledStandardFibers->GetPoint(standardPointList->GetId(i), standardPoint);
+            const double edge = testCentroid[p] - m_Fibers.Centroids[3 * f + p];
+            centroidSquares += edge * edge;
+            }
+          if( std::sqrt(centroidSquares) > minDist * ( 1.0 + FiberDistanceTolerance ) )
+            {
+            continue;
+            }
+          const double dist = MeanPointDistance(testPoints, &m_Fibers.Points[3 * m_NumberOfPoints * f],
+                                                m_NumberOfPoints, minDist);
+          if( dist < minDist || ( dist == minDist && m_Fibers.CellIds[f] < closest ) )
+            {
+            minDist = dist;
+            closest = m_Fibers.CellIds[f];
+            }
+          }
+      };
 
-            double sumSquares = 0.0;
-            for( int p = 0; p < 3; p++ )
+    for( int r = 0; ; r++ )
+      {
+      // The cells at Chebyshev distance r from the center cell.
+      for( int dz = -r; dz <= r; dz++ )
+        {
+        for( int dy = -r; dy <= r; dy++ )
+          {
+          if( dz == -r || dz == r || dy == -r || dy == r )
+            {
+            for( int dx = -r; dx <= r; dx++ )
               {
-              double edge = testPoint[p] - standardPoint[p];
-              sumSquares += edge * edge;
+              visitCell(center[0] + dx, center[1] + dy, center[2] + dz);
               }
-            sumDist += std::sqrt(sumSquares);
             }
-
-          double dist = ( sumDist / numberOfPoints );
-          if( dist < minDist )
+          else
             {
-            minDist = dist;
-            closestK = k;
+            visitCell(center[0] - r, center[1] + dy, center[2] + dz);
+            if( r > 0 )
+              {
+              visitCell(center[0] + r, center[1] + dy, center[2] + dz);
+              }
             }
           }
         }
 
-      std::cout << "Pairing test fiber " << j << " with standard fiber " << closestK << " at distance " << minDist
-                << std::endl;
-      if( maxDistances < minDist )
+      // Lower bound of the distance to the cells beyond ring r.
+      bool   cellsRemain = false;
+      double remainingDistance = std::numeric_limits<double>::infinity();
+      for( int d = 0; d < 3; d++ )
         {
-        maxDistances = minDist;
+        if( center[d] + r + 1 < m_Size[d] )
+          {
+          cellsRemain = true;
+          remainingDistance = std::min(remainingDistance,
+                                       m_Origin[d] + ( center[d] + r + 1 ) * m_CellSize - testCentroid[d]);
+          }
+        if( center[d] - r - 1 >= 0 )
+          {
+          cellsRemain = true;
+          remainingDistance = std::min(remainingDistance,
+                                       testCentroid[d] - ( m_Origin[d] + ( center[d] - r ) * m_CellSize ) );
+          }
         }
+      if( !cellsRemain || remainingDistance > minDist * ( 1.0 + FiberDistanceTolerance ) )
+        {
+        return;
+        }
+      }
+  }
+
+private:
+  void GetCellIndex(const double *point, int cellIndex[3]) const
+  {
+    for( int d = 0; d < 3; d++ )
+      {
+      const double index = std::floor( ( point[d] - m_Origin[d] ) / m_CellSize );
+      cellIndex[d] = static_cast<int>( std::max(0.0, std::min(index, static_cast<double>( m_Size[d] - 1 ) ) ) );
+      }
+  }
+
+  size_t GetCellOffset(const int x, const int y, const int z) const
+  {
+    return ( static_cast<size_t>( z ) * m_Size[1] + y ) * m_Size[0] + x;
+  }
+
+  const FiberSetType & m_Fibers;
+  const int            m_NumberOfPoints;
+  double               m_Origin[3];
+  double               m_CellSize;
+  int                  m_Size[3];
+  std::vector<size_t>  m_CellStart;
+  std::vector<size_t>  m_CellFibers;
+};
+
+double PairOffFibers(vtkPolyData *resampledTestFibers, vtkPolyData *resampledStandardFibers, int numberOfPoints)
+{
+  FiberSetType testFibers;
+  FiberSetType standardFibers;
+  if( !GetFiberSet(resampledTestFibers, numberOfPoints, testFibers)
+      || !GetFiberSet(resampledStandardFibers, numberOfPoints, standardFibers) )
+    {
+    return std::numeric_limits<double>::quiet_NaN();
+    }
+  const FiberCentroidGrid standardGrid(standardFibers, numberOfPoints);
+
+  const size_t           numberOfTestFibers = testFibers.CellIds.size();
+  std::vector<double>    minDistances(numberOfTestFibers);
+  std::vector<vtkIdType> closestFibers(numberOfTestFibers);
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfTestFibers,
+                        [&](itk::SizeValueType j)
+                          {
+                            standardGrid.FindClosestFiber(testFibers, j, minDistances[j], closestFibers[j]);
+                          },
+                        nullptr );
+
+  double maxDistances = 0.0;
+  for( size_t j = 0; j < numberOfTestFibers; j++ )
+    {
+    std::cout << "Pairing test fiber " << testFibers.CellIds[j] << " with standard fiber " << closestFibers[j]
+              << " at distance " << minDistances[j] << std::endl;
+    if( maxDistances < minDistances[j] )
+      {
+      maxDistances = minDistances[j];
       }
     }
   return maxDistances;
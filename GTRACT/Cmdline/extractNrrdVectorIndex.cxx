@@ -43,12 +43,12 @@
 #include <itkVectorImage.h>
 #include <itkImageFileWriter.h>
 #include <itkImageFileReader.h>
-#include <itkVectorIndexSelectionCastImageFilter.h>
 #include "itkMetaDataObject.h"
 #include "itkIOCommon.h"
 
 #include "extractNrrdVectorIndexCLP.h"
 #include "BRAINSThreadControl.h"
+#include "VectorImageComponents.h"
 #include <BRAINSCommonLib.h>
 #include "DWIConvertLib.h"
 
@@ -109,24 +109,19 @@ int main(int argc, char *argv[])
     }
 
   using IndexImageType = itk::Image<PixelType, 3>;
-  using VectorSelectFilterType = itk::VectorIndexSelectionCastImageFilter<NrrdImageType, IndexImageType>;
-  using VectorSelectFilterPointer = VectorSelectFilterType::Pointer;
 
-  VectorSelectFilterPointer SelectIndexImageFilter = VectorSelectFilterType::New();
-  SelectIndexImageFilter->SetIndex( vectorIndex );
-  SelectIndexImageFilter->SetInput( reader->GetOutput() );
-  try
-    {
-    SelectIndexImageFilter->Update();
-    }
-  catch( itk::ExceptionObject & e )
-    {
-    std::cout << e << std::endl;
-    }
+  // Copy the selected component straight out of the interleaved buffer.
+  IndexImageType::Pointer indexImage = IndexImageType::New();
+  indexImage->CopyInformation( reader->GetOutput() );
+  indexImage->SetRegions( reader->GetOutput()->GetLargestPossibleRegion() );
+  indexImage->Allocate();
+  const std::vector<BRAINSUtils::ComponentView<PixelType> > selectedComponent(
+    1, BRAINSUtils::GetComponentView( reader->GetOutput(), vectorIndex ) );
+  BRAINSUtils::GatherComponents( selectedComponent, indexImage->GetLargestPossibleRegion().GetNumberOfPixels(),
+                                 indexImage->GetBufferPointer() );
 
   /* Hack Required for Certain Output Image Types */
   itk::MetaDataDictionary       meta;
-  IndexImageType::Pointer       indexImage = SelectIndexImageFilter->GetOutput();
   IndexImageType::DirectionType fixImageDir = indexImage->GetDirection();
 #define EncapsulateMD(image, flag) {}
   if( setImageOrientation == "Axial"  ||  setImageOrientation == "AXIAL"  ||  setImageOrientation == "axial" )
@@ -170,8 +165,5 @@ int main(int argc, char *argv[])
     std::cout << e << std::endl;
     }
 
-  // IndexImageType::Pointer indexImage = SelectIndexImageFilter->GetOutput();
-  // std::cout << "Index Image: "<< indexImage  << std::endl;
-
   return EXIT_SUCCESS;
 }
@@ -42,6 +42,8 @@
 #include <itkImageRegionConstIterator.h>
 #include <itkImageFileWriter.h>
 #include <itkImageFileReader.h>
+#include <itkMultiThreaderBase.h>
+#include <itksys/SystemTools.hxx>
 
 /* Defines the Additional Anisotropy Metrics */
 #include "../Common/gtractDiffusionTensor3D.h"
@@ -51,6 +53,57 @@
 #include "BRAINSThreadControl.h"
 #include <BRAINSCommonLib.h>
 
+namespace
+{
+enum AnisotropyMapType
+  {
+  ADC_MAP,
+  FA_MAP,
+  RA_MAP,
+  VR_MAP,
+  AD_MAP,
+  RD_MAP,
+  LI_MAP,
+  UNKNOWN_MAP
+  };
+
+AnisotropyMapType
+ParseAnisotropyType(const std::string & anisotropyType)
+{
+  const std::string code = itksys::SystemTools::UpperCase(anisotropyType);
+
+  if( code == "ADC" )
+    {
+    return ADC_MAP;
+    }
+  else if( code == "FA" )
+    {
+    return FA_MAP;
+    }
+  else if( code == "RA" )
+    {
+    return RA_MAP;
+    }
+  else if( code == "VR" )
+    {
+    return VR_MAP;
+    }
+  else if( code == "AD" )
+    {
+    return AD_MAP;
+    }
+  else if( code == "RD" )
+    {
+    return RD_MAP;
+    }
+  else if( code == "LI" )
+    {
+    return LI_MAP;
+    }
+  return UNKNOWN_MAP;
+}
+}
+
 int main(int argc, char *argv[])
 {
   using TensorComponentType = double;
@@ -69,6 +122,11 @@ int main(int argc, char *argv[])
     std::cout << "Input Tensor Image: " <<  inputTensorVolume << std::endl;
     std::cout << "Output Anisotropy Image: " <<  outputVolume << std::endl;
     std::cout << "Anisotropy Type: " <<  anisotropyType << std::endl;
+    for( size_t i = 0; i < additionalAnisotropyTypes.size() && i < additionalOutputVolumes.size(); ++i )
+      {
+      std::cout << "Additional Anisotropy Image: " << additionalOutputVolumes[i]
+                << " (" << additionalAnisotropyTypes[i] << ")" << std::endl;
+      }
     std::cout << "=====================================================" << std::endl;
     }
 
@@ -81,11 +139,38 @@ int main(int argc, char *argv[])
     {
     violated = true; std::cout << "  --outputVolume Required! "  << std::endl;
     }
+  if( additionalAnisotropyTypes.size() != additionalOutputVolumes.size() )
+    {
+    violated = true;
+    std::cout << "  --additionalAnisotropyTypes and --additionalOutputVolumes must have the same length! "
+              << std::endl;
+    }
   if( violated )
     {
     return EXIT_FAILURE;
     }
 
+  // All requested maps are filled in one pass over the tensors
+  std::vector<AnisotropyMapType> mapTypes;
+  std::vector<std::string>       mapFileNames;
+  mapTypes.push_back( ParseAnisotropyType(anisotropyType) );
+  mapFileNames.push_back(outputVolume);
+  for( size_t i = 0; i < additionalAnisotropyTypes.size(); ++i )
+    {
+    mapTypes.push_back( ParseAnisotropyType(additionalAnisotropyTypes[i]) );
+    mapFileNames.push_back(additionalOutputVolumes[i]);
+    }
+  bool needsEigenValues = false;
+  for( size_t i = 0; i < mapTypes.size(); ++i )
+    {
+    if( mapTypes[i] == UNKNOWN_MAP )
+      {
+      std::cout << "Unknown anisotropy type for " << mapFileNames[i] << std::endl;
+      return EXIT_FAILURE;
+      }
+    needsEigenValues |= ( mapTypes[i] == AD_MAP || mapTypes[i] == RD_MAP );
+    }
+
   using TensorImageReaderType = itk::ImageFileReader<TensorImageType>;
   TensorImageReaderType::Pointer tensorImageReader = TensorImageReaderType::New();
   tensorImageReader->SetFileName( inputTensorVolume );
@@ -102,66 +187,101 @@ int main(int argc, char *argv[])
 
   TensorImageType::Pointer tensorImage = tensorImageReader->GetOutput();
 
-  AnisotropyImageType::Pointer anisotropyImage =  AnisotropyImageType::New();
-  anisotropyImage->SetRegions( tensorImage->GetLargestPossibleRegion() );
-  anisotropyImage->SetSpacing( tensorImage->GetSpacing() );
-  anisotropyImage->SetOrigin( tensorImage->GetOrigin() );
-  anisotropyImage->SetDirection( tensorImage->GetDirection() );
-  anisotropyImage->Allocate();
+  std::vector<AnisotropyImageType::Pointer> anisotropyImages;
+  for( size_t i = 0; i < mapTypes.size(); ++i )
+    {
+    AnisotropyImageType::Pointer anisotropyImage =  AnisotropyImageType::New();
+    anisotropyImage->SetRegions( tensorImage->GetLargestPossibleRegion() );
+    anisotropyImage->SetSpacing( tensorImage->GetSpacing() );
+    anisotropyImage->SetOrigin( tensorImage->GetOrigin() );
+    anisotropyImage->SetDirection( tensorImage->GetDirection() );
+    anisotropyImage->Allocate();
+    anisotropyImages.push_back(anisotropyImage);
+    }
 
   using IteratorType = itk::ImageRegionIterator<AnisotropyImageType>;
-  IteratorType anisoIt( anisotropyImage, anisotropyImage->GetRequestedRegion() );
-
   using ConstIteratorType = itk::ImageRegionConstIterator<TensorImageType>;
-  ConstIteratorType tensorIt( tensorImage, tensorImage->GetRequestedRegion() );
 
-  float anisotropy = 0.0;
-  for( anisoIt.GoToBegin(), tensorIt.GoToBegin(); !anisoIt.IsAtEnd(); ++anisoIt, ++tensorIt )
-    {
-    TensorPixelType tensorPixel = tensorIt.Get();
-    if( anisotropyType == "ADC"  ||  anisotropyType == "adc" )
-      {
-      anisotropy = static_cast<float>( tensorPixel.GetTrace() / 3.0 );
-      }
-    else if( anisotropyType == "FA"  ||  anisotropyType == "fa" )
-      {
-      anisotropy = static_cast<float>( tensorPixel.GetFractionalAnisotropy() );
-      }
-    else if( anisotropyType == "RA"  ||  anisotropyType == "ra" )
-      {
-      anisotropy = static_cast<float>( tensorPixel.GetRelativeAnisotropy() );
-      }
-    else if( anisotropyType == "VR"  ||  anisotropyType == "vr" )
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeImageRegion<TensorImageType::ImageDimension>(
+    tensorImage->GetLargestPossibleRegion(),
+    [&](const TensorImageType::RegionType & region)
       {
-      anisotropy = static_cast<float>( tensorPixel.GetVolumeRatio() );
-      }
-    else if( anisotropyType == "AD"  ||  anisotropyType == "ad" )
-      {
-      anisotropy = static_cast<float>( tensorPixel.GetAxialDiffusivity() );
-      }
-    else if( anisotropyType == "RD"  ||  anisotropyType == "rd" )
+        ConstIteratorType         tensorIt( tensorImage, region );
+        std::vector<IteratorType> anisoIts;
+        for( size_t i = 0; i < anisotropyImages.size(); ++i )
+          {
+          anisoIts.emplace_back( anisotropyImages[i], region );
+          }
+
+        // Eigenvalue magnitudes, ascending, as GetAxialDiffusivity and
+        // GetRadialDiffusivity of the tensor pixel use them
+        TVector eigenValues(3, 0.0F);
+        for( tensorIt.GoToBegin(); !tensorIt.IsAtEnd(); ++tensorIt )
+          {
+          const TensorPixelType tensorPixel = tensorIt.Get();
+          if( needsEigenValues )
+            {
+            const double components[6] = { tensorPixel[0], tensorPixel[1], tensorPixel[2],
+                                           tensorPixel[3], tensorPixel[4], tensorPixel[5] };
+            double       eig[3];
+            SymmetricEigenValues3(components, eig);
+            for( unsigned int e = 0; e < 3; ++e )
+              {
+              eigenValues[e] = static_cast<float>( itk::Math::abs( eig[e] ) );
+              }
+            }
+          for( size_t i = 0; i < mapTypes.size(); ++i )
+            {
+            float anisotropy = 0.0;
+            switch( mapTypes[i] )
+              {
+              case ADC_MAP:
+                anisotropy = static_cast<float>( tensorPixel.GetTrace() / 3.0 );
+                break;
+              case FA_MAP:
+                anisotropy = static_cast<float>( tensorPixel.GetFractionalAnisotropy() );
+                break;
+              case RA_MAP:
+                anisotropy = static_cast<float>( tensorPixel.GetRelativeAnisotropy() );
+                break;
+              case VR_MAP:
+                anisotropy = static_cast<float>( tensorPixel.GetVolumeRatio() );
+                break;
+              case AD_MAP:
+                anisotropy = AxialDiffusivity( eigenValues );
+                break;
+              case RD_MAP:
+                anisotropy = RadialDiffusivity( eigenValues );
+                break;
+              case LI_MAP:
+                anisotropy = static_cast<float>( tensorPixel.GetLatticeIndex() );
+                break;
+              default:
+                break;
+              }
+            anisoIts[i].Set( anisotropy );
+            ++anisoIts[i];
+            }
+          }
+      },
+    nullptr);
+
+  using WriterType = itk::ImageFileWriter<AnisotropyImageType>;
+  for( size_t i = 0; i < anisotropyImages.size(); ++i )
+    {
+    WriterType::Pointer anisotropyWriter = WriterType::New();
+    anisotropyWriter->UseCompressionOn();
+    anisotropyWriter->SetInput( anisotropyImages[i] );
+    anisotropyWriter->SetFileName( mapFileNames[i] );
+    try
       {
-      anisotropy = static_cast<float>( tensorPixel.GetRadialDiffusivity() );
+      anisotropyWriter->Update();
       }
-    else if( anisotropyType == "LI"  ||  anisotropyType == "li" )
+    catch( itk::ExceptionObject & e )
       {
-      anisotropy = static_cast<float>( tensorPixel.GetLatticeIndex() );
+      std::cout << e << std::endl;
       }
-    anisoIt.Set( anisotropy );
-    }
-
-  using WriterType = itk::ImageFileWriter<AnisotropyImageType>;
-  WriterType::Pointer anisotropyWriter = WriterType::New();
-  anisotropyWriter->UseCompressionOn();
-  anisotropyWriter->SetInput( anisotropyImage );
-  anisotropyWriter->SetFileName( outputVolume );
-  try
-    {
-    anisotropyWriter->Update();
-    }
-  catch( itk::ExceptionObject & e )
-    {
-    std::cout << e << std::endl;
     }
   return EXIT_SUCCESS;
 }
@@ -48,11 +48,11 @@
 #include <itkMetaDataObject.h>
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
-#include <itkVectorIndexSelectionCastImageFilter.h>
 
 #include "gtractAverageBvaluesCLP.h"
 #include "BRAINSThreadControl.h"
 #include "DWIMetaDataDictionaryValidator.h"
+#include "VectorImageComponents.h"
 #include <BRAINSCommonLib.h>
 #include "DWIConvertLib.h"
 
@@ -104,10 +104,8 @@ int main(int argc, char *argv[])
 
   using PixelType = signed short;
   using NrrdImageType = itk::VectorImage<PixelType, 3>;
-  using IndexImageType = itk::Image<PixelType, 3>;
 
   using AvgPixelType = float;
-  using NrrdAvgImageType = itk::VectorImage<AvgPixelType, 3>;
 
   using FileReaderType = itk::ImageFileReader<NrrdImageType,
                                itk::DefaultConvertPixelTraits<PixelType> >;
@@ -151,14 +149,6 @@ int main(int argc, char *argv[])
   // for (int i=0;i<vectorLength;i++)
   //  std::cout << i << " " << lut[i] << " " << count[i] << std::endl;
 
-  NrrdAvgImageType::Pointer avgImage = NrrdAvgImageType::New();
-  avgImage->SetRegions( imageReader->GetOutput()->GetLargestPossibleRegion() );
-  avgImage->SetSpacing( imageReader->GetOutput()->GetSpacing() );
-  avgImage->SetOrigin( imageReader->GetOutput()->GetOrigin() );
-  avgImage->SetDirection( imageReader->GetOutput()->GetDirection() );
-  avgImage->SetVectorLength( numUniqueDirections );
-  avgImage->Allocate();
-
   NrrdImageType::Pointer outputImage = NrrdImageType::New();
   outputImage->SetRegions( imageReader->GetOutput()->GetLargestPossibleRegion() );
   outputImage->SetSpacing( imageReader->GetOutput()->GetSpacing() );
@@ -167,43 +157,15 @@ int main(int argc, char *argv[])
   outputImage->SetVectorLength( numUniqueDirections );
   outputImage->Allocate();
 
-  using ExtractImageFilterType = itk::VectorIndexSelectionCastImageFilter<NrrdImageType, IndexImageType>;
-  ExtractImageFilterType::Pointer extractImageFilter = ExtractImageFilterType::New();
-  extractImageFilter->SetInput( imageReader->GetOutput() );
-
-  using ConstIndexImageIteratorType = itk::ImageRegionConstIterator<IndexImageType>;
-  using VectorImageIteratorType = itk::ImageRegionIterator<NrrdAvgImageType>;
-  using VectorOutputImageIteratorType = itk::ImageRegionIterator<NrrdImageType>;
+  // Average the gradients of each unique direction in a single pass over the voxels.
+  std::vector<std::vector<BRAINSUtils::ComponentView<PixelType> > > directionGroups( numUniqueDirections );
   for( int i = 0; i < vectorLength; i++ )
     {
-    int currentIndex = lut[i];
-
-    extractImageFilter->SetIndex( i );
-    extractImageFilter->Update();
-
-    ConstIndexImageIteratorType it( extractImageFilter->GetOutput(),
-                                    extractImageFilter->GetOutput()->GetRequestedRegion() );
-    VectorImageIteratorType ot( avgImage, avgImage->GetRequestedRegion() );
-    for( ot.GoToBegin(), it.GoToBegin(); !ot.IsAtEnd(); ++ot, ++it )
-      {
-      NrrdAvgImageType::PixelType vectorImagePixel = ot.Get();
-      vectorImagePixel[currentIndex] += static_cast<AvgPixelType>( it.Value() );
-      ot.Set( vectorImagePixel );
-      }
-    }
-
-  VectorOutputImageIteratorType tmpt( outputImage, outputImage->GetRequestedRegion() );
-  VectorImageIteratorType       ot( avgImage, avgImage->GetRequestedRegion() );
-  for( ot.GoToBegin(), tmpt.GoToBegin(); !ot.IsAtEnd(); ++ot, ++tmpt )
-    {
-    NrrdAvgImageType::PixelType vectorImagePixel = ot.Get();
-    NrrdImageType::PixelType    outputImagePixel = tmpt.Get();
-    for( int i = 0; i < numUniqueDirections; i++ )
-      {
-      outputImagePixel[i] = static_cast<PixelType>( vectorImagePixel[i] / static_cast<AvgPixelType>( count[i] ) );
-      }
-    tmpt.Set( outputImagePixel );
+    directionGroups[lut[i]].push_back( BRAINSUtils::GetComponentView( imageReader->GetOutput(), i ) );
     }
+  BRAINSUtils::AverageComponents<AvgPixelType>( directionGroups,
+                                                outputImage->GetLargestPossibleRegion().GetNumberOfPixels(),
+                                                outputImage->GetBufferPointer() );
 
   /* Update the Meta data Header */
   DWIMetaDataDictionaryValidator metaDataValidator;
@@ -273,8 +235,8 @@ int buildDirectionLut(itk::Array<int> & lut,
         {
         if( lut[i] == 0 )
           {
-          lut[i] = j;
-          count[j]++;
+          lut[i] = lut[j];
+          count[lut[j]]++;
           break;
           }
         }
@@ -47,13 +47,12 @@
 #include <itkMetaDataObject.h>
 #include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
-#include <itkVectorIndexSelectionCastImageFilter.h>
-#include <itkComposeImageFilter.h>
 #include "itkNumberToString.h"
 
 
 #include "BRAINSThreadControl.h"
 #include "DWIMetaDataDictionaryValidator.h"
+#include "VectorImageComponents.h"
 #include <BRAINSCommonLib.h>
 
 #include "gtractConcatDwiCLP.h"
@@ -102,7 +101,6 @@ int main(int argc, char *argv[])
 
   using PixelType = signed short;
   using NrrdImageType = itk::VectorImage<PixelType, 3>;
-  using IndexImageType = itk::Image<PixelType, 3>;
 
   using FileReaderType = itk::ImageFileReader<NrrdImageType,
                                itk::DefaultConvertPixelTraits<PixelType> >;
@@ -111,11 +109,10 @@ int main(int argc, char *argv[])
   DWIMetaDataDictionaryValidator resultMetaDataValidator;
   DWIMetaDataDictionaryValidator::GradientTableType resultGradTable;
 
-  using VectorImageFilterType = itk::ComposeImageFilter<IndexImageType>;
-  VectorImageFilterType::Pointer indexImageToVectorImageFilter = VectorImageFilterType::New();
-
-  int                            vectorIndex = 0;
-  double                         baselineBvalue = 0.0;
+  // Every input stays in memory and is gathered into the result in one pass.
+  std::vector<NrrdImageType::Pointer>                 inputImages;
+  std::vector<BRAINSUtils::ComponentView<PixelType> > componentViews;
+  double                                              baselineBvalue = 0.0;
 
   NrrdImageType::PointType firstOrigin;
   for( unsigned i = 0; i < inputVolume.size(); i++ )
@@ -132,19 +129,26 @@ int main(int argc, char *argv[])
       std::cout << ex << std::endl << std::flush;
       throw;
       }
+    NrrdImageType::Pointer currentImage = imageReader->GetOutput();
 
-    currentMetaDataValidator.SetMetaDataDictionary(imageReader->GetOutput()->GetMetaDataDictionary());
-    NrrdImageType::PointType currentOrigin = imageReader->GetOutput()->GetOrigin();
+    currentMetaDataValidator.SetMetaDataDictionary(currentImage->GetMetaDataDictionary());
+    NrrdImageType::PointType currentOrigin = currentImage->GetOrigin();
     if( i == 0 )
       {
       firstOrigin = currentOrigin;
 
-      resultMetaDataValidator.SetMetaDataDictionary(imageReader->GetOutput()->GetMetaDataDictionary());
+      resultMetaDataValidator.SetMetaDataDictionary(currentImage->GetMetaDataDictionary());
       resultMetaDataValidator.DeleteGradientTable();
       baselineBvalue = resultMetaDataValidator.GetBValue();
       }
     else
       {
+      if( currentImage->GetLargestPossibleRegion() != inputImages[0]->GetLargestPossibleRegion() )
+        {
+        std::cerr << "Image sizes differ " << inputImages[0]->GetLargestPossibleRegion().GetSize()
+                  << " " << currentImage->GetLargestPossibleRegion().GetSize() << std::endl;
+        return EXIT_FAILURE;
+        }
       double distance =
         std::sqrt(firstOrigin.SquaredEuclideanDistanceTo(currentOrigin) );
       if( !ignoreOrigins && distance > 1.0E-3 )
@@ -153,31 +157,13 @@ int main(int argc, char *argv[])
                   << " " << currentOrigin << std::endl;
         return EXIT_FAILURE;
         }
-      else if( distance > 1.0E-6 )
-        {
-        // if there is a small difference make them the same
-        imageReader->GetOutput()->SetOrigin(firstOrigin);
-        }
       }
     DWIMetaDataDictionaryValidator::GradientTableType currGradTable = currentMetaDataValidator.GetGradientTable();
     double currentBvalue = currentMetaDataValidator.GetBValue();
     double bValueScale = currentBvalue / baselineBvalue;
-    for( unsigned int j = 0; j < imageReader->GetOutput()->GetVectorLength(); j++ )
+    for( unsigned int j = 0; j < currentImage->GetVectorLength(); j++ )
       {
-      using VectorSelectFilterType = itk::VectorIndexSelectionCastImageFilter<NrrdImageType, IndexImageType>;
-      using VectorSelectFilterPointer = VectorSelectFilterType::Pointer;
-      VectorSelectFilterPointer selectIndexImageFilter = VectorSelectFilterType::New();
-      selectIndexImageFilter->SetIndex( j );
-      selectIndexImageFilter->SetInput( imageReader->GetOutput() );
-      try
-        {
-        selectIndexImageFilter->Update();
-        }
-      catch( itk::ExceptionObject & e )
-        {
-        std::cout << e << std::endl;
-        }
-      indexImageToVectorImageFilter->SetInput( vectorIndex, selectIndexImageFilter->GetOutput() );
+      componentViews.push_back( BRAINSUtils::GetComponentView( currentImage.GetPointer(), j ) );
 
       // Scale the current gradient and put in the result gradient table
       DWIMetaDataDictionaryValidator::Double3x1ArrayType scaledGradient;
@@ -185,28 +171,28 @@ int main(int argc, char *argv[])
       scaledGradient[1] = currGradTable[j][1] * bValueScale;
       scaledGradient[2] = currGradTable[j][2] * bValueScale;
       resultGradTable.push_back(scaledGradient);
-
-      vectorIndex++;
       }
+    inputImages.push_back( currentImage );
     }
   resultMetaDataValidator.SetGradientTable( resultGradTable );
 
-  try
-    {
-    indexImageToVectorImageFilter->Update();
-    indexImageToVectorImageFilter->GetOutput()->SetMetaDataDictionary( resultMetaDataValidator.GetMetaDataDictionary() );
-    }
-  catch( itk::ExceptionObject & ex )
-    {
-    std::cout << ex << std::endl << std::flush;
-    throw;
-    }
+  // The result takes the geometry of the first volume, small origin
+  // differences of the other volumes are ignored.
+  NrrdImageType::Pointer concatImage = NrrdImageType::New();
+  concatImage->CopyInformation( inputImages[0] );
+  concatImage->SetRegions( inputImages[0]->GetLargestPossibleRegion() );
+  concatImage->SetVectorLength( componentViews.size() );
+  concatImage->Allocate();
+  BRAINSUtils::GatherComponents( componentViews, concatImage->GetLargestPossibleRegion().GetNumberOfPixels(),
+                                 concatImage->GetBufferPointer() );
+  concatImage->SetMetaDataDictionary( resultMetaDataValidator.GetMetaDataDictionary() );
+  inputImages.clear();
 
   using WriterType = itk::ImageFileWriter<NrrdImageType>;
   WriterType::Pointer nrrdWriter = WriterType::New();
   nrrdWriter->UseCompressionOn();
   nrrdWriter->UseInputMetaDataDictionaryOn();
-  nrrdWriter->SetInput( indexImageToVectorImageFilter->GetOutput() );
+  nrrdWriter->SetInput( concatImage );
   nrrdWriter->SetFileName( outputVolume );
   try
     {
@@ -34,8 +34,12 @@
 
 =========================================================================*/
 
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include <fstream>
+#include <mutex>
+#include <thread>
 
 #include <itkImage.h>
 #include <itkVectorImage.h>
@@ -151,6 +155,17 @@ int main(int argc, char *argv[])
     throw;
     }
 
+  // Every registered gradient is resampled onto the fixed grid and stored in
+  // an image with the moving volume's region, so the two regions must match.
+  if( fixedImageReader->GetOutput()->GetLargestPossibleRegion()
+      != movingImageReader->GetOutput()->GetLargestPossibleRegion() )
+    {
+    std::cerr << "The fixed volume region " << fixedImageReader->GetOutput()->GetLargestPossibleRegion()
+              << " differs from the moving volume region "
+              << movingImageReader->GetOutput()->GetLargestPossibleRegion() << std::endl;
+    return EXIT_FAILURE;
+    }
+
   /* Extract Image Index to be used for Coregistration */
   ExtractImageFilterType::Pointer fixedImageExtractionFilter = ExtractImageFilterType::New();
   fixedImageExtractionFilter->SetIndex( fixedVolumeIndex );
@@ -161,7 +176,8 @@ int main(int argc, char *argv[])
   OutputImageType::Pointer RegisteredImage;
 
   using RegisterFilterType = itk::BRAINSFitHelper;
-  RegisterFilterType::Pointer registerImageFilter = RegisterFilterType::New();
+  using CompositeTransformType = itk::CompositeTransform<double, 3>;
+  using GenericTransformType = itk::Transform<double, 3, 3>;
 
   std::vector<double> minStepLength;
   minStepLength.push_back( (double)minimumStepSize);
@@ -175,6 +191,14 @@ int main(int argc, char *argv[])
   std::vector<int> iterations;
   iterations.push_back(numberOfIterations);
 
+  if(numberOfSpatialSamples > 0)
+    {
+      const unsigned long numberOfAllSamples = fixedImageExtractionFilter->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+      samplingPercentage = static_cast<double>( numberOfSpatialSamples )/numberOfAllSamples;
+      std::cout << "WARNING --numberOfSpatialSamples is deprecated, please use --samplingPercentage instead " << std::endl;
+      std::cout << "WARNING: Replacing command line --samplingPercentage " << samplingPercentage << std::endl;
+    }
+
   // Allocate output image
   RegisteredImage = OutputImageType::New();
   RegisteredImage->SetRegions( movingImageReader->GetOutput()->GetLargestPossibleRegion() );
@@ -186,12 +210,18 @@ int main(int argc, char *argv[])
   RegisteredImage->Allocate();
 
   using ConstIteratorType = itk::ImageRegionConstIterator<OutputIndexImageType>;
-  using IteratorType = itk::ImageRegionIterator<OutputImageType>;
 
-  IteratorType               ot( RegisteredImage, RegisteredImage->GetRequestedRegion() );
-  OutputImageType::PixelType vectorImagePixel;
-  for( unsigned int i = 0; i < movingImageReader->GetOutput()->GetVectorLength(); i++ )
-    {
+  const unsigned int                         numberOfGradients = movingImageReader->GetOutput()->GetVectorLength();
+  std::vector<GenericTransformType::Pointer> gradientTransforms( numberOfGradients );
+  std::vector<std::string>                   gradientKeys( numberOfGradients );
+  std::vector<std::string>                   gradientValues( numberOfGradients );
+
+  // Register gradient i, starting from warmStartTransform (moments alignment
+  // when null).  Gradients are registered concurrently: every registration
+  // uses its own filters and its own views (grafts) of the fixed and moving
+  // images, and only writes component i of the registered image.
+  auto registerGradient = [&](const unsigned int i, const GenericTransformType *warmStartTransform)
+  {
     // Get Current Gradient Direction
     vnl_vector<double> curGradientDirection(3);
     char               tmpStr[64];
@@ -199,113 +229,102 @@ int main(int argc, char *argv[])
     std::string KeyString(tmpStr);
     std::string NrrdValue;
 
-    itk::MetaDataDictionary inputMetaDataDictionary = movingImageReader->GetOutput()->GetMetaDataDictionary();
+    const itk::MetaDataDictionary & inputMetaDataDictionary = movingImageReader->GetOutput()->GetMetaDataDictionary();
     itk::ExposeMetaData<std::string>(inputMetaDataDictionary, KeyString, NrrdValue);
     /* %lf is 'long float', i.e., double. */
-    // std::cout<<"KeyString: "<<KeyString<<std::endl;
-    // std::cout<<"NrrdValue: "<<NrrdValue<<std::endl;
     sscanf(
       NrrdValue.c_str(), " %lf %lf %lf", &curGradientDirection[0], &curGradientDirection[1], &curGradientDirection[2]);
-    // std::cout<<" before: "<<std::endl;
-    // std::cout<<curGradientDirection<<std::endl;
 
+    NrrdImageType::Pointer movingImage = NrrdImageType::New();
+    movingImage->Graft( movingImageReader->GetOutput() );
+    InputIndexImageType::Pointer fixedImage = InputIndexImageType::New();
+    fixedImage->Graft( fixedImageExtractionFilter->GetOutput() );
+
+    ExtractImageFilterType::Pointer movingImageExtractionFilter = ExtractImageFilterType::New();
+    movingImageExtractionFilter->SetInput( movingImage );
+    movingImageExtractionFilter->SetIndex( i );
+    movingImageExtractionFilter->Update();
+
+    RegisterFilterType::Pointer registerImageFilter = RegisterFilterType::New();
     if( eddyCurrentCorrection == 0 )
       {
-      std::cout << "Rigid Registration: " << std::endl;
+      std::cout << "Rigid Registration: " << i << std::endl;
       registerImageFilter->SetTransformType(rigidTransformTypes);
       }
     else
       {
-      std::cout << "Full Affine Registration: " << std::endl;
+      std::cout << "Full Affine Registration: " << i << std::endl;
       registerImageFilter->SetTransformType(affineTransformTypes);
       }
-    movingImageExtractionFilter->SetIndex( i );
-    movingImageExtractionFilter->Update();
-
     registerImageFilter->SetTranslationScale( spatialScale );
     registerImageFilter->SetMaximumStepLength( maximumStepSize );
     registerImageFilter->SetMinimumStepLength( minStepLength );
     registerImageFilter->SetRelaxationFactor( relaxationFactor );
     registerImageFilter->SetNumberOfIterations( iterations );
-    if(numberOfSpatialSamples > 0)
-      {
-        const unsigned long numberOfAllSamples = fixedImageExtractionFilter->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
-        samplingPercentage = static_cast<double>( numberOfSpatialSamples )/numberOfAllSamples;
-        std::cout << "WARNING --numberOfSpatialSamples is deprecated, please use --samplingPercentage instead " << std::endl;
-        std::cout << "WARNING: Replacing command line --samplingPercentage " << samplingPercentage << std::endl;
-      }
     registerImageFilter->SetSamplingPercentage( samplingPercentage );
     registerImageFilter->SetMovingVolume( movingImageExtractionFilter->GetOutput() );
-    registerImageFilter->SetFixedVolume( fixedImageExtractionFilter->GetOutput() );
+    registerImageFilter->SetFixedVolume( fixedImage );
     registerImageFilter->SetDebugLevel(debugLevel);
     registerImageFilter->SetInitializeTransformMode("useMomentsAlign" );
-
-
-    try
+    if( warmStartTransform != nullptr )
       {
-      registerImageFilter->Update();
-      }
-    catch( itk::ExceptionObject & ex )
-      {
-      std::cout << ex << std::endl;
-      throw;
-      }
-    using GenericTransformType = itk::Transform<double, 3, 3>;
-    // restore writing out transform if specified on command line.
-    if( outputTransform.size() != 0 )
-      {
-      GenericTransformType::Pointer transform =
-        registerImageFilter->GetCurrentGenericTransform()->GetNthTransform(0);
-      itk::TransformFileWriter::Pointer xfrmWriter =
-        itk::TransformFileWriter::New();
-      xfrmWriter->SetFileName(outputTransform);
-      xfrmWriter->SetInput(transform);
-#if ITK_VERSION_MAJOR >= 5
-      xfrmWriter->SetUseCompression(true);
-#endif
-      xfrmWriter->Update();
+      // The initializer is skipped when a current transform is given.
+      CompositeTransformType::Pointer warmStart = CompositeTransformType::New();
+      warmStart->AddTransform( warmStartTransform->Clone() );
+      registerImageFilter->SetCurrentGenericTransform( warmStart );
       }
+
+    registerImageFilter->Update();
+
+    GenericTransformType::Pointer transform =
+      registerImageFilter->GetCurrentGenericTransform()->GetNthTransform(0);
+
     using ResampleFilterType = itk::ResampleImageFilter<InputIndexImageType, OutputIndexImageType, double>;
     ResampleFilterType::Pointer resampler = ResampleFilterType::New();
     resampler->SetTransform( registerImageFilter->GetCurrentGenericTransform() );
     resampler->SetInput( movingImageExtractionFilter->GetOutput() );
     // Remember:  the Data is Moving's, the shape is Fixed's.
-    resampler->SetOutputParametersFromImage(fixedImageExtractionFilter->GetOutput() );
+    resampler->SetOutputParametersFromImage( fixedImage );
     resampler->SetDefaultPixelValue( 0 );
     resampler->Update();
 
     if( eddyCurrentCorrection == 0 )
       {
-      RigidTransformType::Pointer rigidTransform;
-      rigidTransform =
-        dynamic_cast<RigidTransformType *>(registerImageFilter->GetCurrentGenericTransform().GetPointer() );
+      const RigidTransformType *rigidTransform = dynamic_cast<const RigidTransformType *>( transform.GetPointer() );
+      if( rigidTransform == nullptr )
+        {
+        itkGenericExceptionMacro(<< "Gradient " << i << " was not registered with a rigid transform");
+        }
       curGradientDirection = rigidTransform->GetMatrix().GetVnlMatrix() * curGradientDirection;
       }
     else
       {
-      LocalAffineTransformType::Pointer affineTransform;
-      affineTransform =
-        dynamic_cast<LocalAffineTransformType *>(registerImageFilter->GetCurrentGenericTransform().GetPointer() );
+      const LocalAffineTransformType *affineTransform =
+        dynamic_cast<const LocalAffineTransformType *>( transform.GetPointer() );
+      if( affineTransform == nullptr )
+        {
+        itkGenericExceptionMacro(<< "Gradient " << i << " was not registered with an affine transform");
+        }
       itk::Matrix<double, 3, 3> NonOrthog = affineTransform->GetMatrix();
       itk::Matrix<double, 3, 3> Orthog( itk::Orthogonalize3DRotationMatrix(NonOrthog) );
       curGradientDirection = Orthog.GetVnlMatrix() * curGradientDirection;
-      // std::cout<<"i = "<<i<<std::endl;
-      // std::cout<<curGradientDirection<<std::endl;
       }
 
-    // Write RegisteredImage
-    ConstIteratorType it( resampler->GetOutput(), resampler->GetOutput()->GetRequestedRegion() );
-    for( ot.GoToBegin(), it.GoToBegin(); !ot.IsAtEnd(); ++ot, ++it )
+    // Write component i of RegisteredImage
+    const unsigned int vectorLength = RegisteredImage->GetNumberOfComponentsPerPixel();
+    const size_t       numberOfPixels = RegisteredImage->GetBufferedRegion().GetNumberOfPixels();
+    if( resampler->GetOutput()->GetBufferedRegion().GetNumberOfPixels() != numberOfPixels )
+      {
+      itkGenericExceptionMacro(<< "The resampled gradient " << i << " does not fit the registered image");
+      }
+    OutputPixelType * ot = RegisteredImage->GetBufferPointer() + i;
+    ConstIteratorType it( resampler->GetOutput(), resampler->GetOutput()->GetBufferedRegion() );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it, ot += vectorLength )
       {
-      vectorImagePixel = ot.Get();
-      vectorImagePixel[i] = it.Value();
-      ot.Set( vectorImagePixel );
+      *ot = it.Value();
       }
 
     // Add the gradient direction to the resulting image
-    // sprintf(tmpStr, " %18.15lf %18.15lf %18.15lf", curGradientDirection[0], curGradientDirection[1],
-    //         curGradientDirection[2]);
-    // NrrdValue = tmpStr;
     NrrdValue = " ";
     for( unsigned dir = 0; dir < 3; ++dir )
       {
@@ -315,7 +334,95 @@ int main(int argc, char *argv[])
         }
       NrrdValue += doubleConvert(curGradientDirection[dir]);
       }
-    itk::EncapsulateMetaData<std::string>(RegisteredImage->GetMetaDataDictionary(), KeyString, NrrdValue);
+    gradientTransforms[i] = transform;
+    gradientKeys[i] = KeyString;
+    gradientValues[i] = NrrdValue;
+  };
+
+  // The first gradient is aligned by moments.  The others are split into
+  // numberOfConcurrentRegistrations runs of consecutive gradients, each
+  // registered from the solution of the previous gradient of its run, and
+  // from the first gradient's solution at the start of the run.  The runs
+  // share the ITK thread pool (numberOfThreads).
+  try
+    {
+    registerGradient(0, nullptr);
+    }
+  catch( itk::ExceptionObject & ex )
+    {
+    std::cout << ex << std::endl;
+    throw;
+    }
+
+  const unsigned int numberOfRemainingGradients = numberOfGradients - 1;
+  unsigned int       numberOfRuns = ( numberOfConcurrentRegistrations > 0 ) ?
+    static_cast<unsigned int>( numberOfConcurrentRegistrations ) :
+    itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  numberOfRuns = std::max( 1U, std::min( numberOfRuns, numberOfRemainingGradients ) );
+
+  std::mutex         failureMutex;
+  std::exception_ptr failure;
+  auto               registerRun = [&](const unsigned int run)
+  {
+    const unsigned int first = 1 + run * numberOfRemainingGradients / numberOfRuns;
+    const unsigned int last = 1 + ( run + 1 ) * numberOfRemainingGradients / numberOfRuns;
+    try
+      {
+      for( unsigned int i = first; i < last; ++i )
+        {
+        registerGradient( i, gradientTransforms[i - 1 < first ? 0 : i - 1].GetPointer() );
+        }
+      }
+    catch( ... )
+      {
+      std::lock_guard<std::mutex> lock( failureMutex );
+      if( !failure )
+        {
+        failure = std::current_exception();
+        }
+      }
+  };
+  std::vector<std::thread> runThreads;
+  for( unsigned int run = 1; run < numberOfRuns; ++run )
+    {
+    runThreads.emplace_back( registerRun, run );
+    }
+  registerRun(0);
+  for( auto & runThread : runThreads )
+    {
+    runThread.join();
+    }
+  if( failure )
+    {
+    try
+      {
+      std::rethrow_exception( failure );
+      }
+    catch( itk::ExceptionObject & ex )
+      {
+      std::cout << ex << std::endl;
+      throw;
+      }
+    }
+
+  for( unsigned int i = 0; i < numberOfGradients; ++i )
+    {
+    itk::EncapsulateMetaData<std::string>(RegisteredImage->GetMetaDataDictionary(), gradientKeys[i], gradientValues[i]);
+    }
+
+  // restore writing out transform if specified on command line.
+  // As when the gradients were registered one after the other, the file
+  // holds the transform of the last gradient.
+  if( outputTransform.size() != 0 )
+    {
+    itk::TransformFileWriter::Pointer xfrmWriter =
+      itk::TransformFileWriter::New();
+    xfrmWriter->SetFileName(outputTransform);
+    xfrmWriter->SetInput( gradientTransforms[numberOfGradients - 1] );
+#if ITK_VERSION_MAJOR >= 5
+    xfrmWriter->SetUseCompression(true);
+#endif
+    xfrmWriter->Update();
     }
 
   using WriterType = itk::ImageFileWriter<OutputImageType>;
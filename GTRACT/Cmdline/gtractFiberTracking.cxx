@@ -39,6 +39,9 @@
 
 #include <itkImage.h>
 #include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkNearestNeighborInterpolateImageFunction.h>
+#include <itkResampleImageFilter.h>
 #include <itkSpatialOrientationAdapter.h>
 #include <itkThresholdImageFilter.h>
 
@@ -126,6 +129,10 @@ int main(int argc, char *argv[])
     std::cout << "Tensor Image: " <<  inputTensorVolume << std::endl;
     std::cout << "Anisotropy Image: " <<  inputAnisotropyVolume << std::endl;
     std::cout << "Output Tract: " <<  outputTract << std::endl;
+    std::cout << "Output Track Density: " <<  outputTrackDensityVolume << std::endl;
+    std::cout << "Output Mean Anisotropy: " <<  outputMeanAnisotropyVolume << std::endl;
+    std::cout << "Connectivity Label Map: " <<  inputConnectivityLabelMapVolume << std::endl;
+    std::cout << "Output Connectivity Matrix: " <<  outputConnectivityMatrix << std::endl;
     std::cout << "Starting Seeds LabelMap Image: " <<  inputStartingSeedsLabelMapVolume << std::endl;
     std::cout << "Ending Seeds LabelMap Image: " <<  inputEndingSeedsLabelMapVolume << std::endl;
     std::cout << "Input Guide Tract: " <<  inputTract << std::endl;
@@ -202,6 +209,10 @@ int main(int argc, char *argv[])
     }
 
   AnisotropyImageType::Pointer anisotropyImage = anisotropyImageReader->GetOutput();
+  // Tracking runs in index space, keep the geometry for the aggregate outputs
+  const AnisotropyImageType::PointType     anisotropyOrigin = anisotropyImage->GetOrigin();
+  const AnisotropyImageType::SpacingType   anisotropySpacing = anisotropyImage->GetSpacing();
+  const AnisotropyImageType::DirectionType anisotropyDirection = anisotropyImage->GetDirection();
   // std::cout << "Anisotropy Image: " << anisotropyImage << std::endl;
   AdaptOriginAndDirection<AnisotropyImageType>( anisotropyImage );
   // std::cout << "Anisotropy Image Updated: " << anisotropyImage << std::endl;
@@ -273,6 +284,85 @@ int main(int argc, char *argv[])
     AdaptOriginAndDirection<MaskImageType>( endingSeedMask );
     }
 
+  /* Optional aggregation of the fibers while tracking */
+  using TrackingFilterBaseType = itk::DtiTrackingFilterBase<TensorImageType, AnisotropyImageType, MaskImageType>;
+  TrackingFilterBaseType::ConnectivityLabelImageType::Pointer connectivityLabelImage;
+  if( inputConnectivityLabelMapVolume != "" )
+    {
+    using ConnectivityLabelReaderType = itk::ImageFileReader<TrackingFilterBaseType::ConnectivityLabelImageType>;
+    ConnectivityLabelReaderType::Pointer connectivityLabelReader = ConnectivityLabelReaderType::New();
+    connectivityLabelReader->SetFileName( inputConnectivityLabelMapVolume );
+    try
+      {
+      connectivityLabelReader->Update();
+      }
+    catch( itk::ExceptionObject & ex )
+      {
+      std::cout << ex << std::endl;
+      throw;
+      }
+    connectivityLabelImage = connectivityLabelReader->GetOutput();
+
+    // Connectivity is counted at the tracking voxels, so the labels must be
+    // on the anisotropy grid
+    const double geometryTolerance = 1.0e-4;
+    bool         sameGrid = connectivityLabelImage->GetLargestPossibleRegion().GetSize()
+      == anisotropyImage->GetLargestPossibleRegion().GetSize();
+    for( unsigned int i = 0; i < 3 && sameGrid; ++i )
+      {
+      sameGrid = std::abs( connectivityLabelImage->GetSpacing()[i] - anisotropySpacing[i] ) < geometryTolerance
+        && std::abs( connectivityLabelImage->GetOrigin()[i] - anisotropyOrigin[i] ) < geometryTolerance;
+      for( unsigned int j = 0; j < 3 && sameGrid; ++j )
+        {
+        sameGrid = std::abs( connectivityLabelImage->GetDirection()[i][j] - anisotropyDirection[i][j] )
+          < geometryTolerance;
+        }
+      }
+    if( !sameGrid )
+      {
+      std::cout << "Resampling the connectivity label map onto the anisotropy grid (nearest neighbor)"
+                << std::endl;
+      using LabelImageType = TrackingFilterBaseType::ConnectivityLabelImageType;
+      using LabelResampleType = itk::ResampleImageFilter<LabelImageType, LabelImageType>;
+      using LabelInterpolatorType = itk::NearestNeighborInterpolateImageFunction<LabelImageType, double>;
+      LabelResampleType::Pointer labelResampler = LabelResampleType::New();
+      labelResampler->SetInput( connectivityLabelImage );
+      labelResampler->SetInterpolator( LabelInterpolatorType::New() );
+      labelResampler->SetSize( anisotropyImage->GetLargestPossibleRegion().GetSize() );
+      labelResampler->SetOutputStartIndex( anisotropyImage->GetLargestPossibleRegion().GetIndex() );
+      labelResampler->SetOutputSpacing( anisotropySpacing );
+      labelResampler->SetOutputOrigin( anisotropyOrigin );
+      labelResampler->SetOutputDirection( anisotropyDirection );
+      labelResampler->SetDefaultPixelValue( 0 );
+      labelResampler->Update();
+      connectivityLabelImage = labelResampler->GetOutput();
+      }
+    AdaptOriginAndDirection<TrackingFilterBaseType::ConnectivityLabelImageType>( connectivityLabelImage );
+    }
+  if( outputConnectivityMatrix != "" && connectivityLabelImage.IsNull() )
+    {
+    std::cerr << "Missing label map for the connectivity matrix (--inputConnectivityLabelMapVolume)" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const bool aggregateFibers = outputTrackDensityVolume != "" || outputMeanAnisotropyVolume != ""
+    || outputConnectivityMatrix != "";
+  if( outputTract == "" && !aggregateFibers )
+    {
+    std::cerr << "Missing output filename (--outputTract)" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Fibers are only kept when they are written out
+  const auto configureAggregation = [&](TrackingFilterBaseType *filter)
+    {
+      filter->SetAggregateFibers( aggregateFibers );
+      filter->SetRetainFibers( outputTract != "" );
+      if( connectivityLabelImage.IsNotNull() )
+        {
+        filter->SetConnectivityLabelImage( connectivityLabelImage );
+        }
+    };
+  TrackingFilterBaseType::Pointer trackingFilter;
+
   vtkPolyData *fibers;
   if( trackingMethod == "Guided" )
     {
@@ -335,8 +425,10 @@ int main(int argc, char *argv[])
     acturalTrackingFilter->SetUseLoopDetection( useLoopDetection );
     acturalTrackingFilter->SetSeedThreshold( seedThreshold );
     acturalTrackingFilter->SetAnisotropyThreshold( trackingThreshold );
+    configureAggregation( acturalTrackingFilter );
     acturalTrackingFilter->Update();
     fibers = acturalTrackingFilter->GetOutput();
+    trackingFilter = acturalTrackingFilter.GetPointer();
     }
   else if( trackingMethod == "Streamline" )
     {
@@ -357,8 +449,10 @@ int main(int argc, char *argv[])
     acturalTrackingFilter->SetUseLoopDetection( useLoopDetection );
     acturalTrackingFilter->SetSeedThreshold( seedThreshold );
     acturalTrackingFilter->SetAnisotropyThreshold( trackingThreshold );
+    configureAggregation( acturalTrackingFilter );
     acturalTrackingFilter->Update();
     fibers = acturalTrackingFilter->GetOutput();
+    trackingFilter = acturalTrackingFilter.GetPointer();
     }
   else if( trackingMethod == "Free" )
     {
@@ -384,8 +478,10 @@ int main(int argc, char *argv[])
     acturalTrackingFilter->SetUseLoopDetection( useLoopDetection );
     acturalTrackingFilter->SetSeedThreshold( seedThreshold );
     acturalTrackingFilter->SetAnisotropyThreshold( trackingThreshold );
+    configureAggregation( acturalTrackingFilter );
     acturalTrackingFilter->Update();
     fibers = acturalTrackingFilter->GetOutput();
+    trackingFilter = acturalTrackingFilter.GetPointer();
     }
   else if( trackingMethod == "GraphSearch" )
     {
@@ -411,8 +507,10 @@ int main(int argc, char *argv[])
     acturalTrackingFilter->SetUseLoopDetection( useLoopDetection );
     acturalTrackingFilter->SetSeedThreshold( seedThreshold );
     acturalTrackingFilter->SetAnisotropyThreshold( trackingThreshold );
+    configureAggregation( acturalTrackingFilter );
     acturalTrackingFilter->Update();
     fibers = acturalTrackingFilter->GetOutput();
+    trackingFilter = acturalTrackingFilter.GetPointer();
     }
   else
     {
@@ -422,6 +520,50 @@ int main(int argc, char *argv[])
 
   //   vtkPolyData *fibers = acturalTrackingFilter->GetOutput();
 
+  if( aggregateFibers )
+    {
+    std::cout << "Aggregated " << trackingFilter->GetNumberOfAggregatedFibers() << " fibers" << std::endl;
+    using TrackImageType = TrackingFilterBaseType::TrackImageType;
+    using TrackWriterType = itk::ImageFileWriter<TrackImageType>;
+    const auto writeTrackImage = [&](TrackImageType::Pointer image, const std::string & fileName)
+      {
+        image->SetOrigin( anisotropyOrigin );
+        image->SetSpacing( anisotropySpacing );
+        image->SetDirection( anisotropyDirection );
+        TrackWriterType::Pointer trackWriter = TrackWriterType::New();
+        trackWriter->UseCompressionOn();
+        trackWriter->SetInput( image );
+        trackWriter->SetFileName( fileName );
+        trackWriter->Update();
+      };
+    if( outputTrackDensityVolume != "" )
+      {
+      writeTrackImage( trackingFilter->GetTrackDensityImage(), outputTrackDensityVolume );
+      }
+    if( outputMeanAnisotropyVolume != "" )
+      {
+      writeTrackImage( trackingFilter->GetMeanAnisotropyImage(), outputMeanAnisotropyVolume );
+      }
+    if( outputConnectivityMatrix != "" )
+      {
+      std::ofstream connectivityFile( outputConnectivityMatrix.c_str() );
+      if( !connectivityFile.is_open() )
+        {
+        std::cerr << "Could not open " << outputConnectivityMatrix << " for writing" << std::endl;
+        return EXIT_FAILURE;
+        }
+      connectivityFile << "label1,label2,fibers" << std::endl;
+      for( const auto & entry : trackingFilter->GetConnectivityMatrix() )
+        {
+        connectivityFile << entry.first.first << "," << entry.first.second << "," << entry.second << std::endl;
+        }
+      }
+    }
+  if( outputTract == "" )
+    {
+    return EXIT_SUCCESS;
+    }
+
   vtkMatrixToLinearTransform *ijkToRasTransform = vtkMatrixToLinearTransform::New();
   ijkToRasTransform->SetInput(IjkToRasMatrix);
 
@@ -37,6 +37,7 @@
 #include "itkImage.h"
 #include "itkVector.h"
 #include "itkGtractInverseDisplacementFieldImageFilter.h"
+#include "itkGtractFixedPointInverseDisplacementFieldImageFilter.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "gtractInvertDisplacementFieldCLP.h"
@@ -91,28 +92,64 @@ int main( int argc, char *argv[] )
     }
 
   // Invert the deformationfield field
-  typedef itk::GtractInverseDisplacementFieldImageFilter<
-      DisplacementFieldType,
-      DisplacementFieldType
-      >  FilterType;
-
-  FilterType::Pointer inverseFilter = FilterType::New();
-  inverseFilter->SetOutputSpacing( scalarReader->GetOutput()->GetSpacing() );
-  inverseFilter->SetOutputOrigin( scalarReader->GetOutput()->GetOrigin() );
-  ScalarImageType::RegionType region = scalarReader->GetOutput()->GetLargestPossibleRegion();
-
-  inverseFilter->SetSize( region.GetSize() );
-  inverseFilter->SetInput( vectorReader->GetOutput() );
-  inverseFilter->SetSubsamplingFactor( subsamplingFactor );
-
-  try
+  const ScalarImageType::ConstPointer baseVolume = scalarReader->GetOutput();
+  DisplacementFieldType::Pointer      inverseField;
+  if( inversionMethod == "ThinPlateSpline" )
     {
-    inverseFilter->UpdateLargestPossibleRegion();
+    typedef itk::GtractInverseDisplacementFieldImageFilter<
+        DisplacementFieldType,
+        DisplacementFieldType
+        >  FilterType;
+
+    FilterType::Pointer inverseFilter = FilterType::New();
+    inverseFilter->SetOutputSpacing( baseVolume->GetSpacing() );
+    inverseFilter->SetOutputOrigin( baseVolume->GetOrigin() );
+    inverseFilter->SetOutputDirection( baseVolume->GetDirection() );
+    inverseFilter->SetSize( baseVolume->GetLargestPossibleRegion().GetSize() );
+    inverseFilter->SetInput( vectorReader->GetOutput() );
+    inverseFilter->SetSubsamplingFactor( subsamplingFactor );
+
+    try
+      {
+      inverseFilter->UpdateLargestPossibleRegion();
+      }
+    catch( itk::ExceptionObject & excp )
+      {
+      std::cerr << "Exception thrown in Inverse filter" << std::endl;
+      std::cerr << excp << std::endl;
+      }
+    inverseField = inverseFilter->GetOutput();
     }
-  catch( itk::ExceptionObject & excp )
+  else
     {
-    std::cerr << "Exception thrown in Inverse filter" << std::endl;
-    std::cerr << excp << std::endl;
+    typedef itk::GtractFixedPointInverseDisplacementFieldImageFilter<
+        DisplacementFieldType,
+        DisplacementFieldType
+        >  FilterType;
+
+    FilterType::Pointer inverseFilter = FilterType::New();
+    inverseFilter->SetOutputSpacing( baseVolume->GetSpacing() );
+    inverseFilter->SetOutputOrigin( baseVolume->GetOrigin() );
+    inverseFilter->SetOutputDirection( baseVolume->GetDirection() );
+    inverseFilter->SetSize( baseVolume->GetLargestPossibleRegion().GetSize() );
+    inverseFilter->SetInput( vectorReader->GetOutput() );
+    inverseFilter->SetMaximumNumberOfIterations( maximumNumberOfIterations );
+    inverseFilter->SetErrorTolerance( errorTolerance );
+
+    try
+      {
+      inverseFilter->UpdateLargestPossibleRegion();
+      }
+    catch( itk::ExceptionObject & excp )
+      {
+      std::cerr << "Exception thrown in Inverse filter" << std::endl;
+      std::cerr << excp << std::endl;
+      return EXIT_FAILURE;
+      }
+    std::cout << "Inverse consistency error: mean " << inverseFilter->GetMeanErrorNorm()
+              << ", max " << inverseFilter->GetMaxErrorNorm() << ", "
+              << inverseFilter->GetNumberOfUnconvergedPixels() << " voxels above the tolerance" << std::endl;
+    inverseField = inverseFilter->GetOutput();
     }
 
   // Write an image for regression testing
@@ -120,7 +157,7 @@ int main( int argc, char *argv[] )
 
   WriterType::Pointer writer = WriterType::New();
   writer->UseCompressionOn();
-  writer->SetInput( inverseFilter->GetOutput() );
+  writer->SetInput( inverseField );
   writer->SetFileName( outputVolume );
 
   try
@@ -32,17 +32,15 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
 
 #include <itkImage.h>
 #include <itkVectorImage.h>
 #include <itkImageFileWriter.h>
 #include <itkImageFileReader.h>
 #include <itkExceptionObject.h>
-#include <itkVectorIndexSelectionCastImageFilter.h>
-#include <itkComposeImageFilter.h>
-#include <itkImageRegionIterator.h>
 #include <itkImageRegionConstIterator.h>
-#include <itkResampleImageFilter.h>
+#include <itkMultiThreaderBase.h>
 #include <itkTransformFileWriter.h>
 #include "DWIMetaDataDictionaryValidator.h"
 
@@ -50,6 +48,8 @@
 #include "GenericTransformImage.h"
 #include "BRAINSFitHelper.h"
 #include "BRAINSThreadControl.h"
+#include "VectorImageComponents.h"
+#include <vnl/algo/vnl_svd.h>
 
 #include "gtractResampleDWIInPlaceCLP.h"
 #include "itkImageDuplicator.h"
@@ -83,6 +83,237 @@ SetVectorImageRigidTransformInPlace(typename itk::VersorRigid3DTransform<double>
   return OutputAlignedImage;
 }
 
+/**
+ * \brief Matrix and offset of a linear transform (y = Matrix x + Offset), found by mapping the
+ * origin and the unit points so that composite transforms of linear transforms are handled too.
+ * A null transform is the identity.
+ * \return false when the transform is not linear.
+ */
+bool
+GetLinearTransformMatrix(const itk::Transform<double, 3, 3> *Transform, itk::Matrix<double, 3, 3> & Matrix,
+                         itk::Vector<double, 3> & Offset)
+{
+  Matrix.SetIdentity();
+  Offset.Fill(0.0);
+  if( Transform == nullptr )
+    {
+    return true;
+    }
+  if( !Transform->IsLinear() )
+    {
+    return false;
+    }
+  itk::Point<double, 3> point;
+  point.Fill(0.0);
+  const itk::Point<double, 3> mappedOrigin = Transform->TransformPoint(point);
+  for( unsigned int j = 0; j < 3; ++j )
+    {
+    point.Fill(0.0);
+    point[j] = 1.0;
+    const itk::Point<double, 3> mappedPoint = Transform->TransformPoint(point);
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      Matrix[i][j] = mappedPoint[i] - mappedOrigin[i];
+      }
+    }
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    Offset[i] = mappedOrigin[i];
+    }
+  return true;
+}
+
+/**
+ * \brief Rotation part (polar decomposition) of a linear transform matrix, the rotation that
+ * diffusion gradients follow under an affine warp.  It is the matrix itself for a rigid transform.
+ */
+itk::Matrix<double, 3, 3>
+GetRotationPart(const itk::Matrix<double, 3, 3> & Matrix)
+{
+  vnl_svd<double>           svd( Matrix.GetVnlMatrix() );
+  const vnl_matrix<double>  rotation = svd.U() * svd.V().transpose();
+  itk::Matrix<double, 3, 3> result;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = 0; j < 3; ++j )
+      {
+      result[i][j] = rotation[i][j];
+      }
+    }
+  return result;
+}
+
+/**
+ * \brief Resample all the components of a DWI onto the grid of ReferenceImage in one threaded pass.
+ * The voxel to voxel mapping through Transform (the identity when null) and the trilinear neighbours
+ * and weights are computed once per output voxel and applied to every gradient component, which are
+ * contiguous in the VectorImage buffer.  A linear transform is folded with both image geometries into
+ * a single index to continuous index matrix.
+ * The values are those of ResampleImageFilter with its default linear interpolator and a background
+ * of 0 run on each component, up to round-off.
+ * \param InputImage a fully buffered DWI
+ * \return a DWI on the reference grid, with the meta data dictionary of InputImage.
+ */
+template <typename TVectorImage, typename TReferenceImage>
+typename TVectorImage::Pointer
+ResampleVectorImageToReference(const TVectorImage *InputImage, const TReferenceImage *ReferenceImage,
+                               const itk::Transform<double, 3, 3> *Transform)
+{
+  using PixelType = typename TVectorImage::InternalPixelType;
+  using RegionType = typename TVectorImage::RegionType;
+  using IndexType = typename TVectorImage::IndexType;
+
+  const size_t numberOfComponents = InputImage->GetNumberOfComponentsPerPixel();
+
+  typename TVectorImage::Pointer outputImage = TVectorImage::New();
+  outputImage->SetRegions( ReferenceImage->GetLargestPossibleRegion() );
+  outputImage->SetSpacing( ReferenceImage->GetSpacing() );
+  outputImage->SetOrigin( ReferenceImage->GetOrigin() );
+  outputImage->SetDirection( ReferenceImage->GetDirection() );
+  outputImage->SetVectorLength( numberOfComponents );
+  outputImage->SetMetaDataDictionary( InputImage->GetMetaDataDictionary() );
+  outputImage->Allocate();
+
+  const RegionType  inputRegion = InputImage->GetBufferedRegion();
+  const PixelType * inputBuffer = InputImage->GetBufferPointer();
+  itk::OffsetValueType start[3];
+  itk::OffsetValueType end[3];
+  itk::OffsetValueType stride[3];
+  double               continuousStart[3];
+  double               continuousEnd[3];
+  for( unsigned int d = 0; d < 3; ++d )
+    {
+    start[d] = inputRegion.GetIndex()[d];
+    end[d] = start[d] + static_cast<itk::OffsetValueType>( inputRegion.GetSize()[d] ) - 1;
+    stride[d] = ( d == 0 ) ? numberOfComponents : stride[d - 1] * inputRegion.GetSize()[d - 1];
+    // ImageFunction::IsInsideBuffer for a continuous index
+    continuousStart[d] = start[d] - 0.5;
+    continuousEnd[d] = end[d] + 0.5;
+    }
+
+  // continuous index = IndexMatrix index + IndexOffset for a linear transform
+  itk::Matrix<double, 3, 3> transformMatrix;
+  itk::Vector<double, 3>    transformOffset;
+  const bool                isLinear = GetLinearTransformMatrix(Transform, transformMatrix, transformOffset);
+  double                    indexMatrix[3][3];
+  double                    indexOffset[3];
+  if( isLinear )
+    {
+    const itk::Matrix<double, 3, 3> physicalToIndex = InputImage->GetPhysicalPointToIndex();
+    const itk::Matrix<double, 3, 3> matrix =
+      physicalToIndex * transformMatrix * ReferenceImage->GetIndexToPhysicalPoint();
+    const itk::Vector<double, 3> offset =
+      physicalToIndex * ( transformMatrix * ReferenceImage->GetOrigin().GetVectorFromOrigin() + transformOffset
+                          - InputImage->GetOrigin().GetVectorFromOrigin() );
+    for( unsigned int i = 0; i < 3; ++i )
+      {
+      for( unsigned int j = 0; j < 3; ++j )
+        {
+        indexMatrix[i][j] = matrix[i][j];
+        }
+      indexOffset[i] = offset[i];
+      }
+    }
+
+  const RegionType  outputRegion = outputImage->GetBufferedRegion();
+  const IndexType   outputStart = outputRegion.GetIndex();
+  const size_t      rowLength = outputRegion.GetSize()[0];
+  const size_t      rowsPerSlice = outputRegion.GetSize()[1];
+  const size_t      numberOfRows = rowsPerSlice * outputRegion.GetSize()[2];
+  PixelType * const outputBuffer = outputImage->GetBufferPointer();
+  const double      minimumValue = itk::NumericTraits<PixelType>::NonpositiveMin();
+  const double      maximumValue = itk::NumericTraits<PixelType>::max();
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfRows,
+                        [&](itk::SizeValueType row)
+                          {
+                            IndexType index = outputStart;
+                            index[1] += row % rowsPerSlice;
+                            index[2] += row / rowsPerSlice;
+                            PixelType *out = outputBuffer + row * rowLength * numberOfComponents;
+                            for( size_t x = 0; x < rowLength; ++x, out += numberOfComponents )
+                              {
+                              index[0] = outputStart[0] + x;
+                              double cindex[3];
+                              if( isLinear )
+                                {
+                                for( unsigned int i = 0; i < 3; ++i )
+                                  {
+                                  cindex[i] = indexOffset[i] + indexMatrix[i][0] * index[0]
+                                    + indexMatrix[i][1] * index[1] + indexMatrix[i][2] * index[2];
+                                  }
+                                }
+                              else
+                                {
+                                typename TReferenceImage::PointType point;
+                                ReferenceImage->TransformIndexToPhysicalPoint(index, point);
+                                itk::ContinuousIndex<double, 3> continuousIndex;
+                                InputImage->TransformPhysicalPointToContinuousIndex(
+                                  Transform->TransformPoint(point), continuousIndex);
+                                for( unsigned int i = 0; i < 3; ++i )
+                                  {
+                                  cindex[i] = continuousIndex[i];
+                                  }
+                                }
+
+                              bool inside = true;
+                              for( unsigned int d = 0; d < 3; ++d )
+                                {
+                                // Written so that a NaN is outside.
+                                inside = inside && cindex[d] >= continuousStart[d] && cindex[d] < continuousEnd[d];
+                                }
+                              if( !inside )
+                                {
+                                std::fill( out, out + numberOfComponents, PixelType( 0 ) );
+                                continue;
+                                }
+
+                              // Neighbours clamped to the buffer as in LinearInterpolateImageFunction
+                              itk::OffsetValueType lowerOffset[3];
+                              itk::OffsetValueType upperOffset[3];
+                              double               distance[3];
+                              for( unsigned int d = 0; d < 3; ++d )
+                                {
+                                const itk::OffsetValueType base = static_cast<itk::OffsetValueType>(
+                                    std::floor( cindex[d] ) );
+                                distance[d] = cindex[d] - base;
+                                lowerOffset[d] = ( std::max( base, start[d] ) - start[d] ) * stride[d];
+                                upperOffset[d] = ( std::min( base + 1, end[d] ) - start[d] ) * stride[d];
+                                }
+                              const PixelType *neighbours[8];
+                              double           weights[8];
+                              for( unsigned int k = 0; k < 8; ++k )
+                                {
+                                itk::OffsetValueType offset = 0;
+                                double               weight = 1.0;
+                                for( unsigned int d = 0; d < 3; ++d )
+                                  {
+                                  const bool upper = ( k >> d ) & 1;
+                                  offset += upper ? upperOffset[d] : lowerOffset[d];
+                                  weight *= upper ? distance[d] : 1.0 - distance[d];
+                                  }
+                                neighbours[k] = inputBuffer + offset;
+                                weights[k] = weight;
+                                }
+
+                              for( size_t c = 0; c < numberOfComponents; ++c )
+                                {
+                                double value = 0.0;
+                                for( unsigned int k = 0; k < 8; ++k )
+                                  {
+                                  value += weights[k] * neighbours[k][c];
+                                  }
+                                // ResampleImageFilter::CastPixelWithBoundsChecking
+                                value = std::min( std::max( value, minimumValue ), maximumValue );
+                                out[c] = static_cast<PixelType>( value );
+                                }
+                              }
+                          },
+                        nullptr );
+  return outputImage;
+}
+
 int main(int argc, char *argv[])
 {
   PARSE_ARGS;
@@ -208,6 +439,21 @@ int main(int argc, char *argv[])
       }
     }
 
+  // The DWI is only warped when resampled to the reference volume.  The gradients then follow the
+  // rotation of a linear warp, a nonlinear warp has no single rotation and leaves them unchanged.
+  itk::Matrix<double, 3, 3> warpGradientRotation;
+  warpGradientRotation.SetIdentity();
+  if( referenceVolume != "" && warpDWIXFRM.IsNotNull() )
+    {
+    itk::Matrix<double, 3, 3> warpMatrix;
+    itk::Vector<double, 3>    warpOffset;
+    if( GetLinearTransformMatrix(warpDWIXFRM.GetPointer(), warpMatrix, warpOffset) )
+      {
+      // Points are mapped from the reference to the DWI, the image content moves by the inverse.
+      warpGradientRotation = GetRotationPart(warpMatrix).GetTranspose();
+      }
+    }
+
   // Instantiate an object of MetaDataDictionaryValidator class, and set its MetaDataDictionary
   DWIMetaDataDictionaryValidator resampleImageValidator;
   resampleImageValidator.SetMetaDataDictionary(resampleImage->GetMetaDataDictionary());
@@ -232,7 +478,14 @@ int main(int argc, char *argv[])
 
   DWIMetaDataDictionaryValidator::GradientTableType newGradTable( gradTable.size() );
 
-  // Rotate gradient vectors by rigid transform and inverse measurement frame
+  RigidTransformType::Pointer inverseRigidTransform = RigidTransformType::New();
+  inverseRigidTransform->SetCenter( rigidTransform->GetCenter() );
+  inverseRigidTransform->SetIdentity();
+  rigidTransform->GetInverse(inverseRigidTransform);
+  const itk::Matrix<double, 3, 3> gradientRotation =
+    warpGradientRotation * inverseRigidTransform->GetMatrix() * DWIInverseMeasurementFrame;
+
+  // Rotate gradient vectors by rigid transform, linear warp and inverse measurement frame
   for( unsigned int i = 0; i < gradTable.size(); i++ )
     {
     // Get Current Gradient Direction
@@ -241,15 +494,8 @@ int main(int argc, char *argv[])
     curGradientDirection[1] = gradTable[i][1];
     curGradientDirection[2] = gradTable[i][2];
 
-    // Rotate the diffusion gradient with rigid transform and inverse measurement frame
-    RigidTransformType::Pointer inverseRigidTransform = RigidTransformType::New();
-    const NrrdImageType::PointType centerPoint = rigidTransform->GetCenter();
-    inverseRigidTransform->SetCenter( centerPoint );
-    inverseRigidTransform->SetIdentity();
-    rigidTransform->GetInverse(inverseRigidTransform);
-
-    curGradientDirection =
-      inverseRigidTransform->GetMatrix() * DWIInverseMeasurementFrame * curGradientDirection;
+    // Rotate the diffusion gradient with rigid transform, linear warp and inverse measurement frame
+    curGradientDirection = gradientRotation * curGradientDirection;
 
     newGradTable[i][0] = curGradientDirection[0];
     newGradTable[i][1] = curGradientDirection[1];
@@ -383,71 +629,46 @@ int main(int argc, char *argv[])
             << std::endl;
   std::cout << "Output DWI Image Size: " << newSize[0] << " " << newSize[1] << " " << newSize[2] << std::endl;
 
-  NrrdImageType::Pointer paddedImage = NrrdImageType::New();
-  paddedImage->CopyInformation(resampleImage);
-  paddedImage->SetVectorLength( resampleImage->GetVectorLength() );
-  paddedImage->SetMetaDataDictionary( resampleImage->GetMetaDataDictionary() );
-  paddedImage->SetRegions( newSize );
-  paddedImage->SetOrigin( newOrigin );
-  paddedImage->Allocate();
-
-  NrrdImageType::Pointer finalImage;
-  using IteratorType = itk::ImageRegionIterator<NrrdImageType>;
-  IteratorType InIt( resampleImage, resampleImage->GetRequestedRegion() );
-  for( InIt.GoToBegin(); !InIt.IsAtEnd(); ++InIt )
+  NrrdImageType::Pointer paddedImage = resampleImage;
+  if( newSize != inputSize )
     {
-    NrrdImageType::IndexType InIndex = InIt.GetIndex();
-    NrrdImageType::IndexType OutIndex;
-    OutIndex[0] = InIndex[0] + imagePadding[0];
-    OutIndex[1] = InIndex[1] + imagePadding[1];
-    OutIndex[2] = InIndex[2] + imagePadding[2];
-
-    NrrdImageType::PixelType InImagePixel = resampleImage->GetPixel( InIndex );
-    paddedImage->SetPixel( OutIndex, InImagePixel );
+    paddedImage = NrrdImageType::New();
+    paddedImage->CopyInformation(resampleImage);
+    paddedImage->SetVectorLength( resampleImage->GetVectorLength() );
+    paddedImage->SetMetaDataDictionary( resampleImage->GetMetaDataDictionary() );
+    paddedImage->SetRegions( newSize );
+    paddedImage->SetOrigin( newOrigin );
+    paddedImage->Allocate(true); // The padding is 0
+
+    // Copy the input rows into the padded buffer
+    const size_t     vectorLength = resampleImage->GetVectorLength();
+    const size_t     rowLength = inputSize[0] * vectorLength;
+    const PixelType *inputBuffer = resampleImage->GetBufferPointer();
+    PixelType *      paddedBuffer = paddedImage->GetBufferPointer();
+    for( size_t k = 0; k < inputSize[2]; ++k )
+      {
+      for( size_t j = 0; j < inputSize[1]; ++j )
+        {
+        const size_t paddedRow = ( ( k + imagePadding[2] ) * newSize[1] + j + imagePadding[1] ) * newSize[0]
+          + imagePadding[0];
+        std::copy( inputBuffer, inputBuffer + rowLength, paddedBuffer + paddedRow * vectorLength );
+        inputBuffer += rowLength;
+        }
+      }
     }
-  paddedImage->Update();
+
+  NrrdImageType::Pointer finalImage;
 
   if(referenceVolume != "")
     {
-    //For each component, extract, resample to list, and finally compose back into a vector image.
     using ReferenceFileReaderType = itk::ImageFileReader<SingleComponentImageType>;
     ReferenceFileReaderType::Pointer referenceImageReader = ReferenceFileReaderType::New();
     referenceImageReader->SetFileName(referenceVolume);
     referenceImageReader->Update();
 
-    const size_t lengthOfPixelVector = paddedImage->GetVectorLength();
-
-    using ComposeCovariantVectorImageFilterType = itk::ComposeImageFilter<SingleComponentImageType, NrrdImageType>;
-    ComposeCovariantVectorImageFilterType::Pointer composer= ComposeCovariantVectorImageFilterType::New();
-
-    using VectorIndexSelectionCastImageFilterType = itk::VectorIndexSelectionCastImageFilter< NrrdImageType, SingleComponentImageType >;
-    VectorIndexSelectionCastImageFilterType::Pointer vectorImageToImageSelector = VectorIndexSelectionCastImageFilterType::New();
-    vectorImageToImageSelector->SetInput(paddedImage);
-    for(size_t componentToExtract = 0; componentToExtract < lengthOfPixelVector; ++componentToExtract )
-      {
-      vectorImageToImageSelector->SetIndex( componentToExtract );
-      vectorImageToImageSelector->Update();
-
-      // Resample to a new space with basic linear/identity transform.
-      using ComponentResamplerType = itk::ResampleImageFilter<SingleComponentImageType,SingleComponentImageType>;
-      ComponentResamplerType::Pointer componentResampler = ComponentResamplerType::New();
-      componentResampler->SetOutputParametersFromImage(referenceImageReader->GetOutput());
-      componentResampler->SetInput(vectorImageToImageSelector->GetOutput());
-      if(warpDWIXFRM.IsNotNull())
-        {
-        componentResampler->SetTransform(warpDWIXFRM);
-        }
-      //default to linear
-      //default to IdentityTransform
-      // TODO feed it composite transform.
-      //default background value of 0.
-      componentResampler->Update();
-      //Add to list for Compose
-      composer->SetInput(componentToExtract,componentResampler->GetOutput());
-      }
-    composer->Update();
-    finalImage = composer->GetOutput();
-    finalImage->SetMetaDataDictionary(paddedImage->GetMetaDataDictionary() );
+    // All the gradient components are interpolated together with one mapping per voxel.
+    finalImage = ResampleVectorImageToReference<NrrdImageType, SingleComponentImageType>(
+        paddedImage, referenceImageReader->GetOutput(), warpDWIXFRM.GetPointer() );
     }
   else
     {
@@ -473,17 +694,20 @@ int main(int argc, char *argv[])
     {
     constexpr size_t B0Index = 0;
 
-    using VectorIndexSelectionCastImageFilterType = itk::VectorIndexSelectionCastImageFilter< NrrdImageType, SingleComponentImageType >;
-    VectorIndexSelectionCastImageFilterType::Pointer vectorImageToImageSelector = VectorIndexSelectionCastImageFilterType::New();
-    vectorImageToImageSelector->SetInput(finalImage);
-    vectorImageToImageSelector->SetIndex( B0Index );
-    vectorImageToImageSelector->Update();
+    SingleComponentImageType::Pointer b0Image = SingleComponentImageType::New();
+    b0Image->CopyInformation( finalImage );
+    b0Image->SetRegions( finalImage->GetLargestPossibleRegion() );
+    b0Image->Allocate();
+    const std::vector<BRAINSUtils::ComponentView<PixelType> > b0View( 1, BRAINSUtils::GetComponentView(
+                                                                          finalImage.GetPointer(), B0Index) );
+    BRAINSUtils::GatherComponents( b0View, b0Image->GetBufferedRegion().GetNumberOfPixels(),
+                                   b0Image->GetBufferPointer() );
 
     // Write out resampled in place DWI
     using B0WriterType = itk::ImageFileWriter<SingleComponentImageType>;
     B0WriterType::Pointer B0Writer = B0WriterType::New();
     B0Writer->UseCompressionOn();
-    B0Writer->SetInput( vectorImageToImageSelector->GetOutput() );
+    B0Writer->SetInput( b0Image );
     B0Writer->SetFileName( outputResampledB0 );
     try
       {
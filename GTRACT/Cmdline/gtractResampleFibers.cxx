@@ -72,6 +72,7 @@
 
 #include "algo.h"
 #include "GtractTypes.h"
+#include "itkGtractFixedPointInverseDisplacementFieldImageFilter.h"
 
 // ////////////////////////////////////////////////////////////////////////
 
@@ -158,20 +159,46 @@ int main( int argc, char *argv[] )
   DisplacementFieldType::Pointer forwardDeformationField = forwardFieldReader->GetOutput();
   // AdaptOriginAndDirection<DisplacementFieldType>( forwardDeformationField );
 
-  FieldReaderType::Pointer reverseFieldReader = FieldReaderType::New();
-  reverseFieldReader->SetFileName( inputReverseDeformationFieldVolume );
-
-  try
+  DisplacementFieldType::Pointer reverseDeformationField;
+  if( inputReverseDeformationFieldVolume.empty() )
     {
-    std::cout << "Reading Reverse Displacement Field........." << std::endl;
-    reverseFieldReader->Update();
+    // Invert the forward field on its own grid
+    using InverseFilterType =
+      itk::GtractFixedPointInverseDisplacementFieldImageFilter<DisplacementFieldType, DisplacementFieldType>;
+    InverseFilterType::Pointer inverseFilter = InverseFilterType::New();
+    inverseFilter->SetInput( forwardDeformationField );
+    try
+      {
+      std::cout << "Inverting Forward Displacement Field........." << std::endl;
+      inverseFilter->Update();
+      }
+    catch( itk::ExceptionObject & fe )
+      {
+      std::cerr << "Field Exception caught ! " << fe << std::endl;
+      return EXIT_FAILURE;
+      }
+    std::cout << "Inverse consistency error: mean " << inverseFilter->GetMeanErrorNorm()
+              << ", max " << inverseFilter->GetMaxErrorNorm() << ", "
+              << inverseFilter->GetNumberOfUnconvergedPixels() << " voxels not converged" << std::endl;
+    reverseDeformationField = inverseFilter->GetOutput();
     }
-  catch( itk::ExceptionObject & fe )
+  else
     {
-    std::cout << "Field Exception caught ! " << fe << std::endl;
-    }
+    FieldReaderType::Pointer reverseFieldReader = FieldReaderType::New();
+    reverseFieldReader->SetFileName( inputReverseDeformationFieldVolume );
+
+    try
+      {
+      std::cout << "Reading Reverse Displacement Field........." << std::endl;
+      reverseFieldReader->Update();
+      }
+    catch( itk::ExceptionObject & fe )
+      {
+      std::cout << "Field Exception caught ! " << fe << std::endl;
+      }
 
-  DisplacementFieldType::Pointer reverseDeformationField = reverseFieldReader->GetOutput();
+    reverseDeformationField = reverseFieldReader->GetOutput();
+    }
   // AdaptOriginAndDirection<DisplacementFieldType>( reverseDeformationField );
 
   using OrientFilterType = itk::OrientImageFilter<DisplacementFieldType, DisplacementFieldType>;
@@ -93,6 +93,7 @@ int main(int argc, char *argv[])
     std::cout << "Threshold: " << backgroundSuppressingThreshold << std::endl;
     std::cout << "B0 Index: " << b0Index << std::endl;
     std::cout << "Apply Measurement Frame: " << applyMeasurementFrame << std::endl;
+    std::cout << "Fitting Method: " << fittingMethod << std::endl;
     std::cout << "=====================================================" << std::endl;
     }
 
@@ -321,7 +322,15 @@ int main(int argc, char *argv[])
   tensorFilter->SetGradientImage( gradientDirectionContainer, indexImageToVectorImageFilter->GetOutput() );
   tensorFilter->SetThreshold( backgroundSuppressingThreshold );
   tensorFilter->SetBValue(BValue);     /* Required */
-  tensorFilter->SetNumberOfWorkUnits(1); /* Required */
+  if( fittingMethod == "WLS" )
+    {
+    tensorFilter->SetFittingMethod(TensorFilterType::WeightedLinearLeastSquares);
+    }
+  else if( fittingMethod == "IWLS" )
+    {
+    tensorFilter->SetFittingMethod(TensorFilterType::IterativeWeightedLinearLeastSquares);
+    tensorFilter->SetNumberOfIterations(numberOfFittingIterations);
+    }
   if( maskImage.IsNotNull() )
     {
     tensorFilter->SetMaskImage(maskImage);
@@ -35,6 +35,8 @@
 =========================================================================*/
 
 #include "algo.h"
+#include "itkMath.h"
+#include <algorithm>
 
 TMatrix Matrix_Inverse( TMatrix M )
 {
@@ -76,6 +78,41 @@ TVector Eigen_Value( TMatrix M )
   return result;
 }
 
+void SymmetricEigenValues3( const double tensor[6], double eigenValues[3] )
+{
+  const double xx = tensor[0];
+  const double xy = tensor[1];
+  const double xz = tensor[2];
+  const double yy = tensor[3];
+  const double yz = tensor[4];
+  const double zz = tensor[5];
+
+  const double offDiagonal = xy * xy + xz * xz + yz * yz;
+  if( offDiagonal == 0.0 )
+    {
+    eigenValues[0] = xx;
+    eigenValues[1] = yy;
+    eigenValues[2] = zz;
+    std::sort(eigenValues, eigenValues + 3);
+    return;
+    }
+
+  const double q = ( xx + yy + zz ) / 3.0;
+  const double dxx = xx - q;
+  const double dyy = yy - q;
+  const double dzz = zz - q;
+  const double p = std::sqrt( ( dxx * dxx + dyy * dyy + dzz * dzz + 2.0 * offDiagonal ) / 6.0 );
+
+  // r = det( (A - qI) / p ) / 2, clamped against round off
+  const double det = dxx * ( dyy * dzz - yz * yz ) - xy * ( xy * dzz - yz * xz ) + xz * ( xy * yz - dyy * xz );
+  const double r = std::max( -1.0, std::min( 1.0, det / ( 2.0 * p * p * p ) ) );
+  const double phi = std::acos(r) / 3.0;
+
+  eigenValues[2] = q + 2.0 * p * std::cos(phi);
+  eigenValues[0] = q + 2.0 * p * std::cos( phi + ( 2.0 * itk::Math::pi / 3.0 ) );
+  eigenValues[1] = 3.0 * q - eigenValues[0] - eigenValues[2];
+}
+
 TMatrix Tensor2Matrix(TVector ADCe)
 {
   TMatrix M(3, 3);
@@ -59,6 +59,11 @@ extern GTRACT_COMMON_EXPORT float My_lsf( TVector x, TVector y);
 
 extern GTRACT_COMMON_EXPORT TVector Eigen_Value( TMatrix M );
 
+/** Closed form (trigonometric) eigenvalues of a symmetric 3x3 tensor given
+ *  as xx, xy, xz, yy, yz, zz.  The eigenvalues are returned in ascending
+ *  order, like Eigen_Value, without allocating. */
+extern GTRACT_COMMON_EXPORT void SymmetricEigenValues3( const double tensor[6], double eigenValues[3] );
+
 extern GTRACT_COMMON_EXPORT TMatrix Tensor2Matrix(TVector ADCe);
 
 extern GTRACT_COMMON_EXPORT TMatrix Tensor2Matrix(itk::FixedArray<float, 6> ADCe);
@@ -105,6 +105,11 @@ protected:
   }
 
 private:
+  /** Seed of the random stream of one tracking seed, mixed from the base
+   * seed so that the random walk does not depend on the thread schedule */
+  static RandomGeneratorType::IntegerType TrackRandomSeed(RandomGeneratorType::IntegerType baseSeed,
+                                                          SizeValueType seedNumber);
+
   RandomGeneratorPointer m_RandomGenerator;
 
   float        m_AnisotropyBranchingValue;
@@ -101,6 +101,22 @@ typename itk::Point<double,
   return sum;
 }
 
+template <typename TTensorImageType, typename TAnisotropyImageType,
+          typename TMaskImageType>
+typename DtiGraphSearchTrackingFilter<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::RandomGeneratorType::IntegerType
+DtiGraphSearchTrackingFilter<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::TrackRandomSeed(RandomGeneratorType::IntegerType baseSeed, SizeValueType seedNumber)
+{
+  // splitmix64 finalizer, neighbouring seed numbers give unrelated streams
+  uint64_t z = ( static_cast<uint64_t>( baseSeed ) << 32 ) + static_cast<uint64_t>( seedNumber )
+    + 0x9E3779B97F4A7C15ULL;
+  z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+  z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+  z = z ^ ( z >> 31 );
+  return static_cast<RandomGeneratorType::IntegerType>( z ^ ( z >> 32 ) );
+}
+
 template <typename TTensorImageType, typename TAnisotropyImageType,
           typename TMaskImageType>
 void DtiGraphSearchTrackingFilter<
@@ -111,15 +127,6 @@ void DtiGraphSearchTrackingFilter<
   typedef typename Self::TensorImageType::PixelType::
     EigenVectorsMatrixType EigenVectorsMatrixType;
 
-  float   anisotropy, anisotropySum;
-  TVector vin(3), vout(3);
-
-  typename Self::ContinuousIndexType index, tmpIndex;
-  bool stop;
-  typename Self::BranchListType      branchList;
-  typename Self::SeedListType        newSeeds;
-  typename Self::DirectionListType   newDirections;
-
   const double inRadians = this->pi / 180.0;
   double       curvatureBranchAngle
     = std::cos(this->m_CurvatureBranchAngle * inRadians);
@@ -131,15 +138,17 @@ void DtiGraphSearchTrackingFilter<
   this->m_TrackingDirections.clear();
   this->m_Seeds.clear();
 
-  /* Initialize the random number generator */
-
+  /* Initialize the random number generator, each seed tracks with its own
+   * stream derived from this base seed */
+  RandomGeneratorType::IntegerType baseSeed;
   if( this->m_RandomSeed == -1 )
     {
     this->m_RandomGenerator->Initialize();
+    baseSeed = this->m_RandomGenerator->GetIntegerVariate();
     }
   else
     {
-    this->m_RandomGenerator->Initialize(this->m_RandomSeed);
+    baseSeed = static_cast<RandomGeneratorType::IntegerType>( this->m_RandomSeed );
     }
 
   // std::cout << "AnisotropyImageRegion: " <<
@@ -160,11 +169,6 @@ void DtiGraphSearchTrackingFilter<
   this->m_StartIP->SetInputImage(this->m_StartingRegion);
   Self::InitializeSeeds();
 
-  constexpr int maxFibers = 25;
-  int       sizeOfOutput = 0;
-  int       oldsizeOfOutput = 0;
-  int       originalSeedCount = 0;
-
   // ////////////////////////////////////////////////////////////////////////
   // Get the Center Of Mass for the Ending Region
   // ///////////////////////////////////////////////////////////////////////
@@ -178,356 +182,349 @@ void DtiGraphSearchTrackingFilter<
   this->MMToContinuousIndex(tmpPoint, endP);
   // std::cout << "Ending Bound Box: " << bb << std::endl;
   // std::cout << "Ending Center Point: " << endP << std::endl;
-  while( !( this->m_Seeds.empty() ) )
+  auto trackSeed = [&](SizeValueType seedNumber,
+                       const typename Self::ContinuousIndexType & seedIndex,
+                       const TVector & seedDirection,
+                       typename Superclass::TrackedFiberListType & fibers)
     {
-    originalSeedCount++;
-    if( oldsizeOfOutput != sizeOfOutput )
-      {
-      oldsizeOfOutput = sizeOfOutput;
-      std::cout << std::endl;
-      }
-    if( sizeOfOutput > maxFibers )    // useful for some cases of debugging:
-      {
-      // break;
-      }
-
-    anisotropySum = 0.0;
-
-    index = this->m_Seeds.back();
-    this->m_Seeds.pop_back();
-    vin = vout = this->m_TrackingDirections.back();
-    this->m_TrackingDirections.pop_back();
-
-    // std::cout << "Seed Index: " << index << " Seed Size: " <<
-    // this->m_Seeds.size() << std::endl;
-    // std::cout << "Direction: " << vin << std::endl;
-    // std::cout << "Image Region: " << ImageRegion << std::endl;
-
-    stop = false;
-    // int order = 1;
-
-    vtkPoints *    fiber = vtkPoints::New();
-    vtkFloatArray *fiberTensors = vtkFloatArray::New();
-    fiberTensors->SetName("Tensors");
-    fiberTensors->SetNumberOfComponents(9);
-    vtkFloatArray *fiberAnisotropy = vtkFloatArray::New();
-    fiberAnisotropy->SetName("Anisotropy");
-    vtkFloatArray *fiberAnisotropySum = vtkFloatArray::New();
-    fiberAnisotropySum->SetName("Anisotropy-Sum");
-    int currentPointId = 0;
-
-    branchList.clear();
-
-    // ////////////////////////////////////////////////////////////////////////
-    // Tracking start from given 'index' and 'vout'
-    while( !stop )
-      {
-      if( ImageRegion.IsInside(index) )
-        {
-        anisotropy = this->m_ScalarIP->EvaluateAtContinuousIndex(index);
-        }
-      else
-        {
-        anisotropy = -1;
-        }
+      RandomGeneratorPointer rng = RandomGeneratorType::New();
+      rng->Initialize( Self::TrackRandomSeed(baseSeed, seedNumber) );
 
-      //
-      // ////////////////////////////////////////////////////////////////////////
-      // Evaluate the stopping criteria
-      //
-      // ////////////////////////////////////////////////////////////////////////
-      bool isLoop = false;
-      if( this->m_UseLoopDetection )
-        {
-        isLoop = Self::IsLoop(fiber);
-        }
-      bool outOfBounds = false;
-
-      if( ( currentPointId > ( this->m_MaximumLength / this->m_StepSize ) )
-          || ( anisotropy < this->m_AnisotropyThreshold )
-          || ( isLoop ) || ( outOfBounds ) )
-      // || ( branchList.size() > this->m_MaximumBranches) ) - Removed as a
-      // stopping criteria
-        {
-        // std::cout << "Stop Track" << std::endl;
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        // some other conditions: (avrAI<this->m_MeanAI)
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        // Backup to the previous branch restart tracking
-        if( !branchList.empty() )
-          {
-          BranchPointType bp = branchList.back();
-          branchList.pop_back();
-          // fiber.resize(bp.m_DivergePoint);
-          while( currentPointId > bp.m_DivergePoint )
-            {
-            fiberTensors->RemoveLastTuple();
-            fiberAnisotropy->RemoveLastTuple();
-            fiberAnisotropySum->RemoveLastTuple();
-            currentPointId--;
-            }
+      float   anisotropy;
+      float   anisotropySum = 0.0;
+      TVector vin(seedDirection), vout(seedDirection);
 
-          // fiber->SetNumberOfPoints( currentPointId );
+      typename Self::ContinuousIndexType index(seedIndex), tmpIndex;
 
-          vtkPoints *newfiber = vtkPoints::New();
-          newfiber->SetNumberOfPoints(currentPointId);
-          for( int i = 0; i < currentPointId; i++ )
-            {
-            newfiber->SetPoint( i, fiber->GetPoint(i) );
-            }
-          fiber->Delete();
-          fiber = newfiber;
+      // std::cout << "Seed Index: " << index << " Seed Size: " <<
+      // this->m_Seeds.size() << std::endl;
+      // std::cout << "Direction: " << vin << std::endl;
+      // std::cout << "Image Region: " << ImageRegion << std::endl;
 
-          vout = bp.m_Direction;
-          double *p = fiber->GetPoint(currentPointId - 1);
-          this->MMToContinuousIndex(p, index);
-          }
-        else
-          {
-          stop = true;
-          }
-        }
-      else
+      bool stop = false;
+      // int order = 1;
+
+      vtkPoints *    fiber = vtkPoints::New();
+      vtkFloatArray *fiberTensors = vtkFloatArray::New();
+      fiberTensors->SetName("Tensors");
+      fiberTensors->SetNumberOfComponents(9);
+      vtkFloatArray *fiberAnisotropy = vtkFloatArray::New();
+      fiberAnisotropy->SetName("Anisotropy");
+      vtkFloatArray *fiberAnisotropySum = vtkFloatArray::New();
+      fiberAnisotropySum->SetName("Anisotropy-Sum");
+      int currentPointId = 0;
+
+      typename Self::BranchListType branchList;
+
+      // ////////////////////////////////////////////////////////////////////////
+      // Tracking start from given 'index' and 'vout'
+      while( !stop )
         {
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        // forward propagating
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        anisotropy = this->m_ScalarIP->EvaluateAtContinuousIndex(index);
-        if( currentPointId )
+        if( ImageRegion.IsInside(index) )
           {
-          anisotropySum += anisotropy;
+          anisotropy = this->m_ScalarIP->EvaluateAtContinuousIndex(index);
           }
         else
           {
-          anisotropySum = anisotropy;
+          anisotropy = -1;
           }
-        fiberAnisotropy->InsertNextValue(anisotropy);
-        fiberAnisotropySum->InsertNextValue(anisotropySum);
-
-        typename Self::PointType t;
-        this->ContinuousIndexToMM(index, t);
-        fiber->InsertNextPoint( t.GetDataPointer() );
-        currentPointId++;
-
-        EigenValuesArrayType   eigenValues;
-        EigenVectorsMatrixType eigenVectors;
-        typename Self::TensorImagePixelType tensorPixel
-          = this->m_VectorIP->EvaluateAtContinuousIndex(index);
-
-        TMatrix fullTensorPixel(3, 3);
-
-        fullTensorPixel = Tensor2Matrix(tensorPixel);
-        fiberTensors->InsertNextTypedTuple( fullTensorPixel.data_block() );
-
-        tensorPixel.ComputeEigenAnalysis(eigenValues, eigenVectors);
 
         //
         // ////////////////////////////////////////////////////////////////////////
-        // Get two tracking vectors - Primary and Secondary Eigen Value
+        // Evaluate the stopping criteria
         //
         // ////////////////////////////////////////////////////////////////////////
-        TVector e2(3);
-
-        e2[0] = eigenVectors[2][0];
-        e2[1] = eigenVectors[2][1];
-        e2[2] = eigenVectors[2][2];
-        if( dot_product(vin, e2) < 0 )
+        bool isLoop = false;
+        if( this->m_UseLoopDetection )
           {
-          e2 *= -1;
+          isLoop = Self::IsLoop(fiber);
           }
-        TVector e1(3);
+        bool outOfBounds = false;
 
-        e1[0] = eigenVectors[1][0];
-        e1[1] = eigenVectors[1][1];
-        e1[2] = eigenVectors[1][2];
-        if( dot_product(vin, e1) < 0 )
+        if( ( currentPointId > ( this->m_MaximumLength / this->m_StepSize ) )
+            || ( anisotropy < this->m_AnisotropyThreshold )
+            || ( isLoop ) || ( outOfBounds ) )
+        // || ( branchList.size() > this->m_MaximumBranches) ) - Removed as a
+        // stopping criteria
           {
-          e1 *= -1;
-          }
-
-        // std::cout << "Forward Track Directions: (" << e2 << ") and (" << e1
-        // << ")" << std::endl;
-
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        // Add a branch points - Check Criteria for Branching
-        //
-        // ////////////////////////////////////////////////////////////////////////
-
-        if( ( ( anisotropy < this->m_AnisotropyBranchingValue )
-              || ( dot_product(e2, vin) < curvatureBranchAngle ) )
-            && ( branchList.size() <= this->m_MaximumBranches ) )
-          {
-          // std::cout << "Branch Point" << std::endl;
+          // std::cout << "Stop Track" << std::endl;
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // some other conditions: (avrAI<this->m_MeanAI)
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // Backup to the previous branch restart tracking
+          if( !branchList.empty() )
+            {
+            BranchPointType bp = branchList.back();
+            branchList.pop_back();
+            // fiber.resize(bp.m_DivergePoint);
+            while( currentPointId > bp.m_DivergePoint )
+              {
+              fiberTensors->RemoveLastTuple();
+              fiberAnisotropy->RemoveLastTuple();
+              fiberAnisotropySum->RemoveLastTuple();
+              currentPointId--;
+              }
 
-          BranchPointType bp;
-          // bp.m_AI = 0;        bp.m_Length = 0;
-          bp.m_DivergePoint = currentPointId;
+            // fiber->SetNumberOfPoints( currentPointId );
 
-          if( this->m_UseRandomWalk )
-            {
-            TVector v(3);
-
-            v[0] = endP[0] - index[0];
-            v[1] = endP[1] - index[1];
-            v[2] = endP[2] - index[2];
-            v.normalize();
-
-            // std::cout << "Random Walk Direction: " << v << std::endl;
-
-            double x, y, z;
-            x
-              = ( 0.5
-                  - this->m_RandomGenerator->
-                  GetVariateWithOpenRange() ) * 2.0;
-            y
-              = ( 0.5
-                  - this->m_RandomGenerator->
-                  GetVariateWithOpenRange() ) * 2.0;
-            z
-              = ( 0.5
-                  - this->m_RandomGenerator->
-                  GetVariateWithOpenRange() ) * 2.0;
-            double m = std::sqrt( ( x * x ) + ( y * y ) + ( z * z ) );
-            x /= m;
-            y /= m;
-            z /= m;
-
-            // Scale the angle in radians 0...pi/2 to the range 0...1
-            // for scaling of the random direction
-            x *= ( randomWalkAngle / ( this->pi / 2.0 ) );
-            y *= ( randomWalkAngle / ( this->pi / 2.0 ) );
-            z *= ( randomWalkAngle / ( this->pi / 2.0 ) );
-
-            // gsl_ran_dir_3d(r,&x,&y,&z);
-            TVector randDir(3);
-
-            randDir[0] = x;
-            randDir[1] = y;
-            randDir[2] = z;
-            if( dot_product(v, randDir) < 0 )
+            vtkPoints *newfiber = vtkPoints::New();
+            newfiber->SetNumberOfPoints(currentPointId);
+            for( int i = 0; i < currentPointId; i++ )
               {
-              randDir *= -1;
+              newfiber->SetPoint( i, fiber->GetPoint(i) );
               }
-            v += randDir;
-            v.normalize();
-            vout = v;
-            bp.m_Direction = e2;
-            branchList.push_back(bp);
-            bp.m_Direction = e1;
-            branchList.push_back(bp);
+            fiber->Delete();
+            fiber = newfiber;
+
+            vout = bp.m_Direction;
+            double *p = fiber->GetPoint(currentPointId - 1);
+            this->MMToContinuousIndex(p, index);
             }
           else
             {
-            bp.m_Direction = e1;
-            branchList.push_back(bp);
-            vout = e2;
+            stop = true;
             }
           }
         else
           {
-          // Using TEND????
-          if( this->m_UseTend )
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // forward propagating
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          anisotropy = this->m_ScalarIP->EvaluateAtContinuousIndex(index);
+          if( currentPointId )
             {
-            this->ApplyTensorDeflection(vin, fullTensorPixel, e2, vout);
+            anisotropySum += anisotropy;
             }
           else
             {
-            vout = e2;
+            anisotropySum = anisotropy;
+            }
+          fiberAnisotropy->InsertNextValue(anisotropy);
+          fiberAnisotropySum->InsertNextValue(anisotropySum);
+
+          typename Self::PointType t;
+          this->ContinuousIndexToMM(index, t);
+          fiber->InsertNextPoint( t.GetDataPointer() );
+          currentPointId++;
+
+          EigenValuesArrayType   eigenValues;
+          EigenVectorsMatrixType eigenVectors;
+          typename Self::TensorImagePixelType tensorPixel
+            = this->m_VectorIP->EvaluateAtContinuousIndex(index);
+
+          TMatrix fullTensorPixel(3, 3);
+
+          fullTensorPixel = Tensor2Matrix(tensorPixel);
+          fiberTensors->InsertNextTypedTuple( fullTensorPixel.data_block() );
+
+          tensorPixel.ComputeEigenAnalysis(eigenValues, eigenVectors);
+
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // Get two tracking vectors - Primary and Secondary Eigen Value
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          TVector e2(3);
+
+          e2[0] = eigenVectors[2][0];
+          e2[1] = eigenVectors[2][1];
+          e2[2] = eigenVectors[2][2];
+          if( dot_product(vin, e2) < 0 )
+            {
+            e2 *= -1;
+            }
+          TVector e1(3);
+
+          e1[0] = eigenVectors[1][0];
+          e1[1] = eigenVectors[1][1];
+          e1[2] = eigenVectors[1][2];
+          if( dot_product(vin, e1) < 0 )
+            {
+            e1 *= -1;
+            }
+
+          // std::cout << "Forward Track Directions: (" << e2 << ") and (" << e1
+          // << ")" << std::endl;
+
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // Add a branch points - Check Criteria for Branching
+          //
+          // ////////////////////////////////////////////////////////////////////////
+
+          if( ( ( anisotropy < this->m_AnisotropyBranchingValue )
+                || ( dot_product(e2, vin) < curvatureBranchAngle ) )
+              && ( branchList.size() <= this->m_MaximumBranches ) )
+            {
+            // std::cout << "Branch Point" << std::endl;
+
+            BranchPointType bp;
+            // bp.m_AI = 0;        bp.m_Length = 0;
+            bp.m_DivergePoint = currentPointId;
+
+            if( this->m_UseRandomWalk )
+              {
+              TVector v(3);
+
+              v[0] = endP[0] - index[0];
+              v[1] = endP[1] - index[1];
+              v[2] = endP[2] - index[2];
+              v.normalize();
+
+              // std::cout << "Random Walk Direction: " << v << std::endl;
+
+              double x, y, z;
+              x
+                = ( 0.5
+                    - rng->GetVariateWithOpenRange() ) * 2.0;
+              y
+                = ( 0.5
+                    - rng->GetVariateWithOpenRange() ) * 2.0;
+              z
+                = ( 0.5
+                    - rng->GetVariateWithOpenRange() ) * 2.0;
+              double m = std::sqrt( ( x * x ) + ( y * y ) + ( z * z ) );
+              x /= m;
+              y /= m;
+              z /= m;
+
+              // Scale the angle in radians 0...pi/2 to the range 0...1
+              // for scaling of the random direction
+              x *= ( randomWalkAngle / ( this->pi / 2.0 ) );
+              y *= ( randomWalkAngle / ( this->pi / 2.0 ) );
+              z *= ( randomWalkAngle / ( this->pi / 2.0 ) );
+
+              // gsl_ran_dir_3d(r,&x,&y,&z);
+              TVector randDir(3);
+
+              randDir[0] = x;
+              randDir[1] = y;
+              randDir[2] = z;
+              if( dot_product(v, randDir) < 0 )
+                {
+                randDir *= -1;
+                }
+              v += randDir;
+              v.normalize();
+              vout = v;
+              bp.m_Direction = e2;
+              branchList.push_back(bp);
+              bp.m_Direction = e1;
+              branchList.push_back(bp);
+              }
+            else
+              {
+              bp.m_Direction = e1;
+              branchList.push_back(bp);
+              vout = e2;
+              }
+            }
+          else
+            {
+            // Using TEND????
+            if( this->m_UseTend )
+              {
+              this->ApplyTensorDeflection(vin, fullTensorPixel, e2, vout);
+              }
+            else
+              {
+              vout = e2;
+              }
             }
           }
-        }
 
-      //
-      // ////////////////////////////////////////////////////////////////////////
-      // Calculate the new index
-      this->StepIndex(tmpIndex, index, vout);
-      bool backTrack = false;
-      if( ImageRegion.IsInside(tmpIndex) )
-        {
         //
         // ////////////////////////////////////////////////////////////////////////
-        // Check if we are in the ending region?
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        if( ( this->m_EndIP->EvaluateAtContinuousIndex(tmpIndex) >= 0.5 )
-            && ( fiber->GetNumberOfPoints() / this->m_StepSize >= this->m_MinimumLength ) )
+        // Calculate the new index
+        this->StepIndex(tmpIndex, index, vout);
+        bool backTrack = false;
+        if( ImageRegion.IsInside(tmpIndex) )
           {
-          // Add Fiber to the Current Fiber Track //
-          sizeOfOutput++;
-          std::
-          cerr << "Fiber (" << originalSeedCount << "  "
-               << sizeOfOutput << "  " << currentPointId << "); ";
-          this->AddFiberToOutput(fiber, fiberTensors);
-          // // newSeeds.push_back(index);
-          // // newDirections.push_back(vout);
-          // std::cout << "Add Track" << std::endl;
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // Check if we are in the ending region?
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          if( ( this->m_EndIP->EvaluateAtContinuousIndex(tmpIndex) >= 0.5 )
+              && ( fiber->GetNumberOfPoints() / this->m_StepSize >= this->m_MinimumLength ) )
+            {
+            // Add Fiber to the Current Fiber Track //
+            Self::KeepFiber(fiber, fiberTensors, fibers);
+            // // newSeeds.push_back(index);
+            // // newDirections.push_back(vout);
+            // std::cout << "Add Track" << std::endl;
 
+            backTrack = true;
+            }
+          }
+        else
+          {
           backTrack = true;
+          outOfBounds = true;       // back up to a previous branch point, if any.
           }
-        }
-      else
-        {
-        backTrack = true;
-        outOfBounds = true;       // back up to a previous branch point, if any.
-        }
 
-      if( backTrack )
-        {
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        // back tracking
-        if( !branchList.empty() )
+        if( backTrack )
           {
-          BranchPointType bp = branchList.back();
-          branchList.pop_back();
-          // fiber.resize(bp.m_DivergePoint);
-          while( currentPointId > bp.m_DivergePoint )
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // back tracking
+          if( !branchList.empty() )
             {
-            fiberTensors->RemoveLastTuple();
-            fiberAnisotropy->RemoveLastTuple();
-            fiberAnisotropySum->RemoveLastTuple();
-            currentPointId--;
-            }
+            BranchPointType bp = branchList.back();
+            branchList.pop_back();
+            // fiber.resize(bp.m_DivergePoint);
+            while( currentPointId > bp.m_DivergePoint )
+              {
+              fiberTensors->RemoveLastTuple();
+              fiberAnisotropy->RemoveLastTuple();
+              fiberAnisotropySum->RemoveLastTuple();
+              currentPointId--;
+              }
 
-          // fiber->SetNumberOfPoints( currentPointId );
+            // fiber->SetNumberOfPoints( currentPointId );
 
-          vtkPoints *newfiber = vtkPoints::New();
-          newfiber->SetNumberOfPoints(currentPointId);
-          for( int i = 0; i < currentPointId; i++ )
+            vtkPoints *newfiber = vtkPoints::New();
+            newfiber->SetNumberOfPoints(currentPointId);
+            for( int i = 0; i < currentPointId; i++ )
+              {
+              newfiber->SetPoint( i, fiber->GetPoint(i) );
+              }
+            fiber->Delete();
+            fiber = newfiber;
+
+            vout = bp.m_Direction;
+            double *p
+              = fiber->GetPoint(currentPointId - 1);
+            typename Self::ContinuousIndexType prevIndex;
+            this->MMToContinuousIndex(p, prevIndex);
+            this->StepIndex(tmpIndex, prevIndex, vout);
+            }
+          else
             {
-            newfiber->SetPoint( i, fiber->GetPoint(i) );
+            stop = true;
             }
-          fiber->Delete();
-          fiber = newfiber;
-
-          vout = bp.m_Direction;
-          double *p
-            = fiber->GetPoint(currentPointId - 1);
-          typename Self::ContinuousIndexType prevIndex;
-          this->MMToContinuousIndex(p, prevIndex);
-          this->StepIndex(tmpIndex, prevIndex, vout);
-          }
-        else
-          {
-          stop = true;
           }
-        }
 
-      //
-      // ////////////////////////////////////////////////////////////////////////
-      // Reset the current index
-      index = tmpIndex;
-      vin = vout;
-
-      // std::cout << "New Index: " << index << std::endl;
-      // std::cout << "Vin: " << vin << std::endl;
-      }                       // End Stop
-    }                         // End - Seeds not empty
+        //
+        // ////////////////////////////////////////////////////////////////////////
+        // Reset the current index
+        index = tmpIndex;
+        vin = vout;
+
+        // std::cout << "New Index: " << index << std::endl;
+        // std::cout << "Vin: " << vin << std::endl;
+        }                       // End Stop
+
+      fiber->Delete();
+      fiberTensors->Delete();
+      fiberAnisotropy->Delete();
+      fiberAnisotropySum->Delete();
+    };
+  this->TrackSeeds(trackSeed);
 
   //  fiber.clear();
   //  branchList.clear();
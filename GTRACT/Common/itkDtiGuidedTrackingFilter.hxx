@@ -95,13 +95,6 @@ DtiGuidedTrackingFilter<TTensorImageType, TAnisotropyImageType, TMaskImageType>
 
   // ////////////////////////////////////////////////////////////////////////
   // Initialize some parameters
-  float   anisotropy, anisotropySum(0);
-  TVector vin(3), vout(3), vguide(3);
-
-  typename Self::ContinuousIndexType index, tmpIndex;
-  bool stop;
-  int  count = 0;
-
   const double inRadians = this->pi / 180.0;
   double       curvatureThreshold = std::cos( this->m_CurvatureThreshold * inRadians );
   double       guidedCurvatureThreshold = std::cos( this->m_GuidedCurvatureThreshold * inRadians );
@@ -110,216 +103,225 @@ DtiGuidedTrackingFilter<TTensorImageType, TAnisotropyImageType, TMaskImageType>
 
   // ////////////////////////////////////////////////////////////////////////
   // For each seed point, start guided tracking
-  while( !this->m_Seeds.empty() )
+  auto trackSeed = [&](SizeValueType,
+                       const typename Self::ContinuousIndexType & seedIndex,
+                       const TVector & seedDirection,
+                       typename Superclass::TrackedFiberListType & fibers)
     {
-    index = this->m_Seeds.back();              this->m_Seeds.pop_back();
-    vin = vout  = this->m_TrackingDirections.back();  this->m_TrackingDirections.pop_back();
-
-    stop = false;
-    // addFiber = false;
-    vtkPoints *    fiber = vtkPoints::New();
-    vtkFloatArray *fiberTensors = vtkFloatArray::New();
-    fiberTensors->SetName("Tensors");
-    fiberTensors->SetNumberOfComponents(9);
-    vtkFloatArray *fiberAnisotropy = vtkFloatArray::New();
-    fiberAnisotropy->SetName("Anisotropy");
-    vtkFloatArray *fiberAnisotropySum = vtkFloatArray::New();
-    fiberAnisotropySum->SetName("Anisotropy-Sum");
-    int   currentPointId = 0;
-    float pathLength = 0.0;
-
-    typename Self::PointType p2;
-    double p1[3];
-    this->m_GuideFiber->GetPoint(0, p1);
-    this->ContinuousIndexToMM( index, p2 );
-    typename Self::ContinuousIndexType index1;
-    this->MMToContinuousIndex( p1, index1 );
-
-    // std::cout << "Guide Index: " << index1 << std::endl;
-    // std::cout << "Guide Point 0: " << p1[0] << " " << p1[1] << " " << p1[2]
-    // << std::endl;
-    // std::cout << "Seed Index: " << index << std::endl;
-    // std::cout << "Seed Point: " << p2 << std::endl;
-
-    /***VAM - MaxDistance is now defined by the user */
-    // float MaxDist =
-    //
-    // std::sqrt(pow((double)(p1[0]-p2[0]),2.0)+pow((double)(p1[1]-p2[1]),2.0)+pow((double)(p1[2]-p2[2]),2.0));
-    // MaxDist *= 1.5;
-    double MaxDist = this->m_MaximumGuideDistance;
-    // std::cout << "Max Distance: " << MaxDist << std::endl;
-
-    while( !stop )
-      {
-      if( ImageRegion.IsInside(index) )
-        {
-        anisotropy = this->m_ScalarIP->EvaluateAtContinuousIndex(index);
-        }
-      else
-        {
-        anisotropy = -1;
-        }
-
+      float   anisotropy, anisotropySum(0);
+      TVector vin(seedDirection), vout(seedDirection), vguide(3);
+
+      typename Self::ContinuousIndexType index(seedIndex), tmpIndex;
+
+      bool stop = false;
+      // addFiber = false;
+      vtkPoints *    fiber = vtkPoints::New();
+      vtkFloatArray *fiberTensors = vtkFloatArray::New();
+      fiberTensors->SetName("Tensors");
+      fiberTensors->SetNumberOfComponents(9);
+      vtkFloatArray *fiberAnisotropy = vtkFloatArray::New();
+      fiberAnisotropy->SetName("Anisotropy");
+      vtkFloatArray *fiberAnisotropySum = vtkFloatArray::New();
+      fiberAnisotropySum->SetName("Anisotropy-Sum");
+      int   currentPointId = 0;
+      float pathLength = 0.0;
+
+      typename Self::PointType p2;
+      double p1[3];
+      this->m_GuideFiber->GetPoint(0, p1);
+      this->ContinuousIndexToMM( index, p2 );
+      typename Self::ContinuousIndexType index1;
+      this->MMToContinuousIndex( p1, index1 );
+
+      // std::cout << "Guide Index: " << index1 << std::endl;
+      // std::cout << "Guide Point 0: " << p1[0] << " " << p1[1] << " " << p1[2]
+      // << std::endl;
+      // std::cout << "Seed Index: " << index << std::endl;
+      // std::cout << "Seed Point: " << p2 << std::endl;
+
+      /***VAM - MaxDistance is now defined by the user */
+      // float MaxDist =
       //
-      // ////////////////////////////////////////////////////////////////////////
-      // Evaluate the stopping criteria: is below fa threshold? is outside image
-      // region?
-      if( anisotropy >= this->m_AnisotropyThreshold )
+      // std::sqrt(pow((double)(p1[0]-p2[0]),2.0)+pow((double)(p1[1]-p2[1]),2.0)+pow((double)(p1[2]-p2[2]),2.0));
+      // MaxDist *= 1.5;
+      double MaxDist = this->m_MaximumGuideDistance;
+      // std::cout << "Max Distance: " << MaxDist << std::endl;
+
+      while( !stop )
         {
-        if( currentPointId == 0 )
+        if( ImageRegion.IsInside(index) )
           {
-          anisotropySum = anisotropy;
+          anisotropy = this->m_ScalarIP->EvaluateAtContinuousIndex(index);
           }
         else
           {
-          anisotropySum += anisotropy;
+          anisotropy = -1;
           }
 
-        typename Self::PointType p;
-        this->ContinuousIndexToMM( index, p );
-        fiber->InsertNextPoint( p.GetDataPointer() );
-
-        currentPointId++;
-        fiberAnisotropy->InsertNextValue( anisotropy );
-        fiberAnisotropySum->InsertNextValue( anisotropySum );
-
-        // std::cout << "\tFiber Point: " << index << std::endl;
-
         //
         // ////////////////////////////////////////////////////////////////////////
-        // Seeking guidance
-        bool isGuided = GuideDirection(index, this->m_GuideFiber, MaxDist, vguide);
+        // Evaluate the stopping criteria: is below fa threshold? is outside image
+        // region?
+        if( anisotropy >= this->m_AnisotropyThreshold )
+          {
+          if( currentPointId == 0 )
+            {
+            anisotropySum = anisotropy;
+            }
+          else
+            {
+            anisotropySum += anisotropy;
+            }
 
-        EigenValuesArrayType   eigenValues;
-        EigenVectorsMatrixType eigenVectors;
-        typename Self::TensorImagePixelType tensorPixel = this->m_VectorIP->EvaluateAtContinuousIndex(index);
+          typename Self::PointType p;
+          this->ContinuousIndexToMM( index, p );
+          fiber->InsertNextPoint( p.GetDataPointer() );
 
-        TMatrix fullTensorPixel(3, 3); fullTensorPixel = Tensor2Matrix( tensorPixel );
-        fiberTensors->InsertNextTypedTuple( fullTensorPixel.data_block() );
+          currentPointId++;
+          fiberAnisotropy->InsertNextValue( anisotropy );
+          fiberAnisotropySum->InsertNextValue( anisotropySum );
 
-        tensorPixel.ComputeEigenAnalysis(eigenValues, eigenVectors);
+          // std::cout << "\tFiber Point: " << index << std::endl;
 
-        TVector e2(3); e2[0] = eigenVectors[2][0]; e2[1] = eigenVectors[2][1]; e2[2] = eigenVectors[2][2];
-        // std::cout << "\tEigen Vector " << e2 << " Guide Direction " << vguide
-        // << std::endl;
-        if( isGuided )
-          {
-          // std::cout << "\tGuided Fiber: " << std::endl;
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          // Seeking guidance
+          bool isGuided = GuideDirection(index, this->m_GuideFiber, MaxDist, vguide);
 
-          if( dot_product(e2, vin) < 0 )
-            {
-            e2 *= -1;
-            }
+          EigenValuesArrayType   eigenValues;
+          EigenVectorsMatrixType eigenVectors;
+          typename Self::TensorImagePixelType tensorPixel = this->m_VectorIP->EvaluateAtContinuousIndex(index);
 
-          if( dot_product(vguide, vin) < 0 )
-            {
-            vguide *= -1;
-            }
+          TMatrix fullTensorPixel(3, 3); fullTensorPixel = Tensor2Matrix( tensorPixel );
+          fiberTensors->InsertNextTypedTuple( fullTensorPixel.data_block() );
 
-          if( dot_product(e2, vguide) < guidedCurvatureThreshold )
-            {
-            vout = vguide; // using guiding direction
-            // std::cout << "\tUsing Guide Direction: " << vguide << std::endl;
-            }
-          else
+          tensorPixel.ComputeEigenAnalysis(eigenValues, eigenVectors);
+
+          TVector e2(3); e2[0] = eigenVectors[2][0]; e2[1] = eigenVectors[2][1]; e2[2] = eigenVectors[2][2];
+          // std::cout << "\tEigen Vector " << e2 << " Guide Direction " << vguide
+          // << std::endl;
+          if( isGuided )
             {
-            // std::cout << "\tUsing EigenVector Direction: " << e2 <<
-            // std::endl;
-            // Use tend???
-            if( this->m_UseTend )
+            // std::cout << "\tGuided Fiber: " << std::endl;
+
+            if( dot_product(e2, vin) < 0 )
               {
-              this->ApplyTensorDeflection(vin, fullTensorPixel, e2, vout);
+              e2 *= -1;
               }
-            else
+
+            if( dot_product(vguide, vin) < 0 )
               {
-              vout  = e2;
+              vguide *= -1;
               }
-            }
-
-          // std::cout << "\tOut Direction: " << vout << std::endl;
-          //
-          // ////////////////////////////////////////////////////////////////////////
-          // Update Index
-          this->StepIndex(tmpIndex, index, vout);
-          pathLength += this->m_StepSize;
-          index = tmpIndex;
-          vin = vout;
-          // std::cout << "New Index: " << index << std::endl;
-          }
-        else
-          {
-          //
-          // ////////////////////////////////////////////////////////////////////////
-          // Unguided -- can't use the guide
-          // std::cout << "\tUnguided Fiber: " << std::endl;
-          //
-          // ////////////////////////////////////////////////////////////////////////
-          // Get the principle eigen vector at the current point
-
-          if( dot_product(vin, e2) < 0 )
-            {
-            e2 *= -1;
-            }
 
-          // Check the Curvature Threshold
-          if( dot_product(vin, e2) < curvatureThreshold )
-            {
-            if( this->m_UseTend )
+            if( dot_product(e2, vguide) < guidedCurvatureThreshold )
               {
-              this->ApplyTensorDeflection(vin, fullTensorPixel, e2, vout);
+              vout = vguide; // using guiding direction
+              // std::cout << "\tUsing Guide Direction: " << vguide << std::endl;
               }
             else
               {
-              vout = e2;
+              // std::cout << "\tUsing EigenVector Direction: " << e2 <<
+              // std::endl;
+              // Use tend???
+              if( this->m_UseTend )
+                {
+                this->ApplyTensorDeflection(vin, fullTensorPixel, e2, vout);
+                }
+              else
+                {
+                vout  = e2;
+                }
               }
 
+            // std::cout << "\tOut Direction: " << vout << std::endl;
+            //
+            // ////////////////////////////////////////////////////////////////////////
+            // Update Index
             this->StepIndex(tmpIndex, index, vout);
             pathLength += this->m_StepSize;
             index = tmpIndex;
             vin = vout;
+            // std::cout << "New Index: " << index << std::endl;
             }
           else
             {
-            // std::cout << "Abandon Unguided Fiber Below Curvature Threshold"
-            // << std::endl;
-            stop = true;
+            //
+            // ////////////////////////////////////////////////////////////////////////
+            // Unguided -- can't use the guide
+            // std::cout << "\tUnguided Fiber: " << std::endl;
+            //
+            // ////////////////////////////////////////////////////////////////////////
+            // Get the principle eigen vector at the current point
+
+            if( dot_product(vin, e2) < 0 )
+              {
+              e2 *= -1;
+              }
+
+            // Check the Curvature Threshold
+            if( dot_product(vin, e2) < curvatureThreshold )
+              {
+              if( this->m_UseTend )
+                {
+                this->ApplyTensorDeflection(vin, fullTensorPixel, e2, vout);
+                }
+              else
+                {
+                vout = e2;
+                }
+
+              this->StepIndex(tmpIndex, index, vout);
+              pathLength += this->m_StepSize;
+              index = tmpIndex;
+              vin = vout;
+              }
+            else
+              {
+              // std::cout << "Abandon Unguided Fiber Below Curvature Threshold"
+              // << std::endl;
+              stop = true;
+              }
             }
+          //
+          // ////////////////////////////////////////////////////////////////////////
+          }
+        else
+          {
+          stop = true;
+          // std::cout << "Abandon Fiber Below Anisotropy Threshold" << std::endl;
           }
-        //
-        // ////////////////////////////////////////////////////////////////////////
-        }
-      else
-        {
-        stop = true;
-        // std::cout << "Abandon Fiber Below Anisotropy Threshold" << std::endl;
-        }
-
-      if( ( this->m_EndIP->EvaluateAtContinuousIndex(index) >= 0.5 ) && ( pathLength >= this->m_MinimumLength ) )
-        {
-        std::cerr << "\tFiber-" << count << " (" << currentPointId <<  "); ";
-        this->AddFiberToOutput( fiber, fiberTensors );
-        stop = true;
-        count++;
-        }
 
-      // Check for loops if selected by the user
-      if( this->m_UseLoopDetection )
-        {
-        if( Self::IsLoop(fiber) )
+        if( ( this->m_EndIP->EvaluateAtContinuousIndex(index) >= 0.5 ) && ( pathLength >= this->m_MinimumLength ) )
           {
+          Self::KeepFiber( fiber, fiberTensors, fibers );
           stop = true;
           }
-        }
 
-      // Check fiber length
-      if( pathLength > this->m_MaximumLength )
-        {
-        // std::cout << "Abandon Max Length" << fiber->GetNumberOfPoints() <<
-        // std::endl;
-        stop = true;
-        }
-      } // Fiber Path Loop
-    }   // Seed Loop
+        // Check for loops if selected by the user
+        if( this->m_UseLoopDetection )
+          {
+          if( Self::IsLoop(fiber) )
+            {
+            stop = true;
+            }
+          }
+
+        // Check fiber length
+        if( pathLength > this->m_MaximumLength )
+          {
+          // std::cout << "Abandon Max Length" << fiber->GetNumberOfPoints() <<
+          // std::endl;
+          stop = true;
+          }
+        } // Fiber Path Loop
+
+      fiber->Delete();
+      fiberTensors->Delete();
+      fiberAnisotropy->Delete();
+      fiberAnisotropySum->Delete();
+    };
+  this->TrackSeeds(trackSeed);
 }
 
 template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
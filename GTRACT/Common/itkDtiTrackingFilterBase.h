@@ -78,6 +78,8 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 // ////////////////////////////////////////////////////////////////////////
 
@@ -197,6 +199,41 @@ public:
 
   DtiFiberType GetOutput();
 
+  /** Tract aggregation.  When AggregateFibers is on every accepted fiber is
+   * accumulated, as it is generated, into a track density image (number of
+   * fibers visiting each voxel), a per voxel mean of the fibers' mean
+   * anisotropy, and, if a ConnectivityLabelImage is set, the number of fibers
+   * joining each pair of labels at their end points.  Turn RetainFibers off
+   * to skip building the vtkPolyData output entirely.  The aggregates are
+   * defined on the grid of the anisotropy image and accumulate over Update()
+   * calls until ResetAggregation(). */
+  using TrackImageType = itk::Image<float, 3>;
+  using TrackImagePointer = typename TrackImageType::Pointer;
+  using ConnectivityLabelImageType = itk::Image<unsigned short, 3>;
+  using ConnectivityLabelType = typename ConnectivityLabelImageType::PixelType;
+  using ConnectivityMatrixType = std::map<std::pair<ConnectivityLabelType, ConnectivityLabelType>, unsigned long>;
+
+  itkSetMacro(AggregateFibers, bool);
+  itkGetConstMacro(AggregateFibers, bool);
+  itkBooleanMacro(AggregateFibers);
+  itkSetMacro(RetainFibers, bool);
+  itkGetConstMacro(RetainFibers, bool);
+  itkBooleanMacro(RetainFibers);
+  itkSetObjectMacro(ConnectivityLabelImage, ConnectivityLabelImageType);
+
+  TrackImagePointer GetTrackDensityImage();
+
+  TrackImagePointer GetMeanAnisotropyImage();
+
+  const ConnectivityMatrixType & GetConnectivityMatrix() const
+  {
+    return m_ConnectivityMatrix;
+  }
+
+  itkGetConstMacro(NumberOfAggregatedFibers, unsigned long);
+
+  void ResetAggregation();
+
   // void Update();
 protected:
   DtiTrackingFilterBase();
@@ -224,6 +261,32 @@ protected:
 
   void AddFiberToOutput( vtkPoints *currentFiber, vtkFloatArray *fiberTensors );
 
+  void AggregateFiber( vtkPoints *currentFiber );
+
+  /** A fiber accepted while tracking one seed.  It is kept until the fibers
+   * of a whole block of seeds are added to the output in seed order. */
+  struct TrackedFiberType
+    {
+    vtkPoints *Points;
+    vtkFloatArray *Tensors;
+    };
+  using TrackedFiberListType = std::vector<TrackedFiberType>;
+
+  /** Number of seeds tracked concurrently between additions to the output */
+  static constexpr unsigned int SeedBlockSize = 256;
+
+  /** Keep a deep copy of an accepted fiber, the tracker goes on editing its
+   * own buffers when it backs up to a branch point. */
+  static void KeepFiber( vtkPoints *fiber, vtkFloatArray *fiberTensors, TrackedFiberListType & fibers );
+
+  /** Track all seeds of m_Seeds concurrently.  The functor is called as
+   * trackSeed(seedNumber, index, direction, fibers) and must only read the
+   * filter state.  Seeds are numbered in the order the serial trackers took
+   * them (last seed first) and their fibers are added to the output in that
+   * order, so the result does not depend on the number of threads. */
+  template <typename TTrackSeedFunction>
+  void TrackSeeds( TTrackSeedFunction trackSeed );
+
   DirectionListType m_TrackingDirections;
 
   // Input and Output Image
@@ -251,6 +314,15 @@ protected:
   float m_TendG;
   float m_TendF;
 
+  // Aggregation output
+  bool                                         m_AggregateFibers;
+  bool                                         m_RetainFibers;
+  typename ConnectivityLabelImageType::Pointer m_ConnectivityLabelImage;
+  TrackImagePointer                            m_TrackDensityImage;
+  TrackImagePointer                            m_AnisotropySumImage;
+  ConnectivityMatrixType                       m_ConnectivityMatrix;
+  unsigned long                                m_NumberOfAggregatedFibers;
+
   float pi;
 };  // end of class
 } // end namespace itk
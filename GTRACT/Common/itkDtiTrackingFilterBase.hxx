@@ -50,12 +50,14 @@
 // #include <itkIOCommon.h>
 // #include "itkMetaDataObject.h"
 #include "itkProgressAccumulator.h"
+#include "itkMultiThreaderBase.h"
 
 #include "itkDtiTrackingFilterBase.h"
 // #include "algo.h"
 
 
 #include <iostream>
+#include <algorithm>
 
 namespace itk
 {
@@ -72,6 +74,9 @@ DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
   m_MinimumLength = 0.0;
   m_AnisotropyThreshold = 0.3;
   m_SeedThreshold = 0.5;
+  m_AggregateFibers = false;
+  m_RetainFibers = true;
+  m_NumberOfAggregatedFibers = 0;
   m_ScalarIP    = ScalarIPType::New();
   m_VectorIP    = VectorIPType::New();
   m_StartIP             = Self::MaskIPType::New();
@@ -239,6 +244,14 @@ void
 DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
 ::AddFiberToOutput( vtkPoints *currentFiber, vtkFloatArray *fiberTensors )
 {
+  if( this->m_AggregateFibers )
+    {
+    this->AggregateFiber( currentFiber );
+    }
+  if( !this->m_RetainFibers )
+    {
+    return;
+    }
   // std::cerr << "NumPts " << currentFiber->GetNumberOfPoints() << ".  ";
 
   vtkCellArray *line = vtkCellArray::New();
@@ -272,5 +285,186 @@ DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
   //  data->Delete();
   //  line->Delete();
 }
+
+template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
+void
+DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::ResetAggregation()
+{
+  m_TrackDensityImage = TrackImageType::New();
+  m_TrackDensityImage->CopyInformation( m_AnisotropyImage );
+  m_TrackDensityImage->SetRegions( m_AnisotropyImage->GetLargestPossibleRegion() );
+  m_TrackDensityImage->Allocate();
+  m_TrackDensityImage->FillBuffer(0.0F);
+
+  m_AnisotropySumImage = TrackImageType::New();
+  m_AnisotropySumImage->CopyInformation( m_AnisotropyImage );
+  m_AnisotropySumImage->SetRegions( m_AnisotropyImage->GetLargestPossibleRegion() );
+  m_AnisotropySumImage->Allocate();
+  m_AnisotropySumImage->FillBuffer(0.0F);
+
+  m_ConnectivityMatrix.clear();
+  m_NumberOfAggregatedFibers = 0;
+}
+
+template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
+void
+DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::AggregateFiber( vtkPoints *currentFiber )
+{
+  if( m_TrackDensityImage.IsNull() )
+    {
+    this->ResetAggregation();
+    }
+
+  const vtkIdType numberOfPoints = currentFiber->GetNumberOfPoints();
+  if( numberOfPoints == 0 )
+    {
+    return;
+    }
+
+  // Each fiber counts once per voxel it visits
+  std::vector<OffsetValueType> visited;
+  visited.reserve( numberOfPoints );
+  double    anisotropySum = 0.0;
+  vtkIdType numberOfAnisotropySamples = 0;
+  for( vtkIdType i = 0; i < numberOfPoints; i++ )
+    {
+    PointType p;
+    currentFiber->GetPoint( i, p.GetDataPointer() );
+    typename AnisotropyImageType::IndexType index;
+    if( m_AnisotropyImage->TransformPhysicalPointToIndex( p, index ) )
+      {
+      visited.push_back( m_AnisotropyImage->ComputeOffset( index ) );
+      }
+    if( m_ScalarIP->IsInsideBuffer( p ) )
+      {
+      anisotropySum += m_ScalarIP->Evaluate( p );
+      ++numberOfAnisotropySamples;
+      }
+    }
+  std::sort( visited.begin(), visited.end() );
+  visited.erase( std::unique( visited.begin(), visited.end() ), visited.end() );
+
+  // Points outside of the anisotropy buffer do not contribute to the mean
+  const float meanAnisotropy = ( numberOfAnisotropySamples > 0 )
+    ? static_cast<float>( anisotropySum / numberOfAnisotropySamples ) : 0.0F;
+  float *     density = m_TrackDensityImage->GetBufferPointer();
+  float *     anisotropy = m_AnisotropySumImage->GetBufferPointer();
+  for( const auto offset : visited )
+    {
+    density[offset] += 1.0F;
+    anisotropy[offset] += meanAnisotropy;
+    }
+
+  if( m_ConnectivityLabelImage.IsNotNull() )
+    {
+    ConnectivityLabelType endLabels[2] = { 0, 0 };
+    const vtkIdType       endPoints[2] = { 0, numberOfPoints - 1 };
+    for( unsigned int e = 0; e < 2; ++e )
+      {
+      PointType p;
+      currentFiber->GetPoint( endPoints[e], p.GetDataPointer() );
+      typename ConnectivityLabelImageType::IndexType index;
+      if( m_ConnectivityLabelImage->TransformPhysicalPointToIndex( p, index ) )
+        {
+        endLabels[e] = m_ConnectivityLabelImage->GetPixel( index );
+        }
+      }
+    if( endLabels[0] != 0 && endLabels[1] != 0 )
+      {
+      ++m_ConnectivityMatrix[std::make_pair( std::min( endLabels[0], endLabels[1] ),
+                                             std::max( endLabels[0], endLabels[1] ) )];
+      }
+    }
+  ++m_NumberOfAggregatedFibers;
+}
+
+template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
+typename DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>::TrackImagePointer
+DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::GetTrackDensityImage()
+{
+  if( m_TrackDensityImage.IsNull() )
+    {
+    this->ResetAggregation();
+    }
+  return m_TrackDensityImage;
+}
+
+template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
+typename DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>::TrackImagePointer
+DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::GetMeanAnisotropyImage()
+{
+  TrackImagePointer density = this->GetTrackDensityImage();
+
+  TrackImagePointer meanImage = TrackImageType::New();
+  meanImage->CopyInformation( density );
+  meanImage->SetRegions( density->GetLargestPossibleRegion() );
+  meanImage->Allocate();
+
+  const float *     counts = density->GetBufferPointer();
+  const float *     sums = m_AnisotropySumImage->GetBufferPointer();
+  float *           means = meanImage->GetBufferPointer();
+  const SizeValueType numberOfPixels = density->GetLargestPossibleRegion().GetNumberOfPixels();
+  for( SizeValueType i = 0; i < numberOfPixels; ++i )
+    {
+    means[i] = ( counts[i] > 0.0F ) ? sums[i] / counts[i] : 0.0F;
+    }
+  return meanImage;
+}
+
+template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
+void
+DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::KeepFiber( vtkPoints *fiber, vtkFloatArray *fiberTensors, TrackedFiberListType & fibers )
+{
+  TrackedFiberType kept;
+  kept.Points = vtkPoints::New();
+  kept.Points->DeepCopy( fiber );
+  kept.Tensors = vtkFloatArray::New();
+  kept.Tensors->DeepCopy( fiberTensors );
+  kept.Tensors->SetName( fiberTensors->GetName() );
+  fibers.push_back( kept );
+}
+
+template <typename TTensorImageType, typename TAnisotropyImageType, typename TMaskImageType>
+template <typename TTrackSeedFunction>
+void
+DtiTrackingFilterBase<TTensorImageType, TAnisotropyImageType, TMaskImageType>
+::TrackSeeds( TTrackSeedFunction trackSeed )
+{
+  // The serial trackers popped seeds from the back of the lists
+  const std::vector<ContinuousIndexType> seeds( m_Seeds.rbegin(), m_Seeds.rend() );
+  const std::vector<TVector>             directions( m_TrackingDirections.rbegin(), m_TrackingDirections.rend() );
+  m_Seeds.clear();
+  m_TrackingDirections.clear();
+
+  MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+  for( size_t blockStart = 0; blockStart < seeds.size(); blockStart += SeedBlockSize )
+    {
+    const size_t                      blockEnd = std::min( seeds.size(), blockStart + SeedBlockSize );
+    std::vector<TrackedFiberListType> blockFibers( blockEnd - blockStart );
+    mt->ParallelizeArray( blockStart, blockEnd,
+                          [&](SizeValueType seedNumber)
+                            {
+                              trackSeed( seedNumber, seeds[seedNumber], directions[seedNumber],
+                                         blockFibers[seedNumber - blockStart] );
+                            },
+                          nullptr );
+    for( size_t i = 0; i < blockFibers.size(); ++i )
+      {
+      for( auto & fiber : blockFibers[i] )
+        {
+        itkDebugMacro( << "Fiber (" << blockStart + i << "  " << fiber.Points->GetNumberOfPoints() << ")" );
+        this->AddFiberToOutput( fiber.Points, fiber.Tensors );
+        fiber.Points->Delete();
+        fiber.Tensors->Delete();
+        }
+      }
+    }
+}
+
 } // end namespace itk
 #endif
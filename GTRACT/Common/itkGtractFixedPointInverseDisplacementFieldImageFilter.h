@@ -0,0 +1,192 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkGtractFixedPointInverseDisplacementFieldImageFilter_h
+#define __itkGtractFixedPointInverseDisplacementFieldImageFilter_h
+
+#include "itkImageToImageFilter.h"
+
+namespace itk
+{
+/** \class GtractFixedPointInverseDisplacementFieldImageFilter
+ * \brief Computes the inverse of a displacement field by fixed point iteration.
+ *
+ * If the input displacement field v maps a point x of space A to x + v(x)
+ * in space B, the output u maps a point y of B back to A.  At every output
+ * voxel y the inverse displacement is the fixed point of
+ *
+ *   u(y) = -v( y + u(y) )
+ *
+ * iterated from the displacement found at the previous voxel of the row
+ * (-v(y) for the first one) until the residual |u + v(y + u)|, the distance
+ * between y and the forward mapping of y + u, is below ErrorTolerance or
+ * MaximumNumberOfIterations is reached.  The iteration converges for
+ * displacement fields with a displacement gradient of norm below one, as
+ * registration fields are.  The input is interpolated linearly; the
+ * displacement is zero outside of the input field.
+ *
+ * Every output voxel is independent, the rows are processed in parallel.
+ * Unlike GtractInverseDisplacementFieldImageFilter the input field is used
+ * at full resolution, and the cost is linear in the number of voxels.
+ *
+ * The output grid is set with Size, OutputSpacing, OutputOrigin and
+ * OutputDirection.  When the size is not set the output has the grid of
+ * the input field.
+ *
+ * This filter expects both the input and output images to be of pixel type
+ * Vector.
+ *
+ * \ingroup ImageToImageFilter
+ */
+template <typename TInputImage, typename TOutputImage>
+class GtractFixedPointInverseDisplacementFieldImageFilter :
+  public         ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  ITK_DISALLOW_COPY_AND_ASSIGN(GtractFixedPointInverseDisplacementFieldImageFilter);
+
+  /** Standard class type alias. */
+  using Self = GtractFixedPointInverseDisplacementFieldImageFilter;
+  using Superclass = ImageToImageFilter<TInputImage, TOutputImage>;
+  using Pointer = SmartPointer<Self>;
+  using ConstPointer = SmartPointer<const Self>;
+
+  using InputImageType = TInputImage;
+  using InputImagePointer = typename InputImageType::Pointer;
+  using InputImageConstPointer = typename InputImageType::ConstPointer;
+  using InputImageRegionType = typename InputImageType::RegionType;
+  using InputPixelType = typename InputImageType::PixelType;
+  using OutputImageType = TOutputImage;
+  using OutputImagePointer = typename OutputImageType::Pointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(GtractFixedPointInverseDisplacementFieldImageFilter, ImageToImageFilter);
+
+  /** Number of dimensions. */
+  static constexpr unsigned int ImageDimension = TOutputImage::ImageDimension;
+
+  /** Image size type alias. */
+  using SizeType = typename OutputImageType::SizeType;
+
+  /** Image index type alias. */
+  using IndexType = typename OutputImageType::IndexType;
+
+  /** Image pixel value type alias. */
+  using OutputPixelType = typename TOutputImage::PixelType;
+  using OutputPixelComponentType = typename OutputPixelType::ValueType;
+
+  /** Typedef to describe the output image region type. */
+  using OutputImageRegionType = typename TOutputImage::RegionType;
+
+  /** Image spacing type alias */
+  using SpacingType = typename TOutputImage::SpacingType;
+  using OriginPointType = typename TOutputImage::PointType;
+
+  /** Image direction type alias */
+  using DirectionType = typename TOutputImage::DirectionType;
+
+  /** Set/Get the size of the output image, the size of the input when all zero. */
+  itkSetMacro( Size, SizeType );
+  itkGetConstReferenceMacro( Size, SizeType );
+
+  /** Set/Get the output image spacing. */
+  itkSetMacro(OutputSpacing, SpacingType);
+  itkGetConstReferenceMacro( OutputSpacing, SpacingType );
+
+  /** Set/Get the output image origin. */
+  itkSetMacro(OutputOrigin, OriginPointType);
+  itkGetConstReferenceMacro( OutputOrigin, OriginPointType );
+
+  /** Set/Get the output image direction. */
+  itkSetMacro(OutputDirection, DirectionType);
+  itkGetConstReferenceMacro( OutputDirection, DirectionType );
+
+  /** Set/Get the maximum number of fixed point iterations per voxel. */
+  itkSetMacro( MaximumNumberOfIterations, unsigned int );
+  itkGetConstMacro( MaximumNumberOfIterations, unsigned int );
+
+  /** Set/Get the residual, in physical units, below which a voxel has converged. */
+  itkSetMacro( ErrorTolerance, double );
+  itkGetConstMacro( ErrorTolerance, double );
+
+  /** Mean and maximum residual over the output after the last update. */
+  itkGetConstMacro( MeanErrorNorm, double );
+  itkGetConstMacro( MaxErrorNorm, double );
+
+  /** Number of output voxels that did not reach ErrorTolerance in the last update. */
+  itkGetConstMacro( NumberOfUnconvergedPixels, SizeValueType );
+
+  /** The output grid is not the input grid. \sa ProcessObject::GenerateOutputInformaton() */
+  void GenerateOutputInformation() override;
+
+  /** The whole input field is needed. \sa ProcessObject::GenerateInputRequestedRegion() */
+  void GenerateInputRequestedRegion() override;
+
+  /** The whole output is computed. */
+  void EnlargeOutputRequestedRegion(DataObject *output) override;
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  /** Begin concept checking */
+  itkConceptMacro( OutputHasNumericTraitsCheck,
+                   ( Concept::HasNumericTraits<OutputPixelComponentType> ) );
+  /** End concept checking */
+#endif
+protected:
+  GtractFixedPointInverseDisplacementFieldImageFilter();
+  ~GtractFixedPointInverseDisplacementFieldImageFilter() override
+  {
+  }
+
+  void PrintSelf(std::ostream & os, Indent indent) const override;
+
+  /** Iterate every output voxel to its fixed point. */
+  void GenerateData() override;
+
+private:
+  /** Linear interpolation of the input field at a physical point, zero outside */
+  void EvaluateDisplacement(const double point[], double displacement[]) const;
+
+  SizeType        m_Size;                            // Size of the output image
+  SpacingType     m_OutputSpacing;                   // output image spacing
+  OriginPointType m_OutputOrigin;                    // output image origin
+  DirectionType   m_OutputDirection;                 // output image direction
+
+  unsigned int  m_MaximumNumberOfIterations;
+  double        m_ErrorTolerance;
+  double        m_MeanErrorNorm;
+  double        m_MaxErrorNorm;
+  SizeValueType m_NumberOfUnconvergedPixels;
+
+  // Input field buffer and geometry, set up by GenerateData
+  const InputPixelType *m_InputBuffer;
+  OffsetValueType       m_InputStart[ImageDimension];
+  OffsetValueType       m_InputEnd[ImageDimension];
+  OffsetValueType       m_InputStride[ImageDimension];
+  double                m_InputOrigin[ImageDimension];
+  double                m_InputPhysicalToIndex[ImageDimension][ImageDimension];
+};
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkGtractFixedPointInverseDisplacementFieldImageFilter.hxx"
+#endif
+
+#endif // __itkGtractFixedPointInverseDisplacementFieldImageFilter_h
@@ -0,0 +1,317 @@
+/*=========================================================================
+ *
+ *  Copyright SINAPSE: Scalable Informatics for Neuroscience, Processing and Software Engineering
+ *            The University of Iowa
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *         http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkGtractFixedPointInverseDisplacementFieldImageFilter_hxx
+#define __itkGtractFixedPointInverseDisplacementFieldImageFilter_hxx
+
+#include "itkGtractFixedPointInverseDisplacementFieldImageFilter.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace itk
+{
+/**
+ * Initialize new instance
+ */
+template <typename TInputImage, typename TOutputImage>
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::GtractFixedPointInverseDisplacementFieldImageFilter() :
+  m_MaximumNumberOfIterations(20),
+  m_ErrorTolerance(0.01),
+  m_MeanErrorNorm(0.0),
+  m_MaxErrorNorm(0.0),
+  m_NumberOfUnconvergedPixels(0),
+  m_InputBuffer(nullptr)
+{
+  m_Size.Fill(0);
+  m_OutputSpacing.Fill(1.0);
+  m_OutputOrigin.Fill(0.0);
+  m_OutputDirection.SetIdentity();
+}
+
+/**
+ * Print out a description of self
+ */
+template <typename TInputImage, typename TOutputImage>
+void
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "Size:                      " << m_Size << std::endl;
+  os << indent << "OutputSpacing:             " << m_OutputSpacing << std::endl;
+  os << indent << "OutputOrigin:              " << m_OutputOrigin << std::endl;
+  os << indent << "OutputDirection:           " << m_OutputDirection << std::endl;
+  os << indent << "MaximumNumberOfIterations: " << m_MaximumNumberOfIterations << std::endl;
+  os << indent << "ErrorTolerance:            " << m_ErrorTolerance << std::endl;
+  os << indent << "MeanErrorNorm:             " << m_MeanErrorNorm << std::endl;
+  os << indent << "MaxErrorNorm:              " << m_MaxErrorNorm << std::endl;
+  os << indent << "NumberOfUnconvergedPixels: " << m_NumberOfUnconvergedPixels << std::endl;
+}
+
+/**
+ * Linear interpolation of the input field, with the boundary handling of
+ * VectorLinearInterpolateImageFunction and zero outside of the buffer.
+ */
+template <typename TInputImage, typename TOutputImage>
+void
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::EvaluateDisplacement(const double point[], double displacement[]) const
+{
+  double cindex[ImageDimension];
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    cindex[i] = 0.0;
+    for( unsigned int j = 0; j < ImageDimension; ++j )
+      {
+      cindex[i] += m_InputPhysicalToIndex[i][j] * ( point[j] - m_InputOrigin[j] );
+      }
+    }
+  for( unsigned int i = 0; i < ImageDimension; ++i )
+    {
+    displacement[i] = 0.0;
+    }
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    // Written so that a NaN is outside.
+    if( !( cindex[d] >= m_InputStart[d] - 0.5 && cindex[d] < m_InputEnd[d] + 0.5 ) )
+      {
+      return;
+      }
+    }
+
+  OffsetValueType lowerOffset[ImageDimension];
+  OffsetValueType upperOffset[ImageDimension];
+  double          distance[ImageDimension];
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    const OffsetValueType base = static_cast<OffsetValueType>( std::floor( cindex[d] ) );
+    distance[d] = cindex[d] - base;
+    lowerOffset[d] = ( std::max( base, m_InputStart[d] ) - m_InputStart[d] ) * m_InputStride[d];
+    upperOffset[d] = ( std::min( base + 1, m_InputEnd[d] ) - m_InputStart[d] ) * m_InputStride[d];
+    }
+  for( unsigned int k = 0; k < ( 1u << ImageDimension ); ++k )
+    {
+    OffsetValueType offset = 0;
+    double          weight = 1.0;
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+      {
+      const bool upper = ( k >> d ) & 1;
+      offset += upper ? upperOffset[d] : lowerOffset[d];
+      weight *= upper ? distance[d] : 1.0 - distance[d];
+      }
+    const InputPixelType & value = m_InputBuffer[offset];
+    for( unsigned int i = 0; i < ImageDimension; ++i )
+      {
+      displacement[i] += weight * value[i];
+      }
+    }
+}
+
+/**
+ * GenerateData
+ */
+template <typename TInputImage, typename TOutputImage>
+void
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  const InputImageType *inputPtr = this->GetInput();
+  OutputImageType *     outputPtr = this->GetOutput();
+
+  outputPtr->SetBufferedRegion( outputPtr->GetRequestedRegion() );
+  outputPtr->Allocate();
+
+  const InputImageRegionType inputRegion = inputPtr->GetBufferedRegion();
+  m_InputBuffer = inputPtr->GetBufferPointer();
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    m_InputStart[d] = inputRegion.GetIndex()[d];
+    m_InputEnd[d] = m_InputStart[d] + static_cast<OffsetValueType>( inputRegion.GetSize()[d] ) - 1;
+    m_InputStride[d] = ( d == 0 ) ? 1 : m_InputStride[d - 1] * inputRegion.GetSize()[d - 1];
+    m_InputOrigin[d] = inputPtr->GetOrigin()[d];
+    for( unsigned int j = 0; j < ImageDimension; ++j )
+      {
+      m_InputPhysicalToIndex[d][j] = inputPtr->GetPhysicalPointToIndex()[d][j];
+      }
+    }
+
+  const OutputImageRegionType region = outputPtr->GetBufferedRegion();
+  const SizeType              size = region.GetSize();
+  const SizeValueType         rowLength = size[0];
+  const SizeValueType         numberOfRows = region.GetNumberOfPixels() / rowLength;
+  OutputPixelType *           outputBuffer = outputPtr->GetBufferPointer();
+  const double                tolerance = m_ErrorTolerance;
+  const unsigned int          maximumNumberOfIterations = m_MaximumNumberOfIterations;
+
+  // Per row results, summed in row order so the result does not depend on the threads.
+  std::vector<double>        rowErrorSum( numberOfRows, 0.0 );
+  std::vector<double>        rowErrorMax( numberOfRows, 0.0 );
+  std::vector<SizeValueType> rowUnconverged( numberOfRows, 0 );
+
+  MultiThreaderBase::Pointer mt = MultiThreaderBase::New();
+  mt->ParallelizeArray( 0, numberOfRows,
+                        [&](SizeValueType row)
+                          {
+                            IndexType     index = region.GetIndex();
+                            SizeValueType remainder = row;
+                            for( unsigned int d = 1; d < ImageDimension; ++d )
+                              {
+                              index[d] += remainder % size[d];
+                              remainder /= size[d];
+                              }
+
+                            OutputPixelType *out = outputBuffer + row * rowLength;
+                            typename OutputImageType::PointType outputPoint;
+                            double inverse[ImageDimension];
+                            double displacement[ImageDimension];
+                            double mappedPoint[ImageDimension];
+                            for( SizeValueType x = 0; x < rowLength; ++x )
+                              {
+                              index[0] = region.GetIndex()[0] + x;
+                              outputPtr->TransformIndexToPhysicalPoint( index, outputPoint );
+                              if( x == 0 )
+                                {
+                                // The first voxel of a row starts from -v(y), the others from their neighbour.
+                                EvaluateDisplacement( outputPoint.GetDataPointer(), displacement );
+                                for( unsigned int i = 0; i < ImageDimension; ++i )
+                                  {
+                                  inverse[i] = -displacement[i];
+                                  }
+                                }
+
+                              double error = 0.0;
+                              for( unsigned int iteration = 0;; ++iteration )
+                                {
+                                for( unsigned int i = 0; i < ImageDimension; ++i )
+                                  {
+                                  mappedPoint[i] = outputPoint[i] + inverse[i];
+                                  }
+                                EvaluateDisplacement( mappedPoint, displacement );
+                                error = 0.0;
+                                for( unsigned int i = 0; i < ImageDimension; ++i )
+                                  {
+                                  const double residual = inverse[i] + displacement[i];
+                                  error += residual * residual;
+                                  }
+                                error = std::sqrt( error );
+                                if( error <= tolerance || iteration >= maximumNumberOfIterations )
+                                  {
+                                  break;
+                                  }
+                                for( unsigned int i = 0; i < ImageDimension; ++i )
+                                  {
+                                  inverse[i] = -displacement[i];
+                                  }
+                                }
+
+                              for( unsigned int i = 0; i < ImageDimension; ++i )
+                                {
+                                out[x][i] = static_cast<OutputPixelComponentType>( inverse[i] );
+                                }
+                              rowErrorSum[row] += error;
+                              rowErrorMax[row] = std::max( rowErrorMax[row], error );
+                              rowUnconverged[row] += ( error > tolerance ) ? 1 : 0;
+                              }
+                          },
+                        this );
+
+  double        errorSum = 0.0;
+  m_MaxErrorNorm = 0.0;
+  m_NumberOfUnconvergedPixels = 0;
+  for( SizeValueType row = 0; row < numberOfRows; ++row )
+    {
+    errorSum += rowErrorSum[row];
+    m_MaxErrorNorm = std::max( m_MaxErrorNorm, rowErrorMax[row] );
+    m_NumberOfUnconvergedPixels += rowUnconverged[row];
+    }
+  m_MeanErrorNorm = errorSum / region.GetNumberOfPixels();
+  m_InputBuffer = nullptr;
+}
+
+/**
+ * Request the entire input field
+ */
+template <typename TInputImage, typename TOutputImage>
+void
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  // call the superclass's implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+
+  if( !this->GetInput() )
+    {
+    return;
+    }
+
+  InputImagePointer inputPtr = const_cast<InputImageType *>( this->GetInput() );
+  inputPtr->SetRequestedRegionToLargestPossibleRegion();
+}
+
+template <typename TInputImage, typename TOutputImage>
+void
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *output)
+{
+  Superclass::EnlargeOutputRequestedRegion(output);
+  output->SetRequestedRegionToLargestPossibleRegion();
+}
+
+/**
+ * Inform pipeline of required output region
+ */
+template <typename TInputImage, typename TOutputImage>
+void
+GtractFixedPointInverseDisplacementFieldImageFilter<TInputImage, TOutputImage>
+::GenerateOutputInformation()
+{
+  // call the superclass' implementation of this method, the output has the grid of the input
+  Superclass::GenerateOutputInformation();
+
+  OutputImagePointer outputPtr = this->GetOutput();
+  if( !outputPtr )
+    {
+    return;
+    }
+
+  bool sizeIsSet = false;
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+    sizeIsSet = sizeIsSet || m_Size[d] != 0;
+    }
+  if( !sizeIsSet )
+    {
+    return;
+    }
+
+  typename TOutputImage::RegionType outputLargestPossibleRegion;
+  outputLargestPossibleRegion.SetSize( m_Size );
+  outputPtr->SetLargestPossibleRegion( outputLargestPossibleRegion );
+
+  outputPtr->SetSpacing( m_OutputSpacing );
+  outputPtr->SetOrigin( m_OutputOrigin );
+  outputPtr->SetDirection( m_OutputDirection );
+}
+} // end namespace itk
+
+#endif // __itkGtractFixedPointInverseDisplacementFieldImageFilter_hxx
@@ -122,8 +122,8 @@ FunctorClassDeclare2(squareroot, sqrt( (double)a) );
     IntermediateImage = filter->GetOutput();                                 \
     }
 
-#include "itkDiscreteGaussianImageFilter.h"
 #include "itkHistogramMatchingImageFilter.h"
+#include "BRAINSScaleSpaceCache.h"
 
 static std::stringstream EffectiveInputFilters;
 
@@ -133,25 +133,20 @@ template <typename ImageType>
 typename ImageType::Pointer
 DoGaussian( typename ImageType::Pointer input,  const double sigma )
 {
-  using InternalImageType = itk::Image<float, ImageType::ImageDimension>;
-  // Cast to float
-  using ToFloatCasterType = itk::CastImageFilter<ImageType, InternalImageType>;
-  typename ToFloatCasterType::Pointer toFloatCaster = ToFloatCasterType::New();
-  toFloatCaster->SetInput(input);
-
-  using FilterType = itk::DiscreteGaussianImageFilter<InternalImageType, InternalImageType>;
-  /*============Filter the inputVolume using DiscreteGaussianImageFilter
-   *   Include setting the x and y directions of the input images and setting order
-   *     to be zero, and including normalizing Gaussian filter==================*/
-  typename FilterType::Pointer filter = FilterType::New();
-  filter->SetVariance( sigma );
-  filter->SetMaximumError( 0.01 );
-  filter->SetInput(toFloatCaster->GetOutput() );
-  filter->Update();
+  using ScaleSpaceType = BRAINSScaleSpaceCache<ImageType>;
+  using InternalImageType = typename ScaleSpaceType::RealImageType;
+
+  /*============Smooth the inputVolume with the discrete Gaussian of variance sigma
+   *   (DiscreteGaussianImageFilter with a maximum error of 0.01 for narrow kernels),
+   *   shared with any other smoothing of the same image at the same scale==================*/
+  const typename InternalImageType::ConstPointer smoothed =
+    ScaleSpaceType::GetSmoothedImage( input.GetPointer(), std::sqrt( sigma ) );
 
   using FromFloatCasterType = itk::CastImageFilter<InternalImageType, ImageType>;
   typename FromFloatCasterType::Pointer fromFloatCaster = FromFloatCasterType::New();
-  fromFloatCaster->SetInput(filter->GetOutput() );
+  fromFloatCaster->SetInput( smoothed );
+  // The smoothed image is shared with the cache, a float ImageType must not take over its buffer
+  fromFloatCaster->InPlaceOff();
   fromFloatCaster->Update();
   // Cast to data type
   return fromFloatCaster->GetOutput();